@@ -689,6 +689,11 @@ typedef enum
                                          local memory on the card */
     WD_ITEM_MEM_USER_MAP =         0x4, /**< Map physical memory from user mode,
                                          Linux only */
+    WD_ITEM_MEM_USER_MAP_WC =      0x8, /**< Map physical memory from user mode
+                                         as write-combining (prefetchable PCI
+                                         memory BARs only), Linux only.
+                                         Handled by the WDC library, see
+                                         WDC_FlushWriteCombining() */
 } WD_ITEM_MEM_OPTIONS;
 
 typedef struct
@@ -2714,6 +2719,9 @@ enum
 #ifdef WDLOG
     #include "wd_log.h"
 #endif
+#ifdef WD_STATS
+    #include "wd_stats.h"
+#endif
 
 #ifndef MIN
     #define MIN(a,b) ((a) > (b) ? (b) : (a))
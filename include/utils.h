@@ -59,6 +59,310 @@ DWORD DLLCALLCONV ThreadStart(_Outptr_ HANDLE *phThread,
 *
 */
 void DLLCALLCONV ThreadWait(_In_ HANDLE hThread);
+
+/**
+*  Restricts a thread to a set of CPUs.
+*
+*   @param [in] hThread:   The handle to the thread, received from
+*                          ThreadStart(), or NULL for the calling thread
+*   @param [in] qwCpuMask: Bit mask of the CPUs (CPUs 0-63)
+*
+* @return
+*  Returns WD_STATUS_SUCCESS (0) on success,
+*  or an appropriate error code otherwise
+*
+*/
+DWORD DLLCALLCONV ThreadSetAffinity(_In_ HANDLE hThread,
+    _In_ UINT64 qwCpuMask);
+
+/**
+*  Restricts a thread to the CPUs of a NUMA node.
+*
+*   @param [in] hThread: The handle to the thread, received from ThreadStart(),
+*                        or NULL for the calling thread
+*   @param [in] dwNode:  NUMA node number
+*
+* @return
+*  Returns WD_STATUS_SUCCESS (0) on success,
+*  or an appropriate error code otherwise
+*
+*/
+DWORD DLLCALLCONV ThreadBindNumaNode(_In_ HANDLE hThread, _In_ DWORD dwNode);
+
+/** Thread scheduling policies */
+typedef enum {
+    THREAD_SCHED_DEFAULT = 0, /**< The default time-sharing policy */
+    THREAD_SCHED_FIFO = 1,    /**< Real-time, first in first out */
+    THREAD_SCHED_RR = 2       /**< Real-time, round robin */
+} THREAD_SCHED_POLICY;
+
+/** Thread attributes options */
+typedef enum {
+    THREAD_ATTR_MLOCK_ALL = 0x1 /**< Lock all the current and future memory
+                                 * of the process (Linux) */
+} THREAD_ATTR_OPTIONS;
+
+/** Maximal size of the stack prefault of a thread */
+#define THREAD_ATTR_MAX_STACK_PREFAULT (256 * 1024)
+
+/** Thread attributes -- see ThreadStartAttr() */
+typedef struct {
+    UINT64 qwCpuMask;     /**< CPUs of the thread (CPUs 0-63); 0 - all */
+    DWORD dwPolicy;       /**< THREAD_SCHED_POLICY */
+    DWORD dwPriority;     /**< Priority of a real-time policy: 1 (lowest) -
+                           * 99 (highest). On Windows, it is mapped to the
+                           * thread priority levels. */
+    DWORD dwOptions;      /**< Bitmask of THREAD_ATTR_OPTIONS flags */
+    DWORD dwStackPrefaultBytes; /**< Bytes of the thread's stack to touch
+                           * before the thread function is called (up to
+                           * THREAD_ATTR_MAX_STACK_PREFAULT); 0 - none */
+} THREAD_ATTR;
+
+/** Classes of the threads that are created by the library -- see
+ * ThreadClassAttrSet() */
+typedef enum {
+    THREAD_CLASS_INTERRUPT = 0, /**< Interrupt threads and the interrupts
+                                 * reactor workers */
+    THREAD_CLASS_EVENT = 1,     /**< Plug-and-play and power management
+                                 * events threads */
+    THREAD_CLASS_POLLER = 2,    /**< Completion polling threads of the
+                                 * application (e.g. the QDMA poll threads) */
+    THREAD_CLASS_EXECUTOR = 3,  /**< Task executor workers -- see
+                                 * ExecutorCreate() */
+    THREAD_CLASS_NUM
+} THREAD_CLASS;
+
+/**
+*  Creates a thread with attributes.
+*
+*  The attributes are applied by the new thread before pFunc is called, and
+*  the function returns after they were applied. An attribute that cannot be
+*  applied (for example, a real-time policy without the required privileges)
+*  does not fail the function; the attributes that were actually applied are
+*  returned in pApplied.
+*
+*   @param [out] phThread: Returns the handle to the created thread
+*   @param [in] pFunc:     Starting address of the code that the new thread
+*                          is to execute
+*   @param [in] pData:     Pointer to the data to be passed to the new thread
+*   @param [in] pAttr:     Pointer to the thread attributes, or NULL for the
+*                          default attributes (as ThreadStart())
+*   @param [out] pApplied: Pointer to the attributes that were applied, or
+*                          NULL. qwCpuMask, dwPolicy and dwPriority are read
+*                          back from the thread.
+*
+* @return
+*  Returns WD_STATUS_SUCCESS (0) on success,
+*  or an appropriate error code otherwise
+*
+*/
+DWORD DLLCALLCONV ThreadStartAttr(_Outptr_ HANDLE *phThread,
+    _In_ HANDLER_FUNC pFunc, _In_ void *pData, _In_ const THREAD_ATTR *pAttr,
+    _Out_ THREAD_ATTR *pApplied);
+
+/**
+*  Sets the attributes of the threads of a class.
+*  The attributes apply to the threads of the class that are created after
+*  the call, with ThreadStartClass().
+*
+*   @param [in] dwClass: THREAD_CLASS
+*   @param [in] pAttr:   Pointer to the attributes, or NULL for the default
+*                        attributes
+*
+* @return
+*  Returns WD_STATUS_SUCCESS (0) on success,
+*  or an appropriate error code otherwise
+*
+*/
+DWORD DLLCALLCONV ThreadClassAttrSet(_In_ DWORD dwClass,
+    _In_ const THREAD_ATTR *pAttr);
+
+/**
+*  Gets the attributes of the threads of a class.
+*
+*   @param [in] dwClass:   THREAD_CLASS
+*   @param [out] pAttr:    Pointer to the attributes that were set with
+*                          ThreadClassAttrSet(), or NULL
+*   @param [out] pApplied: Pointer to the attributes that were applied to the
+*                          last thread of the class that was created, or NULL
+*
+* @return
+*  Returns WD_STATUS_SUCCESS (0) on success,
+*  or an appropriate error code otherwise
+*
+*/
+DWORD DLLCALLCONV ThreadClassAttrGet(_In_ DWORD dwClass,
+    _Out_ THREAD_ATTR *pAttr, _Out_ THREAD_ATTR *pApplied);
+
+/**
+*  Creates a thread with the attributes of its class.
+*
+*   @param [out] phThread: Returns the handle to the created thread
+*   @param [in] dwClass:   THREAD_CLASS
+*   @param [in] pFunc:     Starting address of the code that the new thread
+*                          is to execute
+*   @param [in] pData:     Pointer to the data to be passed to the new thread
+*
+* @return
+*  Returns WD_STATUS_SUCCESS (0) on success,
+*  or an appropriate error code otherwise
+*
+*/
+DWORD DLLCALLCONV ThreadStartClass(_Outptr_ HANDLE *phThread,
+    _In_ DWORD dwClass, _In_ HANDLER_FUNC pFunc, _In_ void *pData);
+
+/**
+*  Checks whether the attributes of a thread class set the CPUs of its
+*  threads, which callers should not override (e.g. with a NUMA binding).
+*
+*   @param [in] dwClass: THREAD_CLASS
+*
+* @return
+*  Returns TRUE if the class attributes include a CPU mask
+*
+*/
+BOOL DLLCALLCONV ThreadClassHasAffinity(_In_ DWORD dwClass);
+
+/* -----------------------------------------------
+    Task executor
+   ----------------------------------------------- */
+
+/** Task executor parameters -- see ExecutorCreate() */
+typedef struct {
+    DWORD dwWorkers;    /**< Number of worker threads; 0 - the number of
+                         * CPUs */
+    UINT64 qwCpuMask;   /**< CPUs (0-63) to pin the workers to, round robin;
+                         * 0 - the CPUs of the THREAD_CLASS_EXECUTOR
+                         * attributes */
+    DWORD dwIdleSpinUs; /**< Time that an idle worker spins before it
+                         * sleeps, in microseconds */
+} EXECUTOR_PARAMS;
+
+/** Task executor statistics -- see ExecutorGetStats() */
+typedef struct {
+    UINT64 qwSubmitted; /**< Submitted tasks */
+    UINT64 qwExecuted;  /**< Executed tasks */
+    UINT64 qwSteals;    /**< Tasks that were executed by a worker other than
+                         * the one they were submitted to */
+    UINT64 qwSleeps;    /**< Times that idle workers slept */
+} EXECUTOR_STATS;
+
+/**
+*  Parallel for callback -- see ExecutorParallelFor().
+*
+*   @param [in] pData:   The data that was passed to ExecutorParallelFor()
+*   @param [in] qwBegin: The first index of the range
+*   @param [in] qwEnd:   The index after the last index of the range
+*
+* @return
+*  None
+*
+*/
+typedef void (DLLCALLCONV *EXECUTOR_FOR_FUNC)(void *pData, UINT64 qwBegin,
+    UINT64 qwEnd);
+
+/**
+*  Creates a task executor: a pool of worker threads with a tasks deque per
+*  worker. A worker executes the tasks of its own deque, newest first, and
+*  when it is empty, steals the oldest tasks of the other workers. Tasks that
+*  are submitted by a worker are queued to its own deque; other tasks are
+*  distributed between the workers.
+*
+*   @param [in] pParams:     Pointer to the executor parameters, or NULL for
+*                            the defaults
+*   @param [out] phExecutor: Returns the handle to the executor
+*
+* @return
+*  Returns WD_STATUS_SUCCESS (0) on success,
+*  or an appropriate error code otherwise
+*
+*/
+DWORD DLLCALLCONV ExecutorCreate(_In_ const EXECUTOR_PARAMS *pParams,
+    _Outptr_ HANDLE *phExecutor);
+
+/**
+*  Destroys a task executor, after all of its queued tasks were executed.
+*  Must not be called from a task of the executor.
+*
+*   @param [in] hExecutor: The handle to the executor
+*
+* @return
+*  None
+*
+*/
+void DLLCALLCONV ExecutorDestroy(_In_ HANDLE hExecutor);
+
+/**
+*  Submits a task to an executor.
+*
+*   @param [in] hExecutor: The handle to the executor
+*   @param [in] pFunc:     The task function
+*   @param [in] pData:     The data of the task function
+*   @param [out] phTask:   Returns the handle to the task, which must be
+*                          passed to ExecutorTaskWait(), or NULL if the task
+*                          is not awaited
+*
+* @return
+*  Returns WD_STATUS_SUCCESS (0) on success,
+*  or an appropriate error code otherwise
+*
+*/
+DWORD DLLCALLCONV ExecutorSubmit(_In_ HANDLE hExecutor,
+    _In_ HANDLER_FUNC pFunc, _In_ void *pData, _Outptr_ HANDLE *phTask);
+
+/**
+*  Waits for a task to complete. While waiting, the caller executes other
+*  tasks of the executor, so that tasks can wait for the tasks that they
+*  submit.
+*
+*   @param [in] hTask:       The handle to the task, received from
+*                            ExecutorSubmit()
+*   @param [in] qwTimeoutUs: Time-out interval, in microseconds, or
+*                            OS_EVENT_INFINITE
+*
+* @return
+*  Returns WD_STATUS_SUCCESS (0) if the task completed, and the task handle
+*  is released; WD_TIME_OUT_EXPIRED if the time-out elapsed, and the task
+*  must be waited for again; or an appropriate error code otherwise
+*
+*/
+DWORD DLLCALLCONV ExecutorTaskWait(_In_ HANDLE hTask,
+    _In_ UINT64 qwTimeoutUs);
+
+/**
+*  Calls a function on the ranges of [qwBegin, qwEnd), in parallel, and
+*  waits for all the calls to complete. The caller executes ranges as well.
+*
+*   @param [in] hExecutor: The handle to the executor
+*   @param [in] qwBegin:   The first index
+*   @param [in] qwEnd:     The index after the last index
+*   @param [in] qwGrain:   Number of indexes per call; 0 - divide the
+*                          indexes between the workers
+*   @param [in] pFunc:     The function to call per range
+*   @param [in] pData:     The data of the function
+*
+* @return
+*  Returns WD_STATUS_SUCCESS (0) on success,
+*  or an appropriate error code otherwise
+*
+*/
+DWORD DLLCALLCONV ExecutorParallelFor(_In_ HANDLE hExecutor,
+    _In_ UINT64 qwBegin, _In_ UINT64 qwEnd, _In_ UINT64 qwGrain,
+    _In_ EXECUTOR_FOR_FUNC pFunc, _In_ void *pData);
+
+/**
+*  Gets the statistics of an executor.
+*
+*   @param [in] hExecutor: The handle to the executor
+*   @param [out] pStats:   Pointer to the statistics
+*
+* @return
+*  Returns WD_STATUS_SUCCESS (0) on success,
+*  or an appropriate error code otherwise
+*
+*/
+DWORD DLLCALLCONV ExecutorGetStats(_In_ HANDLE hExecutor,
+    _Out_ EXECUTOR_STATS *pStats);
 #endif
 
 /**
@@ -101,6 +405,78 @@ void DLLCALLCONV OsEventClose(_In_ HANDLE hOsEvent);
 */
 DWORD DLLCALLCONV OsEventWait(_In_ HANDLE hOsEvent, _In_ DWORD dwSecTimeout);
 
+/** Infinite timeout of OsEventWaitNs(), OsEventWaitUs() and OsEventWaitAny()
+ */
+#define OS_EVENT_INFINITE ((UINT64)-1)
+/** Maximal number of events of OsEventWaitAny() */
+#define OS_EVENT_WAIT_ANY_MAX 64
+
+/**
+*  Waits until the specified event object is in the signaled state or the
+*  time-out interval elapses, with a nanoseconds time-out.
+*  The time-out is measured on a monotonic clock (on Linux, the event is
+*  futex-based, and the time-out is not affected by changes of the system
+*  time). The caller first spins on the event for up to qwSpinNs, which saves
+*  the sleep and wakeup of the thread when the event is signaled shortly.
+*
+*    @param [in] hOsEvent:    The handle to the event object
+*    @param [in] qwTimeoutNs: Time-out interval, in nanoseconds, or
+*                             OS_EVENT_INFINITE. On Windows, the time-out is
+*                             rounded up to milliseconds.
+*    @param [in] qwSpinNs:    Spin time before blocking, in nanoseconds;
+*                             0 - no spinning
+*
+* @return
+*  Returns WD_STATUS_SUCCESS (0) on success, WD_TIME_OUT_EXPIRED if the
+*  time-out elapsed, or an appropriate error code otherwise
+*
+*/
+DWORD DLLCALLCONV OsEventWaitNs(_In_ HANDLE hOsEvent, _In_ UINT64 qwTimeoutNs,
+    _In_ UINT64 qwSpinNs);
+
+/**
+*  Waits until the specified event object is in the signaled state or the
+*  time-out interval elapses, with a microseconds time-out. See
+*  OsEventWaitNs().
+*
+*    @param [in] hOsEvent:    The handle to the event object
+*    @param [in] qwTimeoutUs: Time-out interval, in microseconds, or
+*                             OS_EVENT_INFINITE
+*    @param [in] dwSpinUs:    Spin time before blocking, in microseconds;
+*                             0 - no spinning
+*
+* @return
+*  Returns WD_STATUS_SUCCESS (0) on success, WD_TIME_OUT_EXPIRED if the
+*  time-out elapsed, or an appropriate error code otherwise
+*
+*/
+DWORD DLLCALLCONV OsEventWaitUs(_In_ HANDLE hOsEvent, _In_ UINT64 qwTimeoutUs,
+    _In_ DWORD dwSpinUs);
+
+/**
+*  Waits until one of the specified event objects is in the signaled state or
+*  the time-out interval elapses. Only the returned event is reset.
+*
+*    @param [in] phOsEvents:  Array of handles to event objects
+*    @param [in] dwNumEvents: Number of events in the array (up to
+*                             OS_EVENT_WAIT_ANY_MAX)
+*    @param [in] qwTimeoutUs: Time-out interval, in microseconds, or
+*                             OS_EVENT_INFINITE
+*    @param [in] dwSpinUs:    Spin time before blocking, in microseconds;
+*                             0 - no spinning
+*    @param [out] pdwIndex:   Returns the index of the signaled event in the
+*                             array. If several events are signaled, the
+*                             lowest index is returned.
+*
+* @return
+*  Returns WD_STATUS_SUCCESS (0) on success, WD_TIME_OUT_EXPIRED if the
+*  time-out elapsed, or an appropriate error code otherwise
+*
+*/
+DWORD DLLCALLCONV OsEventWaitAny(_In_ HANDLE *phOsEvents,
+    _In_ DWORD dwNumEvents, _In_ UINT64 qwTimeoutUs, _In_ DWORD dwSpinUs,
+    _Out_ DWORD *pdwIndex);
+
 /**
 * Sets the specified event object to the signaled state.
 *
@@ -190,6 +566,93 @@ void DLLCALLCONV SleepWrapper(_In_ DWORD dwMicroSecs);
     #define OsMemoryBarrier() MemoryBarrier()
 #endif
 
+/* Thread-local storage class of variables (a single instance in the kernel) */
+#if defined(__KERNEL__)
+    #define OS_THREAD_LOCAL
+#elif defined(_MSC_VER)
+    #define OS_THREAD_LOCAL __declspec(thread)
+#else
+    #define OS_THREAD_LOCAL __thread
+#endif
+
+/* Lazily formatted message (for example, a library's last error message).
+ * UtilLazyMsgSet() only captures the format string and the arguments; the
+ * message is formatted when it is first read by UtilLazyMsgGet(). The format
+ * string must remain valid until the message is read (e.g. a string
+ * literal); string arguments are copied. Declare the message OS_THREAD_LOCAL
+ * to keep a separate message per thread. */
+#define UTIL_LAZY_MSG_LEN 256
+#define UTIL_LAZY_MSG_MAX_ARGS 16
+
+#if defined(__KERNEL__)
+typedef struct {
+    CHAR sMsg[UTIL_LAZY_MSG_LEN];
+} UTIL_LAZY_MSG;
+
+/* In the kernel the message is formatted immediately */
+static inline void UtilLazyMsgSet(UTIL_LAZY_MSG *pMsg, const CHAR *sFormat,
+    va_list argp)
+{
+    vsnprintf(pMsg->sMsg, sizeof(pMsg->sMsg) - 1, sFormat, argp);
+}
+
+static inline const CHAR *UtilLazyMsgGet(UTIL_LAZY_MSG *pMsg)
+{
+    return pMsg->sMsg;
+}
+#else
+/* Captured argument of a lazily formatted message */
+typedef struct {
+    DWORD dwType;   /* Internal argument type */
+    union {
+        long long i;
+        double d;
+        long double ld;
+        const void *p;
+        DWORD dwStrOffset; /* String arguments: offset in sStrings */
+    } u;
+} UTIL_LAZY_MSG_ARG;
+
+typedef struct {
+    const CHAR *sFormat;    /* NULL if the message is already formatted */
+    DWORD dwNumArgs;
+    DWORD dwStrBytes;
+    UTIL_LAZY_MSG_ARG args[UTIL_LAZY_MSG_MAX_ARGS];
+    CHAR sStrings[UTIL_LAZY_MSG_LEN]; /* Copies of the string arguments */
+    CHAR sMsg[UTIL_LAZY_MSG_LEN];     /* Formatted message */
+} UTIL_LAZY_MSG;
+
+/**
+* Sets a lazily formatted message.
+*
+*    @param [out] pMsg:   Pointer to the message
+*    @param [in] sFormat: Format-control string. Must remain valid until the
+*                         message is read.
+*    @param [in] argp:    Format arguments
+*
+* @return
+*  None
+*
+* @remarks
+*  Format strings with conversions that cannot be captured (e.g. wide
+*  strings), or with more than UTIL_LAZY_MSG_MAX_ARGS arguments, are
+*  formatted immediately.
+*/
+void DLLCALLCONV UtilLazyMsgSet(_Out_ UTIL_LAZY_MSG *pMsg,
+    _In_ const CHAR *sFormat, _In_ va_list argp);
+
+/**
+* Gets a lazily formatted message, formatting it on the first call after it
+* was set.
+*
+*    @param [in] pMsg: Pointer to the message
+*
+* @return
+*  The formatted message
+*/
+const CHAR * DLLCALLCONV UtilLazyMsgGet(_Inout_ UTIL_LAZY_MSG *pMsg);
+#endif
+
 #if !defined(__KERNEL__)
 
 
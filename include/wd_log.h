@@ -7,7 +7,7 @@
     extern "C" {
 #endif
 
-ULONG DLLCALLCONV WdFunctionLog(DWORD wFuncNum, HANDLE h, PVOID pParam,
+DWORD DLLCALLCONV WdFunctionLog(DWORD wFuncNum, HANDLE h, PVOID pParam,
     DWORD dwSize, BOOL fWait);
 HANDLE DLLCALLCONV WD_OpenLog(void);
 void DLLCALLCONV WD_CloseLog(HANDLE hWD);
@@ -56,6 +56,72 @@ VOID DLLCALLCONV WD_LogStop(void);
 */
 VOID DLLCALLCONV WD_LogAdd(const char *sFormat, ...);
 
+/** Binary ioctl tracer statistics */
+typedef struct {
+    UINT64 qwRecords; /**< Number of ioctls recorded */
+    UINT64 qwDropped; /**< Number of ioctls that were not recorded, because
+                       * the calling thread's trace ring was full */
+} WD_TRACE_STATS;
+
+/**
+*  Starts tracing all API calls to a binary trace file.
+*
+*   @param [in] sFileName: Name of the trace file to create
+*
+* @return
+*  Returns WD_STATUS_SUCCESS (0) on success,
+*  or an appropriate error code otherwise
+*
+* @remarks
+*  Unlike WD_LogStart(), the calling thread does not format or write anything:
+*  each call appends a fixed-size binary record (ioctl code, handle, time
+*  stamps before and after the call, return status and the first bytes of the
+*  ioctl parameter, captured after the call) to a lock-free ring of the calling
+*  thread, and a background thread writes the rings to the trace file.
+*  When a thread's ring is full, its calls are not recorded (see
+*  WD_TraceGetStats()).
+*  Use WD_TraceDecode() to convert the trace file to a text log.
+*/
+DWORD DLLCALLCONV WD_TraceStart(const char *sFileName);
+
+/**
+*  Stops tracing, writes all the pending trace records and closes the trace
+*  file.
+*
+* @return
+*  None
+*/
+VOID DLLCALLCONV WD_TraceStop(void);
+
+/**
+*  Gets the statistics of the current, or last, tracing session.
+*
+*   @param [out] pStats: Pointer to the statistics
+*
+* @return
+*  Returns WD_STATUS_SUCCESS (0) on success,
+*  or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WD_TraceGetStats(WD_TRACE_STATS *pStats);
+
+/**
+*  Converts a binary trace file to a text log.
+*
+*   @param [in] sTraceFileName: Name of a trace file created by WD_TraceStart()
+*   @param [in] sLogFileName:   Name of the text log file to create
+*
+* @return
+*  Returns WD_STATUS_SUCCESS (0) on success,
+*  or an appropriate error code otherwise
+*
+* @remarks
+*  The ioctl parameters are formatted as in the WD_LogStart() log, limited to
+*  the captured bytes. Pointer fields are printed but not followed.
+*/
+DWORD DLLCALLCONV WD_TraceDecode(const char *sTraceFileName,
+    const char *sLogFileName);
+
+#if defined(WDLOG)
 #undef WD_FUNCTION
 #undef WD_Close
 #undef WD_Open
@@ -63,6 +129,7 @@ VOID DLLCALLCONV WD_LogAdd(const char *sFormat, ...);
 #define WD_FUNCTION WdFunctionLog
 #define WD_Close WD_CloseLog
 #define WD_Open WD_OpenLog
+#endif
 
 #ifdef __cplusplus
 }
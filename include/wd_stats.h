@@ -0,0 +1,71 @@
+/* Jungo Connectivity Confidential. Copyright (c) 2022 Jungo Connectivity Ltd.  https://www.jungo.com */
+
+#ifndef _WD_STATS_H_
+#define _WD_STATS_H_
+
+/*****************************************************************************
+*  File: wd_stats.h - WinDriver API calls statistics definitions.            *
+*        When WD_STATS is defined, all the WinDriver API calls (WD_xxx())    *
+*        are counted per ioctl: number of calls, number of errors and a      *
+*        latency histogram. The WinDriver API library is built with          *
+*        WD_STATS; see WDC_GetStats().                                       *
+******************************************************************************/
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+/** Maximum number of ioctls that are counted (ioctl function numbers are
+ * unique in their low 8 bits) */
+#define WD_STATS_MAX_IOCTLS 256
+/** Number of latency histogram buckets */
+#define WD_STATS_HIST_BUCKETS 32
+
+/** Statistics of one ioctl */
+typedef struct {
+    UINT32 dwIoctl;     /**< Ioctl code */
+    UINT32 dwReserved;
+    UINT64 qwCalls;     /**< Number of calls */
+    UINT64 qwErrors;    /**< Number of calls that returned a status other than
+                         * WD_STATUS_SUCCESS */
+    UINT64 qwTotalNs;   /**< Total calls duration, in nanoseconds */
+    UINT64 qwHist[WD_STATS_HIST_BUCKETS]; /**< Latency histogram: bucket N
+                                           * counts the calls that took
+                                           * 2^N - 2^(N+1)-1 nanoseconds (the
+                                           * first bucket also counts 0 ns,
+                                           * the last bucket also counts
+                                           * longer calls) */
+} WD_IOCTL_STATS;
+
+/** Statistics snapshot file magic number */
+#define WD_STATS_FILE_MAGIC 0x41545357 /* "WSTA" */
+/** Statistics snapshot file format version */
+#define WD_STATS_FILE_VERSION 1
+
+/** Statistics snapshot file header, followed by dwNumIoctls WD_IOCTL_STATS
+ * structures (see WDC_ExportStats()) */
+typedef struct {
+    UINT32 dwMagic;         /**< WD_STATS_FILE_MAGIC */
+    UINT32 dwVersion;       /**< WD_STATS_FILE_VERSION */
+    UINT32 dwProcessId;     /**< ID of the process that exported the
+                             * statistics */
+    UINT32 dwNumIoctls;     /**< Number of WD_IOCTL_STATS structures */
+    UINT64 qwTime;          /**< Export time (seconds since the Epoch) */
+} WD_STATS_FILE_HEADER;
+
+#if !defined(__KERNEL__)
+DWORD DLLCALLCONV WdFunctionStats(DWORD dwIoctl, HANDLE h, PVOID pParam,
+    DWORD dwSize, BOOL fWait);
+
+#if defined(WD_STATS) && !defined(WDLOG)
+    /* With WDLOG, WdFunctionLog() calls WdFunctionStats() */
+    #undef WD_FUNCTION
+    #define WD_FUNCTION WdFunctionStats
+#endif
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _WD_STATS_H_ */
@@ -23,13 +23,22 @@
     Memory / I/O / Registers
    ----------------------------------------------- */
 
+/** Address space options */
+typedef enum {
+    WDC_ADDR_DESC_WRITE_COMBINING = 0x1, /** pUserDirectMemAddr is a
+                                          * write-combining mapping: writes may
+                                          * be merged and reordered until
+                                          * WDC_FlushWriteCombining() is called
+                                          */
+} WDC_ADDR_DESC_OPTIONS;
+
 /** Address space information struct */
 typedef struct {
     DWORD  dwAddrSpace;        /** Address space number */
     BOOL   fIsMemory;          /** TRUE: memory address space; FALSE: I/O */
     DWORD  dwItemIndex;        /** Index of address space in the
                                 * pDev->cardReg.Card.Item array */
-    DWORD  reserved;
+    DWORD  dwOptions;          /** Bitmask of WDC_ADDR_DESC_OPTIONS flags */
     UINT64 qwBytes;            /** Size of address space */
     KPTR   pAddr;              /** I/O / Memory kernel mapped address -- for
                                 * WD_Transfer(), WD_MultiTransfer(), or direct
@@ -67,6 +76,10 @@ typedef struct WDC_DEVICE {
 
     PVOID                   pCtx;            /** User-specific context */
     PAD_TO_64(pCtx)
+
+    PVOID                   pPriv;           /** WDC library internal
+                                              * information */
+    PAD_TO_64(pPriv)
 } WDC_DEVICE, *PWDC_DEVICE;
 
 /*************************************************************
@@ -86,6 +99,10 @@ typedef struct WDC_DEVICE {
 /** Check if memory or I/O address */
 #define WDC_ADDR_IS_MEM(pAddrDesc) (pAddrDesc)->fIsMemory
 
+/** Check if the user-mode mapping of a memory address is write-combining */
+#define WDC_ADDR_IS_WC(pAddrDesc) \
+    ((pAddrDesc)->dwOptions & WDC_ADDR_DESC_WRITE_COMBINING)
+
 /* -----------------------------------------------
     Kernel PlugIn
    ----------------------------------------------- */
@@ -13,6 +13,7 @@
     #include "kpstdlib.h"
 #endif
 #include "windrvr.h"
+#include "wd_stats.h"
 #include "windrvr_int_thread.h"
 #include "windrvr_events.h"
 #include "bits.h"
@@ -617,6 +618,64 @@ DWORD DLLCALLCONV WDC_PciDeviceClose(_In_ WDC_DEVICE_HANDLE hDev);
 *   or an appropriate error code otherwise
 */
 DWORD DLLCALLCONV WDC_IsaDeviceClose(_In_ WDC_DEVICE_HANDLE hDev);
+
+/** -----------------------------------------------
+    NUMA placement
+   ----------------------------------------------- */
+/** No NUMA node: memory and threads are not placed */
+#define WDC_NUMA_NODE_ANY ((DWORD)-1)
+
+/**
+*  Gets the NUMA node of a device.
+*
+*  WDC_PciDeviceOpen() detects the NUMA node of the device (on Linux, from
+*  sysfs). The DMA buffers of the device (WDC_DMAContigBufLock(),
+*  WDC_DMASGBufLock(), the DMA buffers pools) are allocated on the node, and
+*  the interrupts and events threads of the device are restricted to the CPUs
+*  of the node. The first detected node is also the default node, used for
+*  allocations that are not associated with a device (WDS_SharedBufferAlloc()).
+*
+*   @param [in] hDev:     Handle to a WDC device, returned by
+*                         WDC_xxxDeviceOpen(), or NULL for the default node
+*   @param [out] pdwNode: Returns the NUMA node, or WDC_NUMA_NODE_ANY if the
+*                         node is unknown
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_GetNumaNode(_In_ WDC_DEVICE_HANDLE hDev,
+    _Out_ DWORD *pdwNode);
+
+/**
+*  Overrides the NUMA node of a device.
+*  The new node applies to DMA buffers that are locked, and to interrupts and
+*  events that are enabled, after the call.
+*
+*   @param [in] hDev:   Handle to a WDC device, returned by
+*                       WDC_xxxDeviceOpen(), or NULL to set the default node
+*   @param [in] dwNode: NUMA node, or WDC_NUMA_NODE_ANY to disable the
+*                       placement
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_SetNumaNode(_In_ WDC_DEVICE_HANDLE hDev,
+    _In_ DWORD dwNode);
+
+/**
+*  Restricts a thread to the CPUs of the NUMA node of a device.
+*  Does nothing if the node of the device is WDC_NUMA_NODE_ANY.
+*
+*   @param [in] hDev:    Handle to a WDC device, returned by
+*                        WDC_xxxDeviceOpen(), or NULL for the default node
+*   @param [in] hThread: Handle to the thread, returned by ThreadStart(), or
+*                        NULL for the calling thread
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_NumaThreadBind(_In_ WDC_DEVICE_HANDLE hDev,
+    _In_ HANDLE hThread);
 #endif
 
 /** -----------------------------------------------
@@ -907,6 +966,12 @@ DWORD DLLCALLCONV WDC_WriteAddr64(_In_ WDC_DEVICE_HANDLE hDev,
 *                     see WDC_ADDR_RW_OPTIONS.
 *                     The function automatically sets the WDC_RW_BLOCK flag.
 *
+* Memory address spaces are accessed directly from the calling context, using
+* accesses of the width specified by mode (WDC_MODE_64 blocks may also be
+* accessed with wider SIMD accesses when WDC_ADDR_RW_NO_AUTOINC is not set).
+* I/O address spaces, and memory blocks that are not aligned to mode, are
+* transferred by the WinDriver kernel module.
+*
 * @return  Returns WD_STATUS_SUCCESS (0) on success,
 *   or an appropriate error code otherwise
 */
@@ -931,6 +996,12 @@ DWORD DLLCALLCONV WDC_ReadAddrBlock(_In_ WDC_DEVICE_HANDLE hDev,
 *                     written see WDC_ADDR_RW_OPTIONS.
 *                     The function automatically sets the WDC_RW_BLOCK flag.
 *
+* Memory address spaces are accessed directly from the calling context, using
+* accesses of the width specified by mode (WDC_MODE_64 blocks may also be
+* accessed with wider SIMD accesses when WDC_ADDR_RW_NO_AUTOINC is not set).
+* I/O address spaces, and memory blocks that are not aligned to mode, are
+* transferred by the WinDriver kernel module.
+*
 * @return  Returns WD_STATUS_SUCCESS (0) on success,
 *   or an appropriate error code otherwise
 */
@@ -1000,811 +1071,1841 @@ DWORD DLLCALLCONV WDC_WriteAddrBlock(_In_ WDC_DEVICE_HANDLE hDev,
 DWORD DLLCALLCONV WDC_MultiTransfer(_In_ WD_TRANSFER *pTransCmds,
     _In_ DWORD dwNumTrans);
 
+/** Write batch handle -- see WDC_WriteBatchCreate() (user mode only) */
+typedef void *WDC_WRITE_BATCH_HANDLE;
+
+#if !defined(__KERNEL__)
+/** Command buffer handle -- see WDC_CmdBufCreate() */
+typedef void *WDC_CMD_BUF_HANDLE;
+
 /**
-*  Checks if the specified memory or I/O address space is active ,i.e.,
-*  if its size is not zero.
+*  Creates a command buffer: a reusable sequence of read/write commands on a
+*  device's address spaces, which is built once with WDC_CmdBufAppendXXX() and
+*  can be executed any number of times with WDC_CmdBufExecute().
+*  Commands on memory address spaces are executed directly on the user-mode
+*  mapping of the address space; only runs of consecutive I/O commands are
+*  passed to the WinDriver kernel module, each run in a single call.
 *
-*   @param [in] hDev:        Handle to a WDC device, returned by
-*                            WDC_xxxDeviceOpen().
-*   @param [in] dwAddrSpace: The memory or I/O address space to look for.
+*   @param [in] hDev:       Handle to a WDC device,
+*                           returned by WDC_xxxDeviceOpen()
+*   @param [in] dwMaxCmds:  Maximal number of commands in the buffer
+*   @param [out] phCmdBuf:  Pointer to a command buffer handle, to be filled by
+*                           the function
 *
-* @return  Returns TRUE if the specified address space is active;
-*   otherwise returns FALSE.
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
 */
-BOOL DLLCALLCONV WDC_AddrSpaceIsActive(_In_ WDC_DEVICE_HANDLE hDev,
-    _In_ DWORD dwAddrSpace);
-
-/** -----------------------------------------------
-    Access PCI configuration space
-   ----------------------------------------------- */
-/** Read/write a block of any length from the PCI configuration space */
-  /** Identify device by its location. */
+DWORD DLLCALLCONV WDC_CmdBufCreate(_In_ WDC_DEVICE_HANDLE hDev,
+    _In_ DWORD dwMaxCmds, _Outptr_ WDC_CMD_BUF_HANDLE *phCmdBuf);
 
 /**
-*  Reads data from a specified offset in a PCI device's configuration space or
-*  a PCI Express device's extended configuration space.
-*  The device is identified by its location on the PCI bus.
+*  Destroys a command buffer created with WDC_CmdBufCreate().
 *
-*   @param [in] pPciSlot: Pointer to a PCI device location information
-*                  structure, which can be acquired by calling
-*                  WDC_PciScanDevices()
-*   @param [in] dwOffset: The offset from the beginning of the PCI
-*                  configuration space to read from.
-*   @param [out] pData:   Pointer to a buffer to be filled with the data that
-*                  is read from the PCI configuration space.
-*   @param [in] dwBytes:  The number of bytes to read.
+*   @param [in] hCmdBuf: Command buffer handle
 *
 * @return  Returns WD_STATUS_SUCCESS (0) on success,
 *   or an appropriate error code otherwise
 */
-DWORD DLLCALLCONV WDC_PciReadCfgBySlot(_In_ WD_PCI_SLOT *pPciSlot,
-    _In_ DWORD dwOffset, _Outptr_ PVOID pData, _In_ DWORD dwBytes);
+DWORD DLLCALLCONV WDC_CmdBufDestroy(_In_ WDC_CMD_BUF_HANDLE hCmdBuf);
 
 /**
-*  Write data to a specified offset in a PCI device's configuration space
-*  or a PCI Express device's extended configuration space.
-*  The device is identified by its location on the PCI bus.
+*  Removes all the commands from a command buffer, so that it can be rebuilt.
 *
-*   @param [in] pPciSlot: Pointer to a PCI device location information
-*                  structure, which can be acquired by calling
-*                  WDC_PciScanDevices()
-*   @param [in] dwOffset: The offset from the beginning of the PCI
-*                  configuration space to write to.
-*   @param [in] pData:    Pointer to a data buffer that holds the data to write
-*   @param [in] dwBytes:  The number of bytes to write
+*   @param [in] hCmdBuf: Command buffer handle
 *
 * @return  Returns WD_STATUS_SUCCESS (0) on success,
 *   or an appropriate error code otherwise
 */
-DWORD DLLCALLCONV WDC_PciWriteCfgBySlot(_In_ WD_PCI_SLOT *pPciSlot,
-    _In_ DWORD dwOffset, _In_ PVOID pData, _In_ DWORD dwBytes);
-
-
-/** Identify device by handle */
+DWORD DLLCALLCONV WDC_CmdBufReset(_In_ WDC_CMD_BUF_HANDLE hCmdBuf);
 
 /**
-*  Reads data from a specified offset in a PCI device's configuration space or
-*  a PCI Express device's extended configuration space.
+*  Appends a single read command to a command buffer.
+*  The value read is available after execution via WDC_CmdBufGetResult().
 *
-*   @param [in] hDev:     Handle to a WDC PCI device structure,
-*                  returned by WDC_PciDeviceOpen()
-*   @param [in] dwOffset: The offset from the beginning of the PCI
-*                  configuration space to read from.
-*   @param [out] pData:   Pointer to a buffer to be filled with the data that
-*                  is read from the PCI configuration space
-*   @param [in] dwBytes:  The number of bytes to read
+*   @param [in] hCmdBuf:     Command buffer handle
+*   @param [in] dwAddrSpace: The memory or I/O address space to read from
+*   @param [in] dwOffset:    The offset from the beginning of the specified
+*                            address space (dwAddrSpace) to read from
+*   @param [in] mode:        The read access mode - see WDC_ADDR_MODE
+*   @param [out] pdwIndex:   Pointer to the index of the command in the
+*                            buffer, to be filled by the function (optional)
 *
 * @return  Returns WD_STATUS_SUCCESS (0) on success,
 *   or an appropriate error code otherwise
 */
-DWORD DLLCALLCONV WDC_PciReadCfg(_In_ WDC_DEVICE_HANDLE hDev,
-    _In_ DWORD dwOffset, _Outptr_ PVOID pData, _In_ DWORD dwBytes);
+DWORD DLLCALLCONV WDC_CmdBufAppendRead(_In_ WDC_CMD_BUF_HANDLE hCmdBuf,
+    _In_ DWORD dwAddrSpace, _In_ KPTR dwOffset, _In_ WDC_ADDR_MODE mode,
+    _Outptr_ DWORD *pdwIndex);
 
 /**
-*  Writes data to a specified offset in a PCI device's configuration space or
-*  a PCI Express device's extended configuration space.
+*  Appends a single write command to a command buffer.
 *
-*   @param [in] hDev:     Handle to a WDC PCI device structure,
-*                  returned by WDC_PciDeviceOpen()
-*   @param [in] dwOffset: The offset from the beginning of the PCI
-*                  configuration space to write to.
-*   @param [in] pData:    Pointer to a data buffer that holds the data to write
-*   @param [in] dwBytes:  The number of bytes to write
+*   @param [in] hCmdBuf:     Command buffer handle
+*   @param [in] dwAddrSpace: The memory or I/O address space to write to
+*   @param [in] dwOffset:    The offset from the beginning of the specified
+*                            address space (dwAddrSpace) to write to
+*   @param [in] mode:        The write access mode - see WDC_ADDR_MODE
+*   @param [in] qwVal:       The data to write; only the lower mode bytes
+*                            are used
+*   @param [out] pdwIndex:   Pointer to the index of the command in the
+*                            buffer, to be filled by the function (optional)
 *
 * @return  Returns WD_STATUS_SUCCESS (0) on success,
 *   or an appropriate error code otherwise
 */
-DWORD DLLCALLCONV WDC_PciWriteCfg(_In_ WDC_DEVICE_HANDLE hDev,
-    _In_ DWORD dwOffset, _In_ PVOID pData, _In_ DWORD dwBytes);
-
-/** Read/write 8/16/32/64 bits from the PCI configuration space.
-   Identify device by its location. */
+DWORD DLLCALLCONV WDC_CmdBufAppendWrite(_In_ WDC_CMD_BUF_HANDLE hCmdBuf,
+    _In_ DWORD dwAddrSpace, _In_ KPTR dwOffset, _In_ WDC_ADDR_MODE mode,
+    _In_ UINT64 qwVal, _Outptr_ DWORD *pdwIndex);
 
 /**
-*  Reads 1 byte (8 bits) from a specified offset in a PCI device's
-*  configuration space or a PCI Express device's extended configuration space.
-* The device is identified by its location on the PCI bus.
+*  Appends transfer commands, as passed to WDC_MultiTransfer(), to a command
+*  buffer. Memory commands (RM_XXX/WM_XXX) whose pPort is within one of the
+*  device's memory address spaces are executed directly from user mode; all
+*  other commands are passed to the WinDriver kernel module.
+*  String commands keep referring to the Data.pBuffer of the original command.
 *
-*   @param [in] pPciSlot: Pointer to a PCI device location information
-*                  structure, which can be acquired by calling
-*                  WDC_PciScanDevices()
-*   @param [in] dwOffset: The offset from the beginning of the PCI
-*                   configuration space to read from.
-*   @param [out] pbVal:   Pointer to a buffer to be filled with the data that
-*                  is read from the PCI configuration space
+*   @param [in] hCmdBuf:    Command buffer handle
+*   @param [in] pTransCmds: Pointer to an array of transfer commands
+*   @param [in] dwNumTrans: Number of transfer commands in the pTransCmds array
 *
 * @return  Returns WD_STATUS_SUCCESS (0) on success,
 *   or an appropriate error code otherwise
 */
-DWORD DLLCALLCONV WDC_PciReadCfgBySlot8(_In_ WD_PCI_SLOT *pPciSlot,
-     _In_ DWORD dwOffset, _Outptr_ BYTE *pbVal);
+DWORD DLLCALLCONV WDC_CmdBufAppendTransfers(_In_ WDC_CMD_BUF_HANDLE hCmdBuf,
+    _In_ const WD_TRANSFER *pTransCmds, _In_ DWORD dwNumTrans);
 
 /**
-*  Reads 2 bytes (16 bits) from a specified offset in a PCI device's
-*  configuration space or a PCI Express device's extended configuration space.
-* The device is identified by its location on the PCI bus.
+*  Executes all the commands of a command buffer, in order.
 *
-*   @param [in] pPciSlot: Pointer to a PCI device location information
-*                  structure,
-*                  which can be acquired by calling WDC_PciScanDevices()
-*   @param [in] dwOffset: The offset from the beginning of the PCI
-*                  configuration space to read from.
-*   @param [out] pwVal:   Pointer to a buffer to be filled with the data that
-*                  is read from the PCI configuration space
+*   @param [in] hCmdBuf: Command buffer handle
 *
 * @return  Returns WD_STATUS_SUCCESS (0) on success,
-*   or an appropriate error code otherwise
+*   or an appropriate error code otherwise. On failure of a run of I/O
+*   commands, the execution stops and the following commands are not executed.
 */
-DWORD DLLCALLCONV WDC_PciReadCfgBySlot16(_In_ WD_PCI_SLOT *pPciSlot,
-    _In_ DWORD dwOffset, _Outptr_ WORD *pwVal);
+DWORD DLLCALLCONV WDC_CmdBufExecute(_In_ WDC_CMD_BUF_HANDLE hCmdBuf);
 
 /**
-*  Reads 4 bytes (32 bits) from a specified offset in a PCI device's
-*  configuration space or a PCI Express device's extended configuration space.
-* The device is identified by its location on the PCI bus.
+*  Gets the result of a command of a command buffer, from its last execution.
 *
-*   @param [in] pPciSlot: Pointer to a PCI device location information
-*                  structure, which can be acquired by calling
-*                   WDC_PciScanDevices()
-*   @param [in] dwOffset: The offset from the beginning of the PCI
-*                  configuration space to read from.
-*   @param [out] pdwVal:  Pointer to a buffer to be filled with the data
-*                   that is read from the PCI configuration space
+*   @param [in] hCmdBuf:  Command buffer handle
+*   @param [in] dwIndex:  Index of the command in the buffer
+*   @param [out] pqwVal:  Pointer to the value read by a read command (or the
+*                         value written by a write command), to be filled by
+*                         the function
 *
 * @return  Returns WD_STATUS_SUCCESS (0) on success,
 *   or an appropriate error code otherwise
 */
-DWORD DLLCALLCONV WDC_PciReadCfgBySlot32(_In_ WD_PCI_SLOT *pPciSlot,
-    _In_ DWORD dwOffset, _Outptr_ UINT32 *pdwVal);
+DWORD DLLCALLCONV WDC_CmdBufGetResult(_In_ WDC_CMD_BUF_HANDLE hCmdBuf,
+    _In_ DWORD dwIndex, _Outptr_ UINT64 *pqwVal);
 
 /**
-*  Reads 8 bytes (64 bits) from a specified offset in a PCI device's
-*  configuration space or a PCI Express device's extended configuration space.
-* The device is identified by its location on the PCI bus.
+*  Gets the number of commands in a command buffer, and how many of them are
+*  passed to the WinDriver kernel module on execution.
 *
-*   @param [in] pPciSlot: Pointer to a PCI device location information
-*                 structure, which can be acquired by calling
-*                 WDC_PciScanDevices()
-*   @param [in] dwOffset: The offset from the beginning of the PCI
-*                  configuration space to read from.
-*   @param [out] pqwVal:  Pointer to a buffer to be filled with the data
-*                  that is read from the PCI configuration space
+*   @param [in] hCmdBuf:       Command buffer handle
+*   @param [out] pdwNumCmds:   Pointer to the number of commands in the buffer
+*                              (optional)
+*   @param [out] pdwKernelCmds: Pointer to the number of commands executed by
+*                              the kernel module (optional)
+*   @param [out] pdwKernelRuns: Pointer to the number of calls to the kernel
+*                              module per execution (optional)
 *
 * @return  Returns WD_STATUS_SUCCESS (0) on success,
 *   or an appropriate error code otherwise
 */
-DWORD DLLCALLCONV WDC_PciReadCfgBySlot64(_In_ WD_PCI_SLOT *pPciSlot,
-    _In_ DWORD dwOffset, _Outptr_ UINT64 *pqwVal);
+DWORD DLLCALLCONV WDC_CmdBufGetInfo(_In_ WDC_CMD_BUF_HANDLE hCmdBuf,
+    _Outptr_ DWORD *pdwNumCmds, _Outptr_ DWORD *pdwKernelCmds,
+    _Outptr_ DWORD *pdwKernelRuns);
+
+/** -----------------------------------------------
+    Write batches
+   ----------------------------------------------- */
+/** Write batch statistics -- see WDC_WriteBatchGetStats() */
+typedef struct {
+    UINT64 qwScopes;          /** Committed scopes */
+    UINT64 qwWrites;          /** Committed writes */
+    UINT64 qwFlushReads;      /** Flush reads issued (one per scope) */
+    UINT64 qwFlushReadsSaved; /** Flush points that did not require a flush
+                               * read of their own */
+} WDC_WRITE_BATCH_STATS;
 
 /**
-*  writes 1 byte (8 bits) to a specified offset in a PCI device's
-*  configuration space or a PCI Express device's extended configuration space.
-*  The device is identified by its location on the PCI bus.
+*  Creates a write batch: a reusable scope for programming sequences of
+*  register writes, such as DMA descriptors setup.
+*  The writes of a scope (WDC_WriteBatchBegin() ... WDC_WriteBatchCommit())
+*  are executed in order on commit, followed by exactly one read-back of the
+*  device, which replaces the "dummy reads" that would otherwise be issued to
+*  flush the posted writes (see WDC_WriteBatchFlushPoint()).
+*  The writes are executed as a command buffer (see WDC_CmdBufCreate()).
 *
-*   @param [in] pPciSlot: Pointer to a PCI device location information
-*                  structure, which can be acquired by calling
-*                  WDC_PciScanDevices()
-*   @param [in] dwOffset: The offset from the beginning of the PCI
-*                  configuration space to write to.
-*   @param [in] bVal:     The data to write to the PCI configuration space
+*   @param [in] hDev:         Handle to a WDC device,
+*                             returned by WDC_xxxDeviceOpen()
+*   @param [in] dwMaxWrites:  Maximal number of writes in a scope
+*   @param [out] phBatch:     Pointer to a write batch handle, to be filled by
+*                             the function
 *
 * @return  Returns WD_STATUS_SUCCESS (0) on success,
 *   or an appropriate error code otherwise
 */
-DWORD DLLCALLCONV WDC_PciWriteCfgBySlot8(_In_ WD_PCI_SLOT *pPciSlot,
-    _In_ DWORD dwOffset, _In_ BYTE bVal);
+DWORD DLLCALLCONV WDC_WriteBatchCreate(_In_ WDC_DEVICE_HANDLE hDev,
+    _In_ DWORD dwMaxWrites, _Outptr_ WDC_WRITE_BATCH_HANDLE *phBatch);
 
 /**
-*  writes 2 bytes (16 bits) to a specified offset in a PCI device's
-*  configuration space or a PCI Express device's extended configuration space.
-*  The device is identified by its location on the PCI bus.
+*  Destroys a write batch created with WDC_WriteBatchCreate(). The writes of
+*  an open scope are discarded.
 *
-*   @param [in] pPciSlot: Pointer to a PCI device location information
-*                  structure, which can be acquired by calling
-*                  WDC_PciScanDevices()
-*   @param [in] dwOffset: The offset from the beginning of the PCI
-*                  configuration space to write to.
-*   @param [in] wVal:     The data to write to the PCI configuration space
+*   @param [in] hBatch: Write batch handle
 *
 * @return  Returns WD_STATUS_SUCCESS (0) on success,
 *   or an appropriate error code otherwise
 */
-DWORD DLLCALLCONV WDC_PciWriteCfgBySlot16(_In_ WD_PCI_SLOT *pPciSlot,
-    _In_ DWORD dwOffset, _In_ WORD wVal);
+DWORD DLLCALLCONV WDC_WriteBatchDestroy(_In_ WDC_WRITE_BATCH_HANDLE hBatch);
 
 /**
-*  writes 4 bytes (32 bits) to a specified offset in a PCI device's
-*  configuration space or a PCI Express device's extended configuration space.
-*  The device is identified by its location on the PCI bus.
+*  Opens a write batch scope.
+*  If a scope is already open, it is continued: its writes are kept, and only
+*  the flush register is replaced.
+*  Writes made outside of the batch while the scope is open are not ordered
+*  with the writes of the scope.
 *
-*   @param [in] pPciSlot: Pointer to a PCI device location information
-*                  structure, which can be acquired by calling
-*                  WDC_PciScanDevices()
-*   @param [in] dwOffset: The offset from the beginning of the PCI
-*                  configuration
-*                  space to write to.
-*   @param [in] dwVal:    The data to write to the PCI configuration space
+*   @param [in] hBatch:           Write batch handle
+*   @param [in] dwFlushAddrSpace: The address space of the register to read
+*                                 on commit, to flush the writes
+*   @param [in] dwFlushOffset:    The offset of the register to read on commit;
+*                                 the register must be safe to read (no read
+*                                 side effects)
 *
 * @return  Returns WD_STATUS_SUCCESS (0) on success,
 *   or an appropriate error code otherwise
 */
-DWORD DLLCALLCONV WDC_PciWriteCfgBySlot32(_In_ WD_PCI_SLOT *pPciSlot,
-    _In_ DWORD dwOffset, _In_ UINT32 dwVal);
+DWORD DLLCALLCONV WDC_WriteBatchBegin(_In_ WDC_WRITE_BATCH_HANDLE hBatch,
+    _In_ DWORD dwFlushAddrSpace, _In_ KPTR dwFlushOffset);
 
 /**
-*  writes 8 bytes (64 bits) to a specified offset in a PCI device's
-*  configuration space or a PCI Express device's extended configuration space.
-*  The device is identified by its location on the PCI bus.
+*  Adds a 4 bytes (32 bits) write to the open scope of a write batch.
 *
-*   @param [in] pPciSlot: Pointer to a PCI device location information
-*                  structure, which can be acquired by calling
-*                  WDC_PciScanDevices()
-*   @param [in] dwOffset: The offset from the beginning of the PCI
-*                  configuration space to write to.
-*   @param [in] qwVal:    The data to write to the PCI configuration space
+*   @param [in] hBatch:      Write batch handle
+*   @param [in] dwAddrSpace: The memory or I/O address space to write to
+*   @param [in] dwOffset:    The offset from the beginning of the specified
+*                            address space (dwAddrSpace) to write to
+*   @param [in] u32Val:      The data to write to the specified address
 *
 * @return  Returns WD_STATUS_SUCCESS (0) on success,
 *   or an appropriate error code otherwise
 */
-DWORD DLLCALLCONV WDC_PciWriteCfgBySlot64(_In_ WD_PCI_SLOT *pPciSlot,
-    _In_ DWORD dwOffset, _In_ UINT64 qwVal);
-
-/** Read/write 8/16/32/64 bits from the PCI configuration space.
-   Identify device by handle */
+DWORD DLLCALLCONV WDC_WriteBatchWrite32(_In_ WDC_WRITE_BATCH_HANDLE hBatch,
+    _In_ DWORD dwAddrSpace, _In_ KPTR dwOffset, _In_ UINT32 u32Val);
 
 /**
-*  Reads 1 byte (8 bits) from a specified offset in a PCI device's
-*  configuration space or a PCI Express device's extended configuration space.
+*  Adds an 8 bytes (64 bits) write to the open scope of a write batch.
 *
-*   @param [in] hDev:     Handle to a WDC PCI device structure,
-*                  returned by WDC_PciDeviceOpen()
-*   @param [in] dwOffset: The offset from the beginning of the PCI
-*                  configuration space to read from.
-*   @param [out] pbVal:   Pointer to a buffer to be filled with the data that
-*                  is read from the PCI configuration space
+*   @param [in] hBatch:      Write batch handle
+*   @param [in] dwAddrSpace: The memory or I/O address space to write to
+*   @param [in] dwOffset:    The offset from the beginning of the specified
+*                            address space (dwAddrSpace) to write to
+*   @param [in] u64Val:      The data to write to the specified address
 *
 * @return  Returns WD_STATUS_SUCCESS (0) on success,
 *   or an appropriate error code otherwise
 */
-DWORD DLLCALLCONV WDC_PciReadCfg8(_In_ WDC_DEVICE_HANDLE hDev,
-    _In_ DWORD dwOffset, _Outptr_ BYTE *pbVal);
+DWORD DLLCALLCONV WDC_WriteBatchWrite64(_In_ WDC_WRITE_BATCH_HANDLE hBatch,
+    _In_ DWORD dwAddrSpace, _In_ KPTR dwOffset, _In_ UINT64 u64Val);
 
 /**
-*  Reads 2 bytes (16 bits) from a specified offset in a PCI device's
-*  configuration space or a PCI Express device's extended configuration space.
+*  Marks a point in the open scope of a write batch where the preceding writes
+*  would otherwise be flushed with a read of the device. All the flush points
+*  of a scope are served by the single flush read of the commit.
 *
-*   @param [in] hDev:     Handle to a WDC PCI device structure,
-*                  returned by WDC_PciDeviceOpen()
-*   @param [in] dwOffset: The offset from the beginning of the PCI
-*                  configuration space to read from.
-*   @param [out] pwVal:   Pointer to a buffer to be filled with the data that
-*                  is read from the PCI configuration space
+*   @param [in] hBatch: Write batch handle
 *
 * @return  Returns WD_STATUS_SUCCESS (0) on success,
 *   or an appropriate error code otherwise
 */
-DWORD DLLCALLCONV WDC_PciReadCfg16(_In_ WDC_DEVICE_HANDLE hDev,
-    _In_ DWORD dwOffset, _Outptr_ WORD *pwVal);
+DWORD DLLCALLCONV WDC_WriteBatchFlushPoint(_In_ WDC_WRITE_BATCH_HANDLE hBatch);
 
 /**
-*  Reads 4 bytes (32 bits) from a specified offset in a PCI device's
-*  configuration space or a PCI Express device's extended configuration space.
+*  Commits the open scope of a write batch: executes its writes in order, and
+*  then reads the scope's flush register once. The scope is closed, even on
+*  failure.
 *
-*   @param [in] hDev:     Handle to a WDC PCI device structure,
-*                  returned by WDC_PciDeviceOpen()
-*   @param [in] dwOffset: The offset from the beginning of the PCI
-*                  configuration space to read from.
-*   @param [out] pdwVal:  Pointer to a buffer to be filled with the data
-*                  that is read from the PCI configuration space
+*   @param [in] hBatch:        Write batch handle
+*   @param [out] pu32FlushVal: Pointer to the value read from the flush
+*                              register (optional); not set if the scope has
+*                              no writes, in which case no read is issued
 *
 * @return  Returns WD_STATUS_SUCCESS (0) on success,
 *   or an appropriate error code otherwise
 */
-DWORD DLLCALLCONV WDC_PciReadCfg32(_In_ WDC_DEVICE_HANDLE hDev,
-    _In_ DWORD dwOffset, _Outptr_ UINT32 *pdwVal);
+DWORD DLLCALLCONV WDC_WriteBatchCommit(_In_ WDC_WRITE_BATCH_HANDLE hBatch,
+    _Outptr_ UINT32 *pu32FlushVal);
 
 /**
-*  Reads 8 bytes (64 bits) from a specified offset in a PCI device's
-*  configuration space or a PCI Express device's extended configuration space.
+*  Aborts the open scope of a write batch: its writes are discarded without
+*  being issued to the device, and the scope is closed. Does nothing if no
+*  scope is open.
 *
-*   @param [in] hDev:     Handle to a WDC PCI device structure,
-*                  returned by WDC_PciDeviceOpen()
-*   @param [in] dwOffset: The offset from the beginning of the PCI
-*                  configuration space to read from.
-*   @param [out] pqwVal:  Pointer to a buffer to be filled with the data
-*                  that is read from the PCI configuration space
+*   @param [in] hBatch: Write batch handle
 *
 * @return  Returns WD_STATUS_SUCCESS (0) on success,
 *   or an appropriate error code otherwise
 */
-DWORD DLLCALLCONV WDC_PciReadCfg64(_In_ WDC_DEVICE_HANDLE hDev,
-    _In_ DWORD dwOffset, _Outptr_ UINT64 *pqwVal);
+DWORD DLLCALLCONV WDC_WriteBatchAbort(_In_ WDC_WRITE_BATCH_HANDLE hBatch);
 
 /**
-*  Writes 1 byte (8 bits) to a specified offset in a PCI device's
-*  configuration space or a PCI Express device's extended configuration space.
+*  Gets the statistics of a write batch.
 *
-*   @param [in] hDev:     Handle to a WDC PCI device structure,
-*                  returned by WDC_PciDeviceOpen()
+*   @param [in] hBatch:  Write batch handle
+*   @param [out] pStats: Pointer to a statistics struct, to be filled by the
+*                        function
+*   @param [in] fReset:  If TRUE, the statistics are reset after they are read
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_WriteBatchGetStats(_In_ WDC_WRITE_BATCH_HANDLE hBatch,
+    _Outptr_ WDC_WRITE_BATCH_STATS *pStats, _In_ BOOL fReset);
+
+/** -----------------------------------------------
+    Register shadow cache
+   ----------------------------------------------- */
+/** Register shadow cache policies -- see WDC_ShadowRangeSet() */
+typedef enum {
+    WDC_SHADOW_VOLATILE = 0,     /** Not cached: all accesses go to the device
+                                  */
+    WDC_SHADOW_CACHE_ON_READ,    /** Cached after the first read; a write goes
+                                  * to the device and drops the cached value
+                                  * (for registers that do not change, or
+                                  * whose read-back may differ from the
+                                  * written value) */
+    WDC_SHADOW_WRITE_THROUGH,    /** Cached after the first read or write; a
+                                  * write goes to the device and updates the
+                                  * cached value */
+    WDC_SHADOW_WRITE_BACK,       /** Cached after the first read or write; a
+                                  * write only updates the cached value, and
+                                  * is written to the device by
+                                  * WDC_ShadowFlush() */
+} WDC_SHADOW_POLICY;
+
+/** Register shadow cache statistics -- see WDC_ShadowGetStats() */
+typedef struct {
+    UINT64 qwHits;           /** Reads served from the cache */
+    UINT64 qwMisses;         /** Reads of cached ranges that were read from
+                              * the device */
+    UINT64 qwUncached;       /** Accesses outside of the cached ranges, or of
+                              * WDC_SHADOW_VOLATILE ranges */
+    UINT64 qwDeviceWrites;   /** Writes of cached ranges that were written to
+                              * the device */
+    UINT64 qwDeferredWrites; /** WDC_SHADOW_WRITE_BACK writes kept in the
+                              * cache */
+    UINT64 qwFlushedWrites;  /** Deferred writes written to the device by
+                              * WDC_ShadowFlush() */
+    UINT64 qwInvalidations;  /** Cache invalidations */
+} WDC_SHADOW_STATS;
+
+/**
+*  Sets the register shadow cache policy of a range of a device's address
+*  space.
+*  Accesses made with WDC_ShadowReadAddrXXX()/WDC_ShadowWriteAddrXXX() to
+*  offsets within the range follow the range's policy. All other accesses
+*  (including WDC_ReadAddrXXX()/WDC_WriteAddrXXX() calls to the range) go
+*  directly to the device.
+*  The cache is invalidated when a Plug-and-Play or power management event,
+*  registered with WDC_EventRegister(), is received for the device. Call
+*  WDC_ShadowInvalidate() after resetting the device.
+*
+*   @param [in] hDev:        Handle to a WDC device,
+*                            returned by WDC_xxxDeviceOpen()
+*   @param [in] dwAddrSpace: The memory or I/O address space of the range
+*   @param [in] dwOffset:    The offset of the range from the beginning of the
+*                            address space; must be 32-bit aligned
+*   @param [in] dwBytes:     The size of the range, in bytes; must be a
+*                            multiple of 4. The range must not overlap a
+*                            previously set range.
+*   @param [in] policy:      The cache policy of the range
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_ShadowRangeSet(_In_ WDC_DEVICE_HANDLE hDev,
+    _In_ DWORD dwAddrSpace, _In_ KPTR dwOffset, _In_ DWORD dwBytes,
+    _In_ WDC_SHADOW_POLICY policy);
+
+/**
+*  Reads 4 bytes (32 bits) from a device's address space, through the register
+*  shadow cache.
+*
+*   @param [in] hDev:        Handle to a WDC device,
+*                            returned by WDC_xxxDeviceOpen()
+*   @param [in] dwAddrSpace: The memory or I/O address space to read from
+*   @param [in] dwOffset:    The offset from the beginning of the specified
+*                            address space (dwAddrSpace) to read from
+*   @param [out] pu32Val:    Pointer to a buffer to be filled with the data
+*                            that is read from the specified address
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_ShadowReadAddr32(_In_ WDC_DEVICE_HANDLE hDev,
+    _In_ DWORD dwAddrSpace, _In_ KPTR dwOffset, _Outptr_ UINT32 *pu32Val);
+
+/**
+*  Reads 8 bytes (64 bits) from a device's address space, through the register
+*  shadow cache.
+*
+*   @param [in] hDev:        Handle to a WDC device,
+*                            returned by WDC_xxxDeviceOpen()
+*   @param [in] dwAddrSpace: The memory or I/O address space to read from
+*   @param [in] dwOffset:    The offset from the beginning of the specified
+*                            address space (dwAddrSpace) to read from
+*   @param [out] pu64Val:    Pointer to a buffer to be filled with the data
+*                            that is read from the specified address
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_ShadowReadAddr64(_In_ WDC_DEVICE_HANDLE hDev,
+    _In_ DWORD dwAddrSpace, _In_ KPTR dwOffset, _Outptr_ UINT64 *pu64Val);
+
+/**
+*  Writes 4 bytes (32 bits) to a device's address space, through the register
+*  shadow cache.
+*
+*   @param [in] hDev:        Handle to a WDC device,
+*                            returned by WDC_xxxDeviceOpen()
+*   @param [in] dwAddrSpace: The memory or I/O address space to write to
+*   @param [in] dwOffset:    The offset from the beginning of the specified
+*                            address space (dwAddrSpace) to write to
+*   @param [in] u32Val:      The data to write to the specified address
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_ShadowWriteAddr32(_In_ WDC_DEVICE_HANDLE hDev,
+    _In_ DWORD dwAddrSpace, _In_ KPTR dwOffset, _In_ UINT32 u32Val);
+
+/**
+*  Writes 8 bytes (64 bits) to a device's address space, through the register
+*  shadow cache.
+*
+*   @param [in] hDev:        Handle to a WDC device,
+*                            returned by WDC_xxxDeviceOpen()
+*   @param [in] dwAddrSpace: The memory or I/O address space to write to
+*   @param [in] dwOffset:    The offset from the beginning of the specified
+*                            address space (dwAddrSpace) to write to
+*   @param [in] u64Val:      The data to write to the specified address
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_ShadowWriteAddr64(_In_ WDC_DEVICE_HANDLE hDev,
+    _In_ DWORD dwAddrSpace, _In_ KPTR dwOffset, _In_ UINT64 u64Val);
+
+/**
+*  Writes all the deferred writes of WDC_SHADOW_WRITE_BACK ranges to the
+*  device, in ascending address order.
+*  Each register is written with the width of its deferred write (32 or 64
+*  bits); a 32-bit write to a half of a deferred 64-bit write is merged into
+*  the 64-bit write.
+*
+*   @param [in] hDev: Handle to a WDC device, returned by WDC_xxxDeviceOpen()
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_ShadowFlush(_In_ WDC_DEVICE_HANDLE hDev);
+
+/**
+*  Drops all the cached register values of a device, including deferred
+*  writes that were not flushed. Call this function after resetting the
+*  device.
+*
+*   @param [in] hDev: Handle to a WDC device, returned by WDC_xxxDeviceOpen()
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_ShadowInvalidate(_In_ WDC_DEVICE_HANDLE hDev);
+
+/**
+*  Gets the register shadow cache statistics of a device.
+*
+*   @param [in] hDev:    Handle to a WDC device, returned by
+*                        WDC_xxxDeviceOpen()
+*   @param [out] pStats: Pointer to a statistics struct, to be filled by the
+*                        function
+*   @param [in] fReset:  If TRUE, the statistics are reset after they are read
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_ShadowGetStats(_In_ WDC_DEVICE_HANDLE hDev,
+    _Outptr_ WDC_SHADOW_STATS *pStats, _In_ BOOL fReset);
+#endif
+
+/**
+*  Flushes the CPU's write-combining buffers, so that all the preceding writes
+*  to the specified address space reach the device before any following
+*  access to it.
+*  Memory address spaces are mapped as write-combining when the
+*  WD_ITEM_MEM_USER_MAP_WC option is set for their memory item when the device
+*  is opened (Linux, prefetchable PCI memory BARs only); this can be checked
+*  with WDC_ADDR_IS_WC(). WDC_WriteAddrBlock() flushes the buffers itself
+*  (after each element of a WDC_ADDR_RW_NO_AUTOINC write, so that the CPU does
+*  not merge the writes to the same address).
+*
+*   @param [in] hDev:        Handle to a WDC device,
+*                            returned by WDC_xxxDeviceOpen()
+*   @param [in] dwAddrSpace: The memory address space to flush
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_FlushWriteCombining(_In_ WDC_DEVICE_HANDLE hDev,
+    _In_ DWORD dwAddrSpace);
+
+/**
+*  Checks if the specified memory or I/O address space is active ,i.e.,
+*  if its size is not zero.
+*
+*   @param [in] hDev:        Handle to a WDC device, returned by
+*                            WDC_xxxDeviceOpen().
+*   @param [in] dwAddrSpace: The memory or I/O address space to look for.
+*
+* @return  Returns TRUE if the specified address space is active;
+*   otherwise returns FALSE.
+*/
+BOOL DLLCALLCONV WDC_AddrSpaceIsActive(_In_ WDC_DEVICE_HANDLE hDev,
+    _In_ DWORD dwAddrSpace);
+
+/** -----------------------------------------------
+    Access PCI configuration space
+   ----------------------------------------------- */
+/** Read/write a block of any length from the PCI configuration space */
+  /** Identify device by its location. */
+
+/**
+*  Reads data from a specified offset in a PCI device's configuration space or
+*  a PCI Express device's extended configuration space.
+*  The device is identified by its location on the PCI bus.
+*
+*   @param [in] pPciSlot: Pointer to a PCI device location information
+*                  structure, which can be acquired by calling
+*                  WDC_PciScanDevices()
+*   @param [in] dwOffset: The offset from the beginning of the PCI
+*                  configuration space to read from.
+*   @param [out] pData:   Pointer to a buffer to be filled with the data that
+*                  is read from the PCI configuration space.
+*   @param [in] dwBytes:  The number of bytes to read.
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_PciReadCfgBySlot(_In_ WD_PCI_SLOT *pPciSlot,
+    _In_ DWORD dwOffset, _Outptr_ PVOID pData, _In_ DWORD dwBytes);
+
+/**
+*  Write data to a specified offset in a PCI device's configuration space
+*  or a PCI Express device's extended configuration space.
+*  The device is identified by its location on the PCI bus.
+*
+*   @param [in] pPciSlot: Pointer to a PCI device location information
+*                  structure, which can be acquired by calling
+*                  WDC_PciScanDevices()
 *   @param [in] dwOffset: The offset from the beginning of the PCI
 *                  configuration space to write to.
-*   @param [in] bVal:     The data to write to the PCI configuration space
+*   @param [in] pData:    Pointer to a data buffer that holds the data to write
+*   @param [in] dwBytes:  The number of bytes to write
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_PciWriteCfgBySlot(_In_ WD_PCI_SLOT *pPciSlot,
+    _In_ DWORD dwOffset, _In_ PVOID pData, _In_ DWORD dwBytes);
+
+
+/** Identify device by handle */
+
+/**
+*  Reads data from a specified offset in a PCI device's configuration space or
+*  a PCI Express device's extended configuration space.
+*
+*   @param [in] hDev:     Handle to a WDC PCI device structure,
+*                  returned by WDC_PciDeviceOpen()
+*   @param [in] dwOffset: The offset from the beginning of the PCI
+*                  configuration space to read from.
+*   @param [out] pData:   Pointer to a buffer to be filled with the data that
+*                  is read from the PCI configuration space
+*   @param [in] dwBytes:  The number of bytes to read
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_PciReadCfg(_In_ WDC_DEVICE_HANDLE hDev,
+    _In_ DWORD dwOffset, _Outptr_ PVOID pData, _In_ DWORD dwBytes);
+
+/**
+*  Writes data to a specified offset in a PCI device's configuration space or
+*  a PCI Express device's extended configuration space.
+*
+*   @param [in] hDev:     Handle to a WDC PCI device structure,
+*                  returned by WDC_PciDeviceOpen()
+*   @param [in] dwOffset: The offset from the beginning of the PCI
+*                  configuration space to write to.
+*   @param [in] pData:    Pointer to a data buffer that holds the data to write
+*   @param [in] dwBytes:  The number of bytes to write
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_PciWriteCfg(_In_ WDC_DEVICE_HANDLE hDev,
+    _In_ DWORD dwOffset, _In_ PVOID pData, _In_ DWORD dwBytes);
+
+/** Read/write 8/16/32/64 bits from the PCI configuration space.
+   Identify device by its location. */
+
+/**
+*  Reads 1 byte (8 bits) from a specified offset in a PCI device's
+*  configuration space or a PCI Express device's extended configuration space.
+* The device is identified by its location on the PCI bus.
+*
+*   @param [in] pPciSlot: Pointer to a PCI device location information
+*                  structure, which can be acquired by calling
+*                  WDC_PciScanDevices()
+*   @param [in] dwOffset: The offset from the beginning of the PCI
+*                   configuration space to read from.
+*   @param [out] pbVal:   Pointer to a buffer to be filled with the data that
+*                  is read from the PCI configuration space
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_PciReadCfgBySlot8(_In_ WD_PCI_SLOT *pPciSlot,
+     _In_ DWORD dwOffset, _Outptr_ BYTE *pbVal);
+
+/**
+*  Reads 2 bytes (16 bits) from a specified offset in a PCI device's
+*  configuration space or a PCI Express device's extended configuration space.
+* The device is identified by its location on the PCI bus.
+*
+*   @param [in] pPciSlot: Pointer to a PCI device location information
+*                  structure,
+*                  which can be acquired by calling WDC_PciScanDevices()
+*   @param [in] dwOffset: The offset from the beginning of the PCI
+*                  configuration space to read from.
+*   @param [out] pwVal:   Pointer to a buffer to be filled with the data that
+*                  is read from the PCI configuration space
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_PciReadCfgBySlot16(_In_ WD_PCI_SLOT *pPciSlot,
+    _In_ DWORD dwOffset, _Outptr_ WORD *pwVal);
+
+/**
+*  Reads 4 bytes (32 bits) from a specified offset in a PCI device's
+*  configuration space or a PCI Express device's extended configuration space.
+* The device is identified by its location on the PCI bus.
+*
+*   @param [in] pPciSlot: Pointer to a PCI device location information
+*                  structure, which can be acquired by calling
+*                   WDC_PciScanDevices()
+*   @param [in] dwOffset: The offset from the beginning of the PCI
+*                  configuration space to read from.
+*   @param [out] pdwVal:  Pointer to a buffer to be filled with the data
+*                   that is read from the PCI configuration space
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_PciReadCfgBySlot32(_In_ WD_PCI_SLOT *pPciSlot,
+    _In_ DWORD dwOffset, _Outptr_ UINT32 *pdwVal);
+
+/**
+*  Reads 8 bytes (64 bits) from a specified offset in a PCI device's
+*  configuration space or a PCI Express device's extended configuration space.
+* The device is identified by its location on the PCI bus.
+*
+*   @param [in] pPciSlot: Pointer to a PCI device location information
+*                 structure, which can be acquired by calling
+*                 WDC_PciScanDevices()
+*   @param [in] dwOffset: The offset from the beginning of the PCI
+*                  configuration space to read from.
+*   @param [out] pqwVal:  Pointer to a buffer to be filled with the data
+*                  that is read from the PCI configuration space
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_PciReadCfgBySlot64(_In_ WD_PCI_SLOT *pPciSlot,
+    _In_ DWORD dwOffset, _Outptr_ UINT64 *pqwVal);
+
+/**
+*  writes 1 byte (8 bits) to a specified offset in a PCI device's
+*  configuration space or a PCI Express device's extended configuration space.
+*  The device is identified by its location on the PCI bus.
+*
+*   @param [in] pPciSlot: Pointer to a PCI device location information
+*                  structure, which can be acquired by calling
+*                  WDC_PciScanDevices()
+*   @param [in] dwOffset: The offset from the beginning of the PCI
+*                  configuration space to write to.
+*   @param [in] bVal:     The data to write to the PCI configuration space
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_PciWriteCfgBySlot8(_In_ WD_PCI_SLOT *pPciSlot,
+    _In_ DWORD dwOffset, _In_ BYTE bVal);
+
+/**
+*  writes 2 bytes (16 bits) to a specified offset in a PCI device's
+*  configuration space or a PCI Express device's extended configuration space.
+*  The device is identified by its location on the PCI bus.
+*
+*   @param [in] pPciSlot: Pointer to a PCI device location information
+*                  structure, which can be acquired by calling
+*                  WDC_PciScanDevices()
+*   @param [in] dwOffset: The offset from the beginning of the PCI
+*                  configuration space to write to.
+*   @param [in] wVal:     The data to write to the PCI configuration space
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_PciWriteCfgBySlot16(_In_ WD_PCI_SLOT *pPciSlot,
+    _In_ DWORD dwOffset, _In_ WORD wVal);
+
+/**
+*  writes 4 bytes (32 bits) to a specified offset in a PCI device's
+*  configuration space or a PCI Express device's extended configuration space.
+*  The device is identified by its location on the PCI bus.
+*
+*   @param [in] pPciSlot: Pointer to a PCI device location information
+*                  structure, which can be acquired by calling
+*                  WDC_PciScanDevices()
+*   @param [in] dwOffset: The offset from the beginning of the PCI
+*                  configuration
+*                  space to write to.
+*   @param [in] dwVal:    The data to write to the PCI configuration space
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_PciWriteCfgBySlot32(_In_ WD_PCI_SLOT *pPciSlot,
+    _In_ DWORD dwOffset, _In_ UINT32 dwVal);
+
+/**
+*  writes 8 bytes (64 bits) to a specified offset in a PCI device's
+*  configuration space or a PCI Express device's extended configuration space.
+*  The device is identified by its location on the PCI bus.
+*
+*   @param [in] pPciSlot: Pointer to a PCI device location information
+*                  structure, which can be acquired by calling
+*                  WDC_PciScanDevices()
+*   @param [in] dwOffset: The offset from the beginning of the PCI
+*                  configuration space to write to.
+*   @param [in] qwVal:    The data to write to the PCI configuration space
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_PciWriteCfgBySlot64(_In_ WD_PCI_SLOT *pPciSlot,
+    _In_ DWORD dwOffset, _In_ UINT64 qwVal);
+
+/** Read/write 8/16/32/64 bits from the PCI configuration space.
+   Identify device by handle */
+
+/**
+*  Reads 1 byte (8 bits) from a specified offset in a PCI device's
+*  configuration space or a PCI Express device's extended configuration space.
+*
+*   @param [in] hDev:     Handle to a WDC PCI device structure,
+*                  returned by WDC_PciDeviceOpen()
+*   @param [in] dwOffset: The offset from the beginning of the PCI
+*                  configuration space to read from.
+*   @param [out] pbVal:   Pointer to a buffer to be filled with the data that
+*                  is read from the PCI configuration space
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_PciReadCfg8(_In_ WDC_DEVICE_HANDLE hDev,
+    _In_ DWORD dwOffset, _Outptr_ BYTE *pbVal);
+
+/**
+*  Reads 2 bytes (16 bits) from a specified offset in a PCI device's
+*  configuration space or a PCI Express device's extended configuration space.
+*
+*   @param [in] hDev:     Handle to a WDC PCI device structure,
+*                  returned by WDC_PciDeviceOpen()
+*   @param [in] dwOffset: The offset from the beginning of the PCI
+*                  configuration space to read from.
+*   @param [out] pwVal:   Pointer to a buffer to be filled with the data that
+*                  is read from the PCI configuration space
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_PciReadCfg16(_In_ WDC_DEVICE_HANDLE hDev,
+    _In_ DWORD dwOffset, _Outptr_ WORD *pwVal);
+
+/**
+*  Reads 4 bytes (32 bits) from a specified offset in a PCI device's
+*  configuration space or a PCI Express device's extended configuration space.
+*
+*   @param [in] hDev:     Handle to a WDC PCI device structure,
+*                  returned by WDC_PciDeviceOpen()
+*   @param [in] dwOffset: The offset from the beginning of the PCI
+*                  configuration space to read from.
+*   @param [out] pdwVal:  Pointer to a buffer to be filled with the data
+*                  that is read from the PCI configuration space
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_PciReadCfg32(_In_ WDC_DEVICE_HANDLE hDev,
+    _In_ DWORD dwOffset, _Outptr_ UINT32 *pdwVal);
+
+/**
+*  Reads 8 bytes (64 bits) from a specified offset in a PCI device's
+*  configuration space or a PCI Express device's extended configuration space.
+*
+*   @param [in] hDev:     Handle to a WDC PCI device structure,
+*                  returned by WDC_PciDeviceOpen()
+*   @param [in] dwOffset: The offset from the beginning of the PCI
+*                  configuration space to read from.
+*   @param [out] pqwVal:  Pointer to a buffer to be filled with the data
+*                  that is read from the PCI configuration space
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_PciReadCfg64(_In_ WDC_DEVICE_HANDLE hDev,
+    _In_ DWORD dwOffset, _Outptr_ UINT64 *pqwVal);
+
+/**
+*  Writes 1 byte (8 bits) to a specified offset in a PCI device's
+*  configuration space or a PCI Express device's extended configuration space.
+*
+*   @param [in] hDev:     Handle to a WDC PCI device structure,
+*                  returned by WDC_PciDeviceOpen()
+*   @param [in] dwOffset: The offset from the beginning of the PCI
+*                  configuration space to write to.
+*   @param [in] bVal:     The data to write to the PCI configuration space
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_PciWriteCfg8(_In_ WDC_DEVICE_HANDLE hDev,
+    _In_ DWORD dwOffset, _In_ BYTE bVal);
+
+/**
+*  Writes 2 bytes (16 bits) to a specified offset in a PCI device's
+*  configuration space or a PCI Express device's extended configuration space.
+*
+*   @param [in] hDev:     Handle to a WDC PCI device structure,
+*                  returned by WDC_PciDeviceOpen()
+*   @param [in] dwOffset: The offset from the beginning of the PCI
+*                  configuration space to write to.
+*   @param [in] wVal:     The data to write to the PCI configuration space
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_PciWriteCfg16(_In_ WDC_DEVICE_HANDLE hDev,
+    _In_ DWORD dwOffset, _In_ WORD wVal);
+
+/**
+*  Writes 4 bytes (32 bits) to a specified offset in a PCI device's
+*  configuration space or a PCI Express device's extended configuration space.
+*
+*   @param [in] hDev:     Handle to a WDC PCI device structure,
+*                  returned by WDC_PciDeviceOpen()
+*   @param [in] dwOffset: The offset from the beginning of the PCI
+*                  configuration space to write to.
+*   @param [in] dwVal:    The data to write to the PCI configuration space
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_PciWriteCfg32(_In_ WDC_DEVICE_HANDLE hDev,
+    _In_ DWORD dwOffset, _In_ UINT32 dwVal);
+
+/**
+*  Writes 8 bytes (64 bits) to a specified offset in a PCI device's
+*  configuration space or a PCI Express device's extended configuration space.
+*
+*   @param [in] hDev:     Handle to a WDC PCI device structure,
+*                  returned by WDC_PciDeviceOpen()
+*   @param [in] dwOffset: The offset from the beginning of the PCI configuration
+*                  space to write to.
+*   @param [in] qwVal:    The data to write to the PCI configuration space
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_PciWriteCfg64(_In_ WDC_DEVICE_HANDLE hDev,
+    _In_ DWORD dwOffset, _In_ UINT64 qwVal);
+
+/** -----------------------------------------------
+    DMA (Direct Memory Access)
+   ----------------------------------------------- */
+#if !defined(__KERNEL__)
+/**
+*  Allocates a contiguous DMA buffer, locks it in physical memory, and returns
+*  mappings of the allocated buffer to physical address space and to user-mode
+*  and kernel virtual address spaces.
+*
+*   @param [in] hDev:        Handle to a WDC device, returned by
+*                            WDC_xxxDeviceOpen()
+*   @param [out] ppBuf:      Pointer to a pointer to be filled by the function
+*                        with the user-mode mapped address of the allocated DMA
+*                        buffer
+*   @param [in] dwOptions:   A bit mask of any of the following flags
+*                     (defined in an enumeration in windrvr.h):
+*                        DMA_FROM_DEVICE: Synchronize the DMA buffer for
+*                      transfers from the device to memory.
+*                        DMA_TO_DEVICE: Synchronize the DMA buffer for
+*                      transfers from memory to the device.
+*                        DMA_TO_FROM_DEVICE: Synchronize the DMA buffer for
+*                      transfers in both directions  i.e., from the device to
+*                      memory and from memory to the device
+*                      (<=> DMA_FROM_DEVICE | DMA_TO_DEVICE).
+*                        DMA_ALLOW_CACHE: Allow caching of the memory.
+*                        DMA_KBUF_BELOW_16M: Allocate the physical DMA buffer
+*                      within the lower 16MB of the main memory.
+*                        DMA_ALLOW_64BIT_ADDRESS: Allow allocation of
+*                      64-bit DMA addresses.
+*                        DMA_KBUF_ALLOC_SPECIFY_ADDRESS_WIDTH: When using this
+*                      flag, the width of the address must be entered in the
+*                      fourth byte of dwOptions and then the allocated address
+*                      will be limited to this width. Linux: works with
+*                      contiguous buffers only.
+*                        DMA_GET_PREALLOCATED_BUFFERS_ONLY: Windows: Only
+*                      preallocated buffer is allowed.
+*   @param [in] dwDMABufSize: The size (in bytes) of the DMA buffer.
+*   @param [out] ppDma:       Pointer to a pointer to a DMA buffer information
+*                      structure, which is allocated by the function.
+*                      The pointer to this structure (*ppDma) should be passed
+*                      to WDC_DMABufUnlock() when the
+*                      DMA buffer is no longer needed.
+*
+*
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*
+* For more detailed usage of the WDC contiguous-buffer DMA implementaiton,
+* please refer to @ref ch11_2_2_implementing_contiguous-buffer_dma
+*/
+DWORD DLLCALLCONV WDC_DMAContigBufLock(_In_ WDC_DEVICE_HANDLE hDev,
+    _Outptr_ PVOID *ppBuf, _In_ DWORD dwOptions, _In_ DWORD dwDMABufSize,
+    _Outptr_ WD_DMA **ppDma);
+
+/**
+*  Locks a pre-allocated user-mode memory buffer for DMA and returns the
+*  corresponding physical mappings of the locked DMA pages. On Windows the
+*  function also returns a kernel-mode mapping of the buffer.
+*
+*   @param [in] hDev:        Handle to a WDC device, returned by
+*                            WDC_xxxDeviceOpen()
+*   @param [in] pBuf:        Pointer to a user-mode buffer to be mapped to the
+*                     allocated physical DMA buffer(s)
+*   @param [in] dwOptions:   A bit mask of any of the following flags
+*                     (defined in an enumeration in windrvr.h):
+*                        DMA_FROM_DEVICE: Synchronize the DMA buffer for
+*                      transfers from the device to memory.
+*                        DMA_TO_DEVICE: Synchronize the DMA buffer for
+*                      transfers from memory to the device.
+*                        DMA_TO_FROM_DEVICE: Synchronize the DMA buffer for
+*                      transfers in both directions i.e., from the device to
+*                      memory and from memory to the device
+*                      (<=> DMA_FROM_DEVICE | DMA_TO_DEVICE).
+*                        DMA_ALLOW_CACHE: Allow caching of the memory.
+*                        DMA_ALLOW_64BIT_ADDRESS: Allow allocation of
+*                      64-bit DMA addresses.
+*   @param [in] dwDMABufSize: The size (in bytes) of the DMA buffer.
+*   @param [out] ppDma:       Pointer to a pointer to a DMA buffer information
+*                      structure, which is allocated by the function.
+*                      The pointer to this structure (*ppDma) should be passed
+*                      to WDC_DMABufUnlock() when the
+*                      DMA buffer is no longer needed.
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*
+* For more detailed usage of the WDC Scatter/Gather DMA implementaiton,
+* please refer to @ref ch11_2_1_implementing_scatter-gather_dma
+*/
+DWORD DLLCALLCONV WDC_DMASGBufLock(_In_ WDC_DEVICE_HANDLE hDev,
+    _In_ PVOID pBuf, _In_ DWORD dwOptions, _In_ DWORD dwDMABufSize,
+    _Outptr_ WD_DMA **ppDma);
+
+/**
+*  Locks a pre-allocated user-mode memory buffer for DMA, like
+*  WDC_DMASGBufLock(), and limits the size of the returned DMA pages.
+*
+*  Unless the DMA_DISABLE_MERGE_ADJACENT_PAGES flag is set, physically
+*  contiguous pages are merged into single DMA pages (extents), so a buffer
+*  backed by huge pages (see WDC_DMAHugeBufAlloc()) is described by a few
+*  DMA pages, instead of one DMA page per 4KB page. Extents larger than
+*  dwMaxSegSize are split, to fit the device's maximum descriptor length.
+*
+*   @param [in] hDev:         Handle to a WDC device, returned by
+*                             WDC_xxxDeviceOpen()
+*   @param [in] pBuf:         Pointer to a user-mode buffer to be mapped to the
+*                             allocated physical DMA buffer(s)
+*   @param [in] dwOptions:    DMA options - see WDC_DMASGBufLock()
+*   @param [in] dwDMABufSize: The size (in bytes) of the DMA buffer
+*   @param [in] dwMaxSegSize: Maximum size (in bytes) of a DMA page; at least
+*                             the page size. 0 - no limit.
+*   @param [out] ppDma:       Pointer to a pointer to a DMA buffer information
+*                             structure, which is allocated by the function.
+*                             The pointer to this structure (*ppDma) should be
+*                             passed to WDC_DMABufUnlock() when the DMA buffer
+*                             is no longer needed.
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_DMASGBufLockEx(_In_ WDC_DEVICE_HANDLE hDev,
+    _In_ PVOID pBuf, _In_ DWORD dwOptions, _In_ DWORD dwDMABufSize,
+    _In_ DWORD dwMaxSegSize, _Outptr_ WD_DMA **ppDma);
+
+/** Huge pages buffer information -- see WDC_DMAHugeBufAlloc() */
+typedef struct {
+    PVOID pBuf;         /**< Buffer address */
+    UINT64 qwMapBytes;  /**< Size of the buffer mapping (the buffer size,
+                         * rounded up to dwPageSize) */
+    DWORD dwPageSize;   /**< Size of the pages backing the buffer */
+} WDC_DMA_HUGE_BUF;
+
+/**
+*  Allocates a user-mode buffer for Scatter/Gather DMA, backed by huge pages.
+*
+*  Linux: 1GB pages are used for buffers of at least 1GB and 2MB pages for
+*  buffers of at least 2MB, when free pages of that size are reserved
+*  (hugetlbfs, see /sys/kernel/mm/hugepages). Otherwise the buffer is
+*  allocated with regular pages, and is marked for transparent huge pages.
+*  Windows: large pages are used when the process holds the
+*  SeLockMemoryPrivilege privilege.
+*
+*  Lock the buffer with WDC_DMASGBufLockEx(), so that each huge page is
+*  described by a single DMA page.
+*
+*   @param [in] dwBytes:    Size of the buffer, in bytes
+*   @param [out] pHugeBuf:  Pointer to the buffer information, to be passed to
+*                           WDC_DMAHugeBufFree()
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_DMAHugeBufAlloc(_In_ DWORD dwBytes,
+    _Out_ WDC_DMA_HUGE_BUF *pHugeBuf);
+
+/**
+*  Frees a buffer allocated by WDC_DMAHugeBufAlloc(). The buffer must be
+*  unlocked first.
+*
+*   @param [in] pHugeBuf: Pointer to the buffer information
+*
+* @return  None
+*/
+void DLLCALLCONV WDC_DMAHugeBufFree(_In_ WDC_DMA_HUGE_BUF *pHugeBuf);
+
+
+typedef struct {
+    WD_TRANSFER *pTransCmds;
+    DWORD dwNumCmds;
+    DWORD dwOptions;
+    INT_HANDLER funcIntHandler;
+    PVOID pData;
+    BOOL fUseKP;
+} WDC_INTERRUPT_PARAMS;
+
+/**
+*  Initializes the transaction, allocates a contiguous DMA buffer,
+*  locks it in physical memory, and returns mappings of the allocated buffer
+*  to physical address space and to user-mode and kernel
+*  virtual address spaces.
+*
+*   @param [in] hDev:        Handle to a WDC device, returned by
+*                            WDC_xxxDeviceOpen()
+*   @param [out] ppBuf:      Pointer to a pointer to be filled by the function
+*                    with the user-mode mapped address of the allocated DMA
+*                    buffer.
+*   @param [in] dwOptions:   A bit mask of any of the following flags
+*                     (defined in an enumeration in windrvr.h):
+*                       DMA_FROM_DEVICE: Synchronize the DMA buffer for
+*                      transfers from the device to memory.
+*                        DMA_TO_DEVICE: Synchronize the DMA buffer for
+*                      transfers from memory to the device.
+*                        DMA_TO_FROM_DEVICE: Synchronize the DMA buffer for
+*                      transfers in both directions  i.e., from the device to
+*                      memory and from memory to the device
+*                      (<=> DMA_FROM_DEVICE | DMA_TO_DEVICE).
+*                        DMA_ALLOW_CACHE: Allow caching of the memory.
+*                        DMA_ALLOW_64BIT_ADDRESS: Allow allocation of
+*                        64-bit DMA addresses.
+*   @param [in] dwDMABufSize:     The size (in bytes) of the DMA buffer.
+*   @param [out] ppDma:    Pointer to a pointer to a DMA buffer
+*                          information structur, which is allocated
+*                          by the function. The pointer to this structure
+*                          (*ppDma) should be passed to
+*                          WDC_DMATransactionUninit() when the DMA
+*                          buffer is no longer needed.
+*   @param [in] pInterruptParams: WDC_DMATransactionContigInit() invokes
+*                          WDC_IntEnable() with the relevant parameters
+*                          from the structure (WDC_INTERRUPT_PARAMS). No action
+*                          will be taken if this parameter is NULL.
+*   @param [in] dwAlignment:      This value specifies the alignment
+*                          requirement for the contiguous buffer.
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*
+* For more detailed usage of the WDC_DMA Transactions functions,
+* please refer to @ref ch11_3_performing_direct_memory_access_dma_transactions
+*/
+DWORD DLLCALLCONV WDC_DMATransactionContigInit(_In_ WDC_DEVICE_HANDLE hDev,
+    _Outptr_ PVOID *ppBuf, _In_ DWORD dwOptions, _In_ DWORD dwDMABufSize,
+    _Outptr_ WD_DMA **ppDma, _In_ WDC_INTERRUPT_PARAMS *pInterruptParams,
+    _In_ DWORD dwAlignment);
+
+/**
+*  Initializes the transaction and locks a pre-allocated user-mode memory
+*  buffer for DMA.
+*
+*   @param [in] hDev:       Handle to a WDC device, returned by
+*                           WDC_xxxDeviceOpen()
+*   @param [in] pBuf:       Pointer to a user-mode buffer to be mapped to the
+*                    allocated physical DMA buffer(s).
+*   @param [in] dwOptions:   A bit mask of any of the following flags
+*                     (defined in an enumeration in windrvr.h):
+*                        DMA_FROM_DEVICE: Synchronize the DMA buffer for
+*                      transfers from the device to memory.
+*                        DMA_TO_DEVICE: Synchronize the DMA buffer for
+*                      transfers from memory to the device.
+*                        DMA_TO_FROM_DEVICE: Synchronize the DMA buffer for
+*                      transfers in both directions i.e., from the device to
+*                      memory and from memory to the device
+*                      (<=> DMA_FROM_DEVICE | DMA_TO_DEVICE).
+*                        DMA_ALLOW_CACHE: Allow caching of the memory.
+*                        DMA_ALLOW_64BIT_ADDRESS: Allow allocation of
+*                        64-bit DMA addresses.
+*   @param [in] dwDMABufSize:      The size (in bytes) of the DMA buffer.
+*   @param [out] ppDma:            Pointer to a pointer to a DMA buffer
+*                           information structure, which is allocated by the
+*                           function. The pointer to this structure (*ppDma)
+*                           should be passed to WDC_DMATransactionUninit() when
+*                           the DMA buffer is no longer needed.
+*   @param [in] pInterruptParams:   WDC_DMATransactionSGInit() invokes
+*                           WDC_IntEnable() with the relevant parameters
+*                           from the structure (WDC_INTERRUPT_PARAMS).
+*                           No action will be taken if this parameter is NULL.
+*   @param [in] dwMaxTransferSize: The maximum size for each of the transfers.
+*   @param [in] dwTransferElementSize: The size (in bytes) of the DMA transfer
+*                               element (descriptor).
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*
+* For more detailed usage of the WDC_DMA Transactions functions,
+* please refer to @ref ch11_3_performing_direct_memory_access_dma_transactions
+*/
+DWORD DLLCALLCONV WDC_DMATransactionSGInit(_In_ WDC_DEVICE_HANDLE hDev,
+    _In_ PVOID pBuf, _In_ DWORD dwOptions, _In_ DWORD dwDMABufSize,
+    _Outptr_ WD_DMA **ppDma, _In_ WDC_INTERRUPT_PARAMS *pInterruptParams,
+    _In_ DWORD dwMaxTransferSize, _In_ DWORD dwTransferElementSize);
+
+/**
+*  Begins the execution of a specified DMA transaction.
+*
+*   @param [in,out] pDma:           Pointer to a DMA information
+*                                   structure, received from a previous call to
+*                                   WDC_DMATransactionContigInit()
+*                                   (for a Contiguous DMA Buffer Transaction)
+*                                   or WDC_DMATransactionSGInit()
+*                                   (for a Scatter/Gather DMA buffer
+*                                   Transaction)  *ppDma returned by these
+*                                   functions
+*
+*   @param [in] funcDMATransactionCallback:    If the execution is completed
+*                                   successfully, this callback function will
+*                                   be called directly with
+*                                   DMATransactionCallbackCtx as. context
+*                                   No action will be taken if this
+*                                   parameter is NULL.
+*   @param [in] DMATransactionCallbackCtx: Pointer to a DMA transaction
+*                                   callback context
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*
+* For more detailed usage of the WDC_DMA Transactions functions,
+* please refer to @ref ch11_3_performing_direct_memory_access_dma_transactions
+*/
+DWORD DLLCALLCONV WDC_DMATransactionExecute(_Inout_ WD_DMA *pDma,
+    _In_ DMA_TRANSACTION_CALLBACK funcDMATransactionCallback,
+    _In_ PVOID DMATransactionCallbackCtx);
+
+/**
+*  Notifies WinDriver that a device's DMA transfer operation is completed.
+*
+*   @param [in,out] pDma:     Pointer to a DMA information structure,
+*                      received from a previous call to
+*                      WDC_DMATransactionContigInit()
+*                      (for a Contiguous DMA Buffer Transaction)
+*                      or WDC_DMATransactionSGInit()
+*                      (for a Scatter/Gather DMA buffer
+*                      Transaction)  *ppDma returned by these
+*                      functions
+*
+*   @param [in] fRunCallback: If this value is TRUE and the transaction is not
+*                      over (there are more transfers to be made) the callback
+*                      function that was previously provided as a callback to
+*                      the WDC_DMATransactionExecute() function will be
+*                      invoked. Otherwise, the callback function will not
+*                      be invoked.
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*
+* For more detailed usage of the WDC_DMA Transactions functions,
+* please refer to @ref ch11_3_performing_direct_memory_access_dma_transactions
+*/
+DWORD DLLCALLCONV WDC_DMATransferCompletedAndCheck(_Inout_ WD_DMA *pDma,
+    _In_ BOOL fRunCallback);
+
+/**
+*  Terminates a specified DMA transaction without deleting the associated
+*  WD_DMA transaction structure.
+*
+*   @param [in] pDma: Pointer to a DMA information structure,
+*              received from a previous call to
+*              WDC_DMATransactionContigInit()
+*              (for a Contiguous DMA Buffer Transaction)
+*              or WDC_DMATransactionSGInit()
+*              (for a Scatter/Gather DMA buffer
+*              Transaction)  *ppDma returned by these functions
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*
+* For more detailed usage of the WDC_DMA Transactions functions,
+* please refer to @ref ch11_3_performing_direct_memory_access_dma_transactions
+*/
+DWORD DLLCALLCONV WDC_DMATransactionRelease(_In_ WD_DMA *pDma);
+
+/**
+*  Unlocks and frees the memory allocated for a DMA buffer transaction by a
+*  previous call to WDC_DMATransactionContigInit()
+*  or WDC_DMATransactionSGInit()
+*
+*   @param [in] pDma: Pointer to a DMA information structure,
+*              received from a previous call to
+*              WDC_DMATransactionContigInit()
+*              (for a Contiguous DMA Buffer Transaction)
+*              or WDC_DMATransactionSGInit()
+*              (for a Scatter/Gather DMA buffer
+*              Transaction)  *ppDma returned by these functions
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*
+* For more detailed usage of the WDC_DMA Transactions functions,
+* please refer to @ref ch11_3_performing_direct_memory_access_dma_transactions
+*/
+DWORD DLLCALLCONV WDC_DMATransactionUninit(_In_ WD_DMA *pDma);
+
+/**
+*  Locks a physical reserved memory buffer for DMA and returns the
+*  corresponding user mode address of locked DMA buffer.
+*
+*   @param [in] hDev:        Handle to a WDC device, returned by
+*                     WDC_xxxDeviceOpen()
+*   @param [in] qwAddr:      Physical address of the reserved buffer to lock
+*   @param [out] ppBuf:      Pointer to a pointer to be filled by the function
+*                     with the user-mode mapped address of the locked DMA
+*                     buffer
+*   @param [in] dwOptions:   A bit mask of any of the following flags
+*                     (defined in an enumeration in windrvr.h):
+*                        DMA_FROM_DEVICE: Synchronize the DMA buffer for
+*                        transfers from the device to memory.
+*                        DMA_TO_DEVICE: Synchronize the DMA buffer for
+*                        transfers from memory to the device.
+*                        DMA_TO_FROM_DEVICE: Synchronize the DMA buffer for
+*                        transfers in both directions i.e., from the device to
+*                        memory and from memory to the device
+*                        (<=> DMA_FROM_DEVICE | DMA_TO_DEVICE).
+*                        DMA_ALLOW_64BIT_ADDRESS: Allow allocation of 64-bit
+*                      DMA addresses. This flag is supported on Windows and
+*                      Linux.
+*   @param [in] dwDMABufSize: The size (in bytes) of the DMA buffer
+*   @param [out] ppDma:       Pointer to a pointer to a DMA buffer information
+*                      structure, which is allocated by the function.
+*                      The pointer to this structure (*ppDma) should be passed
+*                      to WDC_DMABufUnlock() when the
+*                      DMA buffer is no longer needed.
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*
+* For more detailed usage of the WDC_DMA functions, please refer to 
+* @ref ch11_2_performing_direct_memory_access_dma
+*/
+DWORD DLLCALLCONV WDC_DMAReservedBufLock(_In_ WDC_DEVICE_HANDLE hDev,
+    _In_ PHYS_ADDR qwAddr, _Outptr_ PVOID *ppBuf, _In_ DWORD dwOptions,
+    _In_ DWORD dwDMABufSize, _Outptr_ WD_DMA **ppDma);
+
+
+/**
+*  Unlocks and frees the memory allocated for a DMA buffer by a previous
+*  call to WDC_DMAContigBufLock(), WDC_DMASGBufLock() or
+*  WDC_DMAReservedBufLock()
+*
+*   @param [in] pDma: Pointer to a DMA information structure,
+*              received from a previous call to
+*              WDC_DMATransactionContigInit()
+*              (for a Contiguous DMA Buffer Transaction)
+*              or WDC_DMATransactionSGInit()
+*              (for a Scatter/Gather DMA buffer
+*              Transaction)  *ppDma returned by these functions
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*
+* For more detailed usage of the WDC_DMA functions,
+* please refer to @ref ch11_2_performing_direct_memory_access_dma
+*/
+DWORD DLLCALLCONV WDC_DMABufUnlock(_In_ WD_DMA *pDma);
+
+/** Utility macro that returns a contiguous DMA global handle that can be used
+   for buffer sharing between multiple processes. */
+#define WDC_DMAGetGlobalHandle(pDma) ((pDma)->hDma)
+
+/**
+*  Retrieves a contiguous DMA buffer which was allocated by another process.
+*
+*   @param [in] hDma:   DMA buffer handle.
+*   @param [out] ppDma: Pointer to a pointer to a DMA buffer information
+*                structure, which is associated with hDma.
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*
+* For more detailed usage of the WDC_DMA functions,
+* please refer to @ref ch11_2_performing_direct_memory_access_dma
+*
+* @snippet highlevel_examples.c WDC_DMABufGet
+*/
+DWORD DLLCALLCONV WDC_DMABufGet(_In_ DWORD hDma, _Outptr_ WD_DMA **ppDma);
+
+/**
+*  Synchronizes the cache of all CPUs with the DMA buffer,
+*  by flushing the data from the CPU caches.
+*
+*   @param [in] pDma: Pointer to a DMA information structure,
+*              received from a previous call to
+*              WDC_DMATransactionContigInit()
+*              (for a Contiguous DMA Buffer Transaction)
+*              or WDC_DMATransactionSGInit()
+*              (for a Scatter/Gather DMA buffer
+*              Transaction)  *ppDma returned by these functions
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*
+* For more detailed usage of the WDC_DMA functions,
+* please refer to @ref ch11_2_performing_direct_memory_access_dma
+*/
+DWORD DLLCALLCONV WDC_DMASyncCpu(_In_ WD_DMA *pDma);
+
+/**
+*  Synchronizes the I/O caches with the DMA buffer, by flushing the data
+*  from the I/O caches and updating the CPU caches.
+*
+*   @param [in] pDma: Pointer to a DMA information structure,
+*              received from a previous call to
+*              WDC_DMATransactionContigInit()
+*              (for a Contiguous DMA Buffer Transaction)
+*              or WDC_DMATransactionSGInit()
+*              (for a Scatter/Gather DMA buffer
+*              Transaction)  *ppDma returned by these functions
 *
 * @return  Returns WD_STATUS_SUCCESS (0) on success,
 *   or an appropriate error code otherwise
+*
+* For more detailed usage of the WDC_DMA functions,
+* please refer to @ref ch11_2_performing_direct_memory_access_dma
 */
-DWORD DLLCALLCONV WDC_PciWriteCfg8(_In_ WDC_DEVICE_HANDLE hDev,
-    _In_ DWORD dwOffset, _In_ BYTE bVal);
+DWORD DLLCALLCONV WDC_DMASyncIo(_In_ WD_DMA *pDma);
 
 /**
-*  Writes 2 bytes (16 bits) to a specified offset in a PCI device's
-*  configuration space or a PCI Express device's extended configuration space.
+*  Synchronizes the cache of all CPUs with a range of a DMA buffer.
+*  The driver synchronizes entire buffers, so the range is only validated;
+*  it documents the part of the buffer that the CPU is about to access.
 *
-*   @param [in] hDev:     Handle to a WDC PCI device structure,
-*                  returned by WDC_PciDeviceOpen()
-*   @param [in] dwOffset: The offset from the beginning of the PCI
-*                  configuration space to write to.
-*   @param [in] wVal:     The data to write to the PCI configuration space
+*  WDC_DMASyncCpu(), WDC_DMASyncIo() and their range variants do not call the
+*  driver when the DMA is cache-coherent: on x86 platforms, for contiguous
+*  buffers and for Scatter/Gather buffers locked with
+*  DMA_ALLOW_64BIT_ADDRESS, unless the platform bounces all DMA (e.g. Linux
+*  swiotlb=force or a confidential computing guest). A memory barrier is
+*  issued instead. Set the WDC_DMA_COHERENT environment variable to "0" to
+*  always call the driver, or to "1" to never call it, before calling
+*  WDC_DriverOpen().
+*
+*   @param [in] pDma:     Pointer to a DMA information structure
+*   @param [in] dwOffset: Offset of the range from the start of the buffer
+*   @param [in] dwBytes:  Size of the range, in bytes
 *
 * @return  Returns WD_STATUS_SUCCESS (0) on success,
 *   or an appropriate error code otherwise
 */
-DWORD DLLCALLCONV WDC_PciWriteCfg16(_In_ WDC_DEVICE_HANDLE hDev,
-    _In_ DWORD dwOffset, _In_ WORD wVal);
+DWORD DLLCALLCONV WDC_DMASyncCpuRange(_In_ WD_DMA *pDma, _In_ DWORD dwOffset,
+    _In_ DWORD dwBytes);
 
 /**
-*  Writes 4 bytes (32 bits) to a specified offset in a PCI device's
-*  configuration space or a PCI Express device's extended configuration space.
+*  Synchronizes the I/O caches with a range of a DMA buffer.
+*  See WDC_DMASyncCpuRange().
 *
-*   @param [in] hDev:     Handle to a WDC PCI device structure,
-*                  returned by WDC_PciDeviceOpen()
-*   @param [in] dwOffset: The offset from the beginning of the PCI
-*                  configuration space to write to.
-*   @param [in] dwVal:    The data to write to the PCI configuration space
+*   @param [in] pDma:     Pointer to a DMA information structure
+*   @param [in] dwOffset: Offset of the range from the start of the buffer
+*   @param [in] dwBytes:  Size of the range, in bytes
 *
 * @return  Returns WD_STATUS_SUCCESS (0) on success,
 *   or an appropriate error code otherwise
 */
-DWORD DLLCALLCONV WDC_PciWriteCfg32(_In_ WDC_DEVICE_HANDLE hDev,
-    _In_ DWORD dwOffset, _In_ UINT32 dwVal);
+DWORD DLLCALLCONV WDC_DMASyncIoRange(_In_ WD_DMA *pDma, _In_ DWORD dwOffset,
+    _In_ DWORD dwBytes);
+
+/** DMA buffers synchronization statistics */
+typedef struct {
+    UINT64 qwCpuSyncs;  /**< WDC_DMASyncCpu() calls that called the driver */
+    UINT64 qwIoSyncs;   /**< WDC_DMASyncIo() calls that called the driver */
+    UINT64 qwCpuElided; /**< WDC_DMASyncCpu() calls that only issued a memory
+                         * barrier */
+    UINT64 qwIoElided;  /**< WDC_DMASyncIo() calls that only issued a memory
+                         * barrier */
+    BOOL fCoherent;     /**< TRUE if the DMA was detected as cache-coherent */
+} WDC_DMA_SYNC_STATS;
 
 /**
-*  Writes 8 bytes (64 bits) to a specified offset in a PCI device's
-*  configuration space or a PCI Express device's extended configuration space.
+*  Gets the DMA buffers synchronization statistics of the process.
 *
-*   @param [in] hDev:     Handle to a WDC PCI device structure,
-*                  returned by WDC_PciDeviceOpen()
-*   @param [in] dwOffset: The offset from the beginning of the PCI configuration
-*                  space to write to.
-*   @param [in] qwVal:    The data to write to the PCI configuration space
+*   @param [out] pStats: Pointer to a statistics structure, to be filled
 *
 * @return  Returns WD_STATUS_SUCCESS (0) on success,
 *   or an appropriate error code otherwise
 */
-DWORD DLLCALLCONV WDC_PciWriteCfg64(_In_ WDC_DEVICE_HANDLE hDev,
-    _In_ DWORD dwOffset, _In_ UINT64 qwVal);
+DWORD DLLCALLCONV WDC_DMAGetSyncStats(_Out_ WDC_DMA_SYNC_STATS *pStats);
 
-/** -----------------------------------------------
-    DMA (Direct Memory Access)
+/* -----------------------------------------------
+    DMA buffers pool
    ----------------------------------------------- */
-#if !defined(__KERNEL__)
+/** Handle to a DMA buffers pool -- see WDC_DMAPoolCreate() */
+typedef struct WDC_DMA_POOL *WDC_DMA_POOL_HANDLE;
+
+/** DMA buffers pool parameters */
+typedef struct {
+    DWORD dwMinBufSize;    /**< Smallest buffer size class, in bytes. Size
+                            * classes are powers of two, starting from the
+                            * larger of dwMinBufSize and the page size. */
+    DWORD dwLowWatermark;  /**< Number of buffers locked in advance when a
+                            * size class is first used, and kept by
+                            * WDC_DMAPoolTrim() */
+    DWORD dwHighWatermark; /**< Maximum number of free buffers kept in each
+                            * size class; released buffers above it are
+                            * unlocked. 0 - no limit. */
+    DWORD dwMaxSegSize;    /**< Scatter/Gather buffers: maximum size of a DMA
+                            * page (see WDC_DMASGBufLockEx()). 0 - no
+                            * limit. */
+} WDC_DMA_POOL_PARAMS;
+
+/** DMA buffers pool statistics -- see WDC_DMAPoolGetStats() */
+typedef struct {
+    UINT64 qwHits;      /**< Buffers handed out from the pool */
+    UINT64 qwMisses;    /**< Buffers that had to be locked on request */
+    UINT64 qwReleases;  /**< Buffers released back to the pool */
+    UINT64 qwUnlocks;   /**< Buffers unlocked above the high watermark or by
+                         * WDC_DMAPoolTrim() */
+    DWORD dwClasses;    /**< Number of size classes in use */
+    DWORD dwFree;       /**< Number of free (locked) buffers in the pool */
+    DWORD dwInUse;      /**< Number of buffers handed out and not released */
+} WDC_DMA_POOL_STATS;
+
 /**
-*  Allocates a contiguous DMA buffer, locks it in physical memory, and returns
-*  mappings of the allocated buffer to physical address space and to user-mode
-*  and kernel virtual address spaces.
+*  Creates a pool of locked DMA buffers.
 *
-*   @param [in] hDev:        Handle to a WDC device, returned by
-*                            WDC_xxxDeviceOpen()
-*   @param [out] ppBuf:      Pointer to a pointer to be filled by the function
-*                        with the user-mode mapped address of the allocated DMA
-*                        buffer
-*   @param [in] dwOptions:   A bit mask of any of the following flags
-*                     (defined in an enumeration in windrvr.h):
-*                        DMA_FROM_DEVICE: Synchronize the DMA buffer for
-*                      transfers from the device to memory.
-*                        DMA_TO_DEVICE: Synchronize the DMA buffer for
-*                      transfers from memory to the device.
-*                        DMA_TO_FROM_DEVICE: Synchronize the DMA buffer for
-*                      transfers in both directions  i.e., from the device to
-*                      memory and from memory to the device
-*                      (<=> DMA_FROM_DEVICE | DMA_TO_DEVICE).
-*                        DMA_ALLOW_CACHE: Allow caching of the memory.
-*                        DMA_KBUF_BELOW_16M: Allocate the physical DMA buffer
-*                      within the lower 16MB of the main memory.
-*                        DMA_ALLOW_64BIT_ADDRESS: Allow allocation of
-*                      64-bit DMA addresses.
-*                        DMA_KBUF_ALLOC_SPECIFY_ADDRESS_WIDTH: When using this
-*                      flag, the width of the address must be entered in the
-*                      fourth byte of dwOptions and then the allocated address
-*                      will be limited to this width. Linux: works with
-*                      contiguous buffers only.
-*                        DMA_GET_PREALLOCATED_BUFFERS_ONLY: Windows: Only
-*                      preallocated buffer is allowed.
-*   @param [in] dwDMABufSize: The size (in bytes) of the DMA buffer.
-*   @param [out] ppDma:       Pointer to a pointer to a DMA buffer information
-*                      structure, which is allocated by the function.
-*                      The pointer to this structure (*ppDma) should be passed
-*                      to WDC_DMABufUnlock() when the
-*                      DMA buffer is no longer needed.
+*  The pool keeps released DMA buffers locked, and hands them out again to
+*  requests of the same size class and DMA options, saving the allocation,
+*  locking and mapping of the buffer, and its unlocking on release.
+*
+*   @param [in] hDev:     Handle to a WDC device, returned by
+*                         WDC_xxxDeviceOpen()
+*   @param [in] pParams:  Pool parameters
+*   @param [out] phPool:  Pointer to a pool handle, to be passed to
+*                         WDC_DMAPoolDestroy() when the pool is no longer
+*                         needed
 *
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_DMAPoolCreate(_In_ WDC_DEVICE_HANDLE hDev,
+    _In_ const WDC_DMA_POOL_PARAMS *pParams,
+    _Outptr_ WDC_DMA_POOL_HANDLE *phPool);
+
+/**
+*  Unlocks all the buffers of a DMA buffers pool and frees the pool.
+*  All the buffers handed out by the pool must be released first.
 *
+*   @param [in] hPool: Handle to the pool, returned by WDC_DMAPoolCreate()
 *
 * @return  Returns WD_STATUS_SUCCESS (0) on success,
 *   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_DMAPoolDestroy(_In_ WDC_DMA_POOL_HANDLE hPool);
+
+/**
+*  Gets a locked DMA buffer from a DMA buffers pool.
 *
-* For more detailed usage of the WDC contiguous-buffer DMA implementaiton,
-* please refer to @ref ch11_2_2_implementing_contiguous-buffer_dma
+*  If the DMA_KERNEL_BUFFER_ALLOC flag is set, a contiguous DMA buffer is
+*  handed out (see WDC_DMAContigBufLock()); otherwise the pool allocates a
+*  user-mode buffer with WDC_DMAHugeBufAlloc() and locks it as a
+*  Scatter/Gather DMA buffer (see WDC_DMASGBufLockEx()).
+*
+*   @param [in] hPool:        Handle to the pool, returned by
+*                             WDC_DMAPoolCreate()
+*   @param [in] dwDMABufSize: Required size (in bytes) of the DMA buffer.
+*                             The buffer size ((*ppDma)->dwBytes) is
+*                             rounded up to the buffer size class.
+*   @param [in] dwOptions:    DMA options - see WDC_DMAContigBufLock() and
+*                             WDC_DMASGBufLock(). Buffers are recycled only
+*                             between requests with the same options.
+*   @param [out] ppBuf:       Pointer to the user-mode DMA buffer address
+*   @param [out] ppDma:       Pointer to a pointer to the DMA buffer
+*                             information structure, to be passed to
+*                             WDC_DMAPoolBufRelease() (and not to
+*                             WDC_DMABufUnlock()) when the buffer is no longer
+*                             needed
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
 */
-DWORD DLLCALLCONV WDC_DMAContigBufLock(_In_ WDC_DEVICE_HANDLE hDev,
-    _Outptr_ PVOID *ppBuf, _In_ DWORD dwOptions, _In_ DWORD dwDMABufSize,
+DWORD DLLCALLCONV WDC_DMAPoolBufGet(_In_ WDC_DMA_POOL_HANDLE hPool,
+    _In_ DWORD dwDMABufSize, _In_ DWORD dwOptions, _Outptr_ PVOID *ppBuf,
     _Outptr_ WD_DMA **ppDma);
 
 /**
-*  Locks a pre-allocated user-mode memory buffer for DMA and returns the
-*  corresponding physical mappings of the locked DMA pages. On Windows the
-*  function also returns a kernel-mode mapping of the buffer.
+*  Releases a DMA buffer back to its pool. The buffer stays locked, unless its
+*  size class already holds dwHighWatermark free buffers.
+*  Any other WD_DMA structure (or a buffer that was already released) is
+*  rejected with WD_INVALID_PARAMETER.
 *
-*   @param [in] hDev:        Handle to a WDC device, returned by
-*                            WDC_xxxDeviceOpen()
-*   @param [in] pBuf:        Pointer to a user-mode buffer to be mapped to the
-*                     allocated physical DMA buffer(s)
-*   @param [in] dwOptions:   A bit mask of any of the following flags
-*                     (defined in an enumeration in windrvr.h):
-*                        DMA_FROM_DEVICE: Synchronize the DMA buffer for
-*                      transfers from the device to memory.
-*                        DMA_TO_DEVICE: Synchronize the DMA buffer for
-*                      transfers from memory to the device.
-*                        DMA_TO_FROM_DEVICE: Synchronize the DMA buffer for
-*                      transfers in both directions i.e., from the device to
-*                      memory and from memory to the device
-*                      (<=> DMA_FROM_DEVICE | DMA_TO_DEVICE).
-*                        DMA_ALLOW_CACHE: Allow caching of the memory.
-*                        DMA_ALLOW_64BIT_ADDRESS: Allow allocation of
-*                      64-bit DMA addresses.
-*   @param [in] dwDMABufSize: The size (in bytes) of the DMA buffer.
-*   @param [out] ppDma:       Pointer to a pointer to a DMA buffer information
-*                      structure, which is allocated by the function.
-*                      The pointer to this structure (*ppDma) should be passed
-*                      to WDC_DMABufUnlock() when the
-*                      DMA buffer is no longer needed.
+*   @param [in] pDma: Pointer to a DMA information structure, returned by
+*                     WDC_DMAPoolBufGet()
 *
 * @return  Returns WD_STATUS_SUCCESS (0) on success,
 *   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_DMAPoolBufRelease(_In_ WD_DMA *pDma);
+
+/**
+*  Unlocks the free buffers of a DMA buffers pool above the low watermark of
+*  each size class.
 *
-* For more detailed usage of the WDC Scatter/Gather DMA implementaiton,
-* please refer to @ref ch11_2_1_implementing_scatter-gather_dma
+*   @param [in] hPool: Handle to the pool, returned by WDC_DMAPoolCreate()
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
 */
-DWORD DLLCALLCONV WDC_DMASGBufLock(_In_ WDC_DEVICE_HANDLE hDev,
-    _In_ PVOID pBuf, _In_ DWORD dwOptions, _In_ DWORD dwDMABufSize,
-    _Outptr_ WD_DMA **ppDma);
+DWORD DLLCALLCONV WDC_DMAPoolTrim(_In_ WDC_DMA_POOL_HANDLE hPool);
+
+/**
+*  Gets the statistics of a DMA buffers pool.
+*
+*   @param [in] hPool:   Handle to the pool, returned by WDC_DMAPoolCreate()
+*   @param [out] pStats: Pointer to the statistics
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_DMAPoolGetStats(_In_ WDC_DMA_POOL_HANDLE hPool,
+    _Out_ WDC_DMA_POOL_STATS *pStats);
 
+/* -----------------------------------------------
+    DMA segments pipeline
+   ----------------------------------------------- */
+/** Handle to a DMA segments pipeline -- see WDC_DMAPipelineCreate() */
+typedef struct WDC_DMA_PIPELINE *WDC_DMA_PIPELINE_HANDLE;
 
+/** Segment of a DMA buffer, to be programmed to the device */
 typedef struct {
-    WD_TRANSFER *pTransCmds;
-    DWORD dwNumCmds;
-    DWORD dwOptions;
-    INT_HANDLER funcIntHandler;
-    PVOID pData;
-    BOOL fUseKP;
-} WDC_INTERRUPT_PARAMS;
+    DWORD dwIndex;              /**< Segment number, from 0 */
+    UINT64 qwOffset;            /**< Offset of the segment in the buffer */
+    DWORD dwBytes;              /**< Segment size, in bytes */
+    DWORD dwPages;              /**< Number of pages in pPages */
+    const WD_DMA_PAGE *pPages;  /**< Pages of the segment */
+    BOOL fLast;                 /**< TRUE for the last segment of the
+                                 * buffer */
+} WDC_DMA_SEGMENT;
+
+/** Segment programming function: programs a segment to the device (e.g.
+ * builds its descriptors and queues them to the DMA engine). Called by
+ * WDC_DMAPipelineStart() and WDC_DMAPipelineSegmentDone(), in segment order;
+ * must not call the pipeline functions. Returns WD_STATUS_SUCCESS, or an
+ * error code to stop the pipeline. */
+typedef DWORD (DLLCALLCONV *WDC_DMA_SEG_PROGRAM_FUNC)(PVOID pCtx,
+    WD_DMA *pDma, const WDC_DMA_SEGMENT *pSeg);
 
 /**
-*  Initializes the transaction, allocates a contiguous DMA buffer,
-*  locks it in physical memory, and returns mappings of the allocated buffer
-*  to physical address space and to user-mode and kernel
-*  virtual address spaces.
+*  Creates a DMA segments pipeline over a locked DMA buffer.
 *
-*   @param [in] hDev:        Handle to a WDC device, returned by
-*                            WDC_xxxDeviceOpen()
-*   @param [out] ppBuf:      Pointer to a pointer to be filled by the function
-*                    with the user-mode mapped address of the allocated DMA
-*                    buffer.
-*   @param [in] dwOptions:   A bit mask of any of the following flags
-*                     (defined in an enumeration in windrvr.h):
-*                       DMA_FROM_DEVICE: Synchronize the DMA buffer for
-*                      transfers from the device to memory.
-*                        DMA_TO_DEVICE: Synchronize the DMA buffer for
-*                      transfers from memory to the device.
-*                        DMA_TO_FROM_DEVICE: Synchronize the DMA buffer for
-*                      transfers in both directions  i.e., from the device to
-*                      memory and from memory to the device
-*                      (<=> DMA_FROM_DEVICE | DMA_TO_DEVICE).
-*                        DMA_ALLOW_CACHE: Allow caching of the memory.
-*                        DMA_ALLOW_64BIT_ADDRESS: Allow allocation of
-*                        64-bit DMA addresses.
-*   @param [in] dwDMABufSize:     The size (in bytes) of the DMA buffer.
-*   @param [out] ppDma:    Pointer to a pointer to a DMA buffer
-*                          information structur, which is allocated
-*                          by the function. The pointer to this structure
-*                          (*ppDma) should be passed to
-*                          WDC_DMATransactionUninit() when the DMA
-*                          buffer is no longer needed.
-*   @param [in] pInterruptParams: WDC_DMATransactionContigInit() invokes
-*                          WDC_IntEnable() with the relevant parameters
-*                          from the structure (WDC_INTERRUPT_PARAMS). No action
-*                          will be taken if this parameter is NULL.
-*   @param [in] dwAlignment:      This value specifies the alignment
-*                          requirement for the contiguous buffer.
+*  The DMA transaction API (WDC_DMATransactionExecute()) programs the next
+*  segment of a transaction only after WDC_DMATransferCompletedAndCheck()
+*  reports the completion of the current one, so the DMA engine idles between
+*  segments. A pipeline splits a buffer that was locked once (see
+*  WDC_DMASGBufLock()) into segments in advance, and keeps up to dwDepth
+*  segments programmed to the device: when a segment completes, the next one
+*  is already queued, and another one is programmed in its place.
+*
+*   @param [in] pDma:              Pointer to a locked DMA buffer (not a DMA
+*                                  transaction)
+*   @param [in] dwMaxTransferSize: Maximum segment size, in bytes
+*   @param [in] dwDepth:           Maximum number of segments in flight
+*   @param [in] funcProgram:       Segment programming function
+*   @param [in] pCtx:              Context to pass to funcProgram
+*   @param [out] phPipe:           Returns a handle to the pipeline
 *
 * @return  Returns WD_STATUS_SUCCESS (0) on success,
 *   or an appropriate error code otherwise
-*
-* For more detailed usage of the WDC_DMA Transactions functions,
-* please refer to @ref ch11_3_performing_direct_memory_access_dma_transactions
 */
-DWORD DLLCALLCONV WDC_DMATransactionContigInit(_In_ WDC_DEVICE_HANDLE hDev,
-    _Outptr_ PVOID *ppBuf, _In_ DWORD dwOptions, _In_ DWORD dwDMABufSize,
-    _Outptr_ WD_DMA **ppDma, _In_ WDC_INTERRUPT_PARAMS *pInterruptParams,
-    _In_ DWORD dwAlignment);
+DWORD DLLCALLCONV WDC_DMAPipelineCreate(_In_ WD_DMA *pDma,
+    _In_ DWORD dwMaxTransferSize, _In_ DWORD dwDepth,
+    _In_ WDC_DMA_SEG_PROGRAM_FUNC funcProgram, _In_ PVOID pCtx,
+    _Outptr_ WDC_DMA_PIPELINE_HANDLE *phPipe);
 
 /**
-*  Initializes the transaction and locks a pre-allocated user-mode memory
-*  buffer for DMA.
+*  Destroys a DMA segments pipeline. The DMA buffer is not unlocked.
 *
-*   @param [in] hDev:       Handle to a WDC device, returned by
-*                           WDC_xxxDeviceOpen()
-*   @param [in] pBuf:       Pointer to a user-mode buffer to be mapped to the
-*                    allocated physical DMA buffer(s).
-*   @param [in] dwOptions:   A bit mask of any of the following flags
-*                     (defined in an enumeration in windrvr.h):
-*                        DMA_FROM_DEVICE: Synchronize the DMA buffer for
-*                      transfers from the device to memory.
-*                        DMA_TO_DEVICE: Synchronize the DMA buffer for
-*                      transfers from memory to the device.
-*                        DMA_TO_FROM_DEVICE: Synchronize the DMA buffer for
-*                      transfers in both directions i.e., from the device to
-*                      memory and from memory to the device
-*                      (<=> DMA_FROM_DEVICE | DMA_TO_DEVICE).
-*                        DMA_ALLOW_CACHE: Allow caching of the memory.
-*                        DMA_ALLOW_64BIT_ADDRESS: Allow allocation of
-*                        64-bit DMA addresses.
-*   @param [in] dwDMABufSize:      The size (in bytes) of the DMA buffer.
-*   @param [out] ppDma:            Pointer to a pointer to a DMA buffer
-*                           information structure, which is allocated by the
-*                           function. The pointer to this structure (*ppDma)
-*                           should be passed to WDC_DMATransactionUninit() when
-*                           the DMA buffer is no longer needed.
-*   @param [in] pInterruptParams:   WDC_DMATransactionSGInit() invokes
-*                           WDC_IntEnable() with the relevant parameters
-*                           from the structure (WDC_INTERRUPT_PARAMS).
-*                           No action will be taken if this parameter is NULL.
-*   @param [in] dwMaxTransferSize: The maximum size for each of the transfers.
-*   @param [in] dwTransferElementSize: The size (in bytes) of the DMA transfer
-*                               element (descriptor).
+*   @param [in] hPipe: Handle to the pipeline, returned by
+*                      WDC_DMAPipelineCreate()
 *
 * @return  Returns WD_STATUS_SUCCESS (0) on success,
 *   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_DMAPipelineDestroy(_In_ WDC_DMA_PIPELINE_HANDLE hPipe);
+
+/**
+*  Starts a transfer of the whole DMA buffer: programs the first segments, up
+*  to the pipeline depth. A pipeline can be restarted once all its segments
+*  completed.
+*  Synchronize the buffer (WDC_DMASyncCpu()) before starting a transfer.
 *
-* For more detailed usage of the WDC_DMA Transactions functions,
-* please refer to @ref ch11_3_performing_direct_memory_access_dma_transactions
+*   @param [in] hPipe: Handle to the pipeline, returned by
+*                      WDC_DMAPipelineCreate()
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or the error code returned by the segment programming function
 */
-DWORD DLLCALLCONV WDC_DMATransactionSGInit(_In_ WDC_DEVICE_HANDLE hDev,
-    _In_ PVOID pBuf, _In_ DWORD dwOptions, _In_ DWORD dwDMABufSize,
-    _Outptr_ WD_DMA **ppDma, _In_ WDC_INTERRUPT_PARAMS *pInterruptParams,
-    _In_ DWORD dwMaxTransferSize, _In_ DWORD dwTransferElementSize);
+DWORD DLLCALLCONV WDC_DMAPipelineStart(_In_ WDC_DMA_PIPELINE_HANDLE hPipe);
 
 /**
-*  Begins the execution of a specified DMA transaction.
+*  Reports the completion of the oldest in-flight segment (typically from the
+*  interrupt handler), and programs the next segment.
 *
-*   @param [in,out] pDma:           Pointer to a DMA information
-*                                   structure, received from a previous call to
-*                                   WDC_DMATransactionContigInit()
-*                                   (for a Contiguous DMA Buffer Transaction)
-*                                   or WDC_DMATransactionSGInit()
-*                                   (for a Scatter/Gather DMA buffer
-*                                   Transaction)  *ppDma returned by these
-*                                   functions
+*   @param [in] hPipe:   Handle to the pipeline, returned by
+*                        WDC_DMAPipelineCreate()
+*   @param [out] pfDone: Returns TRUE when no more segments will complete:
+*                        the transfer is complete, or it was stopped by a
+*                        programming error and the in-flight segments
+*                        completed
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or the error code returned by the segment programming function
+*/
+DWORD DLLCALLCONV WDC_DMAPipelineSegmentDone(
+    _In_ WDC_DMA_PIPELINE_HANDLE hPipe, _Out_ BOOL *pfDone);
+
+/**
+*  Gets the progress of a DMA segments pipeline.
 *
-*   @param [in] funcDMATransactionCallback:    If the execution is completed
-*                                   successfully, this callback function will
-*                                   be called directly with
-*                                   DMATransactionCallbackCtx as. context
-*                                   No action will be taken if this
-*                                   parameter is NULL.
-*   @param [in] DMATransactionCallbackCtx: Pointer to a DMA transaction
-*                                   callback context
+*   @param [in] hPipe:         Handle to the pipeline, returned by
+*                              WDC_DMAPipelineCreate()
+*   @param [out] pdwSegments:  Returns the number of segments of the buffer
+*   @param [out] pdwCompleted: Returns the number of completed segments of
+*                              the current transfer
 *
 * @return  Returns WD_STATUS_SUCCESS (0) on success,
 *   or an appropriate error code otherwise
-*
-* For more detailed usage of the WDC_DMA Transactions functions,
-* please refer to @ref ch11_3_performing_direct_memory_access_dma_transactions
 */
-DWORD DLLCALLCONV WDC_DMATransactionExecute(_Inout_ WD_DMA *pDma,
-    _In_ DMA_TRANSACTION_CALLBACK funcDMATransactionCallback,
-    _In_ PVOID DMATransactionCallbackCtx);
+DWORD DLLCALLCONV WDC_DMAPipelineGetInfo(_In_ WDC_DMA_PIPELINE_HANDLE hPipe,
+    _Out_ DWORD *pdwSegments, _Out_ DWORD *pdwCompleted);
+
+/* -----------------------------------------------
+    DMA completion queues
+   ----------------------------------------------- */
+/** Handle to a DMA completion queue -- see WDC_CompletionQueueCreate() */
+typedef struct WDC_COMPLETION_QUEUE *WDC_COMPLETION_QUEUE_HANDLE;
+
+/** Wait handle of a completion queue: an eventfd file descriptor on Linux,
+ * which can be added to poll()/epoll, or a manual-reset event on Windows,
+ * which can be waited with WaitForMultipleObjects() */
+#if defined(WIN32)
+    typedef HANDLE WDC_CQ_WAIT_HANDLE;
+#else
+    typedef int WDC_CQ_WAIT_HANDLE;
+#endif
+
+/** DMA completion entry */
+typedef struct {
+    WD_DMA *pDma;   /**< The completed DMA */
+    PVOID pCtx;     /**< Context passed to WDC_CompletionQueueAttach() or
+                     * WDC_CompletionQueuePost() */
+    DWORD dwStatus; /**< Completion status: WD_STATUS_SUCCESS, or an
+                     * appropriate error code */
+} WDC_COMPLETION_ENTRY;
+
+/** DMA completion queue statistics -- see WDC_CompletionQueueGetStats() */
+typedef struct {
+    UINT64 qwPosted;    /**< Posted completions */
+    UINT64 qwReaped;    /**< Reaped completions */
+    UINT64 qwSignals;   /**< Times the wait handle was signaled (posts to an
+                         * empty queue) */
+    UINT64 qwOverflows; /**< Completions that were not posted since the queue
+                         * was full */
+} WDC_COMPLETION_QUEUE_STATS;
 
 /**
-*  Notifies WinDriver that a device's DMA transfer operation is completed.
+*  Creates a DMA completion queue.
 *
-*   @param [in,out] pDma:     Pointer to a DMA information structure,
-*                      received from a previous call to
-*                      WDC_DMATransactionContigInit()
-*                      (for a Contiguous DMA Buffer Transaction)
-*                      or WDC_DMATransactionSGInit()
-*                      (for a Scatter/Gather DMA buffer
-*                      Transaction)  *ppDma returned by these
-*                      functions
+*  The completions of DMA transactions that are attached to the queue (see
+*  WDC_CompletionQueueAttach()) are posted to the queue by
+*  WDC_DMATransferCompletedAndCheck(), on the interrupt thread, and are
+*  reaped with WDC_CompletionQueueReap() on any thread. The wait handle of the
+*  queue (see WDC_CompletionQueueGetWaitHandle()) is signaled as long as the
+*  queue is not empty, so an application's event loop can wait for
+*  completions without a thread handoff per completion.
 *
-*   @param [in] fRunCallback: If this value is TRUE and the transaction is not
-*                      over (there are more transfers to be made) the callback
-*                      function that was previously provided as a callback to
-*                      the WDC_DMATransactionExecute() function will be
-*                      invoked. Otherwise, the callback function will not
-*                      be invoked.
+*   @param [in] dwDepth: Maximum number of completions in the queue
+*   @param [out] phCq:   Returns a handle to the queue
 *
 * @return  Returns WD_STATUS_SUCCESS (0) on success,
 *   or an appropriate error code otherwise
-*
-* For more detailed usage of the WDC_DMA Transactions functions,
-* please refer to @ref ch11_3_performing_direct_memory_access_dma_transactions
 */
-DWORD DLLCALLCONV WDC_DMATransferCompletedAndCheck(_Inout_ WD_DMA *pDma,
-    _In_ BOOL fRunCallback);
+DWORD DLLCALLCONV WDC_CompletionQueueCreate(_In_ DWORD dwDepth,
+    _Outptr_ WDC_COMPLETION_QUEUE_HANDLE *phCq);
 
 /**
-*  Terminates a specified DMA transaction without deleting the associated
-*  WD_DMA transaction structure.
+*  Detaches all the DMA transactions of a completion queue and destroys the
+*  queue. Completions that were not reaped are dropped.
 *
-*   @param [in] pDma: Pointer to a DMA information structure,
-*              received from a previous call to
-*              WDC_DMATransactionContigInit()
-*              (for a Contiguous DMA Buffer Transaction)
-*              or WDC_DMATransactionSGInit()
-*              (for a Scatter/Gather DMA buffer
-*              Transaction)  *ppDma returned by these functions
+*   @param [in] hCq: Handle to the queue, returned by
+*                    WDC_CompletionQueueCreate()
 *
 * @return  Returns WD_STATUS_SUCCESS (0) on success,
 *   or an appropriate error code otherwise
-*
-* For more detailed usage of the WDC_DMA Transactions functions,
-* please refer to @ref ch11_3_performing_direct_memory_access_dma_transactions
 */
-DWORD DLLCALLCONV WDC_DMATransactionRelease(_In_ WD_DMA *pDma);
+DWORD DLLCALLCONV WDC_CompletionQueueDestroy(
+    _In_ WDC_COMPLETION_QUEUE_HANDLE hCq);
 
 /**
-*  Unlocks and frees the memory allocated for a DMA buffer transaction by a
-*  previous call to WDC_DMATransactionContigInit()
-*  or WDC_DMATransactionSGInit()
+*  Gets the wait handle of a completion queue, which is signaled as long as
+*  the queue is not empty. The handle is owned by the queue.
 *
-*   @param [in] pDma: Pointer to a DMA information structure,
-*              received from a previous call to
-*              WDC_DMATransactionContigInit()
-*              (for a Contiguous DMA Buffer Transaction)
-*              or WDC_DMATransactionSGInit()
-*              (for a Scatter/Gather DMA buffer
-*              Transaction)  *ppDma returned by these functions
+*   @param [in] hCq:     Handle to the queue, returned by
+*                        WDC_CompletionQueueCreate()
+*   @param [out] phWait: Returns the wait handle
 *
 * @return  Returns WD_STATUS_SUCCESS (0) on success,
 *   or an appropriate error code otherwise
-*
-* For more detailed usage of the WDC_DMA Transactions functions,
-* please refer to @ref ch11_3_performing_direct_memory_access_dma_transactions
 */
-DWORD DLLCALLCONV WDC_DMATransactionUninit(_In_ WD_DMA *pDma);
+DWORD DLLCALLCONV WDC_CompletionQueueGetWaitHandle(
+    _In_ WDC_COMPLETION_QUEUE_HANDLE hCq, _Out_ WDC_CQ_WAIT_HANDLE *phWait);
 
 /**
-*  Locks a physical reserved memory buffer for DMA and returns the
-*  corresponding user mode address of locked DMA buffer.
+*  Attaches a DMA transaction to a completion queue: the completion of the
+*  transaction (WDC_DMATransferCompletedAndCheck() returning a status other
+*  than WD_MORE_PROCESSING_REQUIRED) is posted to the queue.
+*  Attaching an attached transaction moves it to the new queue. The
+*  transaction is detached by WDC_DMATransactionUninit().
 *
-*   @param [in] hDev:        Handle to a WDC device, returned by
-*                     WDC_xxxDeviceOpen()
-*   @param [in] qwAddr:      Physical address of the reserved buffer to lock
-*   @param [out] ppBuf:      Pointer to a pointer to be filled by the function
-*                     with the user-mode mapped address of the locked DMA
-*                     buffer
-*   @param [in] dwOptions:   A bit mask of any of the following flags
-*                     (defined in an enumeration in windrvr.h):
-*                        DMA_FROM_DEVICE: Synchronize the DMA buffer for
-*                        transfers from the device to memory.
-*                        DMA_TO_DEVICE: Synchronize the DMA buffer for
-*                        transfers from memory to the device.
-*                        DMA_TO_FROM_DEVICE: Synchronize the DMA buffer for
-*                        transfers in both directions i.e., from the device to
-*                        memory and from memory to the device
-*                        (<=> DMA_FROM_DEVICE | DMA_TO_DEVICE).
-*                        DMA_ALLOW_64BIT_ADDRESS: Allow allocation of 64-bit
-*                      DMA addresses. This flag is supported on Windows and
-*                      Linux.
-*   @param [in] dwDMABufSize: The size (in bytes) of the DMA buffer
-*   @param [out] ppDma:       Pointer to a pointer to a DMA buffer information
-*                      structure, which is allocated by the function.
-*                      The pointer to this structure (*ppDma) should be passed
-*                      to WDC_DMABufUnlock() when the
-*                      DMA buffer is no longer needed.
+*   @param [in] hCq:  Handle to the queue, returned by
+*                     WDC_CompletionQueueCreate()
+*   @param [in] pDma: Pointer to a DMA transaction, received from
+*                     WDC_DMATransactionContigInit() or
+*                     WDC_DMATransactionSGInit()
+*   @param [in] pCtx: Context to return in the completion entries
 *
 * @return  Returns WD_STATUS_SUCCESS (0) on success,
 *   or an appropriate error code otherwise
-*
-* For more detailed usage of the WDC_DMA functions, please refer to 
-* @ref ch11_2_performing_direct_memory_access_dma
 */
-DWORD DLLCALLCONV WDC_DMAReservedBufLock(_In_ WDC_DEVICE_HANDLE hDev,
-    _In_ PHYS_ADDR qwAddr, _Outptr_ PVOID *ppBuf, _In_ DWORD dwOptions,
-    _In_ DWORD dwDMABufSize, _Outptr_ WD_DMA **ppDma);
-
+DWORD DLLCALLCONV WDC_CompletionQueueAttach(
+    _In_ WDC_COMPLETION_QUEUE_HANDLE hCq, _In_ WD_DMA *pDma, _In_ PVOID pCtx);
 
 /**
-*  Unlocks and frees the memory allocated for a DMA buffer by a previous
-*  call to WDC_DMAContigBufLock(), WDC_DMASGBufLock() or
-*  WDC_DMAReservedBufLock()
+*  Detaches a DMA transaction from its completion queue.
 *
-*   @param [in] pDma: Pointer to a DMA information structure,
-*              received from a previous call to
-*              WDC_DMATransactionContigInit()
-*              (for a Contiguous DMA Buffer Transaction)
-*              or WDC_DMATransactionSGInit()
-*              (for a Scatter/Gather DMA buffer
-*              Transaction)  *ppDma returned by these functions
+*   @param [in] pDma: Pointer to the DMA transaction
 *
 * @return  Returns WD_STATUS_SUCCESS (0) on success,
 *   or an appropriate error code otherwise
-*
-* For more detailed usage of the WDC_DMA functions,
-* please refer to @ref ch11_2_performing_direct_memory_access_dma
 */
-DWORD DLLCALLCONV WDC_DMABufUnlock(_In_ WD_DMA *pDma);
-
-/** Utility macro that returns a contiguous DMA global handle that can be used
-   for buffer sharing between multiple processes. */
-#define WDC_DMAGetGlobalHandle(pDma) ((pDma)->hDma)
+DWORD DLLCALLCONV WDC_CompletionQueueDetach(_In_ WD_DMA *pDma);
 
 /**
-*  Retrieves a contiguous DMA buffer which was allocated by another process.
+*  Posts a completion to a completion queue.
+*  For DMA that is not performed with a DMA transaction, call from the
+*  interrupt handler.
 *
-*   @param [in] hDma:   DMA buffer handle.
-*   @param [out] ppDma: Pointer to a pointer to a DMA buffer information
-*                structure, which is associated with hDma.
+*   @param [in] hCq:      Handle to the queue, returned by
+*                         WDC_CompletionQueueCreate()
+*   @param [in] pDma:     Pointer to the completed DMA
+*   @param [in] pCtx:     Completion context
+*   @param [in] dwStatus: Completion status
 *
 * @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   WD_INSUFFICIENT_RESOURCES if the queue is full,
 *   or an appropriate error code otherwise
-*
-* For more detailed usage of the WDC_DMA functions,
-* please refer to @ref ch11_2_performing_direct_memory_access_dma
-*
-* @snippet highlevel_examples.c WDC_DMABufGet
 */
-DWORD DLLCALLCONV WDC_DMABufGet(_In_ DWORD hDma, _Outptr_ WD_DMA **ppDma);
+DWORD DLLCALLCONV WDC_CompletionQueuePost(
+    _In_ WDC_COMPLETION_QUEUE_HANDLE hCq, _In_ WD_DMA *pDma, _In_ PVOID pCtx,
+    _In_ DWORD dwStatus);
 
 /**
-*  Synchronizes the cache of all CPUs with the DMA buffer,
-*  by flushing the data from the CPU caches.
+*  Reaps completions from a completion queue, oldest first, without waiting.
+*  The wait handle of the queue is cleared when the queue is emptied; reap
+*  until fewer than dwMaxEntries entries are returned.
 *
-*   @param [in] pDma: Pointer to a DMA information structure,
-*              received from a previous call to
-*              WDC_DMATransactionContigInit()
-*              (for a Contiguous DMA Buffer Transaction)
-*              or WDC_DMATransactionSGInit()
-*              (for a Scatter/Gather DMA buffer
-*              Transaction)  *ppDma returned by these functions
+*   @param [in] hCq:          Handle to the queue, returned by
+*                             WDC_CompletionQueueCreate()
+*   @param [out] pEntries:    Array of dwMaxEntries entries, to be filled
+*   @param [in] dwMaxEntries: Maximum number of completions to reap
+*   @param [out] pdwEntries:  Returns the number of reaped completions
 *
 * @return  Returns WD_STATUS_SUCCESS (0) on success,
 *   or an appropriate error code otherwise
-*
-* For more detailed usage of the WDC_DMA functions,
-* please refer to @ref ch11_2_performing_direct_memory_access_dma
 */
-DWORD DLLCALLCONV WDC_DMASyncCpu(_In_ WD_DMA *pDma);
+DWORD DLLCALLCONV WDC_CompletionQueueReap(
+    _In_ WDC_COMPLETION_QUEUE_HANDLE hCq,
+    _Out_ WDC_COMPLETION_ENTRY *pEntries, _In_ DWORD dwMaxEntries,
+    _Out_ DWORD *pdwEntries);
 
 /**
-*  Synchronizes the I/O caches with the DMA buffer, by flushing the data
-*  from the I/O caches and updating the CPU caches.
+*  Gets the statistics of a completion queue.
 *
-*   @param [in] pDma: Pointer to a DMA information structure,
-*              received from a previous call to
-*              WDC_DMATransactionContigInit()
-*              (for a Contiguous DMA Buffer Transaction)
-*              or WDC_DMATransactionSGInit()
-*              (for a Scatter/Gather DMA buffer
-*              Transaction)  *ppDma returned by these functions
+*   @param [in] hCq:     Handle to the queue, returned by
+*                        WDC_CompletionQueueCreate()
+*   @param [out] pStats: Pointer to the statistics
 *
 * @return  Returns WD_STATUS_SUCCESS (0) on success,
 *   or an appropriate error code otherwise
-*
-* For more detailed usage of the WDC_DMA functions,
-* please refer to @ref ch11_2_performing_direct_memory_access_dma
 */
-DWORD DLLCALLCONV WDC_DMASyncIo(_In_ WD_DMA *pDma);
+DWORD DLLCALLCONV WDC_CompletionQueueGetStats(
+    _In_ WDC_COMPLETION_QUEUE_HANDLE hCq,
+    _Out_ WDC_COMPLETION_QUEUE_STATS *pStats);
 #endif
 /* -----------------------------------------------
     Interrupts
@@ -1967,6 +3068,156 @@ DWORD DLLCALLCONV WDC_IntEnable(_In_ WDC_DEVICE_HANDLE hDev,
 */
 DWORD DLLCALLCONV WDC_IntDisable(_In_ WDC_DEVICE_HANDLE hDev);
 
+/** Maximal number of vectors for WDC_IntEnableVectors() (the MSI-X table
+ * size limit) */
+#define WDC_INT_MAX_VECTORS 2048
+
+/** Interrupt vector handler information -- see WDC_IntEnableVectors() */
+typedef struct {
+    INT_HANDLER funcIntHandler; /**< Handler of the vector's interrupts */
+    PVOID pData;                /**< Data for the vector's handler */
+} WDC_INT_VECTOR;
+
+/**
+*  Enables interrupt handling for the device, with a separate handler per
+*  MSI/MSI-X vector.
+*
+*  The vectors are numbered from 0, by their order in the device's MSI-X
+*  table (or by their MSI message number). Each vector has its own thread,
+*  which calls the vector's handler, so that the handlers of different vectors
+*  run in parallel.
+*  The driver reports all the vectors of a device through a single interrupt
+*  and reports the message of the last received interrupt only (the message
+*  number, on Windows). So when several interrupts were received at once, or
+*  the vector cannot be identified (for example, the interrupt is not
+*  MSI/MSI-X, it is served by the interrupts reactor, the driver does not
+*  report the message, or several MSI-X vectors share the same message
+*  data), the handlers of all the vectors are called.
+*  The vectors handlers must tolerate calls without a pending interrupt of
+*  their vector.
+*  The interrupt is disabled with WDC_IntDisable().
+*
+*   @param [in] hDev:         Handle to a WDC device, returned by
+*                             WDC_xxxDeviceOpen()
+*   @param [in] pIntVectors:  Array of dwNumVectors vectors handlers
+*   @param [in] dwNumVectors: Number of vectors (up to WDC_INT_MAX_VECTORS)
+*   @param [in] pTransCmds:   Transfer commands, as in WDC_IntEnable()
+*   @param [in] dwNumCmds:    Number of transfer commands in the pTransCmds
+*                             array
+*   @param [in] dwOptions:    Interrupt handling flags, as in WDC_IntEnable().
+*                             INTERRUPT_DONT_GET_MSI_MESSAGE is not allowed.
+*   @param [in] fUseKP:       As in WDC_IntEnable()
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_IntEnableVectors(_In_ WDC_DEVICE_HANDLE hDev,
+    _In_ const WDC_INT_VECTOR *pIntVectors, _In_ DWORD dwNumVectors,
+    _In_ WD_TRANSFER *pTransCmds, _In_ DWORD dwNumCmds, _In_ DWORD dwOptions,
+    _In_ BOOL fUseKP);
+
+/**
+*  Completions poll callback of the hybrid interrupt/polling completion mode
+*  -- see WDC_IntEnableHybrid().
+*  Handles up to dwBudget completions of the device.
+*
+*   @param [in] pCtx:     The context of the hybrid completion (pCtx of
+*                         WDC_INT_HYBRID_PARAMS)
+*   @param [in] dwBudget: Maximal number of completions to handle
+*
+* @return  Returns the number of completions that were handled
+*/
+typedef DWORD (DLLCALLCONV *WDC_INT_POLL_FUNC)(_In_ PVOID pCtx,
+    _In_ DWORD dwBudget);
+
+/**
+*  Interrupt mask callback of the hybrid interrupt/polling completion mode
+*  -- see WDC_IntEnableHybrid().
+*  Masks or unmasks the completion interrupt of the device (usually by
+*  writing to an interrupt enable register of the device).
+*
+*   @param [in] pCtx:  The context of the hybrid completion (pCtx of
+*                      WDC_INT_HYBRID_PARAMS)
+*   @param [in] fMask: TRUE to mask the interrupt, FALSE to unmask it
+*/
+typedef void (DLLCALLCONV *WDC_INT_MASK_FUNC)(_In_ PVOID pCtx,
+    _In_ BOOL fMask);
+
+/** Hybrid interrupt/polling completion parameters -- see
+ * WDC_IntEnableHybrid() */
+typedef struct {
+    WDC_INT_POLL_FUNC funcPoll;    /**< Completions poll callback */
+    WDC_INT_MASK_FUNC funcIntMask; /**< Interrupt mask callback */
+    PVOID pCtx;                    /**< Context of the callbacks */
+    DWORD dwBudget;          /**< Maximal number of completions per poll.
+                              * A poll that reaches the budget switches to
+                              * polling mode. 0 - the default (64). */
+    DWORD dwIdlePolls;       /**< Number of consecutive polls without
+                              * completions, after which the interrupt is
+                              * unmasked. 0 - the default (16). */
+    DWORD dwPollIntervalUs;  /**< Sleep between polls, in microseconds.
+                              * 0 - poll continuously. */
+} WDC_INT_HYBRID_PARAMS;
+
+/** Hybrid interrupt/polling completion statistics -- see
+ * WDC_IntGetHybridStats() */
+typedef struct {
+    UINT64 qwInterrupts;        /**< Received interrupts */
+    UINT64 qwIntCompletions;    /**< Completions handled in interrupt mode */
+    UINT64 qwPolls;             /**< Polls in polling mode */
+    UINT64 qwPollCompletions;   /**< Completions handled in polling mode */
+    UINT64 qwPollModeSwitches;  /**< Switches to polling mode (the interrupt
+                                 * was masked) */
+    UINT64 qwIntModeSwitches;   /**< Switches to interrupt mode (the interrupt
+                                 * was unmasked) */
+} WDC_INT_HYBRID_STATS;
+
+/**
+*  Enables interrupt handling for the device, in hybrid interrupt/polling
+*  completion mode.
+*
+*  On an interrupt, the completions of the device are polled (funcPoll). If
+*  the poll reaches its budget, the device is considered loaded: the interrupt
+*  is masked (funcIntMask) and the completions are polled on the interrupt
+*  thread, without waiting for interrupts. After dwIdlePolls consecutive polls
+*  without completions, the interrupt is unmasked and the interrupt mode
+*  resumes.
+*  The polls run on the interrupt thread (or on the interrupts reactor
+*  worker, whose other interrupts wait while polling).
+*  The interrupt is disabled with WDC_IntDisable().
+*
+*   @param [in] hDev:       Handle to a WDC device, returned by
+*                           WDC_xxxDeviceOpen()
+*   @param [in] pTransCmds: Transfer commands, as in WDC_IntEnable()
+*   @param [in] dwNumCmds:  Number of transfer commands in the pTransCmds
+*                           array
+*   @param [in] dwOptions:  Interrupt handling flags, as in WDC_IntEnable()
+*   @param [in] pParams:    Pointer to the hybrid completion parameters
+*   @param [in] fUseKP:     As in WDC_IntEnable()
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_IntEnableHybrid(_In_ WDC_DEVICE_HANDLE hDev,
+    _In_ WD_TRANSFER *pTransCmds, _In_ DWORD dwNumCmds, _In_ DWORD dwOptions,
+    _In_ const WDC_INT_HYBRID_PARAMS *pParams, _In_ BOOL fUseKP);
+
+/**
+*  Gets the statistics of the hybrid interrupt/polling completion of a device.
+*  The statistics are updated by the interrupt thread without
+*  synchronization, and are intended for tuning.
+*
+*   @param [in] hDev:    Handle to a WDC device, returned by
+*                        WDC_xxxDeviceOpen()
+*   @param [out] pStats: Pointer to the statistics
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   WD_OPERATION_FAILED if the hybrid completion is not enabled for the
+*   device, or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_IntGetHybridStats(_In_ WDC_DEVICE_HANDLE hDev,
+    _Out_ WDC_INT_HYBRID_STATS *pStats);
+
 #endif
 
 /**
@@ -1985,6 +3236,44 @@ DWORD DLLCALLCONV WDC_IntDisable(_In_ WDC_DEVICE_HANDLE hDev);
 */
 BOOL DLLCALLCONV WDC_IntIsEnabled(_In_ WDC_DEVICE_HANDLE hDev);
 
+#if !defined(__KERNEL__)
+/** Interrupts reactor parameters -- see WDC_IntReactorStart() */
+typedef INT_REACTOR_PARAMS WDC_INT_REACTOR_PARAMS;
+
+/**
+*  Starts the interrupts reactor of the process.
+*
+*  By default, WDC_IntEnable() and WDC_EventRegister() start a thread per
+*  device interrupt and per events registration, which waits for the
+*  interrupts/events. Interrupts and events that are enabled while the reactor
+*  runs are served instead by the reactor's dwWorkers threads, and their
+*  handlers are called on these threads.
+*  The driver waits for one interrupt per call, so the workers poll the
+*  interrupt counters of their interrupts: a busy worker sweeps continuously,
+*  and an idle worker sleeps between sweeps, from dwMinSleepUs up to
+*  dwMaxSleepUs - which bounds the interrupt latency. Interrupts that are
+*  enabled with INTERRUPT_CMD_COPY keep a thread of their own, since the
+*  results of their transfer commands are returned only by the wait.
+*
+*   @param [in] pParams: Pointer to the reactor parameters
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   WD_OPERATION_ALREADY_DONE if the reactor is running,
+*   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_IntReactorStart(
+    _In_ const WDC_INT_REACTOR_PARAMS *pParams);
+
+/**
+*  Stops the interrupts reactor of the process. All the interrupts and events
+*  that are served by the reactor must be disabled first.
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_IntReactorStop(void);
+#endif
+
 /**
 *  Converts interrupt type to string.
 *
@@ -2117,6 +3406,9 @@ BOOL DLLCALLCONV WDC_EventIsRegistered(_In_ WDC_DEVICE_HANDLE hDev);
 *  previous debug settings and sets the default debug options before
 *  attempting to set the new options specified by the caller.
 *
+*  The debug level applies to the debug sections selected by
+*  WDC_SetDebugSections() - see WDC_DBG_ON().
+*
 *   @param [in] dbgOptions: A bit mask of flags indicating the desired debug
 *                    settings - see WDC_DBG_OPTIONS.
 *                    If this parameter is set to zero,
@@ -2165,6 +3457,134 @@ void DLLCALLCONV WDC_Err(const CHAR *format, ...);
 */
 void DLLCALLCONV WDC_Trace(const CHAR *format, ...);
 
+/* -----------------------------------------------
+    Debug sections
+   ----------------------------------------------- */
+/*
+ * Debug messages in hot paths should be guarded by WDC_DBG_ON(), so that the
+ * message arguments are not evaluated and no function is called when the
+ * message is not displayed:
+ *
+ *      if (WDC_DBG_ON(D_TRACE, S_DMA))
+ *          WDC_Trace("Completed descriptors: %d\n", dwCompleted);
+ *
+ *  or, equivalently:
+ *
+ *      WDC_DBG_TRACE(S_DMA, "Completed descriptors: %d\n", dwCompleted);
+ *
+ * Levels above WDC_DBG_MAX_LEVEL are compiled out. At runtime, the check is a
+ * single load of the level's enabled sections mask, which is updated by
+ * WDC_SetDebugOptions() (debug level) and WDC_SetDebugSections() (sections).
+ */
+
+/** Highest debug level that is compiled in (DEBUG_LEVEL); may be defined by
+ * the build. Defaults to D_TRACE in DEBUG builds and to D_ERROR otherwise. */
+#ifndef WDC_DBG_MAX_LEVEL
+    #if defined(DEBUG)
+        #define WDC_DBG_MAX_LEVEL D_TRACE
+    #else
+        #define WDC_DBG_MAX_LEVEL D_ERROR
+    #endif
+#endif
+
+#if defined(__GNUC__)
+    #define WDC_DBG_UNLIKELY(x) __builtin_expect(!!(x), 0)
+#else
+    #define WDC_DBG_UNLIKELY(x) (x)
+#endif
+
+#if defined(WIN32) && !defined(__KERNEL__) && !defined(WDC_LIB_BUILD)
+    #define WDC_DBG_DATA __declspec(dllimport)
+#else
+    #define WDC_DBG_DATA
+#endif
+
+/** Enabled debug sections (DEBUG_SECTION bitmask) of each debug level,
+ * indexed by DEBUG_LEVEL. Do not modify directly - use WDC_SetDebugOptions()
+ * and WDC_SetDebugSections(). */
+extern WDC_DBG_DATA volatile DWORD WdcDbgSectionsMask[D_TRACE + 1];
+
+/** TRUE if debug messages of the given level (DEBUG_LEVEL) and section
+ * (DEBUG_SECTION) are displayed */
+#define WDC_DBG_ON(dwLevel, dwSection) \
+    ((dwLevel) <= WDC_DBG_MAX_LEVEL && \
+    WDC_DBG_UNLIKELY(WdcDbgSectionsMask[(dwLevel)] & (DWORD)(dwSection)))
+
+/** Displays a debug trace message of the given section (DEBUG_SECTION),
+ * only if it is enabled - see WDC_DBG_ON() */
+#define WDC_DBG_TRACE(dwSection, ...) \
+    do { \
+        if (WDC_DBG_ON(D_TRACE, dwSection)) \
+            WDC_Trace(__VA_ARGS__); \
+    } while (0)
+
+/**
+*  Sets the debug sections for which WDC debug messages are displayed
+*  (see WDC_DBG_ON()). Until the function is called, all the sections are
+*  enabled (S_ALL).
+*
+*   @param [in] dwSections: Bitmask of the sections to enable (DEBUG_SECTION),
+*                    e.g. S_DMA | S_INT
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_SetDebugSections(_In_ DWORD dwSections);
+
+#if !defined(__KERNEL__)
+/* -----------------------------------------------
+    API calls statistics
+   ----------------------------------------------- */
+
+/**
+*  Gets the statistics of the WinDriver API calls made by the WDC library
+*  (and by application code built with WD_STATS) since the process started
+*  or since the last call to WDC_ResetStats(): number of calls, number of
+*  errors and a latency histogram per ioctl.
+*
+*  The calls are counted by each calling thread; the threads' counters are
+*  merged when this function is called.
+*
+*   @param [out] pStats:       Array of per-ioctl statistics, sorted by ioctl
+*                              code. Only ioctls that were called are
+*                              returned.
+*                              May be NULL if dwMaxIoctls is 0.
+*   @param [in] dwMaxIoctls:   Number of entries in the pStats array.
+*                              Pass WD_STATS_MAX_IOCTLS to receive all the
+*                              ioctls.
+*   @param [out] pdwNumIoctls: Number of ioctls that were called. On
+*                              success, this is the number of entries
+*                              returned in pStats.
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   WD_INSUFFICIENT_RESOURCES if pStats is too small (its dwMaxIoctls
+*   entries are filled with the ioctls of the lowest codes, and
+*   *pdwNumIoctls is set to the required number of entries),
+*   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_GetStats(_Out_ WD_IOCTL_STATS *pStats,
+    _In_ DWORD dwMaxIoctls, _Out_ DWORD *pdwNumIoctls);
+
+/**
+*  Resets the WinDriver API calls statistics returned by WDC_GetStats().
+*
+* @return  None
+*/
+void DLLCALLCONV WDC_ResetStats(void);
+
+/**
+*  Exports a snapshot of the WinDriver API calls statistics (see
+*  WDC_GetStats()) to a file, which can be displayed using the
+*  `wddebug stats <file>` command.
+*
+*   @param [in] sFileName: Name of the file to create
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDC_ExportStats(_In_ const CHAR *sFileName);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
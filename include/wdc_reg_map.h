@@ -0,0 +1,215 @@
+/* Jungo Connectivity Confidential. Copyright (c) 2022 Jungo Connectivity Ltd.  https://www.jungo.com */
+
+#ifndef _WDC_REG_MAP_H_
+#define _WDC_REG_MAP_H_
+
+/**************************************************************************
+*  File: wdc_reg_map.h - WD card (WDC) compile-time register map template.*
+*        Turns a device's register table into static inline typed        *
+*        accessors, which read/write the cached direct memory address of *
+*        the register's BAR with the offset and width fixed at compile   *
+*        time, bypassing the handle validation and address space lookup  *
+*        of WDC_ReadAddrXXX()/WDC_WriteAddrXXX().                        *
+***************************************************************************/
+
+/*
+ * Usage:
+ *
+ * 1. Describe the registers in an X-macro table. Each entry passes the
+ *    accessors prefix through, followed by the register name, address space
+ *    (BAR), offset, width in bits (8/16/32/64), direction (WDC_DIRECTION) and
+ *    description:
+ *
+ *      #define MYDEV_REG_TABLE(REG, P) \
+ *          REG(P, CTRL, AD_PCI_BAR0, 0x0, 32, WDC_READ_WRITE, "Control") \
+ *          REG(P, STAT, AD_PCI_BAR0, 0x4, 32, WDC_READ, "Status")
+ *
+ * 2. Generate the accessors (in a header or source file):
+ *
+ *      MYDEV_REG_TABLE(WDC_REG_MAP_ACCESSORS, MYDEV)
+ *
+ *    This defines MYDEV_CTRL_Read(pMap), MYDEV_CTRL_Write(pMap, val),
+ *    MYDEV_STAT_Read(pMap), etc.
+ *
+ * 3. Optionally generate a WDC_REG array from the same table, for the
+ *    diagnostics registers menus:
+ *
+ *      static const WDC_REG gMyDev_Regs[] = {
+ *          MYDEV_REG_TABLE(WDC_REG_MAP_WDC_REG, MYDEV)
+ *      };
+ *
+ * 4. Initialize a WDC_REG_MAP once, after opening the device, and pass it to
+ *    the accessors:
+ *
+ *      WDC_RegMapInit(&pDevCtx->regMap, hDev, BIT0);
+ *      u32Stat = MYDEV_STAT_Read(&pDevCtx->regMap);
+ *
+ * The accessors are valid only for memory address spaces that are mapped for
+ * direct access in the calling context (see WDC_MEM_DIRECT_ADDR()). Pass the
+ * bitmask of the address spaces used by the table to WDC_RegMapInit(), so that
+ * this is verified once, when the map is initialized.
+ * In DEBUG builds each access is also verified against the map (mapped
+ * address space, offset within the address space, register direction); in
+ * release builds each accessor compiles to a single load or store.
+ */
+
+#include "wdc_defs.h"
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+/** Maximum number of address spaces that a register map can describe */
+#define WDC_REG_MAP_MAX_ADDR_SPACES AD_PCI_BARS
+
+/** Register map: cached direct memory addresses of a device's address
+ * spaces */
+typedef struct {
+    WDC_DEVICE_HANDLE hDev;  /** Handle to the WDC device */
+    UPTR   pBase[WDC_REG_MAP_MAX_ADDR_SPACES];   /** Direct memory address of
+                                                  * each address space; 0 if
+                                                  * not mapped for direct
+                                                  * access */
+    UINT64 qwBytes[WDC_REG_MAP_MAX_ADDR_SPACES]; /** Size of each address
+                                                  * space */
+} WDC_REG_MAP;
+
+/** Register C types, by register width in bits */
+#define WDC_REG_TYPE_8  BYTE
+#define WDC_REG_TYPE_16 WORD
+#define WDC_REG_TYPE_32 UINT32
+#define WDC_REG_TYPE_64 UINT64
+
+/**
+*  Initializes a register map from a device's address spaces information.
+*
+*   @param [out] pMap:                Pointer to the register map to initialize
+*   @param [in] hDev:                 Handle to a WDC device,
+*                                     returned by WDC_xxxDeviceOpen()
+*   @param [in] dwRequiredAddrSpaces: Bitmask of the address spaces that must be
+*                                     mapped for direct memory access (bit N
+*                                     represents address space N)
+*
+* @return  Returns WD_STATUS_SUCCESS (0) on success,
+*   or an appropriate error code otherwise
+*/
+static inline DWORD WDC_RegMapInit(WDC_REG_MAP *pMap, WDC_DEVICE_HANDLE hDev,
+    DWORD dwRequiredAddrSpaces)
+{
+    PWDC_DEVICE pDev = (PWDC_DEVICE)hDev;
+    DWORD i;
+
+    if (!pMap || !pDev)
+    {
+        WDC_Err("WDC_RegMapInit: Invalid parameters\n");
+        return WD_INVALID_PARAMETER;
+    }
+
+    BZERO(*pMap);
+    pMap->hDev = hDev;
+
+    for (i = 0; i < pDev->dwNumAddrSpaces && i < WDC_REG_MAP_MAX_ADDR_SPACES;
+        i++)
+    {
+        WDC_ADDR_DESC *pAddrDesc = &pDev->pAddrDesc[i];
+
+        if (!WDC_ADDR_IS_MEM(pAddrDesc))
+            continue;
+
+        pMap->pBase[i] = (UPTR)WDC_MEM_DIRECT_ADDR(pAddrDesc);
+        pMap->qwBytes[i] = pMap->pBase[i] ? pAddrDesc->qwBytes : 0;
+    }
+
+    for (i = 0; i < WDC_REG_MAP_MAX_ADDR_SPACES; i++)
+    {
+        if ((dwRequiredAddrSpaces & (1 << i)) && !pMap->pBase[i])
+        {
+            WDC_Err("WDC_RegMapInit: Address space %ld is not mapped for "
+                "direct memory access\n", i);
+            return WD_INVALID_PARAMETER;
+        }
+    }
+
+    return WD_STATUS_SUCCESS;
+}
+
+#if defined(DEBUG)
+/* Verify a register access against the map. Returns TRUE if the access may be
+ * performed. */
+static inline BOOL WDC_RegMapCheck(const WDC_REG_MAP *pMap, DWORD dwAddrSpace,
+    KPTR dwOffset, DWORD dwSize, WDC_DIRECTION direction, BOOL fIsRead,
+    const CHAR *sFunc)
+{
+    if (!pMap || dwAddrSpace >= WDC_REG_MAP_MAX_ADDR_SPACES ||
+        !pMap->pBase[dwAddrSpace])
+    {
+        WDC_Err("%s: Address space %ld is not mapped for direct memory "
+            "access\n", sFunc, dwAddrSpace);
+        return FALSE;
+    }
+
+    if ((UINT64)dwOffset + dwSize > pMap->qwBytes[dwAddrSpace])
+    {
+        WDC_Err("%s: Offset 0x%" PRI64 "x exceeds address space %ld size "
+            "(0x%" PRI64 "x)\n", sFunc, (UINT64)dwOffset, dwAddrSpace,
+            pMap->qwBytes[dwAddrSpace]);
+        return FALSE;
+    }
+
+    if ((fIsRead && direction == WDC_WRITE) ||
+        (!fIsRead && direction == WDC_READ))
+    {
+        WDC_Err("%s: Register direction does not allow this access\n",
+            sFunc);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+    #define WDC_REG_MAP_CHECK(pMap, space, offset, bits, dir, fIsRead, sFunc) \
+        WDC_RegMapCheck(pMap, space, offset, WDC_SIZE_##bits, dir, fIsRead, \
+            sFunc)
+#else
+    #define WDC_REG_MAP_CHECK(pMap, space, offset, bits, dir, fIsRead, sFunc) \
+        TRUE
+#endif
+
+/**
+*  Register table entry generator: defines the register's typed read and write
+*  accessors, P_name_Read(pMap) and P_name_Write(pMap, val).
+*/
+#define WDC_REG_MAP_ACCESSORS(P, name, space, offset, bits, dir, desc) \
+    static inline WDC_REG_TYPE_##bits P##_##name##_Read( \
+        const WDC_REG_MAP *pMap) \
+    { \
+        if (!WDC_REG_MAP_CHECK(pMap, space, offset, bits, dir, TRUE, \
+            #P "_" #name "_Read")) \
+        { \
+            return (WDC_REG_TYPE_##bits)0; \
+        } \
+        return WDC_ReadMem##bits(pMap->pBase[space], offset); \
+    } \
+    static inline void P##_##name##_Write(const WDC_REG_MAP *pMap, \
+        WDC_REG_TYPE_##bits val) \
+    { \
+        if (!WDC_REG_MAP_CHECK(pMap, space, offset, bits, dir, FALSE, \
+            #P "_" #name "_Write")) \
+        { \
+            return; \
+        } \
+        WDC_WriteMem##bits(pMap->pBase[space], offset, val); \
+    }
+
+/**
+*  Register table entry generator: expands to the register's WDC_REG array
+*  initializer (see wdc_diag_lib.h).
+*/
+#define WDC_REG_MAP_WDC_REG(P, name, space, offset, bits, dir, desc) \
+    { space, offset, WDC_SIZE_##bits, dir, #name, desc },
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _WDC_REG_MAP_H_ */
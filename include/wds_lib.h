@@ -228,6 +228,87 @@ DWORD DLLCALLCONV WDS_IpcSubGroupMulticast(_In_ DWORD dwRecipientSubGroupID,
 */
 DWORD DLLCALLCONV WDS_IpcMulticast(_In_ DWORD dwMsgID, _In_ UINT64 qwMsgData);
 
+/** Options of batched IPC messaging -- see WDS_IpcSendBatch() and
+ * WDS_IpcRegisterBatch() */
+enum {
+    WDS_IPC_COALESCE = 0x1, /**< Messages of a batch with the same message ID
+                              * and recipient (sender, when received) are
+                              * delivered once, at the position of the first
+                              * one, with the data of the last one */
+};
+
+/** Maximal number of messages that are passed to an
+ * IPC_MSG_RX_BATCH_HANDLER() in one call */
+#define WDS_IPC_RX_BATCH_MAX 256
+
+/** Maximal number of messages that can be sent in one WDS_IpcSendBatch()
+ * call */
+#define WDS_IPC_TX_BATCH_MAX 256
+
+/** IPC message to send -- see WDS_IpcSendBatch() */
+typedef struct {
+    DWORD  dwOptions;     /**< WD_IPC_UID_UNICAST, WD_IPC_SUBGROUP_MULTICAST
+                            * or WD_IPC_MULTICAST */
+    DWORD  dwRecipientID; /**< Recipient UID (WD_IPC_UID_UNICAST) or
+                            * sub-group ID (WD_IPC_SUBGROUP_MULTICAST) */
+    DWORD  dwMsgID;       /**< Message ID */
+    UINT64 qwMsgData;     /**< Optional - 64 bit additional data */
+} WDS_IPC_MSG_TX;
+
+/**
+*  WinDriver IPC batched messages handler callback.
+*
+*   @param [in] pIpcRxMsgs: Array of the received IPC messages, in the order
+*                           of their arrival
+*   @param [in] dwNumMsgs:  Number of messages in pIpcRxMsgs
+*   @param [in] pData:      Application specific data opaque as passed
+*                           to WDS_IpcRegisterBatch()
+*/
+typedef void (*IPC_MSG_RX_BATCH_HANDLER)(_In_ WDS_IPC_MSG_RX *pIpcRxMsgs,
+    _In_ DWORD dwNumMsgs, _In_ void *pData);
+
+/**
+*  Registers an application with WinDriver IPC, like WDS_IpcRegister(), and
+*  passes the messages that arrive together to the handler in one call.
+*
+*   @param [in] pcProcessName: Optional process name string
+*   @param [in] dwGroupID:     A unique group ID represent the specific
+*                              application. Must be a positive ID
+*   @param [in] dwSubGroupID:  Sub-group ID. Must be a positive ID
+*   @param [in] dwAction:      IPC message type to receive -- see
+*                              WDS_IpcRegister()
+*   @param [in] pFunc:         A user-mode IPC batched messages handler
+*                              callback function
+*                              (See IPC_MSG_RX_BATCH_HANDLER())
+*   @param [in] pData:         Data for pFunc
+*   @param [in] dwOptions:     WDS_IPC_COALESCE, or 0
+*
+* @return
+*  Returns WD_STATUS_SUCCESS (0) on success,
+*  or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDS_IpcRegisterBatch(_In_ const CHAR *pcProcessName,
+    _In_ DWORD dwGroupID, _In_ DWORD dwSubGroupID, _In_ DWORD dwAction,
+    _In_ IPC_MSG_RX_BATCH_HANDLER pFunc, _In_ void *pData,
+    _In_ DWORD dwOptions);
+
+/**
+*  Sends a batch of messages, each to its own recipients, in one call.
+*
+*   @param [in] pMsgs:     Array of the messages to send
+*   @param [in] dwNumMsgs: Number of messages in pMsgs, up to
+*                          WDS_IPC_TX_BATCH_MAX
+*   @param [in] dwOptions: WDS_IPC_COALESCE, or 0
+*   @param [out] pdwSent:  Optional - number of messages that were sent
+*
+* @return
+*  Returns WD_STATUS_SUCCESS (0) on success,
+*  or an appropriate error code otherwise. On failure, the messages after
+*  the failed one are not sent
+*/
+DWORD DLLCALLCONV WDS_IpcSendBatch(_In_ const WDS_IPC_MSG_TX *pMsgs,
+    _In_ DWORD dwNumMsgs, _In_ DWORD dwOptions, _Out_ DWORD *pdwSent);
+
 /* -------------------------------------------------------------------------
     Shared Buffers (User-Mode <-> Kernel Mode) / (User-Mode <-> User-Mode)
    ------------------------------------------------------------------------- */
@@ -321,6 +402,203 @@ DWORD DLLCALLCONV WDS_SharedBufferGet(_In_ DWORD hKerBuf,
 */
 DWORD DLLCALLCONV WDS_SharedBufferFree(_In_ WD_KERNEL_BUFFER *pKerBuf);
 
+/* -------------------------------------------------------------------------
+    Shared rings (User-Mode <-> User-Mode)
+   ------------------------------------------------------------------------- */
+/*
+ * A shared ring streams variable-length records between processes through a
+ * shared buffer. The producers and the consumers access the ring without
+ * system calls; a consumer is woken with a WinDriver IPC message (a
+ * "doorbell") only when a push finds the ring empty.
+ */
+
+/** Shared ring options -- see WDS_RingCreate() */
+enum {
+    WDS_RING_MPMC = 0x1, /**< Multiple producers and multiple consumers.
+                           * Default: a single producer and a single
+                           * consumer */
+};
+
+/** IPC message ID of the doorbells of shared rings. The message data holds
+ * the ring ID -- see WDS_RingCreate() */
+#define WDS_RING_DOORBELL_MSG_ID 0x57524E47
+
+/** Size of the ring control area at the start of the ring memory */
+#define WDS_RING_CTRL_BYTES 320
+
+/**
+*  Shared ring doorbell callback
+*
+*   @param [in] pCtx:          Context as passed to WDS_RingDoorbellSet()
+*   @param [in] dwConsumerUID: Consumer UID as set by WDS_RingConsumerSet()
+*   @param [in] dwRingID:      ID of the ring
+*/
+typedef void (DLLCALLCONV *WDS_RING_DOORBELL_FUNC)(_In_ void *pCtx,
+    _In_ DWORD dwConsumerUID, _In_ DWORD dwRingID);
+
+/**
+*  Formats a shared ring in memory that is shared by the processes, and
+*  returns a handle to the ring.
+*
+*   @param [in] pMem:      Memory of the ring, aligned to 64 bytes
+*   @param [in] qwBytes:   Size of the memory, in bytes. The ring holds up to
+*                          the largest power of 2 that is not greater than
+*                          (qwBytes - WDS_RING_CTRL_BYTES) bytes of records;
+*                          each record takes its size rounded up to 8 bytes,
+*                          plus 8 bytes
+*   @param [in] dwOptions: Ring options -- see WDS_RING_MPMC
+*   @param [in] dwRingID:  ID of the ring, which is passed to the doorbells
+*   @param [out] phRing:   Pointer to the handle of the ring, to be filled by
+*                          the function. The handle should be passed to
+*                          WDS_RingClose()
+*
+* @return
+*  Returns WD_STATUS_SUCCESS (0) on success,
+*  or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDS_RingCreate(_In_ PVOID pMem, _In_ UINT64 qwBytes,
+    _In_ DWORD dwOptions, _In_ DWORD dwRingID, _Outptr_ HANDLE *phRing);
+
+/**
+*  Attaches to a shared ring that another process formatted with
+*  WDS_RingCreate().
+*
+*   @param [in] pMem:    Memory of the ring, as mapped by the calling process
+*   @param [in] qwBytes: Size of the memory, in bytes
+*   @param [out] phRing: Pointer to the handle of the ring, to be filled by
+*                        the function. The handle should be passed to
+*                        WDS_RingClose()
+*
+* @return
+*  Returns WD_STATUS_SUCCESS (0) on success,
+*  or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDS_RingAttach(_In_ PVOID pMem, _In_ UINT64 qwBytes,
+    _Outptr_ HANDLE *phRing);
+
+/**
+*  Allocates a shared buffer (see WDS_SharedBufferAlloc()) and formats a
+*  shared ring in it. The ring ID is the global handle of the buffer, which
+*  other processes pass to WDS_SharedRingGet().
+*
+*   @param [in] qwBytes:   Size of the buffer, in bytes
+*   @param [in] dwOptions: Ring options -- see WDS_RING_MPMC
+*   @param [out] phRing:   Pointer to the handle of the ring, to be filled by
+*                          the function. The handle should be passed to
+*                          WDS_RingClose(), which frees the buffer
+*
+* @return
+*  Returns WD_STATUS_SUCCESS (0) on success,
+*  or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDS_SharedRingAlloc(_In_ UINT64 qwBytes,
+    _In_ DWORD dwOptions, _Outptr_ HANDLE *phRing);
+
+/**
+*  Attaches to a shared ring that another process allocated with
+*  WDS_SharedRingAlloc().
+*
+*   @param [in] dwRingID: ID of the ring -- see WDS_RingIdGet()
+*   @param [out] phRing:  Pointer to the handle of the ring, to be filled by
+*                         the function. The handle should be passed to
+*                         WDS_RingClose()
+*
+* @return
+*  Returns WD_STATUS_SUCCESS (0) on success,
+*  or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDS_SharedRingGet(_In_ DWORD dwRingID,
+    _Outptr_ HANDLE *phRing);
+
+/**
+*  Returns the ID of a shared ring.
+*
+*   @param [in] hRing: Handle of the ring
+*
+* @return
+*  Returns the ID of the ring
+*/
+DWORD DLLCALLCONV WDS_RingIdGet(_In_ HANDLE hRing);
+
+/**
+*  Closes a shared ring handle. The ring memory of WDS_SharedRingAlloc() and
+*  WDS_SharedRingGet() is released as well.
+*
+*   @param [in] hRing: Handle of the ring
+*
+* @return
+*  Returns WD_STATUS_SUCCESS (0) on success,
+*  or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDS_RingClose(_In_ HANDLE hRing);
+
+/**
+*  Sets the WinDriver IPC unique ID of the process that the doorbells of a
+*  shared ring wake. The consumer should be registered with
+*  WDS_IpcRegister() for WD_IPC_UNICAST_MSG messages, and should pop all the
+*  records of the ring when it receives a WDS_RING_DOORBELL_MSG_ID message.
+*
+*   @param [in] hRing:         Handle of the ring
+*   @param [in] dwConsumerUID: IPC unique ID of the consumer, or 0 for no
+*                              doorbells
+*
+* @return
+*  Returns WD_STATUS_SUCCESS (0) on success,
+*  or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDS_RingConsumerSet(_In_ HANDLE hRing,
+    _In_ DWORD dwConsumerUID);
+
+/**
+*  Replaces the doorbells that the calling process rings for a shared ring.
+*  By default, a doorbell is a WDS_IpcUidUnicast() message to the consumer.
+*
+*   @param [in] hRing: Handle of the ring
+*   @param [in] pFunc: Doorbell callback, or NULL to restore the default
+*   @param [in] pCtx:  Context for pFunc
+*
+* @return
+*  Returns WD_STATUS_SUCCESS (0) on success,
+*  or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDS_RingDoorbellSet(_In_ HANDLE hRing,
+    _In_ WDS_RING_DOORBELL_FUNC pFunc, _In_ void *pCtx);
+
+/**
+*  Pushes a record to a shared ring, and rings the doorbell if the ring was
+*  empty.
+*
+*   @param [in] hRing:   Handle of the ring
+*   @param [in] pData:   Data of the record
+*   @param [in] dwBytes: Size of the record, in bytes
+*
+* @return
+*  Returns WD_STATUS_SUCCESS (0) on success,
+*  WD_TRY_AGAIN if the ring is full,
+*  or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDS_RingPush(_In_ HANDLE hRing, _In_ const void *pData,
+    _In_ DWORD dwBytes);
+
+/**
+*  Pops the oldest record of a shared ring.
+*
+*   @param [in] hRing:      Handle of the ring
+*   @param [out] pBuf:      Buffer for the data of the record
+*   @param [in] dwBufBytes: Size of the buffer, in bytes
+*   @param [out] pdwBytes:  Size of the record, in bytes. If the buffer is too
+*                           small, the size of the record is returned and the
+*                           record remains in the ring
+*
+* @return
+*  Returns WD_STATUS_SUCCESS (0) on success,
+*  WD_TRY_AGAIN if the ring is empty,
+*  WD_INSUFFICIENT_RESOURCES if the buffer is too small,
+*  or an appropriate error code otherwise
+*/
+DWORD DLLCALLCONV WDS_RingPop(_In_ HANDLE hRing, _Out_ void *pBuf,
+    _In_ DWORD dwBufBytes, _Out_ DWORD *pdwBytes);
+
 /**
 *  Enables the shared interrupts mechanism of WinDriver.
 *  If the mechanism is already enabled globally (for all processes)
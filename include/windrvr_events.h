@@ -10,11 +10,38 @@ extern "C" {
 #endif
 
 typedef void (*EVENT_HANDLER)(WD_EVENT *pEvent, void *pData);
+/* Called after the events of a wakeup of the events thread were passed to the
+ * EVENT_HANDLER, with the number of the events */
+typedef void (*EVENT_BATCH_END_HANDLER)(DWORD dwNumEvents, void *pData);
 typedef void event_handle_t;
 
 DWORD DLLCALLCONV EventRegister(HANDLE *phEvent, HANDLE hWD, WD_EVENT *pEvent,
     EVENT_HANDLER pFunc, void *pData);
+DWORD DLLCALLCONV EventRegisterBatch(HANDLE *phEvent, HANDLE hWD,
+    WD_EVENT *pEvent, EVENT_HANDLER pFunc, EVENT_BATCH_END_HANDLER pEndFunc,
+    void *pData);
 DWORD DLLCALLCONV EventUnregister(HANDLE hEvent);
+/* Returns the ThreadStart() handle of the events thread */
+HANDLE DLLCALLCONV EventThreadGet(HANDLE hEvent);
+
+/* Events delivery statistics of a registration */
+typedef struct {
+    UINT64 qwDelivered; /* Events passed to the handler */
+    UINT64 qwCoalesced; /* Delivered events that were pulled together with an
+                         * earlier event, without a wakeup of their own */
+    UINT64 qwBatches;   /* Wakeups of the events thread that pulled events */
+} EVENT_STATS;
+
+DWORD DLLCALLCONV EventGetStats(HANDLE hEvent, EVENT_STATS *pStats);
+
+/* Pulls the pending events of the event registration hEvent
+ * (WD_EVENT.hEvent) into the buffer pe, which has room for one match table,
+ * and passes each event to pFunc, until no event is pending or dwMaxEvents
+ * events were pulled (0 - no limit). Events with the WD_ACKNOWLEDGE option
+ * are acknowledged after pFunc returns. Returns the number of pulled events
+ * in *pdwPulled (optional) */
+DWORD DLLCALLCONV EventPullBatch(HANDLE hWD, DWORD hEvent, WD_EVENT *pe,
+    DWORD dwMaxEvents, EVENT_HANDLER pFunc, void *pData, DWORD *pdwPulled);
 
 WD_EVENT * DLLCALLCONV EventAlloc(DWORD dwNumMatchTables);
 void DLLCALLCONV EventFree(WD_EVENT *pe);
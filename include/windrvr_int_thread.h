@@ -14,10 +14,41 @@ extern "C" {
 typedef void (DLLCALLCONV * INT_HANDLER)(PVOID pData);
 typedef INT_HANDLER INT_HANDLER_FUNC;
 
+/* Interrupts reactor parameters -- see InterruptReactorStart() */
+typedef struct
+{
+    DWORD dwWorkers;    /* Number of worker threads */
+    DWORD dwMinSleepUs; /* Sleep after the first idle sweep, in microseconds */
+    DWORD dwMaxSleepUs; /* Maximum sleep between idle sweeps, in
+                         * microseconds: the interrupt latency of an idle
+                         * reactor */
+    UINT64 qwCpuMask;   /* CPUs (0-63) to pin the workers to, round robin;
+                         * 0 - no pinning. Ignored when the
+                         * THREAD_CLASS_INTERRUPT attributes include a CPU
+                         * mask. */
+} INT_REACTOR_PARAMS;
+
 DWORD DLLCALLCONV InterruptEnable(HANDLE *phThread, HANDLE hWD,
     WD_INTERRUPT *pInt, INT_HANDLER func, PVOID pData);
 
+/* As InterruptEnable(), with the THREAD_CLASS of the interrupt thread (see
+ * ThreadClassAttrSet() in utils.h) */
+DWORD DLLCALLCONV InterruptEnableClass(HANDLE *phThread, HANDLE hWD,
+    WD_INTERRUPT *pInt, INT_HANDLER func, PVOID pData, DWORD dwThreadClass);
+
 DWORD DLLCALLCONV InterruptDisable(HANDLE hThread);
+/* Returns the ThreadStart() handle of an interrupt thread, or NULL if the
+ * interrupt is served by the reactor */
+HANDLE DLLCALLCONV InterruptThreadGet(HANDLE hThread);
+/* Starts the interrupts reactor: interrupts that are enabled while the
+ * reactor runs are served by its workers, instead of a thread per interrupt.
+ * The workers poll the interrupt counters (WD_IntCount()), since the driver
+ * waits for one interrupt per call (WD_IntWait()); interrupts with
+ * INTERRUPT_CMD_COPY transfer commands keep a thread of their own. */
+DWORD DLLCALLCONV InterruptReactorStart(HANDLE hWD,
+    const INT_REACTOR_PARAMS *pParams);
+/* Stops the interrupts reactor; fails if interrupts are served by it */
+DWORD DLLCALLCONV InterruptReactorStop(void);
 
 #ifdef __cplusplus
 }
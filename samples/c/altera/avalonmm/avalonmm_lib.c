@@ -39,7 +39,7 @@ typedef struct {
   Global variables definitions
  *************************************************************/
  /* Last error information string */
-static CHAR gsAVALONMM_LastErr[256];
+static OS_THREAD_LOCAL UTIL_LAZY_MSG gAVALONMM_LastErr;
 
 /* Library initialization reference count */
 static DWORD LibInit_count = 0;
@@ -61,9 +61,7 @@ static inline BOOL IsValidDevice(PWDC_DEVICE pDev, const CHAR *sFunc)
 {
     if (!pDev || !(PAVALONMM_DEV_CTX)(pDev->pCtx))
     {
-        snprintf(gsAVALONMM_LastErr, sizeof(gsAVALONMM_LastErr) - 1,
-            "%s: NULL device %s\n", sFunc, !pDev ? "handle" : "context");
-        ErrLog(gsAVALONMM_LastErr);
+        ErrLog("%s: NULL device %s\n", sFunc, !pDev ? "handle" : "context");
         return FALSE;
     }
 
@@ -888,10 +886,9 @@ static void ErrLog(const CHAR *sFormat, ...)
     va_list argp;
 
     va_start(argp, sFormat);
-    vsnprintf(gsAVALONMM_LastErr, sizeof(gsAVALONMM_LastErr) - 1, sFormat,
-        argp);
+    UtilLazyMsgSet(&gAVALONMM_LastErr, sFormat, argp);
 #ifdef DEBUG
-    WDC_Err("AVALONMM lib: %s", gsAVALONMM_LastErr);
+    WDC_Err("AVALONMM lib: %s", UtilLazyMsgGet(&gAVALONMM_LastErr));
 #endif
     va_end(argp);
 }
@@ -915,7 +912,7 @@ static void TraceLog(const CHAR *sFormat, ...)
 /* Get last error */
 const char *AVALONMM_GetLastErr(void)
 {
-    return gsAVALONMM_LastErr;
+    return UtilLazyMsgGet(&gAVALONMM_LastErr);
 }
 
 
@@ -45,7 +45,7 @@ typedef struct {
 /* TODO: You can add fields to store additional device-specific information. */
 
 /* Last error information string */
-static CHAR gsQSYS_LastErr[256];
+static OS_THREAD_LOCAL UTIL_LAZY_MSG gQSYS_LastErr;
 
 /* Library initialization reference count */
 static DWORD LibInit_count = 0;
@@ -67,9 +67,7 @@ static inline BOOL IsValidDevice(PWDC_DEVICE pDev, const CHAR *sFunc)
 {
     if (!pDev || !WDC_GetDevContext(pDev))
     {
-        snprintf(gsQSYS_LastErr, sizeof(gsQSYS_LastErr) - 1, "%s: NULL "
-            "device %s\n", sFunc, !pDev ? "handle" : "context");
-        ErrLog(gsQSYS_LastErr);
+        ErrLog("%s: NULL device %s\n", sFunc, !pDev ? "handle" : "context");
         return FALSE;
     }
 
@@ -850,7 +848,7 @@ static void ErrLog(const CHAR *sFormat, ...)
     va_list argp;
 
     va_start(argp, sFormat);
-    vsnprintf(gsQSYS_LastErr, sizeof(gsQSYS_LastErr) - 1, sFormat, argp);
+    UtilLazyMsgSet(&gQSYS_LastErr, sFormat, argp);
 #if defined(DEBUG)
     WDC_Err("Qsys lib: %s", QSYS_GetLastErr());
 #endif
@@ -876,5 +874,5 @@ static void TraceLog(const CHAR *sFormat, ...)
 /* Get last error */
 const char *QSYS_GetLastErr(void)
 {
-    return gsQSYS_LastErr;
+    return UtilLazyMsgGet(&gQSYS_LastErr);
 }
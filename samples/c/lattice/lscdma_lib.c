@@ -48,7 +48,7 @@ typedef struct {
 } LSCDMA_DEV_CTX, *PLSCDMA_DEV_CTX;
 /* TODO: You can add fields to store additional device-specific information */
 
-static CHAR gsLSCDMA_LastErr[256];
+static OS_THREAD_LOCAL UTIL_LAZY_MSG gLSCDMA_LastErr;
 
 static DWORD LibInit_count = 0;
 /*************************************************************
@@ -105,9 +105,7 @@ static inline BOOL IsValidDevice(PWDC_DEVICE pDev, const CHAR *sFunc)
 {
     if (!pDev || !WDC_GetDevContext(pDev))
     {
-        snprintf(gsLSCDMA_LastErr, sizeof(gsLSCDMA_LastErr) - 1, "%s: NULL device %s\n",
-            sFunc, !pDev ? "handle" : "context");
-        ErrLog(gsLSCDMA_LastErr);
+        ErrLog("%s: NULL device %s\n", sFunc, !pDev ? "handle" : "context");
         return FALSE;
     }
 
@@ -877,7 +875,7 @@ static void ErrLog(const CHAR *sFormat, ...)
 #if defined(DEBUG)
     va_list argp;
     va_start(argp, sFormat);
-    vsnprintf(gsLSCDMA_LastErr, sizeof(gsLSCDMA_LastErr) - 1, sFormat, argp);
+    UtilLazyMsgSet(&gLSCDMA_LastErr, sFormat, argp);
 #if defined(__KERNEL__)
     WDC_Err("KP LSCDMA lib: %s", LSCDMA_GetLastErr());
 #else
@@ -909,5 +907,5 @@ static void TraceLog(const CHAR *sFormat, ...)
 
 const char *LSCDMA_GetLastErr(void)
 {
-    return gsLSCDMA_LastErr;
+    return UtilLazyMsgGet(&gLSCDMA_LastErr);
 }
@@ -43,7 +43,7 @@ typedef struct {
   Global variables definitions
  *************************************************************/
 /* Last error information string */
-static CHAR gsPCI_LastErr[256];
+static OS_THREAD_LOCAL UTIL_LAZY_MSG gPCI_LastErr;
 
 /* Library initialization reference count */
 static DWORD LibInit_count = 0;
@@ -65,9 +65,7 @@ static inline BOOL IsValidDevice(PWDC_DEVICE pDev, const CHAR *sFunc)
 {
     if (!pDev || !(PPCI_DEV_CTX)(pDev->pCtx))
     {
-        snprintf(gsPCI_LastErr, sizeof(gsPCI_LastErr) - 1,
-            "%s: NULL device %s\n", sFunc, !pDev ? "handle" : "context");
-        ErrLog(gsPCI_LastErr);
+        ErrLog("%s: NULL device %s\n", sFunc, !pDev ? "handle" : "context");
         return FALSE;
     }
 
@@ -725,12 +723,12 @@ static void ErrLog(const CHAR *sFormat, ...)
     va_list argp;
 
     va_start(argp, sFormat);
-    vsnprintf(gsPCI_LastErr, sizeof(gsPCI_LastErr) - 1, sFormat, argp);
+    UtilLazyMsgSet(&gPCI_LastErr, sFormat, argp);
 #ifdef DEBUG
     #ifdef __KERNEL__
-        WDC_Err("KP PCI lib: %s", gsPCI_LastErr);
+        WDC_Err("KP PCI lib: %s", UtilLazyMsgGet(&gPCI_LastErr));
     #else
-        WDC_Err("PCI lib: %s", gsPCI_LastErr);
+        WDC_Err("PCI lib: %s", UtilLazyMsgGet(&gPCI_LastErr));
     #endif
 #endif
     va_end(argp);
@@ -759,6 +757,6 @@ static void TraceLog(const CHAR *sFormat, ...)
 /* Get last error */
 const char *PCI_GetLastErr(void)
 {
-    return gsPCI_LastErr;
+    return UtilLazyMsgGet(&gPCI_LastErr);
 }
 
@@ -40,7 +40,7 @@
   Global variables definitions
  *************************************************************/
 /* Last PLX library error string */
-static CHAR gsPLX_LastErr[256];
+static OS_THREAD_LOCAL UTIL_LAZY_MSG gPLX_LastErr;
 
 /*************************************************************
   Static functions prototypes and inline implementation
@@ -84,9 +84,7 @@ static inline BOOL IsValidDevice(PWDC_DEVICE pDev, const CHAR *sFunc)
 {
     if (!pDev || !(PPLX_DEV_CTX)(pDev->pCtx))
     {
-        snprintf(gsPLX_LastErr, sizeof(gsPLX_LastErr) - 1, "%s: NULL "
-            "device %s\n", sFunc, !pDev ? "handle" : "context");
-        ErrLog(gsPLX_LastErr);
+        ErrLog("%s: NULL device %s\n", sFunc, !pDev ? "handle" : "context");
         return FALSE;
     }
 
@@ -1821,9 +1819,9 @@ static void ErrLog(const CHAR *sFormat, ...)
 {
     va_list argp;
     va_start(argp, sFormat);
-    vsnprintf(gsPLX_LastErr, sizeof(gsPLX_LastErr) - 1, sFormat, argp);
+    UtilLazyMsgSet(&gPLX_LastErr, sFormat, argp);
 #if defined(DEBUG)
-    WDC_Err("PLX lib: %s", gsPLX_LastErr);
+    WDC_Err("PLX lib: %s", UtilLazyMsgGet(&gPLX_LastErr));
 #endif
     va_end(argp);
 }
@@ -1844,6 +1842,6 @@ static void TraceLog(const CHAR *sFormat, ...)
 
 const char *PLX_GetLastErr(void)
 {
-    return gsPLX_LastErr;
+    return UtilLazyMsgGet(&gPLX_LastErr);
 }
 
@@ -15,7 +15,7 @@
 #include "utils.h"
 
 /* Last error information string */
-static CHAR gsUSB_LastErr[256];
+static OS_THREAD_LOCAL UTIL_LAZY_MSG gUSB_LastErr;
 
 #include "usb_diag_lib.h"
 
@@ -802,7 +802,7 @@ static void ErrLog(const CHAR *sFormat, ...)
     va_list argp;
 
     va_start(argp, sFormat);
-    vsnprintf(gsUSB_LastErr, sizeof(gsUSB_LastErr) - 1, sFormat, argp);
+    UtilLazyMsgSet(&gUSB_LastErr, sFormat, argp);
     va_end(argp);
 }
 
@@ -825,5 +825,5 @@ static void TraceLog(const CHAR *sFormat, ...)
 /* Get last error */
 const char *USB_GetLastErr(void)
 {
-    return gsUSB_LastErr;
+    return UtilLazyMsgGet(&gUSB_LastErr);
 }
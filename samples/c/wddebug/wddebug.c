@@ -18,6 +18,7 @@
  */
 
 #include "windrvr.h"
+#include "wd_stats.h"
 #include <stdio.h>
 #include <time.h>
 
@@ -49,6 +50,7 @@ static void Usage(void)
         "       WDDEBUG\n"
         "       WDDEBUG [<driver_name>] <command> [<level>] [<sections>]\n"
         "       WDDEBUG [<driver_name>] <command> [<filename>]\n"
+        "       WDDEBUG stats <filename>\n"
         "\n"
         "`WDDEBUG` (no arguments) "
         "displays this help message (<=> `WDDEBUG help`).\n"
@@ -83,10 +85,16 @@ static void Usage(void)
         "  sect_info_on  - Add section(s) information to each debug message.\n"
         "  sect_info_off - Do not add section(s) information to the debug "
             "messages.\n"
+        "  stats         - Display a WinDriver API calls statistics snapshot "
+            "file,\n"
+        "                  exported by an application using "
+            "WDC_ExportStats().\n"
         "  help          - Display usage instructions.\n"
         "\n"
         "<filename>: Path to the file to save the log.\n"
         "            This argument is applicable with the 'dump' command.\n"
+        "            With the 'stats' command: path to the statistics "
+            "snapshot file.\n"
         "<level>: The debug trace level to set: ERROR, WARN, INFO, or TRACE "
             "(default).\n"
         "         This argument is applicable with the 'on' and 'dbg_on' "
@@ -327,6 +335,91 @@ void Print_status(HANDLE hWD)
         debug.dwBufferSize);
 }
 
+/* Returns the upper bound, in nanoseconds, of the latency histogram bucket
+ * that contains the given percentile of the calls */
+static UINT64 Stats_percentile(const WD_IOCTL_STATS *pIoctl, DWORD dwPercent)
+{
+    UINT64 qwCount = 0;
+    UINT64 qwTarget = (pIoctl->qwCalls * dwPercent + 99) / 100;
+    DWORD i;
+
+    for (i = 0; i < WD_STATS_HIST_BUCKETS; i++)
+    {
+        qwCount += pIoctl->qwHist[i];
+        if (qwCount >= qwTarget)
+            break;
+    }
+
+    return (2ULL << MIN(i, WD_STATS_HIST_BUCKETS - 1)) - 1;
+}
+
+static int Print_stats(const char *sFileName)
+{
+    WD_STATS_FILE_HEADER hdr;
+    WD_IOCTL_STATS ioctlStats;
+    time_t exportTime;
+    FILE *fp;
+    DWORD i, j;
+
+    fp = fopen(sFileName, "rb");
+    if (!fp)
+    {
+        fprintf(file_h, "Failed opening '%s' file for read\n", sFileName);
+        return EXIT_FAILURE;
+    }
+
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+        hdr.dwMagic != WD_STATS_FILE_MAGIC ||
+        hdr.dwVersion != WD_STATS_FILE_VERSION)
+    {
+        fprintf(file_h, "'%s' is not a WinDriver statistics file\n",
+            sFileName);
+        fclose(fp);
+        return EXIT_FAILURE;
+    }
+
+    exportTime = (time_t)hdr.qwTime;
+    fprintf(file_h, "WinDriver API calls statistics of process %u\n",
+        hdr.dwProcessId);
+    fprintf(file_h, "Time: %s\n", ctime(&exportTime));
+    fprintf(file_h, "%-10s %-6s %12s %10s %10s %10s %10s\n", "Ioctl",
+        "Func", "Calls", "Errors", "Avg (ns)", "p50 (ns)", "p99 (ns)");
+
+    for (i = 0; i < hdr.dwNumIoctls; i++)
+    {
+        if (fread(&ioctlStats, sizeof(ioctlStats), 1, fp) != 1)
+        {
+            fprintf(file_h, "Truncated statistics file\n");
+            fclose(fp);
+            return EXIT_FAILURE;
+        }
+
+        fprintf(file_h, "0x%08x 0x%-4x %12llu %10llu %10llu %10llu "
+            "%10llu\n", ioctlStats.dwIoctl,
+            (UINT32)WD_CTL_DECODE_FUNC(ioctlStats.dwIoctl),
+            (unsigned long long)ioctlStats.qwCalls,
+            (unsigned long long)ioctlStats.qwErrors,
+            (unsigned long long)(ioctlStats.qwCalls ?
+            ioctlStats.qwTotalNs / ioctlStats.qwCalls : 0),
+            (unsigned long long)Stats_percentile(&ioctlStats, 50),
+            (unsigned long long)Stats_percentile(&ioctlStats, 99));
+
+        for (j = 0; j < WD_STATS_HIST_BUCKETS; j++)
+        {
+            if (!ioctlStats.qwHist[j])
+                continue;
+
+            fprintf(file_h, "    %12llu - %-12llu ns: %llu\n",
+                j ? (unsigned long long)(1ULL << j) : 0ULL,
+                (unsigned long long)((2ULL << j) - 1),
+                (unsigned long long)ioctlStats.qwHist[j]);
+        }
+    }
+
+    fclose(fp);
+    return EXIT_SUCCESS;
+}
+
 int main(int argc, char *argv[])
 {
     WD_VERSION verBuf;
@@ -339,6 +432,20 @@ int main(int argc, char *argv[])
 
     BZERO(debug);
 
+    /* The statistics snapshot is displayed without accessing the driver */
+    if (argc > 1 && !stricmp(argv[1], "stats"))
+    {
+        if (argc != 3)
+        {
+            fprintf(file_h, "%s\n", argc < 3 ? "Missing statistics file name" :
+                "Too many arguments");
+            Usage();
+            return EXIT_FAILURE;
+        }
+
+        return Print_stats(argv[2]);
+    }
+
     /* Check the <driver_name> option */
     if (argc > 2 &&
         stricmp(argv[1], "off") != 0 && stricmp(argv[1], "on") != 0 &&
@@ -0,0 +1,365 @@
+/* Jungo Connectivity Confidential. Copyright (c) 2022 Jungo Connectivity Ltd.  https://www.jungo.com */
+
+/****************************************************************************
+*  File: wds_ipc_bench.c
+*
+*  Latency and throughput benchmark of WinDriver IPC messaging between two
+*  local processes, using the batched IPC API of the WDS library.
+*
+*  Run "wds_ipc_bench rx [-c]" in one process, and then
+*  "wds_ipc_bench tx [-n <messages>] [-b <batch size>] [-p <pings>] [-c]" in
+*  another process. -c coalesces repeated message IDs.
+*
+*  Note: This code sample is provided AS-IS and as a guiding sample only.
+*****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utils.h"
+#include "wds_lib.h"
+#include "diag_lib.h"
+#include "status_strings.h"
+
+/*************************************************************
+  General definitions
+ *************************************************************/
+/* TODO: When using a registered WinDriver version, replace the license string
+         below with the development license in order to use on the development
+         machine. */
+#define IPC_BENCH_LICENSE_STRING "12345abcde1234.license"
+
+#define IPC_BENCH_GROUP_ID 0x1BE0
+#define IPC_BENCH_SUBGROUP_TX 0x1
+#define IPC_BENCH_SUBGROUP_RX 0x2
+
+enum {
+    IPC_BENCH_MSG_PING = 0x1,   /* Answered with a PONG with the same data */
+    IPC_BENCH_MSG_PONG = 0x2,
+    IPC_BENCH_MSG_DONE = 0x3,   /* Answered with a RESULT */
+    IPC_BENCH_MSG_RESULT = 0x4, /* Data: DATA messages received */
+    IPC_BENCH_MSG_DATA = 0x100, /* IPC_BENCH_DATA_IDS IDs, from this ID */
+};
+
+/* Number of message IDs of the DATA messages, which are coalesced per ID */
+#define IPC_BENCH_DATA_IDS 8
+
+#define IPC_BENCH_DEFAULT_MSGS 100000
+#define IPC_BENCH_DEFAULT_BATCH 64
+#define IPC_BENCH_DEFAULT_PINGS 10000
+#define IPC_BENCH_TIMEOUT_US 1000000
+
+typedef struct {
+    HANDLE hPong;            /* Signaled when a PONG is received */
+    HANDLE hResult;          /* Signaled when a RESULT is received */
+    volatile UINT64 qwPongData;
+    volatile UINT64 qwResult;
+    volatile UINT64 qwDataMsgs; /* Receiver: DATA messages received */
+    volatile UINT64 qwCallbacks;
+} IPC_BENCH_CTX;
+
+static IPC_BENCH_CTX gCtx;
+
+/*************************************************************
+  Message handlers
+ *************************************************************/
+/* Receiver: counts the DATA messages and answers the PINGs and DONEs of each
+ * batch with a single batched send */
+static void RxBatchHandler(WDS_IPC_MSG_RX *pIpcRxMsgs, DWORD dwNumMsgs,
+    void *pData)
+{
+    WDS_IPC_MSG_TX replies[WDS_IPC_RX_BATCH_MAX];
+    DWORD i, dwReplies = 0;
+
+    UNUSED_VAR(pData);
+
+    gCtx.qwCallbacks++;
+    for (i = 0; i < dwNumMsgs; i++)
+    {
+        WDS_IPC_MSG_RX *pMsg = &pIpcRxMsgs[i];
+
+        if (pMsg->dwMsgID >= IPC_BENCH_MSG_DATA)
+        {
+            gCtx.qwDataMsgs++;
+            continue;
+        }
+
+        if (pMsg->dwMsgID != IPC_BENCH_MSG_PING &&
+            pMsg->dwMsgID != IPC_BENCH_MSG_DONE)
+        {
+            continue;
+        }
+
+        replies[dwReplies].dwOptions = WD_IPC_UID_UNICAST;
+        replies[dwReplies].dwRecipientID = pMsg->dwSenderUID;
+        if (pMsg->dwMsgID == IPC_BENCH_MSG_PING)
+        {
+            replies[dwReplies].dwMsgID = IPC_BENCH_MSG_PONG;
+            replies[dwReplies].qwMsgData = pMsg->qwMsgData;
+        }
+        else
+        {
+            replies[dwReplies].dwMsgID = IPC_BENCH_MSG_RESULT;
+            replies[dwReplies].qwMsgData = gCtx.qwDataMsgs;
+            printf("Received %" PRI64 "d DATA messages in %" PRI64 "d "
+                "callbacks\n", gCtx.qwDataMsgs, gCtx.qwCallbacks);
+            gCtx.qwDataMsgs = 0;
+            gCtx.qwCallbacks = 0;
+        }
+        dwReplies++;
+    }
+
+    if (dwReplies)
+        WDS_IpcSendBatch(replies, dwReplies, 0, NULL);
+}
+
+/* Sender: wakes the benchmark on PONGs and RESULTs */
+static void TxBatchHandler(WDS_IPC_MSG_RX *pIpcRxMsgs, DWORD dwNumMsgs,
+    void *pData)
+{
+    DWORD i;
+
+    UNUSED_VAR(pData);
+
+    for (i = 0; i < dwNumMsgs; i++)
+    {
+        if (pIpcRxMsgs[i].dwMsgID == IPC_BENCH_MSG_PONG)
+        {
+            gCtx.qwPongData = pIpcRxMsgs[i].qwMsgData;
+            OsEventSignal(gCtx.hPong);
+        }
+        else if (pIpcRxMsgs[i].dwMsgID == IPC_BENCH_MSG_RESULT)
+        {
+            gCtx.qwResult = pIpcRxMsgs[i].qwMsgData;
+            OsEventSignal(gCtx.hResult);
+        }
+    }
+}
+
+/*************************************************************
+  Benchmark
+ *************************************************************/
+static DWORD RxRun(DWORD dwOptions)
+{
+    DWORD dwStatus;
+
+    dwStatus = WDS_IpcRegisterBatch("wds_ipc_bench_rx", IPC_BENCH_GROUP_ID,
+        IPC_BENCH_SUBGROUP_RX, WD_IPC_UNICAST_MSG, RxBatchHandler, NULL,
+        dwOptions);
+    if (dwStatus)
+    {
+        printf("Failed registering to IPC. Error 0x%x - %s\n", dwStatus,
+            Stat2Str(dwStatus));
+        return dwStatus;
+    }
+
+    printf("Receiving. Press Enter to exit\n");
+    getchar();
+
+    WDS_IpcUnRegister();
+
+    return WD_STATUS_SUCCESS;
+}
+
+/* Finds the UID of the receiver process */
+static DWORD RxUidFind(DWORD *pdwRxUID)
+{
+    WDS_IPC_SCAN_RESULT scanResult;
+    DWORD i, dwStatus;
+
+    dwStatus = WDS_IpcScanProcs(&scanResult);
+    if (dwStatus)
+        return dwStatus;
+
+    for (i = 0; i < scanResult.dwNumProcs; i++)
+    {
+        if (scanResult.procInfo[i].dwSubGroupID == IPC_BENCH_SUBGROUP_RX)
+        {
+            *pdwRxUID = scanResult.procInfo[i].hIpc;
+            return WD_STATUS_SUCCESS;
+        }
+    }
+
+    return WD_DEVICE_NOT_FOUND;
+}
+
+static DWORD TxLatency(DWORD dwRxUID, DWORD dwPings)
+{
+    TIME_TYPE startTime, endTime;
+    DWORD i, dwStatus;
+    double dTotalMs;
+
+    get_cur_time(&startTime);
+    for (i = 0; i < dwPings; i++)
+    {
+        dwStatus = WDS_IpcUidUnicast(dwRxUID, IPC_BENCH_MSG_PING, i);
+        if (dwStatus)
+            return dwStatus;
+
+        /* A late PONG of a ping that timed out is skipped */
+        do {
+            dwStatus = OsEventWaitUs(gCtx.hPong, IPC_BENCH_TIMEOUT_US, 0);
+            if (dwStatus)
+            {
+                printf("No PONG for PING %d\n", i);
+                return dwStatus;
+            }
+        } while (gCtx.qwPongData != i);
+    }
+    get_cur_time(&endTime);
+
+    dTotalMs = time_diff(&endTime, &startTime);
+    printf("Latency: %d round trips, average %.2lf [us]\n", dwPings,
+        dTotalMs * 1000 / (dwPings ? dwPings : 1));
+
+    return WD_STATUS_SUCCESS;
+}
+
+static DWORD TxThroughput(DWORD dwRxUID, DWORD dwMsgs, DWORD dwBatch,
+    DWORD dwOptions)
+{
+    WDS_IPC_MSG_TX *pMsgs;
+    TIME_TYPE startTime, endTime;
+    DWORD i, j, dwCount, dwSent, dwTotalSent = 0, dwStatus = 0;
+    double dTotalMs;
+
+    pMsgs = (WDS_IPC_MSG_TX *)calloc(dwBatch, sizeof(WDS_IPC_MSG_TX));
+    if (!pMsgs)
+        return WD_INSUFFICIENT_RESOURCES;
+
+    get_cur_time(&startTime);
+    for (i = 0; i < dwMsgs; i += dwCount)
+    {
+        dwCount = MIN(dwBatch, dwMsgs - i);
+        for (j = 0; j < dwCount; j++)
+        {
+            pMsgs[j].dwOptions = WD_IPC_UID_UNICAST;
+            pMsgs[j].dwRecipientID = dwRxUID;
+            pMsgs[j].dwMsgID = IPC_BENCH_MSG_DATA +
+                (i + j) % IPC_BENCH_DATA_IDS;
+            pMsgs[j].qwMsgData = i + j;
+        }
+
+        dwStatus = WDS_IpcSendBatch(pMsgs, dwCount, dwOptions, &dwSent);
+        dwTotalSent += dwSent;
+        if (dwStatus)
+            goto Exit;
+    }
+
+    dwStatus = WDS_IpcUidUnicast(dwRxUID, IPC_BENCH_MSG_DONE, 0);
+    if (dwStatus)
+        goto Exit;
+
+    dwStatus = OsEventWaitUs(gCtx.hResult, IPC_BENCH_TIMEOUT_US * 10, 0);
+    if (dwStatus)
+    {
+        printf("No RESULT from the receiver\n");
+        goto Exit;
+    }
+    get_cur_time(&endTime);
+
+    dTotalMs = time_diff(&endTime, &startTime);
+    printf("Throughput: %d messages in batches of %d, %d sent, %" PRI64 "d "
+        "received, elapsed time %.2lf [ms], rate %.0lf [messages/sec]\n",
+        dwMsgs, dwBatch, dwTotalSent, gCtx.qwResult, dTotalMs,
+        dwMsgs * 1000 / (dTotalMs ? dTotalMs : 1));
+
+Exit:
+    free(pMsgs);
+    return dwStatus;
+}
+
+static DWORD TxRun(DWORD dwMsgs, DWORD dwBatch, DWORD dwPings,
+    DWORD dwOptions)
+{
+    DWORD dwRxUID, dwStatus;
+
+    if (OsEventCreate(&gCtx.hPong) || OsEventCreate(&gCtx.hResult))
+        return WD_INSUFFICIENT_RESOURCES;
+
+    dwStatus = WDS_IpcRegisterBatch("wds_ipc_bench_tx", IPC_BENCH_GROUP_ID,
+        IPC_BENCH_SUBGROUP_TX, WD_IPC_UNICAST_MSG, TxBatchHandler, NULL, 0);
+    if (dwStatus)
+    {
+        printf("Failed registering to IPC. Error 0x%x - %s\n", dwStatus,
+            Stat2Str(dwStatus));
+        goto Exit;
+    }
+
+    dwStatus = RxUidFind(&dwRxUID);
+    if (dwStatus)
+    {
+        printf("No receiver process. Run \"wds_ipc_bench rx\" first\n");
+        goto Unregister;
+    }
+
+    dwStatus = TxLatency(dwRxUID, dwPings);
+    if (!dwStatus)
+        dwStatus = TxThroughput(dwRxUID, dwMsgs, dwBatch, dwOptions);
+
+Unregister:
+    WDS_IpcUnRegister();
+Exit:
+    OsEventClose(gCtx.hPong);
+    OsEventClose(gCtx.hResult);
+    return dwStatus;
+}
+
+static void Usage(const CHAR *sProgram)
+{
+    printf("Usage: %s rx [-c]\n"
+        "       %s tx [-n <messages>] [-b <batch size>] [-p <pings>] [-c]\n"
+        "  -c: Coalesce repeated message IDs\n", sProgram, sProgram);
+}
+
+int main(int argc, char *argv[])
+{
+    DWORD dwMsgs = IPC_BENCH_DEFAULT_MSGS, dwBatch = IPC_BENCH_DEFAULT_BATCH;
+    DWORD dwPings = IPC_BENCH_DEFAULT_PINGS, dwOptions = 0, dwStatus;
+    BOOL fRx;
+    int i;
+
+    if (argc < 2 || (strcmp(argv[1], "rx") && strcmp(argv[1], "tx")))
+    {
+        Usage(argv[0]);
+        return -1;
+    }
+    fRx = !strcmp(argv[1], "rx");
+
+    for (i = 2; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-c"))
+            dwOptions |= WDS_IPC_COALESCE;
+        else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+            dwMsgs = (DWORD)strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "-b") && i + 1 < argc)
+            dwBatch = (DWORD)strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "-p") && i + 1 < argc)
+            dwPings = (DWORD)strtoul(argv[++i], NULL, 0);
+        else
+        {
+            Usage(argv[0]);
+            return -1;
+        }
+    }
+
+    if (!dwBatch)
+        dwBatch = 1;
+    else if (dwBatch > WDS_IPC_TX_BATCH_MAX)
+        dwBatch = WDS_IPC_TX_BATCH_MAX;
+
+    dwStatus = WDC_DriverOpen(WDC_DRV_OPEN_DEFAULT, IPC_BENCH_LICENSE_STRING);
+    if (dwStatus)
+    {
+        printf("Failed opening a handle to the driver. Error 0x%x - %s\n",
+            dwStatus, Stat2Str(dwStatus));
+        return -1;
+    }
+
+    dwStatus = fRx ? RxRun(dwOptions) :
+        TxRun(dwMsgs, dwBatch, dwPings, dwOptions);
+
+    WDC_DriverClose();
+
+    return dwStatus == WD_STATUS_SUCCESS ? 0 : -1;
+}
@@ -91,42 +91,7 @@ const WDC_REG *gpBMD_CfgRegs = gBMD_CfgRegs;
    ----------------------------------------------- */
 /* Run-time registers information array */
 static const WDC_REG gBMD_Regs[] = {
-    { BMD_SPACE, BMD_DSCR_OFFSET, WDC_SIZE_32, WDC_READ_WRITE, "DSCR",
-        "Device Control Status Register" },
-    { BMD_SPACE, BMD_DDMACR_OFFSET, WDC_SIZE_32, WDC_READ_WRITE,
-        "DDMACR", "Device DMA Control Status Register" },
-    { BMD_SPACE, BMD_WDMATLPA_OFFSET, WDC_SIZE_32, WDC_READ_WRITE,
-        "WDMATLPA", "Write DMA TLP Address" },
-    { BMD_SPACE, BMD_WDMATLPS_OFFSET, WDC_SIZE_32, WDC_READ_WRITE,
-        "WDMATLPS", "Write DMA TLP Size" },
-    { BMD_SPACE, BMD_WDMATLPC_OFFSET, WDC_SIZE_32, WDC_READ_WRITE,
-        "WDMATLPC", "Write DMA TLP Count" },
-    { BMD_SPACE, BMD_WDMATLPP_OFFSET, WDC_SIZE_32, WDC_READ_WRITE,
-        "WDMATLPP", "Write DMA Data Pattern" },
-    { BMD_SPACE, BMD_RDMATLPP_OFFSET, WDC_SIZE_32, WDC_READ_WRITE,
-        "RDMATLPP", "Read DMA Expected Data Pattern" },
-    { BMD_SPACE, BMD_RDMATLPA_OFFSET, WDC_SIZE_32, WDC_READ_WRITE,
-        "RDMATLPA", "Read DMA TLP Address" },
-    { BMD_SPACE, BMD_RDMATLPS_OFFSET, WDC_SIZE_32, WDC_READ_WRITE,
-        "RDMATLPS", "Read DMA TLP Size" },
-    { BMD_SPACE, BMD_RDMATLPC_OFFSET, WDC_SIZE_32, WDC_READ_WRITE,
-        "RDMATLPC", "Read DMA TLP Count" },
-    { BMD_SPACE, BMD_WDMAPERF_OFFSET, WDC_SIZE_32, WDC_READ, "WDMAPERF",
-        "Write DMA Performance" },
-    { BMD_SPACE, BMD_RDMAPERF_OFFSET, WDC_SIZE_32, WDC_READ, "RDMAPERF",
-        "Read DMA Performance" },
-    { BMD_SPACE, BMD_RDMASTAT_OFFSET, WDC_SIZE_32, WDC_READ, "RDMASTAT",
-        "Read DMA Status" },
-    { BMD_SPACE, BMD_NRDCOMP_OFFSET, WDC_SIZE_32, WDC_READ, "NRDCOMP",
-        "Number of Read Completion w/ Data" },
-    { BMD_SPACE, BMD_RCOMPDSIZE_OFFSET, WDC_SIZE_32, WDC_READ,
-        "RCOMPDSIZE", "Read Completion Data Size" },
-    { BMD_SPACE, BMD_DLWSTAT_OFFSET, WDC_SIZE_32, WDC_READ, "DLWSTAT",
-        "Device Link Width Status" },
-    { BMD_SPACE, BMD_DLTRSSTAT_OFFSET, WDC_SIZE_32, WDC_READ,
-        "DLTRSSTAT", "Device Link Transaction Size Status" },
-    { BMD_SPACE, BMD_DMISCCONT_OFFSET, WDC_SIZE_32, WDC_READ_WRITE,
-        "DMISCCONT", "Device Miscellaneous Control" },
+    BMD_REG_TABLE(WDC_REG_MAP_WDC_REG, BMD)
 };
 
 const WDC_REG *gpBMD_Regs = gBMD_Regs;
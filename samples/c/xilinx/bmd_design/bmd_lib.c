@@ -29,7 +29,7 @@
 #define BMD_DEFAULT_DRIVER_NAME WD_DEFAULT_DRIVER_NAME_BASE
 
 /* Last error information string */
-static CHAR gsBMD_LastErr[256];
+static OS_THREAD_LOCAL UTIL_LAZY_MSG gBMD_LastErr;
 
 /*************************************************************
   Static functions prototypes and inline implementation
@@ -42,6 +42,10 @@ static void BMD_EventHandler(WD_EVENT *pEvent, PVOID pData);
 static void ErrLog(const CHAR *sFormat, ...);
 static void TraceLog(const CHAR *sFormat, ...);
 
+/* Get the direct access map of the BMD registers of a device */
+#define BMD_REG_MAP(hDev) \
+    (&((PBMD_DEV_CTX)((PWDC_DEVICE)(hDev))->pCtx)->regMap)
+
 /* Validate a WDC device handle */
 static inline BOOL IsValidDevice(PWDC_DEVICE pDev, const CHAR *sFunc)
 {
@@ -126,6 +130,14 @@ WDC_DEVICE_HANDLE BMD_DeviceOpen(DWORD dwVendorId, DWORD dwDeviceId)
     if (!hDev || !DeviceValidate((PWDC_DEVICE)hDev))
         goto Error;
 
+    /* Cache the direct address of the BMD registers address space */
+    if (WDC_RegMapInit(BMD_REG_MAP(hDev), hDev, 1 << BMD_SPACE))
+    {
+        ErrLog("BMD registers address space (BAR %d) is not mapped for direct "
+            "memory access\n", BMD_SPACE);
+        goto Error;
+    }
+
     return hDev;
 
 Error:
@@ -395,18 +407,20 @@ BOOL BMD_DmaDevicePrepare(BMD_DMA_HANDLE hDma, BOOL fIsRead, WORD wTLPNumItems,
     BYTE bUpperAddr;
     WDC_DEVICE_HANDLE hDev;
     PBMD_DEV_CTX pDevCtx;
+    const WDC_REG_MAP *pMap;
 
     /* Validate the DMA handle */
     if (!IsValidDmaHandle(hDma, "BMD_DmaDevicePrepare"))
         return FALSE;
 
     hDev = hDma->hDev;
+    pMap = BMD_REG_MAP(hDev);
 
     /* Assert Initiator Reset */
-    BMD_WriteReg32(hDev, BMD_DSCR_OFFSET, 0x1);
+    BMD_DSCR_Write(pMap, 0x1);
 
     /* De-assert Initiator Reset */
-    BMD_WriteReg32(hDev, BMD_DSCR_OFFSET, 0x0);
+    BMD_DSCR_Write(pMap, 0x0);
 
     /* Get the lower 32 bits of the DMA address */
     u32LowerAddr = (UINT32)hDma->pDma->Page[0].pPhysicalAddr;
@@ -423,32 +437,32 @@ BOOL BMD_DmaDevicePrepare(BMD_DMA_HANDLE hDma, BOOL fIsRead, WORD wTLPNumItems,
     if (fIsRead)
     {
         /* Set the lower 32 bits of the DMA address */
-        BMD_WriteReg32(hDev, BMD_RDMATLPA_OFFSET, u32LowerAddr);
+        BMD_RDMATLPA_Write(pMap, u32LowerAddr);
 
         /* Set the size, traffic class, 64-bit enable, and upper 8 bits of the
          * DMA address */
-        BMD_WriteReg32(hDev, BMD_RDMATLPS_OFFSET, u32TLPs);
+        BMD_RDMATLPS_Write(pMap, u32TLPs);
 
         /* Set TLP count */
         BMD_WriteReg16(hDev, BMD_RDMATLPC_OFFSET, dwNumItems);
 
         /* Set DMA read data pattern */
-        BMD_WriteReg32(hDev, BMD_RDMATLPP_OFFSET, u32Pattern);
+        BMD_RDMATLPP_Write(pMap, u32Pattern);
     }
     else
     {
         /* Set the lower 32 bits of the DMA address */
-        BMD_WriteReg32(hDev, BMD_WDMATLPA_OFFSET, u32LowerAddr);
+        BMD_WDMATLPA_Write(pMap, u32LowerAddr);
 
         /* Set the size, traffic class, 64-bit enable, and upper 8 bits of the
          * DMA address */
-        BMD_WriteReg32(hDev, BMD_WDMATLPS_OFFSET, u32TLPs);
+        BMD_WDMATLPS_Write(pMap, u32TLPs);
 
         /* Set TLP count */
         BMD_WriteReg16(hDev, BMD_WDMATLPC_OFFSET, dwNumItems);
 
         /* Set DMA read data pattern */
-        BMD_WriteReg32(hDev, BMD_WDMATLPP_OFFSET, u32Pattern);
+        BMD_WDMATLPP_Write(pMap, u32Pattern);
     }
 
     /* Initialize device context DMA fields: */
@@ -523,7 +537,7 @@ WORD BMD_DmaGetMaxPacketSize(WDC_DEVICE_HANDLE hDev, BOOL fIsRead)
         return 0;
 
     /* Read encoded maximum payload sizes */
-    u32DLTRSSTAT = BMD_ReadReg32(hDev, BMD_DLTRSSTAT_OFFSET);
+    u32DLTRSSTAT = BMD_DLTRSSTAT_Read(BMD_REG_MAP(hDev));
 
     /* Convert encoded maximum payload sizes into byte count */
     if (fIsRead)
@@ -567,7 +581,7 @@ BOOL BMD_DmaStart(BMD_DMA_HANDLE hDma, BOOL fIsRead)
     BMD_DmaSyncCpu(hDma);
 
     /* Configure the device to start a DMA transfer */
-    BMD_WriteReg32(hDma->hDev, BMD_DDMACR_OFFSET, fIsRead ? 0x10000 : 0x1);
+    BMD_DDMACR_Write(BMD_REG_MAP(hDma->hDev), fIsRead ? 0x10000 : 0x1);
 
     return TRUE;
 }
@@ -582,7 +596,7 @@ BOOL BMD_DmaIsDone(WDC_DEVICE_HANDLE hDev, BOOL fIsRead)
         return FALSE;
 
     /* Detect DMA transfer completion */
-    ddmacr = BMD_ReadReg32(hDev, BMD_DDMACR_OFFSET);
+    ddmacr = BMD_DDMACR_Read(BMD_REG_MAP(hDev));
     return (fIsRead ? ddmacr & BIT24 : ddmacr & BIT8) ? TRUE : FALSE;
 }
 
@@ -614,14 +628,17 @@ BOOL BMD_DmaPollCompletion(BMD_DMA_HANDLE hDma, BOOL fIsRead)
 /* Enable DMA interrupts */
 BOOL BMD_DmaIntEnable(WDC_DEVICE_HANDLE hDev, BOOL fIsRead)
 {
-    UINT32 ddmacr = BMD_ReadReg32(hDev, BMD_DDMACR_OFFSET);
+    UINT32 ddmacr;
+    const WDC_REG_MAP *pMap;
 
     /* Validate the WDC device handle */
     if (!IsValidDevice((PWDC_DEVICE)hDev, "BMD_DmaIntEnable"))
         return FALSE;
 
+    pMap = BMD_REG_MAP(hDev);
+    ddmacr = BMD_DDMACR_Read(pMap);
     ddmacr &= fIsRead ? ~BIT23 : ~BIT7;
-    BMD_WriteReg32(hDev, BMD_DDMACR_OFFSET, ddmacr);
+    BMD_DDMACR_Write(pMap, ddmacr);
 
     return TRUE;
 }
@@ -629,14 +646,17 @@ BOOL BMD_DmaIntEnable(WDC_DEVICE_HANDLE hDev, BOOL fIsRead)
 /* Disable DMA interrupts */
 BOOL BMD_DmaIntDisable(WDC_DEVICE_HANDLE hDev, BOOL fIsRead)
 {
-    UINT32 ddmacr = BMD_ReadReg32(hDev, BMD_DDMACR_OFFSET);
+    UINT32 ddmacr;
+    const WDC_REG_MAP *pMap;
 
     /* Validate the WDC device handle */
     if (!IsValidDevice((PWDC_DEVICE)hDev, "BMD_DmaIntDisable"))
         return FALSE;
 
+    pMap = BMD_REG_MAP(hDev);
+    ddmacr = BMD_DDMACR_Read(pMap);
     ddmacr |= fIsRead ? BIT23 : BIT7;
-    BMD_WriteReg32(hDev, BMD_DDMACR_OFFSET, ddmacr);
+    BMD_DDMACR_Write(pMap, ddmacr);
 
     return TRUE;
 }
@@ -652,7 +672,7 @@ BOOL BMD_DmaIsReadSucceed(WDC_DEVICE_HANDLE hDev)
         return FALSE;
 
     /* Check for a successful host-to-device (read)DMA  transfer indication */
-    ddmacr = BMD_ReadReg32(hDev, BMD_DDMACR_OFFSET);
+    ddmacr = BMD_DDMACR_Read(BMD_REG_MAP(hDev));
     return ddmacr & BIT31 ? FALSE : TRUE;
 }
 
@@ -821,12 +841,12 @@ static void ErrLog(const CHAR *sFormat, ...)
     va_list argp;
 
     va_start(argp, sFormat);
-    vsnprintf(gsBMD_LastErr, sizeof(gsBMD_LastErr) - 1, sFormat, argp);
+    UtilLazyMsgSet(&gBMD_LastErr, sFormat, argp);
 #if defined(DEBUG)
     #if defined(__KERNEL__)
-        WDC_Err("KP BMD lib: %s", gsBMD_LastErr);
+        WDC_Err("KP BMD lib: %s", UtilLazyMsgGet(&gBMD_LastErr));
      #else
-        WDC_Err("BMD lib: %s", gsBMD_LastErr);
+        WDC_Err("BMD lib: %s", UtilLazyMsgGet(&gBMD_LastErr));
     #endif
 #endif
     va_end(argp);
@@ -855,7 +875,7 @@ static void TraceLog(const CHAR *sFormat, ...)
 /* Get last error */
 const char *BMD_GetLastErr(void)
 {
-    return gsBMD_LastErr;
+    return UtilLazyMsgGet(&gBMD_LastErr);
 }
 
 
@@ -12,6 +12,7 @@
 ****************************************************************************/
 
 #include "wdc_defs.h"
+#include "wdc_reg_map.h"
 #include "utils.h"
 #include "status_strings.h"
 #include "wdc_diag_lib.h"
@@ -107,6 +108,7 @@ typedef struct {
     BOOL fIsRead; /* DMA direction: host-to-device=read; device-to-host=write */
     UINT32 u32Pattern;      /* 32-bit data pattern (used for DMA data) */
     DWORD dwBufNumItems;    /* Size of the pBuf buffer, in units of UINT32 */
+    WDC_REG_MAP regMap;     /* Direct access map of the BMD registers */
 } BMD_DEV_CTX, *PBMD_DEV_CTX;
 /* TODO: You can add fields to store additional device-specific information. */
 
@@ -135,6 +137,50 @@ enum {
     BMD_DMISCCONT_OFFSET = 0x44
 };
 
+/* BMD run-time registers table: name, address space, offset, width (bits),
+ * direction, description. See wdc_reg_map.h */
+#define BMD_REG_TABLE(REG, P) \
+    REG(P, DSCR, BMD_SPACE, BMD_DSCR_OFFSET, 32, WDC_READ_WRITE, \
+        "Device Control Status Register") \
+    REG(P, DDMACR, BMD_SPACE, BMD_DDMACR_OFFSET, 32, WDC_READ_WRITE, \
+        "Device DMA Control Status Register") \
+    REG(P, WDMATLPA, BMD_SPACE, BMD_WDMATLPA_OFFSET, 32, WDC_READ_WRITE, \
+        "Write DMA TLP Address") \
+    REG(P, WDMATLPS, BMD_SPACE, BMD_WDMATLPS_OFFSET, 32, WDC_READ_WRITE, \
+        "Write DMA TLP Size") \
+    REG(P, WDMATLPC, BMD_SPACE, BMD_WDMATLPC_OFFSET, 32, WDC_READ_WRITE, \
+        "Write DMA TLP Count") \
+    REG(P, WDMATLPP, BMD_SPACE, BMD_WDMATLPP_OFFSET, 32, WDC_READ_WRITE, \
+        "Write DMA Data Pattern") \
+    REG(P, RDMATLPP, BMD_SPACE, BMD_RDMATLPP_OFFSET, 32, WDC_READ_WRITE, \
+        "Read DMA Expected Data Pattern") \
+    REG(P, RDMATLPA, BMD_SPACE, BMD_RDMATLPA_OFFSET, 32, WDC_READ_WRITE, \
+        "Read DMA TLP Address") \
+    REG(P, RDMATLPS, BMD_SPACE, BMD_RDMATLPS_OFFSET, 32, WDC_READ_WRITE, \
+        "Read DMA TLP Size") \
+    REG(P, RDMATLPC, BMD_SPACE, BMD_RDMATLPC_OFFSET, 32, WDC_READ_WRITE, \
+        "Read DMA TLP Count") \
+    REG(P, WDMAPERF, BMD_SPACE, BMD_WDMAPERF_OFFSET, 32, WDC_READ, \
+        "Write DMA Performance") \
+    REG(P, RDMAPERF, BMD_SPACE, BMD_RDMAPERF_OFFSET, 32, WDC_READ, \
+        "Read DMA Performance") \
+    REG(P, RDMASTAT, BMD_SPACE, BMD_RDMASTAT_OFFSET, 32, WDC_READ, \
+        "Read DMA Status") \
+    REG(P, NRDCOMP, BMD_SPACE, BMD_NRDCOMP_OFFSET, 32, WDC_READ, \
+        "Number of Read Completion w/ Data") \
+    REG(P, RCOMPDSIZE, BMD_SPACE, BMD_RCOMPDSIZE_OFFSET, 32, WDC_READ, \
+        "Read Completion Data Size") \
+    REG(P, DLWSTAT, BMD_SPACE, BMD_DLWSTAT_OFFSET, 32, WDC_READ, \
+        "Device Link Width Status") \
+    REG(P, DLTRSSTAT, BMD_SPACE, BMD_DLTRSSTAT_OFFSET, 32, WDC_READ, \
+        "Device Link Transaction Size Status") \
+    REG(P, DMISCCONT, BMD_SPACE, BMD_DMISCCONT_OFFSET, 32, WDC_READ_WRITE, \
+        "Device Miscellaneous Control")
+
+/* Direct register accessors: BMD_<reg>_Read(pMap), BMD_<reg>_Write(pMap, val)
+ * (for example, BMD_DDMACR_Read(&pDevCtx->regMap)) */
+BMD_REG_TABLE(WDC_REG_MAP_ACCESSORS, BMD)
+
 /*************************************************************
   Function prototypes
  *************************************************************/
@@ -944,6 +944,11 @@ typedef struct _QDMA_THREAD {
     DWORD dwWeight;
     HANDLE hMutex;
     QUEUE_PAIR *queueListHead;
+    HANDLE hExecutor;       /* Task executor that services the queues instead
+                             * of the thread, or NULL */
+    HANDLE hScheduleMutex;  /* Protects fScheduled and dwTasks */
+    BOOL fScheduled;        /* A service task is queued to the executor */
+    DWORD dwTasks;          /* Service tasks that did not complete */
 } QDMA_THREAD;
 
 typedef union qdma_ind_ctxt_cmd {
@@ -1134,7 +1139,15 @@ typedef enum ClearType {
 } CLEAR_TYPE;
 
 void ErrLog(const CHAR *sFormat, ...);
-void TraceLog(const CHAR *sFormat, ...);
+void QDMA_TraceLog(const CHAR *sFormat, ...);
+
+/* Trace messages are compiled out of release builds, and their arguments are
+ * evaluated only when the WDC S_DMA debug section is traced */
+#define TraceLog(...) \
+    do { \
+        if (WDC_DBG_ON(D_TRACE, S_DMA)) \
+            QDMA_TraceLog(__VA_ARGS__); \
+    } while (0)
 
 #endif /* ifndef QDMA_REG_H__ */
 
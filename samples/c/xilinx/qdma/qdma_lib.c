@@ -18,7 +18,14 @@
 #include "qdma_internal.h"
 #include "wdc_diag_lib.h"
 
-static CHAR gsQDMA_LastErr[256]; /* Last error information string */
+/* Last error information string */
+static OS_THREAD_LOCAL UTIL_LAZY_MSG gQDMA_LastErr;
+
+#if !defined(__KERNEL__)
+/* Task executor that services the queues of the devices that are opened
+ * afterwards, or NULL for poll threads */
+static HANDLE ghQDMA_Executor;
+#endif
 
 /*************************************************************
   Internal definitions
@@ -64,12 +71,14 @@ static void QDMA_DmaRequestTrackerUnlock(DMA_REQUEST_TRACKER *requestTracker);
 /* -----------------------------------------------
     Threads functions
    ----------------------------------------------- */
-static DWORD QDMA_ThreadsCreate(THREAD_MANAGER *thread_manager);
+static DWORD QDMA_ThreadsCreate(WDC_DEVICE_HANDLE hDev,
+    THREAD_MANAGER *thread_manager);
 static QDMA_THREAD *QDMA_ThreadAssociate(WDC_DEVICE_HANDLE hDev,
     DWORD dwQueueId);
 void QDMA_ThreadsTerminate(THREAD_MANAGER *threadManager);
 void QDMA_ThreadNotify(QUEUE_PAIR *queuePair);
 static void DLLCALLCONV QDMA_ThreadPoll(PVOID context);
+static void DLLCALLCONV QDMA_ThreadServiceTask(PVOID context);
 static void QDMA_FreePollThread(WDC_DEVICE_HANDLE hDev, QDMA_THREAD *thread,
     DWORD dwQueueId);
 static void QDMA_DrvMmCompletion_cb(WDC_DEVICE_HANDLE hDev, DWORD dwQueueId,
@@ -122,8 +131,6 @@ static DWORD QDMA_GetGlobalRingSize(WDC_DEVICE_HANDLE hDev, UINT8 u8Index,
    ----------------------------------------------- */
 static void QDMA_CsrInit(WDC_DEVICE_HANDLE hDev, QUEUE_PAIR *queuePair);
 static DWORD QDMA_CsrSetDefaultGlobal(WDC_DEVICE_HANDLE hDev);
-static void QDMA_CsrReadValues(WDC_DEVICE_HANDLE hDev, UINT32 u32RegisterOffset,
-    DWORD dwId, DWORD dwCount, UINT32 *values);
 static void QDMA_CsrWriteValues(WDC_DEVICE_HANDLE hDev, UINT32 u32RegisterOffset,
     DWORD dwId, DWORD dwCount, const UINT32 *values);
 static void QDMA_CsrUpdatePidx(WDC_DEVICE_HANDLE hDev, BOOL fIsH2C,
@@ -277,7 +284,7 @@ BOOL QDMA_DeviceInit(WDC_DEVICE_HANDLE hDev)
         goto Error;
     }
 
-    dwStatus = QDMA_ThreadsCreate(&pDevCtx->threadManager);
+    dwStatus = QDMA_ThreadsCreate(hDev, &pDevCtx->threadManager);
     if (dwStatus != WD_STATUS_SUCCESS)
     {
         ErrLog("%s: Failed creating threads. Error 0x%x - %s\n", __FUNCTION__,
@@ -527,6 +534,11 @@ static void QDMA_InitQdmaGlobal(WDC_DEVICE_HANDLE hDev, PQDMA_DEV_CTX pDevCtx)
         QDMA_CsrSetDefaultGlobal(hDev);
     }
 
+    /* The global ring sizes are set once, above: cache them after their
+     * first read */
+    WDC_ShadowRangeSet(hDev, pDevCtx->dwConfigBarNum, QDMA_OFFSET_GLBL_RNG_SZ,
+        QDMA_NUM_RING_SIZES * sizeof(UINT32), WDC_SHADOW_CACHE_ON_READ);
+
     QDMA_RegWrite(hDev, QDMA_OFFSET_GLBL_ERR_MASK, 0xFFFFFFFF);
     QDMA_RegWrite(hDev, QDMA_OFFSET_GLBL_DSC_ERR_MSK, 0xFFFFFFFF);
     QDMA_RegWrite(hDev, QDMA_OFFSET_GLBL_TRQ_ERR_MSK, 0xFFFFFFFF);
@@ -948,7 +960,8 @@ static void QDMA_DmaRequestTrackerUnlock(DMA_REQUEST_TRACKER *requestTracker)
    ----------------------------------------------- */
 
 /* Create threads which will later execute all the DMA I/O requests */
-static DWORD QDMA_ThreadsCreate(THREAD_MANAGER *thread_manager)
+static DWORD QDMA_ThreadsCreate(WDC_DEVICE_HANDLE hDev,
+    THREAD_MANAGER *thread_manager)
 {
     DWORD dwStatus = WD_STATUS_SUCCESS, i;
     DWORD dwNumberOfProcessors = (DWORD)GetNumberOfProcessors();
@@ -977,8 +990,35 @@ static DWORD QDMA_ThreadsCreate(THREAD_MANAGER *thread_manager)
             goto Exit;
         }
 
-        ThreadStart(&thread_manager->threads[i].hThread, QDMA_ThreadPoll,
-            &thread_manager->threads[i]);
+        /* With a task executor, the queues of each thread object are
+         * serviced by tasks that are submitted when the thread object is
+         * notified, instead of by a dedicated thread */
+        thread_manager->threads[i].hExecutor = ghQDMA_Executor;
+        thread_manager->threads[i].fScheduled = FALSE;
+        thread_manager->threads[i].dwTasks = 0;
+        if (ghQDMA_Executor)
+        {
+            dwStatus = OsMutexCreate(
+                &thread_manager->threads[i].hScheduleMutex);
+            if (dwStatus != WD_STATUS_SUCCESS)
+            {
+                ErrLog("%s: Failed to create thread %d schedule lock. "
+                    "Error 0x%x - %s\n", __FUNCTION__, i, dwStatus,
+                    Stat2Str(dwStatus));
+                goto Exit;
+            }
+            continue;
+        }
+
+        ThreadStartClass(&thread_manager->threads[i].hThread,
+            THREAD_CLASS_POLLER, QDMA_ThreadPoll, &thread_manager->threads[i]);
+        /* Poll on the CPUs of the device's NUMA node, unless CPUs were set
+         * for the poll threads */
+        if (thread_manager->threads[i].hThread &&
+            !ThreadClassHasAffinity(THREAD_CLASS_POLLER))
+        {
+            WDC_NumaThreadBind(hDev, thread_manager->threads[i].hThread);
+        }
     }
 
     dwStatus = OsMutexCreate(&thread_manager->hMutex);
@@ -1040,8 +1080,24 @@ void QDMA_ThreadsTerminate(THREAD_MANAGER *threadManager)
 
     for (i = 0; i < threadManager->dwActiveThreads; i++)
     {
-        threadManager->threads[i].fTerminate = TRUE;
-        OsEventSignal(threadManager->threads[i].hOsEvent);
+        QDMA_THREAD *thread = &threadManager->threads[i];
+
+        thread->fTerminate = TRUE;
+        OsEventSignal(thread->hOsEvent);
+
+        if (!thread->hExecutor)
+            continue;
+
+        /* The service tasks access the thread object until they complete */
+        OsMutexLock(thread->hScheduleMutex);
+        while (thread->dwTasks)
+        {
+            OsMutexUnlock(thread->hScheduleMutex);
+            SleepWrapper(1000);
+            OsMutexLock(thread->hScheduleMutex);
+        }
+        OsMutexUnlock(thread->hScheduleMutex);
+        OsMutexClose(thread->hScheduleMutex);
     }
 
     // TODO: wait for all the events to be signaled?
@@ -1052,13 +1108,83 @@ void QDMA_ThreadsTerminate(THREAD_MANAGER *threadManager)
 /* Set the thread object to the signaled state */
 void QDMA_ThreadNotify(QUEUE_PAIR *queuePair)
 {
-    OsEventSignal(queuePair->thread->hOsEvent);
+    QDMA_THREAD *thread = queuePair->thread;
+    BOOL fSubmit;
+    DWORD dwStatus;
+
+    if (!thread->hExecutor)
+    {
+        OsEventSignal(thread->hOsEvent);
+        return;
+    }
+
+    /* A queued service task services the completions of this notification
+     * as well */
+    OsMutexLock(thread->hScheduleMutex);
+    fSubmit = !thread->fScheduled && !thread->fTerminate;
+    if (fSubmit)
+    {
+        thread->fScheduled = TRUE;
+        thread->dwTasks++;
+    }
+    OsMutexUnlock(thread->hScheduleMutex);
+
+    if (!fSubmit)
+        return;
+
+    dwStatus = ExecutorSubmit(thread->hExecutor, QDMA_ThreadServiceTask,
+        thread, NULL);
+    if (dwStatus != WD_STATUS_SUCCESS)
+    {
+        ErrLog("%s: Failed submitting a queues service task. "
+            "Error 0x%x - %s\n", __FUNCTION__, dwStatus, Stat2Str(dwStatus));
+
+        OsMutexLock(thread->hScheduleMutex);
+        thread->fScheduled = FALSE;
+        thread->dwTasks--;
+        OsMutexUnlock(thread->hScheduleMutex);
+    }
+}
+
+/* Service the queues of a thread object */
+static void QDMA_ThreadServiceQueues(QDMA_THREAD *thread)
+{
+    QUEUE_PAIR *pCurrentQueueList;
+
+    OsMutexLock(thread->hMutex);
+    pCurrentQueueList = thread->queueListHead;
+
+    while (pCurrentQueueList)
+    {
+        QDMA_QueuePairService(pCurrentQueueList);
+        pCurrentQueueList = pCurrentQueueList->next;
+    }
+
+    OsMutexUnlock(thread->hMutex);
+}
+
+/* Executor task function */
+static void DLLCALLCONV QDMA_ThreadServiceTask(PVOID context)
+{
+    QDMA_THREAD *thread = (QDMA_THREAD *)context;
+
+    /* Notifications from now on submit another task, so that completions
+     * that arrive during the service are not missed */
+    OsMutexLock(thread->hScheduleMutex);
+    thread->fScheduled = FALSE;
+    OsMutexUnlock(thread->hScheduleMutex);
+
+    if (!thread->fTerminate)
+        QDMA_ThreadServiceQueues(thread);
+
+    OsMutexLock(thread->hScheduleMutex);
+    thread->dwTasks--;
+    OsMutexUnlock(thread->hScheduleMutex);
 }
 
 /* Start thread function */
 static void DLLCALLCONV QDMA_ThreadPoll(PVOID context)
 {
-    QUEUE_PAIR *pCurrentQueueList;
     QDMA_THREAD *thread = (QDMA_THREAD *)context;
     DWORD dwStatus;
 
@@ -1080,16 +1206,7 @@ static void DLLCALLCONV QDMA_ThreadPoll(PVOID context)
             break;
         }
 
-        OsMutexLock(thread->hMutex);
-        pCurrentQueueList = thread->queueListHead;
-
-        while (pCurrentQueueList)
-        {
-            QDMA_QueuePairService(pCurrentQueueList);
-            pCurrentQueueList = pCurrentQueueList->next;
-        }
-
-        OsMutexUnlock(thread->hMutex);
+        QDMA_ThreadServiceQueues(thread);
     }
 }
 
@@ -1508,7 +1625,8 @@ static DWORD QDMA_QueuePairEnqueueMmRequest(
 
         u64Offset += pDma->Page[i].dwBytes;
 
-        QDMA_DumpDescriptorMm(&desc[u32RingIdx]);
+        if (WDC_DBG_ON(D_TRACE, S_DMA))
+            QDMA_DumpDescriptorMm(&desc[u32RingIdx]);
         QDMA_RingBufferAdvanceIdx(descriptorsRing, &u32RingIdx, 1UL);
     }
 
@@ -1542,7 +1660,8 @@ static DWORD QDMA_QueuePairEnqueueMmRequest(
 
 ExitWithUnlock:
     OsMutexUnlock(hMutex);
-    QDMA_DumpCsrQueueReg(dmaRequestContext->hDev);
+    if (WDC_DBG_ON(D_TRACE, S_DMA))
+        QDMA_DumpCsrQueueReg(dmaRequestContext->hDev);
 
     return dwStatus;
 }
@@ -1826,7 +1945,8 @@ static void QDMA_RegistersAccessUnlock(WDC_DEVICE_HANDLE hDev)
 static DWORD QDMA_GetGlobalRingSize(WDC_DEVICE_HANDLE hDev, UINT8 u8Index,
     UINT8 u8Count, UINT32 *pu32GlobalRingSize)
 {
-    DWORD dwStatus = WD_STATUS_SUCCESS;
+    PQDMA_DEV_CTX pDevCtx;
+    DWORD i, dwStatus = WD_STATUS_SUCCESS;
 
     if (!hDev || !pu32GlobalRingSize || !u8Count)
     {
@@ -1839,8 +1959,15 @@ static DWORD QDMA_GetGlobalRingSize(WDC_DEVICE_HANDLE hDev, UINT8 u8Index,
         goto Exit;
     }
 
-    QDMA_CsrReadValues(hDev, QDMA_OFFSET_GLBL_RNG_SZ, u8Index, u8Count,
-        pu32GlobalRingSize);
+    pDevCtx = (PQDMA_DEV_CTX)WDC_GetDevContext(hDev);
+    for (i = 0; i < u8Count; i++)
+    {
+        dwStatus = WDC_ShadowReadAddr32(hDev, pDevCtx->dwConfigBarNum,
+            QDMA_OFFSET_GLBL_RNG_SZ + (u8Index + i) * sizeof(UINT32),
+            &pu32GlobalRingSize[i]);
+        if (WD_STATUS_SUCCESS != dwStatus)
+            goto Exit;
+    }
 
 Exit:
     return dwStatus;
@@ -1967,21 +2094,6 @@ Exit:
     return dwStatus;
 }
 
-/* Read control/status registers values */
-static void QDMA_CsrReadValues(WDC_DEVICE_HANDLE hDev,
-    UINT32 u32RegisterOffset, DWORD dwId, DWORD dwCount, UINT32 *values)
-{
-    DWORD i;
-    UINT32 u32RegisterAddress;
-
-    u32RegisterAddress = u32RegisterOffset + (dwId * sizeof(UINT32));
-    for (i = 0; i < dwCount; i++)
-    {
-        values[i] = QDMA_RegRead(hDev, u32RegisterAddress +
-            (i * sizeof(UINT32)));
-    }
-}
-
 /* Write control/status registers values */
 static void QDMA_CsrWriteValues(WDC_DEVICE_HANDLE hDev, UINT32 u32RegisterOffset,
     DWORD dwId, DWORD dwCount, const UINT32 *values)
@@ -2312,6 +2424,13 @@ DWORD QDMA_ConfigBarNumGet(WDC_DEVICE_HANDLE hDev)
         (DWORD)WD_STATUS_INVALID_WD_HANDLE;
 }
 
+/* Set the task executor that services the queues of the devices that are
+ * opened afterwards */
+void QDMA_ExecutorSet(HANDLE hExecutor)
+{
+    ghQDMA_Executor = hExecutor;
+}
+
 /* Get vendor id by device handle */
 DWORD QDMA_GetVendorId(WDC_DEVICE_HANDLE hDev)
 {
@@ -2467,19 +2586,19 @@ void ErrLog(const CHAR *sFormat, ...)
     va_list argp;
 
     va_start(argp, sFormat);
-    vsnprintf(gsQDMA_LastErr, sizeof(gsQDMA_LastErr) - 1, sFormat, argp);
+    UtilLazyMsgSet(&gQDMA_LastErr, sFormat, argp);
 #if defined(DEBUG)
 #if defined(__KERNEL__)
-    WDC_Err("KP QDMA lib: %s", gsQDMA_LastErr);
+    WDC_Err("KP QDMA lib: %s", UtilLazyMsgGet(&gQDMA_LastErr));
 #else
-    WDC_Err("QDMA lib: %s", gsQDMA_LastErr);
+    WDC_Err("QDMA lib: %s", UtilLazyMsgGet(&gQDMA_LastErr));
 #endif
 #endif
     va_end(argp);
 }
 
-/* Log a debug trace message */
-void TraceLog(const CHAR *sFormat, ...)
+/* Log a debug trace message -- called through TraceLog() */
+void QDMA_TraceLog(const CHAR *sFormat, ...)
 {
 #if defined(DEBUG)
     CHAR sMsg[256];
@@ -2501,7 +2620,7 @@ void TraceLog(const CHAR *sFormat, ...)
 /* Get last error */
 const char *QDMA_GetLastErr(void)
 {
-    return gsQDMA_LastErr;
+    return UtilLazyMsgGet(&gQDMA_LastErr);
 }
 
 
@@ -147,6 +147,11 @@ BOOL QDMA_DeviceClose(WDC_DEVICE_HANDLE hDev);
 DWORD QDMA_GetVendorId(WDC_DEVICE_HANDLE hDev);
 /* Get device id by device handle */
 DWORD QDMA_GetDeviceId(WDC_DEVICE_HANDLE hDev);
+/* Service the queues of the devices that are opened afterwards on a task
+ * executor (see ExecutorCreate()) instead of dedicated poll threads. NULL
+ * restores the poll threads. The executor must not be destroyed before the
+ * devices are closed */
+void QDMA_ExecutorSet(HANDLE hExecutor);
 
 /* -----------------------------------------------
     Direct Memory Access (DMA)
@@ -21,6 +21,11 @@ int XDMA_printf(char *fmt, ...)
 #define XDMA_OUT XDMA_printf
 #define XDMA_ERR XDMA_printf
 
+/* Completion wait of the DMA performance test: a time-out detects a missed
+ * interrupt */
+#define PERF_EVENT_TIMEOUT_US 1000000
+#define PERF_EVENT_SPIN_US 20
+
 /* Interrupt handler routine for DMA performance testing */
 void DiagXdmaDmaPerfIntHandler(WDC_DEVICE_HANDLE hDev,
     XDMA_INT_RESULT *pIntResult)
@@ -81,7 +86,10 @@ void DmaPerfDevThread(void *pData)
         }
         else
         {
-            dwStatus = OsEventWait(ctx->hOsEvent, 1);
+            /* Spin briefly before sleeping: completions of small transfers
+             * arrive within microseconds */
+            dwStatus = OsEventWaitUs(ctx->hOsEvent, PERF_EVENT_TIMEOUT_US,
+                PERF_EVENT_SPIN_US);
             if (dwStatus == WD_TIME_OUT_EXPIRED)
             {
 #define MAX_RESTARTS 2
@@ -138,7 +146,8 @@ HANDLE DmaPerformanceThreadStart(DMA_PERF_THREAD_CTX *ctx)
     DWORD dwStatus;
     HANDLE hThread;
 
-    dwStatus = ThreadStart(&hThread, (HANDLER_FUNC)DmaPerfDevThread, ctx);
+    dwStatus = ThreadStartClass(&hThread, THREAD_CLASS_POLLER,
+        (HANDLER_FUNC)DmaPerfDevThread, ctx);
     if (dwStatus != WD_STATUS_SUCCESS)
     {
         XDMA_ERR("\nFailed starting performance thread. Error 0x%x - %s\n",
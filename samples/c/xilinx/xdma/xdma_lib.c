@@ -34,10 +34,16 @@
 
 #define XDMA_TRANSACTION_SAMPLE_MAX_TRANSFER_SIZE 0x00FFFFFF
 
+/* Maximal number of register writes batched for a DMA transfer start:
+ * descriptor low/high/adjacent, interrupt masks and engine control */
+#define XDMA_WRITE_BATCH_MAX_WRITES 8
+
 
 typedef struct {
 #define XDMA_DESC_MAGIC   0xAD4B0000
 #define XDMA_MAX_ADJACENT 15
+/* Maximum transfer length of a descriptor (28 bits), rounded down to 4KB */
+#define XDMA_DESC_MAX_BYTES 0x0FFFF000
     UINT32 u32Control;
     UINT32 u32Bytes;    /* Transfer length in bytes */
     UINT64 u64SrcAddr;  /* Source address */
@@ -54,7 +60,7 @@ typedef struct {
     (fToDevice ? dwChannel : dwChannel + XDMA_CHANNELS_NUM)
 
 /* Last error information string */
-static CHAR gsXDMA_LastErr[256];
+static OS_THREAD_LOCAL UTIL_LAZY_MSG gXDMA_LastErr;
 
 /*************************************************************
   Static functions prototypes and inline implementation
@@ -65,7 +71,15 @@ static BOOL DeviceValidate(const PWDC_DEVICE pDev);
 static void DLLCALLCONV XDMA_IntHandler(PVOID pData);
 static void XDMA_EventHandler(WD_EVENT *pEvent, PVOID pData);
 static void ErrLog(const CHAR *sFormat, ...);
-static void TraceLog(const CHAR *sFormat, ...);
+static void XDMA_TraceLog(const CHAR *sFormat, ...);
+
+/* Trace messages are compiled out of release builds, and their arguments are
+ * evaluated only when the WDC S_DMA debug section is traced */
+#define TraceLog(...) \
+    do { \
+        if (WDC_DBG_ON(D_TRACE, S_DMA)) \
+            XDMA_TraceLog(__VA_ARGS__); \
+    } while (0)
 
 #if !defined(__KERNEL__)
 /* Allocate buffer with page aligned address */
@@ -260,6 +274,7 @@ static void EnginesCreate(WDC_DEVICE_HANDLE hDev)
 BOOL DeviceInit(WDC_DEVICE_HANDLE hDev)
 {
     PXDMA_DEV_CTX pDevCtx;
+    DWORD i;
 
     if (!hDev)
         return FALSE;
@@ -276,6 +291,18 @@ BOOL DeviceInit(WDC_DEVICE_HANDLE hDev)
     if (!DeviceValidate((PWDC_DEVICE)hDev))
         return FALSE;
 
+    /* The channels alignments registers are constant: cache them after
+     * their first read */
+    for (i = 0; i < XDMA_CHANNELS_NUM; i++)
+    {
+        WDC_ShadowRangeSet(hDev, pDevCtx->dwConfigBarNum,
+            XDMA_CHANNEL_OFFSET(i, XDMA_H2C_CHANNEL_ALIGNMENTS_OFFSET),
+            sizeof(UINT32), WDC_SHADOW_CACHE_ON_READ);
+        WDC_ShadowRangeSet(hDev, pDevCtx->dwConfigBarNum,
+            XDMA_CHANNEL_OFFSET(i, XDMA_C2H_CHANNEL_ALIGNMENTS_OFFSET),
+            sizeof(UINT32), WDC_SHADOW_CACHE_ON_READ);
+    }
+
     EnginesCreate(hDev);
 
     return TRUE;
@@ -370,13 +397,17 @@ static void HandleEngineInterrupt(XDMA_DMA_STRUCT *pXdmaDma, UINT32 val)
 
     intResult.hDma = pXdmaDma;
 
-    WDC_ReadAddr32(pDev, pDevCtx->dwConfigBarNum,
-        XDMA_CHANNEL_OFFSET(pXdmaDma->dwChannel,
-        pXdmaDma->fToDevice ?  XDMA_H2C_CHANNEL_COMPLETED_DESC_COUNT_OFFSET :
-        XDMA_C2H_CHANNEL_COMPLETED_DESC_COUNT_OFFSET),
-        &val);
-
-    TraceLog("XDMA_IntHandler: Completed DMA descriptors %d\n", val);
+    /* The completed descriptors count is read only for tracing */
+    if (WDC_DBG_ON(D_TRACE, S_DMA))
+    {
+        WDC_ReadAddr32(pDev, pDevCtx->dwConfigBarNum,
+            XDMA_CHANNEL_OFFSET(pXdmaDma->dwChannel,
+            pXdmaDma->fToDevice ?
+            XDMA_H2C_CHANNEL_COMPLETED_DESC_COUNT_OFFSET :
+            XDMA_C2H_CHANNEL_COMPLETED_DESC_COUNT_OFFSET),
+            &val);
+        TraceLog("XDMA_IntHandler: Completed DMA descriptors %d\n", val);
+    }
 
     intResult.dwCounter = pDev->Int.dwCounter;
     intResult.dwLost = pDev->Int.dwLost;
@@ -607,14 +638,28 @@ DWORD XDMA_UserInterruptsDisable(WDC_DEVICE_HANDLE hDev, UINT32 mask)
         XDMA_IRQ_BLOCK_USER_INT_ENABLE_MASK_W1C_OFFSET, mask);
 }
 
-DWORD XDMA_ChannelInterruptsEnable(WDC_DEVICE_HANDLE hDev, UINT32 mask)
+/* Enables channel interrupts. If hBatch is not NULL, the write is added to its
+ * open scope instead of being written to the device immediately */
+static DWORD ChannelInterruptsEnable(WDC_DEVICE_HANDLE hDev,
+    WDC_WRITE_BATCH_HANDLE hBatch, UINT32 mask)
 {
     PXDMA_DEV_CTX pDevCtx = (PXDMA_DEV_CTX)WDC_GetDevContext(hDev);
 
+    if (hBatch)
+    {
+        return WDC_WriteBatchWrite32(hBatch, pDevCtx->dwConfigBarNum,
+            XDMA_IRQ_BLOCK_CHANNEL_INT_ENABLE_MASK_W1S_OFFSET, mask);
+    }
+
     return WDC_WriteAddr32(hDev, pDevCtx->dwConfigBarNum,
         XDMA_IRQ_BLOCK_CHANNEL_INT_ENABLE_MASK_W1S_OFFSET, mask);
 }
 
+DWORD XDMA_ChannelInterruptsEnable(WDC_DEVICE_HANDLE hDev, UINT32 mask)
+{
+    return ChannelInterruptsEnable(hDev, NULL, mask);
+}
+
 DWORD XDMA_ChannelInterruptsDisable(WDC_DEVICE_HANDLE hDev, UINT32 mask)
 {
     PXDMA_DEV_CTX pDevCtx = (PXDMA_DEV_CTX)WDC_GetDevContext(hDev);
@@ -733,10 +778,10 @@ static DWORD LockDmaBuffer(WDC_DEVICE_HANDLE hDev, BOOL fToDevice, PVOID *ppBuf,
 
     if (!fIsTransaction)
     {
-        /* DMA_DISABLE_MERGE_ADJACENT_PAGES is needed to make sure that each SG
-         * page is not larger than 0x0FFFFFFF */
-        dwStatus = WDC_DMASGBufLock(hDev, *ppBuf,
-            dwOptions | DMA_DISABLE_MERGE_ADJACENT_PAGES, dwBytes, ppDma);
+        /* Physically contiguous pages are merged, up to the maximum
+         * descriptor length (0x0FFFFFFF) */
+        dwStatus = WDC_DMASGBufLockEx(hDev, *ppBuf, dwOptions, dwBytes,
+            XDMA_DESC_MAX_BYTES, ppDma);
     }
     else
     {
@@ -758,6 +803,14 @@ Error:
     return dwStatus;
 }
 
+/* Offset of the engine's status register, which is also read to flush the
+ * engine's batched register writes */
+static DWORD EngineStatusRegisterOffset(const XDMA_DMA_STRUCT *pXdmaDma)
+{
+    return XDMA_CHANNEL_OFFSET(pXdmaDma->dwChannel, pXdmaDma->fToDevice ?
+        XDMA_H2C_CHANNEL_STATUS_OFFSET : XDMA_C2H_CHANNEL_STATUS_OFFSET);
+}
+
 static DWORD EngineCtrlRegisterSet(WDC_DEVICE_HANDLE hDev, DWORD dwChannel,
     BOOL fToDevice, UINT32 val)
 {
@@ -770,11 +823,10 @@ static DWORD EngineCtrlRegisterSet(WDC_DEVICE_HANDLE hDev, DWORD dwChannel,
 }
 
 #ifdef HAS_INTS
-static DWORD EnableDmaInterrupts(WDC_DEVICE_HANDLE hDev, DWORD dwChannel,
-    BOOL fStreaming, BOOL fToDevice)
+static DWORD EnableDmaInterrupts(XDMA_DMA_STRUCT *pXdmaDma)
 {
-    PXDMA_DEV_CTX pDevCtx = (PXDMA_DEV_CTX)WDC_GetDevContext(hDev);
-    DWORD offset;
+    PXDMA_DEV_CTX pDevCtx = (PXDMA_DEV_CTX)WDC_GetDevContext(pXdmaDma->hDev);
+    DWORD offset, dwStatus;
     UINT32 val;
 
     /* Error interrupts */
@@ -785,19 +837,22 @@ static DWORD EnableDmaInterrupts(WDC_DEVICE_HANDLE hDev, DWORD dwChannel,
 
     /* Enable completion interrupts */
     val |= XDMA_CTRL_IE_DESC_STOPPED | XDMA_CTRL_IE_DESC_COMPLETED;
-    if (fStreaming)
+    if (pXdmaDma->fStreaming)
         val |= XDMA_CTRL_IE_IDLE_STOPPED;
 
-    offset = XDMA_CHANNEL_OFFSET(dwChannel, fToDevice ?
+    offset = XDMA_CHANNEL_OFFSET(pXdmaDma->dwChannel, pXdmaDma->fToDevice ?
         XDMA_H2C_CHANNEL_INT_ENABLE_MASK_OFFSET :
         XDMA_C2H_CHANNEL_INT_ENABLE_MASK_OFFSET);
 
-    WDC_WriteAddr32(hDev, pDevCtx->dwConfigBarNum, offset, val);
+    /* The writes are committed by XDMA_DmaTransferStart() */
+    dwStatus = WDC_WriteBatchWrite32(pXdmaDma->hWriteBatch,
+        pDevCtx->dwConfigBarNum, offset, val);
+    if (dwStatus != WD_STATUS_SUCCESS)
+        return dwStatus;
 
     /* Make sure channel interrupts are enabled */
-    XDMA_ChannelInterruptsEnable(hDev, 0xFFFFFFFF);
-
-    return WD_STATUS_SUCCESS;
+    return ChannelInterruptsEnable(pXdmaDma->hDev, pXdmaDma->hWriteBatch,
+        0xFFFFFFFF);
 }
 #endif /* ifdef HAS_INTS */
 
@@ -880,8 +935,8 @@ static void DLLCALLCONV DmaTransferBuild(PVOID pData)
             desc[i].u64DstAddr = pXdmaDma->pDma->Page[i].pPhysicalAddr;
         }
 
-        /* Buffer size should not exceed 0x0FFFFFFF bytes, but this should not
-         * happen when using s/g DMA buffer */
+        /* Buffer size should not exceed 0x0FFFFFFF bytes -- see
+         * XDMA_DESC_MAX_BYTES */
         desc[i].u32Bytes = pXdmaDma->pDma->Page[i].dwBytes;
         if (!pXdmaDma->fNonIncMode)
             offset += desc[i].u32Bytes;
@@ -898,24 +953,29 @@ static void DLLCALLCONV DmaTransferBuild(PVOID pData)
     }
 
 
-    WDC_WriteAddr32(pXdmaDma->hDev, pDevCtx->dwConfigBarNum,
+    /* The descriptor registers writes are posted to the device together with
+     * the engine start writes, by XDMA_DmaTransferStart() */
+    WDC_WriteBatchBegin(pXdmaDma->hWriteBatch, pDevCtx->dwConfigBarNum,
+        EngineStatusRegisterOffset(pXdmaDma));
+    WDC_WriteBatchWrite32(pXdmaDma->hWriteBatch, pDevCtx->dwConfigBarNum,
         XDMA_CHANNEL_OFFSET(pXdmaDma->dwChannel,
         pXdmaDma->fToDevice ? XDMA_H2C_SGDMA_DESC_LOW_OFFSET :
         XDMA_C2H_SGDMA_DESC_LOW_OFFSET),
         DMA_ADDR_LOW(pXdmaDma->pDmaDesc->Page[0].pPhysicalAddr));
-    WDC_WriteAddr32(pXdmaDma->hDev, pDevCtx->dwConfigBarNum,
+    WDC_WriteBatchWrite32(pXdmaDma->hWriteBatch, pDevCtx->dwConfigBarNum,
         XDMA_CHANNEL_OFFSET(pXdmaDma->dwChannel,
         pXdmaDma->fToDevice ? XDMA_H2C_SGDMA_DESC_HIGH_OFFSET :
         XDMA_C2H_SGDMA_DESC_HIGH_OFFSET),
         DMA_ADDR_HIGH(pXdmaDma->pDmaDesc->Page[0].pPhysicalAddr));
 
-    WDC_WriteAddr32(pXdmaDma->hDev, pDevCtx->dwConfigBarNum,
+    WDC_WriteBatchWrite32(pXdmaDma->hWriteBatch, pDevCtx->dwConfigBarNum,
         XDMA_CHANNEL_OFFSET(pXdmaDma->dwChannel,
         pXdmaDma->fToDevice ? XDMA_H2C_SGDMA_DESC_ADJACENT_OFFSET :
         XDMA_C2H_SGDMA_DESC_ADJACENT_OFFSET),
         0);
 
-    DmaDescDump(pXdmaDma);
+    if (WDC_DBG_ON(D_TRACE, S_DMA))
+        DmaDescDump(pXdmaDma);
 
     /* TODO: Set adjacent descriptors */
 
@@ -943,7 +1003,7 @@ static DWORD CheckAlignment(XDMA_DMA_STRUCT *pXdmaDma)
     UINT32 u32BufLsb, u32OffsetLsb, u32SizeLsb;
     DWORD dwStatus;
 
-    dwStatus = WDC_ReadAddr32(pXdmaDma->hDev,
+    dwStatus = WDC_ShadowReadAddr32(pXdmaDma->hDev,
         pDevCtx->dwConfigBarNum,
         XDMA_CHANNEL_OFFSET(pXdmaDma->dwChannel,
         pXdmaDma->fToDevice ? XDMA_H2C_CHANNEL_ALIGNMENTS_OFFSET :
@@ -1009,21 +1069,28 @@ DWORD XDMA_DmaTransferStart(XDMA_DMA_HANDLE hDma)
     UINT32 val;
     DWORD dwStatus;
 
+    /* Continues the scope of the descriptor registers writes, if any (see
+     * DmaTransferBuild()) */
+    WDC_WriteBatchBegin(pXdmaDma->hWriteBatch, pDevCtx->dwConfigBarNum,
+        EngineStatusRegisterOffset(pXdmaDma));
+
 #ifdef HAS_INTS
     if (!pXdmaDma->fPolling)
     {
-        dwStatus = EnableDmaInterrupts(pXdmaDma->hDev, pXdmaDma->dwChannel,
-            pXdmaDma->fStreaming, pXdmaDma->fToDevice);
+        dwStatus = EnableDmaInterrupts(pXdmaDma);
         if (dwStatus != WD_STATUS_SUCCESS)
         {
             ErrLog("Failed enabling DMA interrupts. Error 0x%x - %s\n",
                 dwStatus, Stat2Str(dwStatus));
+            /* Do not issue a partial sequence to the device. The descriptor
+             * registers writes are discarded as well, so the transfer must be
+             * rebuilt before it is started again */
+            WDC_WriteBatchAbort(pXdmaDma->hWriteBatch);
             return dwStatus;
         }
 
-        /* Dummy read to flush pending writes */
-        WDC_ReadAddr32(pXdmaDma->hDev, pDevCtx->dwConfigBarNum,
-            XDMA_IRQ_BLOCK_CHANNEL_INT_REQUEST_OFFSET, &val);
+        /* Interrupts must be enabled before the engine is started */
+        WDC_WriteBatchFlushPoint(pXdmaDma->hWriteBatch);
     }
     else
 #endif /* ifdef HAS_INTS */
@@ -1057,21 +1124,20 @@ DWORD XDMA_DmaTransferStart(XDMA_DMA_HANDLE hDma)
     if (pXdmaDma->fNonIncMode)
         val |= XDMA_CTRL_NON_INCR_ADDR;
 
-    dwStatus = EngineCtrlRegisterSet(pXdmaDma->hDev, pXdmaDma->dwChannel,
-        pXdmaDma->fToDevice, val);
+    WDC_WriteBatchWrite32(pXdmaDma->hWriteBatch, pDevCtx->dwConfigBarNum,
+        XDMA_CHANNEL_OFFSET(pXdmaDma->dwChannel, pXdmaDma->fToDevice ?
+        XDMA_H2C_CHANNEL_CONTROL_OFFSET : XDMA_C2H_CHANNEL_CONTROL_OFFSET),
+        val);
+    WDC_WriteBatchFlushPoint(pXdmaDma->hWriteBatch);
+
+    /* Post all the writes in order, and flush them with a single read */
+    dwStatus = WDC_WriteBatchCommit(pXdmaDma->hWriteBatch, &val);
     if (dwStatus != WD_STATUS_SUCCESS)
     {
         ErrLog("Failed starting DMA transfer\n");
         return dwStatus;
     }
 
-    /* Dummy read to flush all previous writes */
-    WDC_ReadAddr32(pXdmaDma->hDev, pDevCtx->dwConfigBarNum,
-        XDMA_CHANNEL_OFFSET(pXdmaDma->dwChannel,
-        pXdmaDma->fToDevice ? XDMA_H2C_CHANNEL_STATUS_OFFSET :
-        XDMA_C2H_CHANNEL_STATUS_OFFSET),
-        &val);
-
     return WD_STATUS_SUCCESS;
 }
 
@@ -1113,7 +1179,7 @@ DWORD XDMA_DmaPollCompletion(XDMA_DMA_HANDLE hDma)
     pWB = (XDMA_DMA_POLL_WB *)pXdmaDma->pWBBuf;
     while (pWB->u32CompletedDescs < pXdmaDma->pDma->dwPages)
     {
-        WDC_DMASyncIo(pXdmaDma->pWBDma);
+        WDC_DMASyncIoRange(pXdmaDma->pWBDma, 0, sizeof(*pWB));
 
         if (pWB->u32CompletedDescs & XDMA_WB_ERR_MASK)
         {
@@ -1227,6 +1293,15 @@ DWORD XDMA_DmaOpen(WDC_DEVICE_HANDLE hDev, XDMA_DMA_HANDLE *phDma,
     pXdmaDma->pData = pData;
     *phDma = (XDMA_DMA_HANDLE)pXdmaDma;
 
+    dwStatus = WDC_WriteBatchCreate(hDev, XDMA_WRITE_BATCH_MAX_WRITES,
+        &pXdmaDma->hWriteBatch);
+    if (dwStatus != WD_STATUS_SUCCESS)
+    {
+        ErrLog("Failed creating registers write batch. Error 0x%x - %s\n",
+            dwStatus, Stat2Str(dwStatus));
+        goto Error;
+    }
+
     WDC_WriteAddr32(hDev, pDevCtx->dwConfigBarNum,
         XDMA_CHANNEL_OFFSET(dwChannel, fToDevice ?
         XDMA_H2C_CHANNEL_CONTROL_W1C_OFFSET :
@@ -1280,6 +1355,11 @@ DWORD XDMA_DmaOpen(WDC_DEVICE_HANDLE hDev, XDMA_DMA_HANDLE *phDma,
     return WD_STATUS_SUCCESS;
 
 Error:
+    if (pXdmaDma->hWriteBatch)
+    {
+        WDC_WriteBatchDestroy(pXdmaDma->hWriteBatch);
+        pXdmaDma->hWriteBatch = NULL;
+    }
     if (pXdmaDma->pDmaDesc)
         WDC_DMABufUnlock(pXdmaDma->pDmaDesc);
     if (pXdmaDma->pDma)
@@ -1392,6 +1472,12 @@ DWORD XDMA_DmaClose(XDMA_DMA_HANDLE hDma)
     if (pXdmaDma->pBuf)
         __vfree(pXdmaDma->pBuf);
 
+    if (pXdmaDma->hWriteBatch)
+    {
+        WDC_WriteBatchDestroy(pXdmaDma->hWriteBatch);
+        pXdmaDma->hWriteBatch = NULL;
+    }
+
     pDevCtx->pEnginesArr[idx].fIsInitialized = FALSE;
 
     return dwStatus;
@@ -1545,19 +1631,19 @@ static void ErrLog(const CHAR *sFormat, ...)
     va_list argp;
 
     va_start(argp, sFormat);
-    vsnprintf(gsXDMA_LastErr, sizeof(gsXDMA_LastErr) - 1, sFormat, argp);
+    UtilLazyMsgSet(&gXDMA_LastErr, sFormat, argp);
 #if defined(DEBUG)
     #if defined(__KERNEL__)
-        WDC_Err("KP XDMA lib: %s", gsXDMA_LastErr);
+        WDC_Err("KP XDMA lib: %s", UtilLazyMsgGet(&gXDMA_LastErr));
      #else
-        WDC_Err("XDMA lib: %s", gsXDMA_LastErr);
+        WDC_Err("XDMA lib: %s", UtilLazyMsgGet(&gXDMA_LastErr));
     #endif
 #endif
     va_end(argp);
 }
 
-/* Log a debug trace message */
-static void TraceLog(const CHAR *sFormat, ...)
+/* Log a debug trace message -- called through TraceLog() */
+static void XDMA_TraceLog(const CHAR *sFormat, ...)
 {
 #if defined(DEBUG)
     CHAR sMsg[256];
@@ -1579,6 +1665,6 @@ static void TraceLog(const CHAR *sFormat, ...)
 /* Get last error */
 const char *XDMA_GetLastErr(void)
 {
-    return gsXDMA_LastErr;
+    return UtilLazyMsgGet(&gXDMA_LastErr);
 }
 
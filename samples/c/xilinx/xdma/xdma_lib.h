@@ -159,6 +159,8 @@ typedef struct {
     UINT32 u32IrqBitMask;   /* Engine interrupt request bit(s) */
     BOOL fIsInitialized;    /* Is the engine struct (this struct) initialized */
     BOOL fIsEnabled;        /* Is the engine enabled on the card */
+    WDC_WRITE_BATCH_HANDLE hWriteBatch; /* Descriptor and engine start
+                                         * registers writes */
 } XDMA_DMA_STRUCT;
 
 /* XDMA device information struct */
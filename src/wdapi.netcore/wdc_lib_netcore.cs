@@ -159,7 +159,8 @@ namespace Jungo
                                         * FALSE: I/O */
             public DWORD dwItemIndex;         /* Index of address space in
                                         * pDev.cardReg.Card.Item array */
-            public DWORD reserved;
+            public DWORD dwOptions;           /* Bitmask of WDC_ADDR_DESC_OPTIONS
+                                        * flags */
             public UINT64 qwBytes;            /* Size of address space */
             public KPTR pAddr;               /* I/O / memory kernel mapped address -
                                         * for WD_Transfer(), WD_MultiTransfer()
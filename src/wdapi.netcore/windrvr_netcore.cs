@@ -847,6 +847,8 @@ namespace Jungo
             public WD_EVENT Event;           /* Event information */
             public HANDLE hEvent;
             public IntPtr pCtx;
+            public IntPtr pPriv;          /* WDC library internal
+                                                * information */
         };
 
         public class WDC_DEVICE
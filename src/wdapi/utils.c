@@ -1,5 +1,9 @@
 /* Jungo Connectivity Confidential. Copyright (c) 2022 Jungo Connectivity Ltd.  https://www.jungo.com */
 
+#if defined(LINUX) && !defined(__KERNEL__) && !defined(_GNU_SOURCE)
+    #define _GNU_SOURCE /* pthread_setaffinity_np() */
+#endif
+
 #include "utils.h"
 #include "windrvr.h"
 
@@ -16,13 +20,19 @@
 
 #if defined(UNIX)
     #include <pthread.h>
+    #include <sched.h>
     #include <sys/time.h>
     #include <unistd.h>
     #include <errno.h>
+    #if !defined(__KERNEL__)
+        #include <alloca.h>
+        #include <sys/mman.h>
+    #endif
 #endif
 
 #if !defined(__KERNEL__)
     #include <stdarg.h>
+    #include <stdint.h>
     #include <stdio.h>
     #include <wchar.h>
     #if !defined (APPLE)
@@ -34,7 +44,31 @@
     #endif
 #endif
 
-#if defined(UNIX)
+#if defined(LINUX) && !defined(__KERNEL__)
+    #include <limits.h>
+    #include <time.h>
+    #include <sys/syscall.h>
+    #include <linux/futex.h>
+
+    /* Futex-based auto-reset event. The waiters are recorded in the futex
+     * word itself, so a single exchange both signals the event and tells
+     * the signaling thread whether to wake; the signaling thread does not
+     * access the event after that, since a waiter may close it at once. */
+    enum {
+        EVENT_CLEAR = 0,
+        EVENT_SIGNALED = 1,
+        EVENT_CLEAR_WAITERS = 2 /* Not signaled, threads may sleep on it */
+    };
+
+    typedef struct {
+        volatile int state; /* The futex word: EVENT_XXX */
+    } wd_linux_event_t;
+
+    /* Sequence of the signals of all the events, on which the
+     * OsEventWaitAny() callers wait */
+    static volatile int gEventsSeq;
+    static volatile int gEventsAnyWaiters;
+#elif defined(UNIX)
     typedef struct {
         pthread_cond_t cond;
         pthread_mutex_t mutex;
@@ -66,8 +100,105 @@ typedef struct
     #if defined(THREAD_WAIT_CHECK)
         thread_handle_t *h_thread;
     #endif
+    const THREAD_ATTR *attr; /* NULL - the default attributes */
+    THREAD_ATTR *applied;    /* The attributes that were applied, or NULL */
+    HANDLE h_applied;        /* Signaled after the attributes were applied */
 } thread_struct_t;
 
+/* Attributes of the threads of each class */
+static struct {
+    BOOL fSet;
+    THREAD_ATTR attr;
+    THREAD_ATTR applied; /* Applied to the last thread of the class */
+} gThreadClasses[THREAD_CLASS_NUM];
+
+/* Touches the pages of the stack below the caller's frame. Functions that
+ * call alloca() are not inlined, so the memory is released on return. */
+static void thread_stack_prefault(DWORD dwBytes)
+{
+    volatile char *p = (volatile char *)alloca(dwBytes);
+    DWORD i;
+
+    for (i = 0; i < dwBytes; i += (DWORD)GetPageSize())
+        p[i] = 0;
+}
+
+/* Applies the attributes to the calling thread */
+static void thread_attr_apply(const THREAD_ATTR *pAttr, THREAD_ATTR *pApplied)
+{
+    BZERO(*pApplied);
+
+    #if defined(WIN32)
+        if (pAttr->qwCpuMask &&
+            !ThreadSetAffinity(NULL, pAttr->qwCpuMask))
+        {
+            pApplied->qwCpuMask = pAttr->qwCpuMask;
+        }
+
+        if (pAttr->dwPolicy != THREAD_SCHED_DEFAULT)
+        {
+            int priority = pAttr->dwPriority >= 90 ?
+                THREAD_PRIORITY_TIME_CRITICAL : pAttr->dwPriority >= 50 ?
+                THREAD_PRIORITY_HIGHEST : THREAD_PRIORITY_ABOVE_NORMAL;
+
+            if (SetThreadPriority(GetCurrentThread(), priority))
+            {
+                pApplied->dwPolicy = pAttr->dwPolicy;
+                pApplied->dwPriority = pAttr->dwPriority;
+            }
+        }
+    #elif defined(LINUX)
+        {
+            struct sched_param param;
+            cpu_set_t set;
+            int policy, i;
+
+            if (pAttr->qwCpuMask)
+                ThreadSetAffinity(NULL, pAttr->qwCpuMask);
+
+            if (pAttr->dwPolicy != THREAD_SCHED_DEFAULT)
+            {
+                policy = pAttr->dwPolicy == THREAD_SCHED_RR ? SCHED_RR :
+                    SCHED_FIFO;
+                param.sched_priority = MAX(sched_get_priority_min(policy),
+                    MIN((int)pAttr->dwPriority,
+                    sched_get_priority_max(policy)));
+                pthread_setschedparam(pthread_self(), policy, &param);
+            }
+
+            if (!pthread_getaffinity_np(pthread_self(), sizeof(set), &set))
+            {
+                for (i = 0; i < 64; i++)
+                {
+                    if (CPU_ISSET(i, &set))
+                        pApplied->qwCpuMask |= (UINT64)1 << i;
+                }
+            }
+
+            if (!pthread_getschedparam(pthread_self(), &policy, &param) &&
+                (policy == SCHED_FIFO || policy == SCHED_RR))
+            {
+                pApplied->dwPolicy = policy == SCHED_RR ? THREAD_SCHED_RR :
+                    THREAD_SCHED_FIFO;
+                pApplied->dwPriority = (DWORD)param.sched_priority;
+            }
+        }
+
+        if ((pAttr->dwOptions & THREAD_ATTR_MLOCK_ALL) &&
+            !mlockall(MCL_CURRENT | MCL_FUTURE))
+        {
+            pApplied->dwOptions |= THREAD_ATTR_MLOCK_ALL;
+        }
+    #endif
+
+    if (pAttr->dwStackPrefaultBytes)
+    {
+        pApplied->dwStackPrefaultBytes = MIN(pAttr->dwStackPrefaultBytes,
+            THREAD_ATTR_MAX_STACK_PREFAULT);
+        thread_stack_prefault(pApplied->dwStackPrefaultBytes);
+    }
+}
+
 #if defined(WIN32)
     static unsigned int DLLCALLCONV thread_handler(void *data)
 #else
@@ -76,6 +207,19 @@ typedef struct
 {
     thread_struct_t *t = (thread_struct_t *)data;
 
+    if (t->attr)
+    {
+        THREAD_ATTR applied;
+
+        thread_attr_apply(t->attr, &applied);
+        if (t->applied)
+            *t->applied = applied;
+        /* The creator of the thread is waiting, with the attributes */
+        t->attr = NULL;
+        t->applied = NULL;
+        OsEventSignal(t->h_applied);
+    }
+
     t->func(t->data);
 #if defined(THREAD_WAIT_CHECK)
     t->h_thread->is_running = FALSE;
@@ -90,8 +234,16 @@ typedef struct
 
 DWORD DLLCALLCONV ThreadStart(_Outptr_ HANDLE *phThread,
     _In_ HANDLER_FUNC pFunc, _In_ void *pData)
+{
+    return ThreadStartAttr(phThread, pFunc, pData, NULL, NULL);
+}
+
+DWORD DLLCALLCONV ThreadStartAttr(_Outptr_ HANDLE *phThread,
+    _In_ HANDLER_FUNC pFunc, _In_ void *pData, _In_ const THREAD_ATTR *pAttr,
+    _Out_ THREAD_ATTR *pApplied)
 {
     thread_struct_t *t;
+    HANDLE h_applied = NULL;
     #if defined(WIN32)
         DWORD dwTmp;
         #if defined(THREAD_WAIT_CHECK)
@@ -106,13 +258,24 @@ DWORD DLLCALLCONV ThreadStart(_Outptr_ HANDLE *phThread,
     if (!t)
         return WD_INSUFFICIENT_RESOURCES;
 
+    if (pAttr && OsEventCreate(&h_applied))
+    {
+        free(t);
+        return WD_INSUFFICIENT_RESOURCES;
+    }
+
     t->func = pFunc;
     t->data = pData;
+    t->attr = pAttr;
+    t->applied = pApplied;
+    t->h_applied = h_applied;
     #if defined(THREAD_WAIT_CHECK)
         h = (thread_handle_t *)malloc(sizeof(thread_handle_t));
         if (!h)
         {
            free(t);
+           if (h_applied)
+               OsEventClose(h_applied);
            return WD_INSUFFICIENT_RESOURCES;
         }
 
@@ -144,9 +307,17 @@ DWORD DLLCALLCONV ThreadStart(_Outptr_ HANDLE *phThread,
         #if defined(THREAD_WAIT_CHECK)
             free(h);
         #endif
+        if (h_applied)
+            OsEventClose(h_applied);
         return WD_INSUFFICIENT_RESOURCES;
     }
 
+    if (h_applied)
+    {
+        OsEventWait(h_applied, INFINITE);
+        OsEventClose(h_applied);
+    }
+
     #if defined(THREAD_WAIT_CHECK)
         h->h_thread = ret;
         *phThread = (HANDLE)h;
@@ -157,6 +328,58 @@ DWORD DLLCALLCONV ThreadStart(_Outptr_ HANDLE *phThread,
     return WD_STATUS_SUCCESS;
 }
 
+DWORD DLLCALLCONV ThreadClassAttrSet(_In_ DWORD dwClass,
+    _In_ const THREAD_ATTR *pAttr)
+{
+    if (dwClass >= THREAD_CLASS_NUM)
+        return WD_INVALID_PARAMETER;
+
+    BZERO(gThreadClasses[dwClass].applied);
+    if (pAttr)
+        gThreadClasses[dwClass].attr = *pAttr;
+    else
+        BZERO(gThreadClasses[dwClass].attr);
+    gThreadClasses[dwClass].fSet = pAttr != NULL;
+
+    return WD_STATUS_SUCCESS;
+}
+
+DWORD DLLCALLCONV ThreadClassAttrGet(_In_ DWORD dwClass,
+    _Out_ THREAD_ATTR *pAttr, _Out_ THREAD_ATTR *pApplied)
+{
+    if (dwClass >= THREAD_CLASS_NUM)
+        return WD_INVALID_PARAMETER;
+
+    if (pAttr)
+        *pAttr = gThreadClasses[dwClass].attr;
+    if (pApplied)
+        *pApplied = gThreadClasses[dwClass].applied;
+
+    return WD_STATUS_SUCCESS;
+}
+
+DWORD DLLCALLCONV ThreadStartClass(_Outptr_ HANDLE *phThread,
+    _In_ DWORD dwClass, _In_ HANDLER_FUNC pFunc, _In_ void *pData)
+{
+    if (dwClass >= THREAD_CLASS_NUM)
+    {
+        *phThread = NULL;
+        return WD_INVALID_PARAMETER;
+    }
+
+    if (!gThreadClasses[dwClass].fSet)
+        return ThreadStart(phThread, pFunc, pData);
+
+    return ThreadStartAttr(phThread, pFunc, pData,
+        &gThreadClasses[dwClass].attr, &gThreadClasses[dwClass].applied);
+}
+
+BOOL DLLCALLCONV ThreadClassHasAffinity(_In_ DWORD dwClass)
+{
+    return dwClass < THREAD_CLASS_NUM && gThreadClasses[dwClass].fSet &&
+        gThreadClasses[dwClass].attr.qwCpuMask;
+}
+
 void DLLCALLCONV ThreadWait(_In_ HANDLE hThread)
 {
     #if defined(WIN32)
@@ -178,12 +401,216 @@ void DLLCALLCONV ThreadWait(_In_ HANDLE hThread)
         free(hThread);
     #endif
 }
+
+#if defined(LINUX)
+/* Parses a CPU list (e.g. "0-7,16-23") into a CPU set */
+static BOOL CpuListParse(const char *sList, cpu_set_t *pSet)
+{
+    const char *p = sList;
+
+    CPU_ZERO(pSet);
+    while (*p >= '0' && *p <= '9')
+    {
+        char *pEnd;
+        unsigned long first = strtoul(p, &pEnd, 10), last = first;
+
+        if (*pEnd == '-')
+            last = strtoul(pEnd + 1, &pEnd, 10);
+        for (; first <= last && first < CPU_SETSIZE; first++)
+            CPU_SET(first, pSet);
+
+        p = *pEnd == ',' ? pEnd + 1 : pEnd;
+    }
+
+    return CPU_COUNT(pSet) > 0;
+}
+#endif
+
+DWORD DLLCALLCONV ThreadSetAffinity(_In_ HANDLE hThread, _In_ UINT64 qwCpuMask)
+{
+    #if defined(WIN32)
+        HANDLE h = GetCurrentThread();
+
+        if (hThread)
+        {
+        #if defined(THREAD_WAIT_CHECK)
+            h = ((thread_handle_t *)hThread)->h_thread;
+        #else
+            h = hThread;
+        #endif
+        }
+
+        if (!qwCpuMask)
+            return WD_INVALID_PARAMETER;
+
+        return SetThreadAffinityMask(h, (DWORD_PTR)qwCpuMask) ?
+            WD_STATUS_SUCCESS : WD_OPERATION_FAILED;
+    #elif defined(LINUX)
+        cpu_set_t set;
+        DWORD i;
+
+        if (!qwCpuMask)
+            return WD_INVALID_PARAMETER;
+
+        CPU_ZERO(&set);
+        for (i = 0; i < 64; i++)
+        {
+            if (qwCpuMask & ((UINT64)1 << i))
+                CPU_SET(i, &set);
+        }
+
+        return pthread_setaffinity_np(hThread ? *(pthread_t *)hThread :
+            pthread_self(), sizeof(set), &set) ? WD_OPERATION_FAILED :
+            WD_STATUS_SUCCESS;
+    #else
+        return WD_NOT_IMPLEMENTED;
+    #endif
+}
+
+DWORD DLLCALLCONV ThreadBindNumaNode(_In_ HANDLE hThread, _In_ DWORD dwNode)
+{
+    #if defined(WIN32)
+        ULONGLONG qwMask = 0;
+        HANDLE h = GetCurrentThread();
+
+        if (hThread)
+        {
+        #if defined(THREAD_WAIT_CHECK)
+            h = ((thread_handle_t *)hThread)->h_thread;
+        #else
+            h = hThread;
+        #endif
+        }
+
+        if (dwNode > 0xFF || !GetNumaNodeProcessorMask((UCHAR)dwNode,
+            &qwMask) || !qwMask)
+        {
+            return WD_INVALID_PARAMETER;
+        }
+
+        return SetThreadAffinityMask(h, (DWORD_PTR)qwMask) ?
+            WD_STATUS_SUCCESS : WD_OPERATION_FAILED;
+    #elif defined(LINUX)
+        char sPath[64], sList[1024];
+        cpu_set_t set;
+        FILE *fp;
+        BOOL fValid;
+
+        snprintf(sPath, sizeof(sPath), "/sys/devices/system/node/node%u/cpulist",
+            (unsigned)dwNode);
+        fp = fopen(sPath, "r");
+        if (!fp)
+            return WD_INVALID_PARAMETER;
+
+        fValid = fgets(sList, sizeof(sList), fp) && CpuListParse(sList, &set);
+        fclose(fp);
+        if (!fValid)
+            return WD_INVALID_PARAMETER;
+
+        return pthread_setaffinity_np(hThread ? *(pthread_t *)hThread :
+            pthread_self(), sizeof(set), &set) ? WD_OPERATION_FAILED :
+            WD_STATUS_SUCCESS;
+    #else
+        return WD_NOT_IMPLEMENTED;
+    #endif
+}
 /* End of threads functions */
 
 #endif /* defined(_MT) */
 
 /* Synchronization objects */
 
+#if defined(LINUX) && !defined(__KERNEL__)
+static UINT64 monotonic_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (UINT64)ts.tv_sec * 1000000000 + (UINT64)ts.tv_nsec;
+}
+
+/* Returns the monotonic deadline of a timeout */
+static UINT64 deadline_ns(UINT64 qwNow, UINT64 qwTimeoutNs)
+{
+    return qwTimeoutNs >= OS_EVENT_INFINITE - qwNow ? OS_EVENT_INFINITE :
+        qwNow + qwTimeoutNs;
+}
+
+/* Waits while the futex word equals iVal, until the monotonic deadline.
+ * Returns FALSE if the deadline expired. */
+static BOOL futex_wait_until(volatile int *pWord, int iVal,
+    UINT64 qwDeadlineNs)
+{
+    struct timespec ts, *pTs = NULL;
+
+    if (qwDeadlineNs != OS_EVENT_INFINITE)
+    {
+        ts.tv_sec = (time_t)(qwDeadlineNs / 1000000000);
+        ts.tv_nsec = (long)(qwDeadlineNs % 1000000000);
+        pTs = &ts;
+    }
+
+    /* FUTEX_WAIT_BITSET takes an absolute CLOCK_MONOTONIC timeout */
+    return !(syscall(SYS_futex, pWord, FUTEX_WAIT_BITSET | FUTEX_PRIVATE_FLAG,
+        iVal, pTs, NULL, FUTEX_BITSET_MATCH_ANY) && errno == ETIMEDOUT);
+}
+
+static void futex_wake(volatile int *pWord, int iCount)
+{
+    syscall(SYS_futex, pWord, FUTEX_WAKE | FUTEX_PRIVATE_FLAG, iCount, NULL,
+        NULL, 0);
+}
+
+static BOOL event_try_take(wd_linux_event_t *linux_event)
+{
+    return linux_event->state == EVENT_SIGNALED &&
+        __sync_bool_compare_and_swap(&linux_event->state, EVENT_SIGNALED,
+        EVENT_CLEAR);
+}
+
+/* Takes the first signaled event of an array */
+static BOOL events_try_take(HANDLE *phOsEvents, DWORD dwNumEvents,
+    DWORD *pdwIndex)
+{
+    DWORD i;
+
+    for (i = 0; i < dwNumEvents; i++)
+    {
+        if (event_try_take((wd_linux_event_t *)phOsEvents[i]))
+        {
+            *pdwIndex = i;
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+#elif defined(WIN32) && !defined(__KERNEL__)
+static UINT64 monotonic_ns(void)
+{
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER count;
+
+    if (!freq.QuadPart)
+        QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+
+    return (UINT64)(count.QuadPart / freq.QuadPart) * 1000000000 +
+        (UINT64)(count.QuadPart % freq.QuadPart) * 1000000000 /
+        freq.QuadPart;
+}
+
+/* Returns the wait of a timeout, in milliseconds, rounded up */
+static DWORD timeout_ms(UINT64 qwTimeoutNs)
+{
+    if (qwTimeoutNs == OS_EVENT_INFINITE)
+        return INFINITE;
+
+    return (DWORD)MIN((qwTimeoutNs + 999999) / 1000000, INFINITE - 1);
+}
+#endif
+
 /* Auto-reset events */
 DWORD DLLCALLCONV OsEventCreate(_Outptr_ HANDLE *phOsEvent)
 {
@@ -201,8 +628,10 @@ DWORD DLLCALLCONV OsEventCreate(_Outptr_ HANDLE *phOsEvent)
         return WD_INSUFFICIENT_RESOURCES;
 
     memset(linux_event, 0, sizeof(wd_linux_event_t));
+#if !defined(LINUX)
     pthread_cond_init(&linux_event->cond, NULL);
     pthread_mutex_init(&linux_event->mutex, NULL);
+#endif
     *phOsEvent = linux_event;
 
     return WD_STATUS_SUCCESS;
@@ -229,8 +658,10 @@ void DLLCALLCONV OsEventClose(_In_ HANDLE hOsEvent)
 #elif defined(UNIX)
     wd_linux_event_t *linux_event = (wd_linux_event_t *)hOsEvent;
 
+#if !defined(LINUX)
     pthread_cond_destroy(&linux_event->cond);
     pthread_mutex_destroy(&linux_event->mutex);
+#endif
     free(linux_event);
 #endif
 #endif
@@ -257,6 +688,9 @@ DWORD DLLCALLCONV OsEventWait(_In_ HANDLE hOsEvent, _In_ DWORD dwSecTimeout)
             rc = WD_SYSTEM_INTERNAL_ERROR;
             break;
     }
+#elif defined(LINUX)
+    rc = OsEventWaitNs(hOsEvent, (dwSecTimeout == INFINITE) ?
+        OS_EVENT_INFINITE : (UINT64)dwSecTimeout * 1000000000, 0);
 #elif defined(UNIX)
     struct timeval now;
     struct timespec timeout;
@@ -287,6 +721,176 @@ DWORD DLLCALLCONV OsEventWait(_In_ HANDLE hOsEvent, _In_ DWORD dwSecTimeout)
 #endif
 }
 
+DWORD DLLCALLCONV OsEventWaitNs(_In_ HANDLE hOsEvent, _In_ UINT64 qwTimeoutNs,
+    _In_ UINT64 qwSpinNs)
+{
+#if defined(__KERNEL__)
+    return WD_NOT_IMPLEMENTED;
+#elif defined(LINUX)
+    wd_linux_event_t *linux_event = (wd_linux_event_t *)hOsEvent;
+    UINT64 qwNow, qwDeadline, qwSpinEnd;
+
+    if (event_try_take(linux_event))
+        return WD_STATUS_SUCCESS;
+    if (!qwTimeoutNs)
+        return WD_TIME_OUT_EXPIRED;
+
+    qwNow = monotonic_ns();
+    qwDeadline = deadline_ns(qwNow, qwTimeoutNs);
+    qwSpinEnd = deadline_ns(qwNow, MIN(qwSpinNs, qwTimeoutNs));
+    while (qwSpinNs && monotonic_ns() < qwSpinEnd)
+    {
+        if (event_try_take(linux_event))
+            return WD_STATUS_SUCCESS;
+    }
+
+    for (;;)
+    {
+        BOOL fExpired = FALSE;
+
+        /* The signaling thread wakes the futex only if it replaces
+         * EVENT_CLEAR_WAITERS, so the event is marked before sleeping */
+        if (__sync_val_compare_and_swap(&linux_event->state, EVENT_CLEAR,
+            EVENT_CLEAR_WAITERS) != EVENT_SIGNALED)
+        {
+            fExpired = !futex_wait_until(&linux_event->state,
+                EVENT_CLEAR_WAITERS, qwDeadline);
+        }
+
+        if (event_try_take(linux_event))
+            return WD_STATUS_SUCCESS;
+        if (fExpired || (qwDeadline != OS_EVENT_INFINITE &&
+            monotonic_ns() >= qwDeadline))
+        {
+            return WD_TIME_OUT_EXPIRED;
+        }
+    }
+#elif defined(WIN32)
+    UINT64 qwStart = monotonic_ns(), qwElapsed = 0;
+    DWORD rc;
+
+    if (qwSpinNs && qwTimeoutNs)
+    {
+        do {
+            if (WaitForSingleObject(hOsEvent, 0) == WAIT_OBJECT_0)
+                return WD_STATUS_SUCCESS;
+            qwElapsed = monotonic_ns() - qwStart;
+        } while (qwElapsed < MIN(qwSpinNs, qwTimeoutNs));
+    }
+
+    rc = WaitForSingleObject(hOsEvent, timeout_ms(
+        qwTimeoutNs == OS_EVENT_INFINITE ? OS_EVENT_INFINITE :
+        qwTimeoutNs - MIN(qwElapsed, qwTimeoutNs)));
+    if (rc == WAIT_OBJECT_0)
+        return WD_STATUS_SUCCESS;
+
+    return rc == WAIT_TIMEOUT ? WD_TIME_OUT_EXPIRED : WD_SYSTEM_INTERNAL_ERROR;
+#else
+    return WD_NOT_IMPLEMENTED;
+#endif
+}
+
+DWORD DLLCALLCONV OsEventWaitUs(_In_ HANDLE hOsEvent, _In_ UINT64 qwTimeoutUs,
+    _In_ DWORD dwSpinUs)
+{
+    return OsEventWaitNs(hOsEvent, qwTimeoutUs >= OS_EVENT_INFINITE / 1000 ?
+        OS_EVENT_INFINITE : qwTimeoutUs * 1000, (UINT64)dwSpinUs * 1000);
+}
+
+DWORD DLLCALLCONV OsEventWaitAny(_In_ HANDLE *phOsEvents,
+    _In_ DWORD dwNumEvents, _In_ UINT64 qwTimeoutUs, _In_ DWORD dwSpinUs,
+    _Out_ DWORD *pdwIndex)
+{
+#if defined(__KERNEL__)
+    return WD_NOT_IMPLEMENTED;
+#else
+    UINT64 qwTimeoutNs = qwTimeoutUs >= OS_EVENT_INFINITE / 1000 ?
+        OS_EVENT_INFINITE : qwTimeoutUs * 1000;
+    UINT64 qwSpinNs = MIN((UINT64)dwSpinUs * 1000, qwTimeoutNs);
+
+    if (!phOsEvents || !pdwIndex || !dwNumEvents ||
+        dwNumEvents > OS_EVENT_WAIT_ANY_MAX)
+    {
+        return WD_INVALID_PARAMETER;
+    }
+
+#if defined(LINUX)
+    {
+        UINT64 qwNow, qwDeadline;
+
+        if (events_try_take(phOsEvents, dwNumEvents, pdwIndex))
+            return WD_STATUS_SUCCESS;
+        if (!qwTimeoutNs)
+            return WD_TIME_OUT_EXPIRED;
+
+        qwNow = monotonic_ns();
+        qwDeadline = deadline_ns(qwNow, qwTimeoutNs);
+        while (qwSpinNs && monotonic_ns() - qwNow < qwSpinNs)
+        {
+            if (events_try_take(phOsEvents, dwNumEvents, pdwIndex))
+                return WD_STATUS_SUCCESS;
+        }
+
+        for (;;)
+        {
+            BOOL fExpired, fTaken;
+            int seq;
+
+            /* A signal after the sequence is read changes the sequence, so
+             * the futex wait does not block */
+            __sync_fetch_and_add(&gEventsAnyWaiters, 1);
+            seq = gEventsSeq;
+            OsMemoryBarrier();
+            fTaken = events_try_take(phOsEvents, dwNumEvents, pdwIndex);
+            fExpired = !fTaken &&
+                !futex_wait_until(&gEventsSeq, seq, qwDeadline);
+            __sync_fetch_and_sub(&gEventsAnyWaiters, 1);
+
+            if (fTaken || events_try_take(phOsEvents, dwNumEvents, pdwIndex))
+                return WD_STATUS_SUCCESS;
+            if (fExpired || (qwDeadline != OS_EVENT_INFINITE &&
+                monotonic_ns() >= qwDeadline))
+            {
+                return WD_TIME_OUT_EXPIRED;
+            }
+        }
+    }
+#elif defined(WIN32)
+    {
+        UINT64 qwStart = monotonic_ns(), qwElapsed = 0;
+        DWORD rc;
+
+        for (;;)
+        {
+            rc = WaitForMultipleObjects(dwNumEvents, phOsEvents, FALSE, 0);
+            if (rc != WAIT_TIMEOUT)
+                break;
+            qwElapsed = monotonic_ns() - qwStart;
+            if (qwElapsed >= qwSpinNs)
+            {
+                rc = WaitForMultipleObjects(dwNumEvents, phOsEvents, FALSE,
+                    timeout_ms(qwTimeoutNs == OS_EVENT_INFINITE ?
+                    OS_EVENT_INFINITE :
+                    qwTimeoutNs - MIN(qwElapsed, qwTimeoutNs)));
+                break;
+            }
+        }
+
+        if (rc < WAIT_OBJECT_0 + dwNumEvents)
+        {
+            *pdwIndex = rc - WAIT_OBJECT_0;
+            return WD_STATUS_SUCCESS;
+        }
+
+        return rc == WAIT_TIMEOUT ? WD_TIME_OUT_EXPIRED :
+            WD_SYSTEM_INTERNAL_ERROR;
+    }
+#else
+    return WD_NOT_IMPLEMENTED;
+#endif
+#endif
+}
+
 DWORD DLLCALLCONV OsEventSignal(_In_ HANDLE hOsEvent)
 {
 #if defined(__KERNEL__)
@@ -295,6 +899,30 @@ DWORD DLLCALLCONV OsEventSignal(_In_ HANDLE hOsEvent)
 #if defined(WIN32)
     if (!SetEvent(hOsEvent))
         return WD_SYSTEM_INTERNAL_ERROR;
+#elif defined(LINUX)
+    wd_linux_event_t *linux_event = (wd_linux_event_t *)hOsEvent;
+    /* Sequentially consistent (__sync_lock_test_and_set() is an acquire
+     * barrier only), as is the read of gEventsAnyWaiters below: the signal
+     * must be visible before gEventsAnyWaiters is read, since an
+     * OsEventWaitAny() waiter that is counted afterwards checks the events
+     * before sleeping */
+    int iPrev = __atomic_exchange_n(&linux_event->state, EVENT_SIGNALED,
+        __ATOMIC_SEQ_CST);
+
+    /* A waiter may take and close the event from here on: only the address
+     * of the futex word is passed to the kernel, which does not access a
+     * private futex on wake. All the sleepers are woken, so that those that
+     * do not take the event mark it again before sleeping. */
+    if (iPrev == EVENT_SIGNALED)
+        return WD_STATUS_SUCCESS;
+    if (iPrev == EVENT_CLEAR_WAITERS)
+        futex_wake(&linux_event->state, INT_MAX);
+
+    if (__atomic_load_n(&gEventsAnyWaiters, __ATOMIC_SEQ_CST))
+    {
+        __sync_fetch_and_add(&gEventsSeq, 1);
+        futex_wake(&gEventsSeq, INT_MAX);
+    }
 #elif defined(UNIX)
     wd_linux_event_t *linux_event = (wd_linux_event_t *)hOsEvent;
 
@@ -591,5 +1219,356 @@ DWORD DLLCALLCONV UtilGetFileName(_Out_ PCHAR pcFileName,
         "Please enter the file name", pcDefaultFileName);
 }
 
+/* Lazily formatted messages: argument types */
+enum {
+    LAZY_ARG_INT,       /* int and shorter integers */
+    LAZY_ARG_LONG,
+    LAZY_ARG_LLONG,
+    LAZY_ARG_SIZE,      /* size_t, ptrdiff_t */
+    LAZY_ARG_INTMAX,
+    LAZY_ARG_DOUBLE,
+    LAZY_ARG_LDOUBLE,
+    LAZY_ARG_STR,
+    LAZY_ARG_PTR,
+};
+
+/* Format specification length modifiers */
+enum {
+    LAZY_LEN_NONE,
+    LAZY_LEN_LONG,
+    LAZY_LEN_LLONG,
+    LAZY_LEN_SIZE,
+    LAZY_LEN_INTMAX,
+    LAZY_LEN_LDOUBLE,
+};
+
+/* Parses the conversion specification that follows a '%': returns a pointer
+ * to its conversion character, the number of '*' width/precision arguments
+ * and the length modifier */
+static const CHAR *LazyParseSpec(const CHAR *p, DWORD *pdwStars,
+    DWORD *pdwLen)
+{
+    *pdwStars = 0;
+    *pdwLen = LAZY_LEN_NONE;
+
+    while (*p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0' ||
+        *p == '\'')
+    {
+        p++;
+    }
+    if (*p == '*')
+    {
+        (*pdwStars)++;
+        p++;
+    }
+    while (*p >= '0' && *p <= '9')
+        p++;
+    if (*p == '.')
+    {
+        p++;
+        if (*p == '*')
+        {
+            (*pdwStars)++;
+            p++;
+        }
+        while (*p >= '0' && *p <= '9')
+            p++;
+    }
+
+    if (*p == 'h')
+    {
+        p += (p[1] == 'h') ? 2 : 1;
+    }
+    else if (*p == 'l')
+    {
+        *pdwLen = (p[1] == 'l') ? LAZY_LEN_LLONG : LAZY_LEN_LONG;
+        p += (p[1] == 'l') ? 2 : 1;
+    }
+    else if (*p == 'q' || (*p == 'I' && p[1] == '6' && p[2] == '4'))
+    {
+        *pdwLen = LAZY_LEN_LLONG;
+        p += (*p == 'q') ? 1 : 3;
+    }
+    else if (*p == 'I' && p[1] == '3' && p[2] == '2')
+    {
+        p += 3;
+    }
+    else if (*p == 'j')
+    {
+        *pdwLen = LAZY_LEN_INTMAX;
+        p++;
+    }
+    else if (*p == 'z' || *p == 't' || *p == 'I')
+    {
+        *pdwLen = LAZY_LEN_SIZE;
+        p++;
+    }
+    else if (*p == 'L')
+    {
+        *pdwLen = LAZY_LEN_LDOUBLE;
+        p++;
+    }
+
+    return p;
+}
+
+/* Captures the arguments of a format string. Returns FALSE if the format
+ * string cannot be captured. */
+static BOOL LazyCapture(UTIL_LAZY_MSG *pMsg, const CHAR *sFormat,
+    va_list argp)
+{
+    const CHAR *p;
+
+    for (p = strchr(sFormat, '%'); p; p = strchr(p + 1, '%'))
+    {
+        UTIL_LAZY_MSG_ARG *pArg;
+        DWORD dwStars, dwLen;
+
+        if (*++p == '%')
+            continue;
+
+        p = LazyParseSpec(p, &dwStars, &dwLen);
+        if (pMsg->dwNumArgs + dwStars + 1 > UTIL_LAZY_MSG_MAX_ARGS)
+            return FALSE;
+
+        for (; dwStars; dwStars--)
+        {
+            pArg = &pMsg->args[pMsg->dwNumArgs++];
+            pArg->dwType = LAZY_ARG_INT;
+            pArg->u.i = va_arg(argp, int);
+        }
+
+        pArg = &pMsg->args[pMsg->dwNumArgs++];
+        switch (*p)
+        {
+        case 'd':
+        case 'i':
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+        case 'c':
+            if (*p == 'c' && dwLen != LAZY_LEN_NONE)
+                return FALSE;
+            if (dwLen == LAZY_LEN_LONG)
+            {
+                pArg->dwType = LAZY_ARG_LONG;
+                pArg->u.i = va_arg(argp, long);
+            }
+            else if (dwLen == LAZY_LEN_LLONG)
+            {
+                pArg->dwType = LAZY_ARG_LLONG;
+                pArg->u.i = va_arg(argp, long long);
+            }
+            else if (dwLen == LAZY_LEN_SIZE)
+            {
+                pArg->dwType = LAZY_ARG_SIZE;
+                pArg->u.i = (long long)va_arg(argp, size_t);
+            }
+            else if (dwLen == LAZY_LEN_INTMAX)
+            {
+                pArg->dwType = LAZY_ARG_INTMAX;
+                pArg->u.i = (long long)va_arg(argp, intmax_t);
+            }
+            else
+            {
+                pArg->dwType = LAZY_ARG_INT;
+                pArg->u.i = va_arg(argp, int);
+            }
+            break;
+
+        case 'e':
+        case 'E':
+        case 'f':
+        case 'F':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            if (dwLen == LAZY_LEN_LDOUBLE)
+            {
+                pArg->dwType = LAZY_ARG_LDOUBLE;
+                pArg->u.ld = va_arg(argp, long double);
+            }
+            else
+            {
+                pArg->dwType = LAZY_ARG_DOUBLE;
+                pArg->u.d = va_arg(argp, double);
+            }
+            break;
+
+        case 's':
+            {
+                const CHAR *sArg = va_arg(argp, const CHAR *);
+                DWORD dwAvail = sizeof(pMsg->sStrings) - pMsg->dwStrBytes;
+                DWORD dwBytes;
+
+                if (dwLen != LAZY_LEN_NONE)
+                    return FALSE;
+                if (!sArg)
+                    sArg = "(null)";
+
+                pArg->dwType = LAZY_ARG_STR;
+                /* A string that does not fit is formatted as an empty string:
+                 * the terminator of the last copied string */
+                if (!dwAvail)
+                {
+                    pArg->u.dwStrOffset = sizeof(pMsg->sStrings) - 1;
+                    break;
+                }
+
+                pArg->u.dwStrOffset = pMsg->dwStrBytes;
+                dwBytes = (DWORD)strlen(sArg);
+                dwBytes = MIN(dwBytes, dwAvail - 1);
+                memcpy(pMsg->sStrings + pMsg->dwStrBytes, sArg, dwBytes);
+                pMsg->sStrings[pMsg->dwStrBytes + dwBytes] = '\0';
+                pMsg->dwStrBytes += dwBytes + 1;
+                break;
+            }
+
+        case 'p':
+            pArg->dwType = LAZY_ARG_PTR;
+            pArg->u.p = va_arg(argp, void *);
+            break;
+
+        default:
+            /* %n, wide characters/strings and unknown conversions */
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+void DLLCALLCONV UtilLazyMsgSet(_Out_ UTIL_LAZY_MSG *pMsg,
+    _In_ const CHAR *sFormat, _In_ va_list argp)
+{
+    va_list argp1;
+
+    pMsg->dwNumArgs = 0;
+    pMsg->dwStrBytes = 0;
+    pMsg->sFormat = sFormat;
+
+    va_copy(argp1, argp);
+    if (!sFormat || !LazyCapture(pMsg, sFormat, argp1))
+    {
+        /* Format now */
+        pMsg->sFormat = NULL;
+        pMsg->sMsg[0] = '\0';
+        if (sFormat)
+            vsnprintf(pMsg->sMsg, sizeof(pMsg->sMsg) - 1, sFormat, argp);
+        pMsg->sMsg[sizeof(pMsg->sMsg) - 1] = '\0';
+    }
+    va_end(argp1);
+}
+
+const CHAR * DLLCALLCONV UtilLazyMsgGet(_Inout_ UTIL_LAZY_MSG *pMsg)
+{
+    const CHAR *p;
+    DWORD dwLen = 0, dwArg = 0;
+    const DWORD dwMax = sizeof(pMsg->sMsg) - 1;
+
+    if (!pMsg->sFormat)
+        return pMsg->sMsg;
+
+    for (p = pMsg->sFormat; *p && dwLen < dwMax; p++)
+    {
+        CHAR sSpec[32];
+        const CHAR *pEnd;
+        DWORD dwStars, dwLenMod, dwSpecLen = 0;
+        UTIL_LAZY_MSG_ARG *pArg;
+        int rc = 0;
+
+        if (*p != '%')
+        {
+            pMsg->sMsg[dwLen++] = *p;
+            continue;
+        }
+        if (p[1] == '%')
+        {
+            pMsg->sMsg[dwLen++] = '%';
+            p++;
+            continue;
+        }
+
+        /* Copy the specification, replacing '*' with the captured width and
+         * precision */
+        pEnd = LazyParseSpec(p + 1, &dwStars, &dwLenMod);
+        for (; p <= pEnd; p++)
+        {
+            if (dwSpecLen >= sizeof(sSpec) - 12)
+                break;
+
+            if (*p == '*')
+            {
+                dwSpecLen += snprintf(sSpec + dwSpecLen,
+                    sizeof(sSpec) - dwSpecLen, "%d",
+                    (int)pMsg->args[dwArg++].u.i);
+            }
+            else
+            {
+                sSpec[dwSpecLen++] = *p;
+            }
+        }
+        if (p <= pEnd)
+            break; /* Specification too long */
+        sSpec[dwSpecLen] = '\0';
+        p = pEnd;
+
+        pArg = &pMsg->args[dwArg++];
+        switch (pArg->dwType)
+        {
+        case LAZY_ARG_INT:
+            rc = snprintf(pMsg->sMsg + dwLen, dwMax - dwLen, sSpec,
+                (int)pArg->u.i);
+            break;
+        case LAZY_ARG_LONG:
+            rc = snprintf(pMsg->sMsg + dwLen, dwMax - dwLen, sSpec,
+                (long)pArg->u.i);
+            break;
+        case LAZY_ARG_LLONG:
+            rc = snprintf(pMsg->sMsg + dwLen, dwMax - dwLen, sSpec,
+                (long long)pArg->u.i);
+            break;
+        case LAZY_ARG_SIZE:
+            rc = snprintf(pMsg->sMsg + dwLen, dwMax - dwLen, sSpec,
+                (size_t)pArg->u.i);
+            break;
+        case LAZY_ARG_INTMAX:
+            rc = snprintf(pMsg->sMsg + dwLen, dwMax - dwLen, sSpec,
+                (intmax_t)pArg->u.i);
+            break;
+        case LAZY_ARG_DOUBLE:
+            rc = snprintf(pMsg->sMsg + dwLen, dwMax - dwLen, sSpec,
+                pArg->u.d);
+            break;
+        case LAZY_ARG_LDOUBLE:
+            rc = snprintf(pMsg->sMsg + dwLen, dwMax - dwLen, sSpec,
+                pArg->u.ld);
+            break;
+        case LAZY_ARG_STR:
+            rc = snprintf(pMsg->sMsg + dwLen, dwMax - dwLen, sSpec,
+                pMsg->sStrings + pArg->u.dwStrOffset);
+            break;
+        case LAZY_ARG_PTR:
+            rc = snprintf(pMsg->sMsg + dwLen, dwMax - dwLen, sSpec,
+                pArg->u.p);
+            break;
+        }
+
+        /* On truncation, snprintf() returns the required length (or -1 on
+         * Windows) */
+        if (rc < 0 || (DWORD)rc >= dwMax - dwLen)
+            dwLen = dwMax;
+        else
+            dwLen += (DWORD)rc;
+    }
+
+    pMsg->sMsg[dwLen] = '\0';
+    pMsg->sFormat = NULL;
+
+    return pMsg->sMsg;
+}
+
 #endif /* !defined(__KERNEL__) */
 
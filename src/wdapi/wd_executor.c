@@ -0,0 +1,678 @@
+/* Jungo Connectivity Confidential. Copyright (c) 2022 Jungo Connectivity Ltd.  https://www.jungo.com */
+
+/*****************************************************************************
+*  File: wd_executor.c - Implementation of the work-stealing task executor   *
+******************************************************************************/
+
+#include "utils.h"
+#include "windrvr.h"
+
+#if !defined(__KERNEL__) && (!defined(WIN32) || defined(_MT))
+
+#include <stdlib.h>
+#include <string.h>
+#if !defined(WIN32)
+    #include <time.h>
+#endif
+
+/*************************************************************
+  General definitions
+ *************************************************************/
+#if defined(WIN32)
+    #define ATOMIC_INC(lVal) InterlockedIncrement(&(lVal))
+    #define ATOMIC_DEC(lVal) InterlockedDecrement(&(lVal))
+    #define ATOMIC_INC64(qwVal) \
+        InterlockedIncrement64((LONGLONG volatile *)&(qwVal))
+    #define ATOMIC_FETCH_INC64(qwVal) \
+        (InterlockedIncrement64((LONGLONG volatile *)&(qwVal)) - 1)
+#else
+    #define ATOMIC_INC(lVal) __sync_add_and_fetch(&(lVal), 1)
+    #define ATOMIC_DEC(lVal) __sync_sub_and_fetch(&(lVal), 1)
+    #define ATOMIC_INC64(qwVal) __sync_add_and_fetch(&(qwVal), 1)
+    #define ATOMIC_FETCH_INC64(qwVal) __sync_fetch_and_add(&(qwVal), 1)
+#endif
+
+#define EXECUTOR_DEQUE_INIT_CAPACITY 256
+/* Wait of an idle worker between checks of the stop request */
+#define EXECUTOR_IDLE_TIMEOUT_US 100000
+/* Wait of a helping waiter between checks for tasks to execute */
+#define EXECUTOR_HELP_SLICE_US 100
+
+struct EXECUTOR;
+
+typedef struct {
+    HANDLER_FUNC pFunc;
+    void *pData;
+    volatile long lPending; /* 1 until the task is executed */
+    volatile long lRefs;    /* Awaited tasks: the worker and the waiter */
+    HANDLE hDone;           /* Awaited tasks: signaled when executed */
+} EXECUTOR_TASK;
+
+typedef struct {
+    struct EXECUTOR *pExecutor;
+    HANDLE hThread;
+    HANDLE hMutex;            /* Protects the deque */
+    EXECUTOR_TASK **ppTasks;  /* Ring of the deque */
+    DWORD dwCapacity;         /* Power of 2 */
+    DWORD dwHead;             /* Index of the oldest task */
+    volatile DWORD dwCount;
+    HANDLE hEvent;            /* Wakes the worker when it is idle */
+    volatile BOOL fIdle;
+} EXECUTOR_WORKER;
+
+typedef struct EXECUTOR {
+    EXECUTOR_PARAMS params;
+    EXECUTOR_WORKER *pWorkers;
+    volatile BOOL fStop;
+    volatile long lNextWorker; /* Round robin of the submissions of
+                                * non-worker threads */
+    EXECUTOR_STATS stats;
+} EXECUTOR;
+
+/* The worker of the calling thread, if it is an executor worker */
+static OS_THREAD_LOCAL EXECUTOR_WORKER *gpCurrentWorker;
+
+/*************************************************************
+  Deques
+ *************************************************************/
+static DWORD DequePush(EXECUTOR_WORKER *pWorker, EXECUTOR_TASK *pTask)
+{
+    DWORD dwStatus = WD_STATUS_SUCCESS;
+
+    OsMutexLock(pWorker->hMutex);
+    if (pWorker->dwCount == pWorker->dwCapacity)
+    {
+        EXECUTOR_TASK **ppTasks = (EXECUTOR_TASK **)malloc(
+            2 * pWorker->dwCapacity * sizeof(EXECUTOR_TASK *));
+        DWORD i;
+
+        if (!ppTasks)
+        {
+            dwStatus = WD_INSUFFICIENT_RESOURCES;
+            goto Exit;
+        }
+
+        for (i = 0; i < pWorker->dwCount; i++)
+        {
+            ppTasks[i] = pWorker->ppTasks[(pWorker->dwHead + i) &
+                (pWorker->dwCapacity - 1)];
+        }
+
+        free(pWorker->ppTasks);
+        pWorker->ppTasks = ppTasks;
+        pWorker->dwCapacity *= 2;
+        pWorker->dwHead = 0;
+    }
+
+    pWorker->ppTasks[(pWorker->dwHead + pWorker->dwCount) &
+        (pWorker->dwCapacity - 1)] = pTask;
+    pWorker->dwCount++;
+
+Exit:
+    OsMutexUnlock(pWorker->hMutex);
+    return dwStatus;
+}
+
+/* Takes the newest task of a deque (by its worker) */
+static EXECUTOR_TASK *DequePop(EXECUTOR_WORKER *pWorker)
+{
+    EXECUTOR_TASK *pTask = NULL;
+
+    if (!pWorker->dwCount)
+        return NULL;
+
+    OsMutexLock(pWorker->hMutex);
+    if (pWorker->dwCount)
+    {
+        pWorker->dwCount--;
+        pTask = pWorker->ppTasks[(pWorker->dwHead + pWorker->dwCount) &
+            (pWorker->dwCapacity - 1)];
+    }
+    OsMutexUnlock(pWorker->hMutex);
+
+    return pTask;
+}
+
+/* Takes the oldest task of a deque (by another thread) */
+static EXECUTOR_TASK *DequeSteal(EXECUTOR_WORKER *pWorker)
+{
+    EXECUTOR_TASK *pTask = NULL;
+
+    if (!pWorker->dwCount)
+        return NULL;
+
+    OsMutexLock(pWorker->hMutex);
+    if (pWorker->dwCount)
+    {
+        pTask = pWorker->ppTasks[pWorker->dwHead];
+        pWorker->dwHead = (pWorker->dwHead + 1) & (pWorker->dwCapacity - 1);
+        pWorker->dwCount--;
+    }
+    OsMutexUnlock(pWorker->hMutex);
+
+    return pTask;
+}
+
+/*************************************************************
+  Tasks
+ *************************************************************/
+/* Finds a task to execute: from the deque of the calling worker (pSelf, or
+ * NULL for a non-worker thread), or stolen from the other deques */
+static EXECUTOR_TASK *TaskFind(EXECUTOR *pExecutor, EXECUTOR_WORKER *pSelf)
+{
+    DWORD i, dwFirst, dwWorkers = pExecutor->params.dwWorkers;
+    EXECUTOR_TASK *pTask;
+
+    if (pSelf)
+    {
+        pTask = DequePop(pSelf);
+        if (pTask)
+            return pTask;
+    }
+
+    /* Start the steal attempts after the calling worker, to spread the
+     * thieves over the victims */
+    dwFirst = pSelf ? (DWORD)(pSelf - pExecutor->pWorkers) + 1 : 0;
+    for (i = 0; i < dwWorkers; i++)
+    {
+        EXECUTOR_WORKER *pVictim =
+            &pExecutor->pWorkers[(dwFirst + i) % dwWorkers];
+
+        if (pVictim == pSelf)
+            continue;
+
+        pTask = DequeSteal(pVictim);
+        if (pTask)
+        {
+            ATOMIC_INC64(pExecutor->stats.qwSteals);
+            return pTask;
+        }
+    }
+
+    return NULL;
+}
+
+static void TaskRun(EXECUTOR *pExecutor, EXECUTOR_TASK *pTask)
+{
+    pTask->pFunc(pTask->pData);
+    ATOMIC_INC64(pExecutor->stats.qwExecuted);
+
+    if (!pTask->hDone)
+    {
+        free(pTask);
+        return;
+    }
+
+    pTask->lPending = 0;
+    OsEventSignal(pTask->hDone);
+    if (!ATOMIC_DEC(pTask->lRefs))
+    {
+        OsEventClose(pTask->hDone);
+        free(pTask);
+    }
+}
+
+/* Wakes an idle worker to execute a task that was queued to pTarget: pTarget
+ * itself, or another worker that will steal the task */
+static void WorkerWake(EXECUTOR *pExecutor, EXECUTOR_WORKER *pTarget)
+{
+    DWORD i;
+
+    /* The task is queued before the idle flags are read; an idle worker
+     * sets its flag before it checks the deques for the last time */
+    OsMemoryBarrier();
+    if (pTarget->fIdle)
+    {
+        OsEventSignal(pTarget->hEvent);
+        return;
+    }
+
+    for (i = 0; i < pExecutor->params.dwWorkers; i++)
+    {
+        if (pExecutor->pWorkers[i].fIdle)
+        {
+            OsEventSignal(pExecutor->pWorkers[i].hEvent);
+            return;
+        }
+    }
+}
+
+static BOOL ExecutorHasTasks(EXECUTOR *pExecutor)
+{
+    DWORD i;
+
+    for (i = 0; i < pExecutor->params.dwWorkers; i++)
+    {
+        if (pExecutor->pWorkers[i].dwCount)
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+static UINT64 ExecutorTimeUs(void)
+{
+#if defined(WIN32)
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER cnt;
+
+    if (!freq.QuadPart)
+        QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&cnt);
+    return (UINT64)(cnt.QuadPart / freq.QuadPart * 1000000 +
+        cnt.QuadPart % freq.QuadPart * 1000000 / freq.QuadPart);
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (UINT64)ts.tv_sec * 1000000 + (UINT64)ts.tv_nsec / 1000;
+#endif
+}
+
+/* Waits until *plPending is 0 and executes tasks meanwhile. The time-out
+ * includes the time spent executing tasks. */
+static DWORD WaitHelping(EXECUTOR *pExecutor, volatile long *plPending,
+    HANDLE hEvent, UINT64 qwTimeoutUs)
+{
+    EXECUTOR_WORKER *pSelf = gpCurrentWorker &&
+        gpCurrentWorker->pExecutor == pExecutor ? gpCurrentWorker : NULL;
+    UINT64 qwStartUs = qwTimeoutUs == OS_EVENT_INFINITE ? 0 :
+        ExecutorTimeUs();
+
+    while (*plPending)
+    {
+        EXECUTOR_TASK *pTask;
+        UINT64 qwLeftUs = EXECUTOR_HELP_SLICE_US;
+
+        if (qwTimeoutUs != OS_EVENT_INFINITE)
+        {
+            UINT64 qwWaitedUs = ExecutorTimeUs() - qwStartUs;
+
+            if (qwWaitedUs >= qwTimeoutUs)
+                return WD_TIME_OUT_EXPIRED;
+            qwLeftUs = MIN(qwLeftUs, qwTimeoutUs - qwWaitedUs);
+        }
+
+        pTask = TaskFind(pExecutor, pSelf);
+        if (pTask)
+        {
+            TaskRun(pExecutor, pTask);
+            continue;
+        }
+
+        OsEventWaitUs(hEvent, qwLeftUs, 0);
+    }
+
+    return WD_STATUS_SUCCESS;
+}
+
+static void DLLCALLCONV WorkerThread(void *pData)
+{
+    EXECUTOR_WORKER *pWorker = (EXECUTOR_WORKER *)pData;
+    EXECUTOR *pExecutor = pWorker->pExecutor;
+
+    gpCurrentWorker = pWorker;
+    for (;;)
+    {
+        EXECUTOR_TASK *pTask = TaskFind(pExecutor, pWorker);
+
+        if (pTask)
+        {
+            TaskRun(pExecutor, pTask);
+            continue;
+        }
+
+        /* The queued tasks are executed before the worker stops */
+        if (pExecutor->fStop)
+            break;
+
+        pWorker->fIdle = TRUE;
+        OsMemoryBarrier();
+        if (!ExecutorHasTasks(pExecutor) && !pExecutor->fStop)
+        {
+            OsEventWaitUs(pWorker->hEvent, EXECUTOR_IDLE_TIMEOUT_US,
+                pExecutor->params.dwIdleSpinUs);
+            ATOMIC_INC64(pExecutor->stats.qwSleeps);
+        }
+        pWorker->fIdle = FALSE;
+    }
+}
+
+/*************************************************************
+  Parallel for
+ *************************************************************/
+typedef struct {
+    EXECUTOR_FOR_FUNC pFunc;
+    void *pData;
+    UINT64 qwBegin;
+    UINT64 qwEnd;
+    UINT64 qwGrain;
+    UINT64 qwChunks;
+    volatile UINT64 qwNextChunk;
+    volatile long lHelpers; /* Helper tasks that did not complete */
+    volatile long lRefs;    /* Helper tasks and the caller */
+    HANDLE hDone;           /* Signaled by the last helper task */
+} PARALLEL_FOR;
+
+static void ParallelForRun(PARALLEL_FOR *pFor)
+{
+    UINT64 qwChunk;
+
+    while ((qwChunk = ATOMIC_FETCH_INC64(pFor->qwNextChunk)) < pFor->qwChunks)
+    {
+        UINT64 qwBegin = pFor->qwBegin + qwChunk * pFor->qwGrain;
+
+        /* qwBegin + qwGrain may overflow */
+        pFor->pFunc(pFor->pData, qwBegin,
+            qwBegin + MIN(pFor->qwEnd - qwBegin, pFor->qwGrain));
+    }
+}
+
+/* The caller may return as soon as lHelpers is 0, so the state is freed by
+ * whoever releases the last reference, and nothing accesses it after that */
+static void ParallelForRelease(PARALLEL_FOR *pFor)
+{
+    if (ATOMIC_DEC(pFor->lRefs))
+        return;
+
+    if (pFor->hDone)
+        OsEventClose(pFor->hDone);
+    free(pFor);
+}
+
+static void ParallelForHelperDone(PARALLEL_FOR *pFor)
+{
+    if (!ATOMIC_DEC(pFor->lHelpers))
+        OsEventSignal(pFor->hDone);
+    ParallelForRelease(pFor);
+}
+
+static void DLLCALLCONV ParallelForHelper(void *pData)
+{
+    PARALLEL_FOR *pFor = (PARALLEL_FOR *)pData;
+
+    ParallelForRun(pFor);
+    ParallelForHelperDone(pFor);
+}
+
+/*************************************************************
+  Functions implementations
+ *************************************************************/
+static void ExecutorFree(EXECUTOR *pExecutor)
+{
+    DWORD i;
+
+    pExecutor->fStop = TRUE;
+    for (i = 0; i < pExecutor->params.dwWorkers; i++)
+    {
+        if (pExecutor->pWorkers[i].hThread)
+            OsEventSignal(pExecutor->pWorkers[i].hEvent);
+    }
+
+    for (i = 0; i < pExecutor->params.dwWorkers; i++)
+    {
+        EXECUTOR_WORKER *pWorker = &pExecutor->pWorkers[i];
+
+        if (pWorker->hThread)
+            ThreadWait(pWorker->hThread);
+        if (pWorker->hEvent)
+            OsEventClose(pWorker->hEvent);
+        if (pWorker->hMutex)
+            OsMutexClose(pWorker->hMutex);
+        free(pWorker->ppTasks);
+    }
+
+    free(pExecutor->pWorkers);
+    free(pExecutor);
+}
+
+DWORD DLLCALLCONV ExecutorCreate(_In_ const EXECUTOR_PARAMS *pParams,
+    _Outptr_ HANDLE *phExecutor)
+{
+    EXECUTOR *pExecutor;
+    DWORD i, dwCpu = 0, dwStatus = WD_STATUS_SUCCESS;
+
+    if (!phExecutor)
+        return WD_INVALID_PARAMETER;
+    *phExecutor = NULL;
+
+    pExecutor = (EXECUTOR *)calloc(1, sizeof(EXECUTOR));
+    if (!pExecutor)
+        return WD_INSUFFICIENT_RESOURCES;
+
+    if (pParams)
+        pExecutor->params = *pParams;
+    if (!pExecutor->params.dwWorkers)
+        pExecutor->params.dwWorkers = (DWORD)MAX(GetNumberOfProcessors(), 1);
+
+    pExecutor->pWorkers = (EXECUTOR_WORKER *)calloc(
+        pExecutor->params.dwWorkers, sizeof(EXECUTOR_WORKER));
+    if (!pExecutor->pWorkers)
+    {
+        free(pExecutor);
+        return WD_INSUFFICIENT_RESOURCES;
+    }
+
+    /* All the deques exist before the first worker starts stealing */
+    for (i = 0; i < pExecutor->params.dwWorkers; i++)
+    {
+        EXECUTOR_WORKER *pWorker = &pExecutor->pWorkers[i];
+
+        pWorker->pExecutor = pExecutor;
+        pWorker->dwCapacity = EXECUTOR_DEQUE_INIT_CAPACITY;
+        pWorker->ppTasks = (EXECUTOR_TASK **)malloc(
+            pWorker->dwCapacity * sizeof(EXECUTOR_TASK *));
+        if (!pWorker->ppTasks || OsMutexCreate(&pWorker->hMutex) ||
+            OsEventCreate(&pWorker->hEvent))
+        {
+            dwStatus = WD_INSUFFICIENT_RESOURCES;
+            break;
+        }
+    }
+
+    for (i = 0; !dwStatus && i < pExecutor->params.dwWorkers; i++)
+    {
+        EXECUTOR_WORKER *pWorker = &pExecutor->pWorkers[i];
+
+        dwStatus = ThreadStartClass(&pWorker->hThread, THREAD_CLASS_EXECUTOR,
+            WorkerThread, pWorker);
+        if (dwStatus)
+        {
+            pWorker->hThread = NULL;
+            break;
+        }
+
+        /* Pin the workers to the CPUs of the mask, round robin */
+        if (pExecutor->params.qwCpuMask)
+        {
+            while (!(pExecutor->params.qwCpuMask & ((UINT64)1 << dwCpu)))
+                dwCpu = (dwCpu + 1) % 64;
+
+            ThreadSetAffinity(pWorker->hThread, (UINT64)1 << dwCpu);
+            dwCpu = (dwCpu + 1) % 64;
+        }
+    }
+
+    if (dwStatus)
+    {
+        ExecutorFree(pExecutor);
+        return dwStatus;
+    }
+
+    *phExecutor = (HANDLE)pExecutor;
+
+    return WD_STATUS_SUCCESS;
+}
+
+void DLLCALLCONV ExecutorDestroy(_In_ HANDLE hExecutor)
+{
+    if (hExecutor)
+        ExecutorFree((EXECUTOR *)hExecutor);
+}
+
+DWORD DLLCALLCONV ExecutorSubmit(_In_ HANDLE hExecutor,
+    _In_ HANDLER_FUNC pFunc, _In_ void *pData, _Outptr_ HANDLE *phTask)
+{
+    EXECUTOR *pExecutor = (EXECUTOR *)hExecutor;
+    EXECUTOR_WORKER *pTarget;
+    EXECUTOR_TASK *pTask;
+    DWORD dwStatus;
+
+    if (phTask)
+        *phTask = NULL;
+
+    if (!pExecutor || !pFunc)
+        return WD_INVALID_PARAMETER;
+
+    pTask = (EXECUTOR_TASK *)calloc(1, sizeof(EXECUTOR_TASK));
+    if (!pTask)
+        return WD_INSUFFICIENT_RESOURCES;
+
+    pTask->pFunc = pFunc;
+    pTask->pData = pData;
+    pTask->lPending = 1;
+    if (phTask)
+    {
+        if (OsEventCreate(&pTask->hDone))
+        {
+            free(pTask);
+            return WD_INSUFFICIENT_RESOURCES;
+        }
+        pTask->lRefs = 2;
+    }
+
+    /* Tasks of a worker are queued to its own deque, where they are likely
+     * to run while their data is in the worker's cache */
+    if (gpCurrentWorker && gpCurrentWorker->pExecutor == pExecutor)
+    {
+        pTarget = gpCurrentWorker;
+    }
+    else
+    {
+        pTarget = &pExecutor->pWorkers[(DWORD)ATOMIC_INC(
+            pExecutor->lNextWorker) % pExecutor->params.dwWorkers];
+    }
+
+    dwStatus = DequePush(pTarget, pTask);
+    if (dwStatus)
+    {
+        if (pTask->hDone)
+            OsEventClose(pTask->hDone);
+        free(pTask);
+        return dwStatus;
+    }
+
+    ATOMIC_INC64(pExecutor->stats.qwSubmitted);
+    if (phTask)
+        *phTask = (HANDLE)pTask;
+
+    WorkerWake(pExecutor, pTarget);
+
+    return WD_STATUS_SUCCESS;
+}
+
+DWORD DLLCALLCONV ExecutorTaskWait(_In_ HANDLE hTask,
+    _In_ UINT64 qwTimeoutUs)
+{
+    EXECUTOR_TASK *pTask = (EXECUTOR_TASK *)hTask;
+    EXECUTOR *pExecutor;
+    DWORD dwStatus;
+
+    if (!pTask || !pTask->hDone)
+        return WD_INVALID_PARAMETER;
+
+    /* A worker that waits executes tasks of its executor; other threads
+     * only wait */
+    pExecutor = gpCurrentWorker ? gpCurrentWorker->pExecutor : NULL;
+    if (pExecutor)
+    {
+        dwStatus = WaitHelping(pExecutor, &pTask->lPending, pTask->hDone,
+            qwTimeoutUs);
+    }
+    else
+    {
+        dwStatus = pTask->lPending ? OsEventWaitUs(pTask->hDone, qwTimeoutUs,
+            0) : WD_STATUS_SUCCESS;
+    }
+
+    if (dwStatus)
+        return dwStatus;
+
+    if (!ATOMIC_DEC(pTask->lRefs))
+    {
+        OsEventClose(pTask->hDone);
+        free(pTask);
+    }
+
+    return WD_STATUS_SUCCESS;
+}
+
+DWORD DLLCALLCONV ExecutorParallelFor(_In_ HANDLE hExecutor,
+    _In_ UINT64 qwBegin, _In_ UINT64 qwEnd, _In_ UINT64 qwGrain,
+    _In_ EXECUTOR_FOR_FUNC pFunc, _In_ void *pData)
+{
+    EXECUTOR *pExecutor = (EXECUTOR *)hExecutor;
+    PARALLEL_FOR *pFor;
+    DWORD i, dwHelpers;
+
+    if (!pExecutor || !pFunc || qwBegin > qwEnd)
+        return WD_INVALID_PARAMETER;
+
+    if (qwBegin == qwEnd)
+        return WD_STATUS_SUCCESS;
+
+    /* The helper tasks may still access the state after the caller
+     * returns, so it is allocated and reference counted */
+    pFor = (PARALLEL_FOR *)calloc(1, sizeof(PARALLEL_FOR));
+    if (!pFor)
+        return WD_INSUFFICIENT_RESOURCES;
+
+    pFor->pFunc = pFunc;
+    pFor->pData = pData;
+    pFor->qwBegin = qwBegin;
+    pFor->qwEnd = qwEnd;
+    /* By default, each worker and the caller get a few ranges, to balance
+     * ranges of different costs */
+    pFor->qwGrain = qwGrain ? qwGrain :
+        MAX((qwEnd - qwBegin) / ((pExecutor->params.dwWorkers + 1) * 4), 1);
+    pFor->qwChunks = (qwEnd - qwBegin - 1) / pFor->qwGrain + 1;
+
+    dwHelpers = (DWORD)MIN(pFor->qwChunks - 1, pExecutor->params.dwWorkers);
+    if (dwHelpers && OsEventCreate(&pFor->hDone))
+    {
+        pFor->hDone = NULL;
+        dwHelpers = 0;
+    }
+
+    pFor->lHelpers = (long)dwHelpers;
+    pFor->lRefs = (long)dwHelpers + 1;
+    for (i = 0; i < dwHelpers; i++)
+    {
+        /* The caller executes the ranges of the missing helpers */
+        if (ExecutorSubmit(hExecutor, ParallelForHelper, pFor, NULL))
+            ParallelForHelperDone(pFor);
+    }
+
+    ParallelForRun(pFor);
+    if (dwHelpers)
+    {
+        WaitHelping(pExecutor, &pFor->lHelpers, pFor->hDone,
+            OS_EVENT_INFINITE);
+    }
+    ParallelForRelease(pFor);
+
+    return WD_STATUS_SUCCESS;
+}
+
+DWORD DLLCALLCONV ExecutorGetStats(_In_ HANDLE hExecutor,
+    _Out_ EXECUTOR_STATS *pStats)
+{
+    if (!hExecutor || !pStats)
+        return WD_INVALID_PARAMETER;
+
+    *pStats = ((EXECUTOR *)hExecutor)->stats;
+
+    return WD_STATUS_SUCCESS;
+}
+
+#endif
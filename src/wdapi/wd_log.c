@@ -5,10 +5,28 @@
 #endif
 
 #include "windrvr.h"
+#include "wd_log.h"
+#include "utils.h"
 #include <stdio.h>
 
 #if defined(LINUX)
     #include <stdarg.h>
+    #include <sys/syscall.h>
+#endif
+
+#if defined(UNIX)
+    #include <pthread.h>
+    #include <time.h>
+    #include <unistd.h>
+#endif
+
+#if defined(__GNUC__) && (defined(x86_64) || defined(__x86_64__) || \
+    defined(__i386__))
+    #include <x86intrin.h>
+    #define WD_TRACE_HAS_TSC
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    #include <intrin.h>
+    #define WD_TRACE_HAS_TSC
 #endif
 
 FILE *fpWdLog;
@@ -16,6 +34,16 @@ FILE *fpWdLog;
 #define STR(s) ((s) ? (s) : "(null)")
 
 static int print_ioctl_data(DWORD dwIoctl, PVOID src, DWORD src_bytes);
+static BOOL TraceIsActive(void);
+static DWORD TraceFunction(DWORD dwIoctl, HANDLE h, PVOID pParam,
+    DWORD dwSize, BOOL fWait);
+
+/* Trace decode mode: when pDecodeBase is set, print_ioctl_data() formats a
+ * trace record payload (see WD_TraceDecode()), of which only dwDecodeBytes
+ * were captured. Pointer fields are not dereferenced and array loops are
+ * clamped to the captured entries. */
+static BYTE *pDecodeBase;
+static DWORD dwDecodeBytes;
 
 DWORD DLLCALLCONV WD_LogStart(const char *sFileName, const char *sMode)
 {
@@ -43,6 +71,9 @@ DWORD DLLCALLCONV WdFunctionLog(DWORD dwIoctl, HANDLE h, PVOID pParam,
     /* Don't log debug messages - too messy */
     DWORD skip = (dwIoctl == IOCTL_WD_DEBUG_ADD);
 
+    if (TraceIsActive() && !skip)
+        return TraceFunction(dwIoctl, h, pParam, dwSize, fWait);
+
     if (fpWdLog && !skip)
     {
         fprintf(fpWdLog, "\nLogging ioctl %x (%x), handle %p, size %x\n",
@@ -50,7 +81,7 @@ DWORD DLLCALLCONV WdFunctionLog(DWORD dwIoctl, HANDLE h, PVOID pParam,
         print_ioctl_data(dwIoctl, pParam, dwSize);
     }
 
-    rc = WD_FUNCTION_LOCAL(dwIoctl, h, pParam, dwSize, fWait);
+    rc = WD_FUNCTION(dwIoctl, h, pParam, dwSize, fWait);
 
     if (fpWdLog && !skip)
     {
@@ -110,6 +141,24 @@ static VOID WD_LogAddIdented(int ident, const char *sFormat, ...)
 
 #define LOG WD_LogAddIdented
 
+/* Returns the number of array entries to log: all dwNum entries, or in trace
+ * decode mode only the entries that were captured */
+static DWORD log_entries(DWORD dwNum, PVOID pFirst, DWORD dwEntrySize)
+{
+    DWORD dwOffset;
+
+    if (!pDecodeBase)
+        return dwNum;
+
+    dwOffset = (DWORD)((BYTE *)pFirst - pDecodeBase);
+    if (dwOffset >= dwDecodeBytes)
+        return 0;
+
+    return MIN(dwNum, (dwDecodeBytes - dwOffset) / dwEntrySize);
+}
+
+#define LOG_ENTRIES(dwNum, arr) log_entries(dwNum, arr, sizeof((arr)[0]))
+
 static void log_hexbuf(PVOID src, DWORD src_bytes, int ident)
 {
     DWORD i;
@@ -217,7 +266,7 @@ static void log_WD_CARD(WD_CARD *p, int ident)
     DWORD i;
     LOG(ident, "WD_CARD:\n");
     LOG(ident + 1, "dwItems=%x\n", p->dwItems);
-    for (i = 0; i < p->dwItems; i++)
+    for (i = 0; i < LOG_ENTRIES(p->dwItems, p->Item); i++)
     {
         LOG(ident + 1, "[%x]", i);
         log_WD_ITEMS(&p->Item[i], ident + 1);
@@ -257,6 +306,11 @@ static void log_WD_CLEANUP_SETUP(WD_CARD_CLEANUP *p, int ident)
     LOG(ident, "WD_CLEANUP_SETUP:\n");
     LOG(ident + 1, "hCard=%x, dwOptions=%x, dwCmds=%x\n",
         p->hCard, p->dwOptions, p->dwCmds);
+    if (pDecodeBase)
+    {
+        LOG(ident + 1, "Cmd=%p (not captured)\n", p->Cmd);
+        return;
+    }
     for (i = 0; i < p->dwCmds; i++)
     {
         LOG(ident + 1, "[%x]", i);
@@ -329,7 +383,7 @@ static int print_ioctl_data(DWORD dwIoctl, PVOID src, DWORD src_bytes)
             INIT_STRUCT_LOG(WD_IPC_SCAN_PROCS);
             LOG(ident + 1, "hIpc=%ld, dwNumProcs=%ld\n", p->hIpc,
                 p->dwNumProcs);
-            for (i = 0; i < p->dwNumProcs; i++)
+            for (i = 0; i < LOG_ENTRIES(p->dwNumProcs, p->procInfo); i++)
                 log_WD_IPC_PROCESS(&p->procInfo[i], ident + 1);
             break;
         }
@@ -387,7 +441,7 @@ static int print_ioctl_data(DWORD dwIoctl, PVOID src, DWORD src_bytes)
                 "hCard=%x\n", p->dwBytes, p->dwOptions, p->dwPages, p->hCard);
             if (p->hDma)
             {
-                for (i = 0; i < p->dwPages; i++)
+                for (i = 0; i < LOG_ENTRIES(p->dwPages, p->Page); i++)
                 {
                     LOG(ident + 1, "[%x]", i);
                     log_WD_DMA_PAGE(&p->Page[i], ident + 1);
@@ -449,7 +503,9 @@ static int print_ioctl_data(DWORD dwIoctl, PVOID src, DWORD src_bytes)
             INIT_STRUCT_LOG(WD_INTERRUPT);
             LOG(ident + 1, "hInterrupt=%x, dwOptions=%x, dwCmds=%x\n",
                 p->hInterrupt, p->dwOptions, p->dwCmds);
-            for (i = 0; i < p->dwCmds; i++)
+            if (pDecodeBase)
+                LOG(ident + 1, "Cmd=%p (not captured)\n", p->Cmd);
+            for (i = 0; !pDecodeBase && i < p->dwCmds; i++)
             {
                 LOG(ident + 1, "[%x]", i);
                 log_WD_TRANSFER(&p->Cmd[i], ident + 1);
@@ -515,7 +571,7 @@ static int print_ioctl_data(DWORD dwIoctl, PVOID src, DWORD src_bytes)
                 "dwOptions=%x\n", p->searchId.dwVendorId,
                 p->searchId.dwDeviceId, p->dwOptions);
             LOG(ident + 1, "dwCards=%x\n", p->dwCards);
-            for (i = 0; i < p->dwCards; i++)
+            for (i = 0; i < LOG_ENTRIES(p->dwCards, p->cardSlot); i++)
             {
                 LOG(ident + 1, "[%x]", i);
                 log_WD_PCI_ID(&p->cardId[i], ident + 1);
@@ -531,7 +587,7 @@ static int print_ioctl_data(DWORD dwIoctl, PVOID src, DWORD src_bytes)
             LOG(ident + 1, "dwCapID [0x%x], dwOptions [0x%x]\n", p->dwCapId,
                 p->dwOptions);
             LOG(ident + 1, "dwNumCaps [0x%x]\n", p->dwNumCaps);
-            for (i = 0; i < p->dwNumCaps; i++)
+            for (i = 0; i < LOG_ENTRIES(p->dwNumCaps, p->pciCaps); i++)
             {
                 LOG(ident + 1, "[0x%x]", i);
                 log_WD_PCI_CAP(&p->pciCaps[i], ident + 1);
@@ -679,3 +735,507 @@ static int print_ioctl_data(DWORD dwIoctl, PVOID src, DWORD src_bytes)
     return WD_STATUS_SUCCESS;
 }
 
+
+/*************************************************************
+  Binary ioctl tracer
+ *************************************************************/
+/* Each traced thread appends fixed-size binary records to its own ring,
+ * without locking and without formatting. A background flusher thread
+ * writes the rings' records to the trace file; WD_TraceDecode() formats a
+ * trace file offline, using the ioctl data formatters above. */
+
+#define WD_TRACE_MAGIC 0x43525457 /* "WTRC" */
+#define WD_TRACE_VERSION 1
+
+/* Number of parameter bytes captured in each record */
+#define WD_TRACE_PAYLOAD_BYTES 96
+/* Number of records in each thread's ring (must be a power of 2) */
+#define WD_TRACE_RING_RECORDS 2048
+/* Interval between the flusher thread's passes over the rings */
+#define WD_TRACE_FLUSH_INTERVAL_US 1000
+/* Size of the buffer in which WD_TraceDecode() formats a record payload; it
+ * is larger than the ioctl parameter structures formatted by
+ * print_ioctl_data(), so unused fields read as zero */
+#define WD_TRACE_DECODE_BUF_BYTES 0x4000
+
+/* Trace file header */
+typedef struct {
+    UINT32 dwMagic;         /* WD_TRACE_MAGIC */
+    UINT32 dwVersion;       /* WD_TRACE_VERSION */
+    UINT32 dwRecordSize;    /* sizeof(WD_TRACE_RECORD) */
+    UINT32 dwPayloadBytes;  /* WD_TRACE_PAYLOAD_BYTES */
+    UINT64 qwTicksPerSec;   /* Record time stamps frequency */
+} WD_TRACE_FILE_HEADER;
+
+/* Trace record: one traced ioctl */
+typedef struct {
+    UINT64 qwStart;         /* Time stamp before the ioctl */
+    UINT64 qwEnd;           /* Time stamp after the ioctl */
+    UINT64 qwHandle;        /* WinDriver handle */
+    UINT32 dwIoctl;         /* Ioctl code */
+    UINT32 dwStatus;        /* Ioctl return status */
+    UINT32 dwSize;          /* Size of the ioctl parameter */
+    UINT32 dwThreadId;      /* ID of the calling thread */
+    BYTE bPayload[WD_TRACE_PAYLOAD_BYTES]; /* Start of the ioctl parameter,
+                                            * captured after the ioctl */
+} WD_TRACE_RECORD;
+
+/* Per-thread records ring. The thread that owns the ring is its only
+ * producer (advances dwHead); the flusher thread is its only consumer
+ * (advances dwTail). Rings are never freed: when a thread exits, its ring is
+ * released for reuse by a new thread. */
+typedef struct WD_TRACE_RING {
+    struct WD_TRACE_RING *pNext;
+    volatile BOOL fInUse;       /* Owned by a thread */
+    DWORD dwThreadId;
+    UINT64 qwRecords;           /* Producer statistics */
+    UINT64 qwDropped;
+    volatile UINT32 dwHead;
+    BYTE pad1[60];
+    volatile UINT32 dwTail;
+    BYTE pad2[60];
+    WD_TRACE_RECORD records[WD_TRACE_RING_RECORDS];
+} WD_TRACE_RING;
+
+static struct {
+    volatile BOOL fActive;
+    volatile BOOL fStop;
+    BOOL fInitialized;
+    FILE *fp;
+    HANDLE hThread;             /* Flusher thread */
+    HANDLE hMutex;              /* Protects the rings list */
+    WD_TRACE_RING *pRings;
+    UINT64 qwRecords;           /* Statistics of the current/last session, */
+    UINT64 qwDropped;           /* relative to the rings' counters below */
+    UINT64 qwRecordsBase;
+    UINT64 qwDroppedBase;
+#if defined(WIN32)
+    DWORD dwTlsIndex;
+#else
+    pthread_key_t tlsKey;
+#endif
+} gTrace;
+
+static BOOL TraceIsActive(void)
+{
+    return gTrace.fActive;
+}
+
+static UINT64 TraceOsTimeNs(void)
+{
+#if defined(WIN32)
+    LARGE_INTEGER cnt, freq;
+
+    QueryPerformanceCounter(&cnt);
+    QueryPerformanceFrequency(&freq);
+    return (UINT64)(cnt.QuadPart / freq.QuadPart * 1000000000 +
+        cnt.QuadPart % freq.QuadPart * 1000000000 / freq.QuadPart);
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (UINT64)ts.tv_sec * 1000000000 + (UINT64)ts.tv_nsec;
+#endif
+}
+
+static UINT64 TraceTimeStamp(void)
+{
+#if defined(WD_TRACE_HAS_TSC)
+    return __rdtsc();
+#else
+    return TraceOsTimeNs();
+#endif
+}
+
+static void TraceSleepUs(DWORD dwMicroSecs)
+{
+#if defined(WIN32)
+    Sleep((dwMicroSecs + 999) / 1000);
+#else
+    usleep(dwMicroSecs);
+#endif
+}
+
+/* Returns the frequency of TraceTimeStamp() */
+static UINT64 TraceTicksPerSec(void)
+{
+#if defined(WD_TRACE_HAS_TSC)
+    UINT64 qwNs0, qwNs1, qwTsc0, qwTsc1;
+
+    qwNs0 = TraceOsTimeNs();
+    qwTsc0 = TraceTimeStamp();
+    TraceSleepUs(10000);
+    qwNs1 = TraceOsTimeNs();
+    qwTsc1 = TraceTimeStamp();
+
+    if (qwNs1 <= qwNs0)
+        return 1000000000;
+    return (UINT64)((double)(qwTsc1 - qwTsc0) * 1000000000.0 /
+        (double)(qwNs1 - qwNs0));
+#else
+    return 1000000000;
+#endif
+}
+
+static DWORD TraceThreadId(void)
+{
+#if defined(WIN32)
+    return GetCurrentThreadId();
+#elif defined(LINUX)
+    return (DWORD)syscall(SYS_gettid);
+#else
+    return (DWORD)(UPTR)pthread_self();
+#endif
+}
+
+/* Called on thread exit: releases the thread's ring for reuse */
+#if defined(WIN32)
+static VOID WINAPI TraceThreadExit(PVOID pData)
+#else
+static void TraceThreadExit(void *pData)
+#endif
+{
+    WD_TRACE_RING *pRing = (WD_TRACE_RING *)pData;
+
+    if (pRing)
+        pRing->fInUse = FALSE;
+}
+
+/* Returns the calling thread's ring, allocating one on the thread's first
+ * traced ioctl */
+static WD_TRACE_RING *TraceThreadRing(void)
+{
+    WD_TRACE_RING *pRing;
+
+#if defined(WIN32)
+    pRing = (WD_TRACE_RING *)FlsGetValue(gTrace.dwTlsIndex);
+#else
+    pRing = (WD_TRACE_RING *)pthread_getspecific(gTrace.tlsKey);
+#endif
+    if (pRing)
+        return pRing;
+
+    OsMutexLock(gTrace.hMutex);
+    for (pRing = gTrace.pRings; pRing && pRing->fInUse; pRing = pRing->pNext)
+        ;
+    if (!pRing)
+    {
+        pRing = (WD_TRACE_RING *)calloc(1, sizeof(*pRing));
+        if (pRing)
+        {
+            pRing->pNext = gTrace.pRings;
+            gTrace.pRings = pRing;
+        }
+    }
+    if (pRing)
+    {
+        pRing->fInUse = TRUE;
+        pRing->dwThreadId = TraceThreadId();
+    }
+    OsMutexUnlock(gTrace.hMutex);
+
+    if (!pRing)
+        return NULL;
+
+#if defined(WIN32)
+    FlsSetValue(gTrace.dwTlsIndex, pRing);
+#else
+    pthread_setspecific(gTrace.tlsKey, pRing);
+#endif
+    return pRing;
+}
+
+static DWORD TraceFunction(DWORD dwIoctl, HANDLE h, PVOID pParam,
+    DWORD dwSize, BOOL fWait)
+{
+    WD_TRACE_RING *pRing = TraceThreadRing();
+    WD_TRACE_RECORD *pRec;
+    UINT64 qwStart, qwEnd;
+    UINT32 dwHead;
+    DWORD rc;
+
+    qwStart = TraceTimeStamp();
+    rc = WD_FUNCTION(dwIoctl, h, pParam, dwSize, fWait);
+    qwEnd = TraceTimeStamp();
+
+    if (!pRing)
+        return rc;
+
+    dwHead = pRing->dwHead;
+    if (dwHead - pRing->dwTail >= WD_TRACE_RING_RECORDS)
+    {
+        pRing->qwDropped++;
+        return rc;
+    }
+
+    pRec = &pRing->records[dwHead & (WD_TRACE_RING_RECORDS - 1)];
+    pRec->qwStart = qwStart;
+    pRec->qwEnd = qwEnd;
+    pRec->qwHandle = (UINT64)(UPTR)h;
+    pRec->dwIoctl = dwIoctl;
+    pRec->dwStatus = rc;
+    pRec->dwSize = dwSize;
+    pRec->dwThreadId = pRing->dwThreadId;
+    if (pParam)
+        memcpy(pRec->bPayload, pParam, MIN(dwSize, WD_TRACE_PAYLOAD_BYTES));
+
+    /* Publish the record to the flusher */
+    OsMemoryBarrier();
+    pRing->dwHead = dwHead + 1;
+    pRing->qwRecords++;
+
+    return rc;
+}
+
+/* Writes the records pending in all the rings to the trace file */
+static void TraceFlushRings(void)
+{
+    WD_TRACE_RING *pRing;
+
+    OsMutexLock(gTrace.hMutex);
+    for (pRing = gTrace.pRings; pRing; pRing = pRing->pNext)
+    {
+        UINT32 dwTail = pRing->dwTail;
+        UINT32 dwHead = pRing->dwHead;
+
+        OsMemoryBarrier();
+        while (dwTail != dwHead)
+        {
+            UINT32 dwIndex = dwTail & (WD_TRACE_RING_RECORDS - 1);
+            UINT32 dwNum = MIN(dwHead - dwTail,
+                WD_TRACE_RING_RECORDS - dwIndex);
+
+            fwrite(&pRing->records[dwIndex], sizeof(WD_TRACE_RECORD), dwNum,
+                gTrace.fp);
+            dwTail += dwNum;
+        }
+
+        /* Release the written records to the producer */
+        OsMemoryBarrier();
+        pRing->dwTail = dwTail;
+    }
+    OsMutexUnlock(gTrace.hMutex);
+}
+
+static void DLLCALLCONV TraceFlusherThread(void *pData)
+{
+    UNUSED_VAR(pData);
+
+    while (!gTrace.fStop)
+    {
+        TraceFlushRings();
+        TraceSleepUs(WD_TRACE_FLUSH_INTERVAL_US);
+    }
+    TraceFlushRings();
+    fflush(gTrace.fp);
+}
+
+/* Sums the rings' statistics counters */
+static void TraceSumRings(UINT64 *pqwRecords, UINT64 *pqwDropped)
+{
+    WD_TRACE_RING *pRing;
+
+    *pqwRecords = 0;
+    *pqwDropped = 0;
+    for (pRing = gTrace.pRings; pRing; pRing = pRing->pNext)
+    {
+        *pqwRecords += pRing->qwRecords;
+        *pqwDropped += pRing->qwDropped;
+    }
+}
+
+DWORD DLLCALLCONV WD_TraceStart(const char *sFileName)
+{
+    WD_TRACE_FILE_HEADER hdr;
+    WD_TRACE_RING *pRing;
+    DWORD dwStatus;
+
+    if (!sFileName)
+        return WD_INVALID_PARAMETER;
+
+    if (gTrace.fActive)
+        return WD_OPERATION_ALREADY_DONE;
+
+    if (!gTrace.fInitialized)
+    {
+        dwStatus = OsMutexCreate(&gTrace.hMutex);
+        if (dwStatus)
+            return dwStatus;
+#if defined(WIN32)
+        gTrace.dwTlsIndex = FlsAlloc(TraceThreadExit);
+        if (gTrace.dwTlsIndex == FLS_OUT_OF_INDEXES)
+#else
+        if (pthread_key_create(&gTrace.tlsKey, TraceThreadExit))
+#endif
+        {
+            OsMutexClose(gTrace.hMutex);
+            return WD_INSUFFICIENT_RESOURCES;
+        }
+        gTrace.fInitialized = TRUE;
+    }
+
+    gTrace.fp = fopen(sFileName, "wb");
+    if (!gTrace.fp)
+        return WD_SYSTEM_INTERNAL_ERROR;
+
+    BZERO(hdr);
+    hdr.dwMagic = WD_TRACE_MAGIC;
+    hdr.dwVersion = WD_TRACE_VERSION;
+    hdr.dwRecordSize = sizeof(WD_TRACE_RECORD);
+    hdr.dwPayloadBytes = WD_TRACE_PAYLOAD_BYTES;
+    hdr.qwTicksPerSec = TraceTicksPerSec();
+    if (fwrite(&hdr, sizeof(hdr), 1, gTrace.fp) != 1)
+    {
+        fclose(gTrace.fp);
+        gTrace.fp = NULL;
+        return WD_SYSTEM_INTERNAL_ERROR;
+    }
+
+    /* Discard records of ioctls that were still in progress when the
+     * previous session was stopped */
+    OsMutexLock(gTrace.hMutex);
+    for (pRing = gTrace.pRings; pRing; pRing = pRing->pNext)
+        pRing->dwTail = pRing->dwHead;
+    TraceSumRings(&gTrace.qwRecordsBase, &gTrace.qwDroppedBase);
+    OsMutexUnlock(gTrace.hMutex);
+
+    gTrace.fStop = FALSE;
+    dwStatus = ThreadStart(&gTrace.hThread, TraceFlusherThread, NULL);
+    if (dwStatus)
+    {
+        fclose(gTrace.fp);
+        gTrace.fp = NULL;
+        return dwStatus;
+    }
+
+    gTrace.fActive = TRUE;
+
+    return WD_STATUS_SUCCESS;
+}
+
+VOID DLLCALLCONV WD_TraceStop(void)
+{
+    if (!gTrace.fActive)
+        return;
+
+    gTrace.fActive = FALSE;
+    gTrace.fStop = TRUE;
+    ThreadWait(gTrace.hThread);
+    gTrace.hThread = NULL;
+
+    OsMutexLock(gTrace.hMutex);
+    TraceSumRings(&gTrace.qwRecords, &gTrace.qwDropped);
+    OsMutexUnlock(gTrace.hMutex);
+    gTrace.qwRecords -= gTrace.qwRecordsBase;
+    gTrace.qwDropped -= gTrace.qwDroppedBase;
+
+    fclose(gTrace.fp);
+    gTrace.fp = NULL;
+}
+
+DWORD DLLCALLCONV WD_TraceGetStats(WD_TRACE_STATS *pStats)
+{
+    if (!pStats)
+        return WD_INVALID_PARAMETER;
+
+    BZERO(*pStats);
+    if (!gTrace.fInitialized)
+        return WD_STATUS_SUCCESS;
+
+    if (gTrace.fActive)
+    {
+        OsMutexLock(gTrace.hMutex);
+        TraceSumRings(&pStats->qwRecords, &pStats->qwDropped);
+        OsMutexUnlock(gTrace.hMutex);
+        pStats->qwRecords -= gTrace.qwRecordsBase;
+        pStats->qwDropped -= gTrace.qwDroppedBase;
+    }
+    else
+    {
+        pStats->qwRecords = gTrace.qwRecords;
+        pStats->qwDropped = gTrace.qwDropped;
+    }
+
+    return WD_STATUS_SUCCESS;
+}
+
+DWORD DLLCALLCONV WD_TraceDecode(const char *sTraceFileName,
+    const char *sLogFileName)
+{
+    WD_TRACE_FILE_HEADER hdr;
+    WD_TRACE_RECORD rec;
+    FILE *fpTrace, *fpOut, *fpPrevLog;
+    BYTE *pBuf;
+    UINT64 qwFirst = 0, qwRecords = 0;
+    DWORD dwStatus = WD_STATUS_SUCCESS;
+
+    if (!sTraceFileName || !sLogFileName)
+        return WD_INVALID_PARAMETER;
+
+    fpTrace = fopen(sTraceFileName, "rb");
+    if (!fpTrace)
+        return WD_SYSTEM_INTERNAL_ERROR;
+
+    if (fread(&hdr, sizeof(hdr), 1, fpTrace) != 1 ||
+        hdr.dwMagic != WD_TRACE_MAGIC || hdr.dwVersion != WD_TRACE_VERSION ||
+        hdr.dwRecordSize != sizeof(WD_TRACE_RECORD) || !hdr.qwTicksPerSec)
+    {
+        fclose(fpTrace);
+        return WD_INVALID_PARAMETER;
+    }
+
+    pBuf = (BYTE *)malloc(WD_TRACE_DECODE_BUF_BYTES);
+    fpOut = fopen(sLogFileName, "w");
+    if (!pBuf || !fpOut)
+    {
+        dwStatus = pBuf ? WD_SYSTEM_INTERNAL_ERROR : WD_INSUFFICIENT_RESOURCES;
+        goto Exit;
+    }
+
+    /* Direct the ioctl data formatters to the output file */
+    fpPrevLog = fpWdLog;
+    fpWdLog = fpOut;
+
+    while (fread(&rec, sizeof(rec), 1, fpTrace) == 1)
+    {
+        DWORD dwCaptured = MIN(rec.dwSize, WD_TRACE_PAYLOAD_BYTES);
+
+        if (!qwRecords++)
+            qwFirst = rec.qwStart;
+
+        fprintf(fpOut, "\n[+%" PRI64 "u ns] thread %x: ioctl %x (%x), handle "
+            "0x%" PRI64 "x, size %x, returned status %x, took %" PRI64
+            "u ns\n",
+            (UINT64)((double)(rec.qwStart - qwFirst) * 1000000000.0 /
+            (double)hdr.qwTicksPerSec), (UINT32)rec.dwThreadId,
+            (UINT32)rec.dwIoctl, WD_CTL_DECODE_FUNC((UINT32)rec.dwIoctl),
+            rec.qwHandle, (UINT32)rec.dwSize, (UINT32)rec.dwStatus,
+            (UINT64)((double)(rec.qwEnd - rec.qwStart) * 1000000000.0 /
+            (double)hdr.qwTicksPerSec));
+        if (dwCaptured < rec.dwSize)
+        {
+            fprintf(fpOut, "(parameter truncated to the first %x bytes)\n",
+                (UINT32)dwCaptured);
+        }
+
+        memset(pBuf, 0, WD_TRACE_DECODE_BUF_BYTES);
+        memcpy(pBuf, rec.bPayload, dwCaptured);
+        pDecodeBase = pBuf;
+        dwDecodeBytes = dwCaptured;
+        print_ioctl_data(rec.dwIoctl, pBuf, dwCaptured);
+        pDecodeBase = NULL;
+        dwDecodeBytes = 0;
+    }
+
+    fprintf(fpOut, "\n%" PRI64 "u records decoded\n", qwRecords);
+    fpWdLog = fpPrevLog;
+
+Exit:
+    if (fpOut)
+        fclose(fpOut);
+    if (pBuf)
+        free(pBuf);
+    fclose(fpTrace);
+
+    return dwStatus;
+}
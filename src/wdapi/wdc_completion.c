@@ -0,0 +1,474 @@
+/* Jungo Connectivity Confidential. Copyright (c) 2022 Jungo Connectivity Ltd.  https://www.jungo.com */
+
+/*****************************************************************************
+*  File: wdc_completion.c - Implementation of the WDC DMA completion queue   *
+*        API                                                                 *
+******************************************************************************/
+
+#include "utils.h"
+#include "wdc_lib.h"
+#include "wdc_defs.h"
+#include "wdc_err.h"
+#include "wdc_priv.h"
+#include "status_strings.h"
+
+#if !defined(__KERNEL__)
+
+#if defined(WIN32)
+    #include <windows.h>
+#elif defined(LINUX)
+    #include <errno.h>
+    #include <unistd.h>
+    #include <sys/eventfd.h>
+#endif
+
+/*************************************************************
+  General definitions
+ *************************************************************/
+/* The wait handle of a completion queue is signaled as long as the queue is
+ * not empty: it is signaled by the post that finds the queue empty, and
+ * cleared by the reap that empties the queue, both with the queue mutex
+ * locked. Completions that are posted to a non-empty queue cost no system
+ * call. */
+typedef struct WDC_COMPLETION_QUEUE {
+    HANDLE hMutex;
+    WDC_CQ_WAIT_HANDLE hWait;
+    WDC_COMPLETION_ENTRY *pEntries; /* Ring of dwDepth entries */
+    DWORD dwDepth;
+    DWORD dwHead;                   /* Oldest entry */
+    DWORD dwCount;
+    WDC_COMPLETION_QUEUE_STATS stats;
+} WDC_COMPLETION_QUEUE;
+
+/* DMA transaction attached to a completion queue */
+typedef struct CQ_ATTACHMENT {
+    struct CQ_ATTACHMENT *pNext;
+    WD_DMA *pDma;
+    WDC_COMPLETION_QUEUE *pCq;
+    PVOID pCtx;
+} CQ_ATTACHMENT;
+
+#define CQ_ATTACH_BUCKETS 64
+#define CQ_ATTACH_BUCKET(pDma) \
+    ((DWORD)(((UPTR)(pDma) >> 4) % CQ_ATTACH_BUCKETS))
+
+/* Attached DMA transactions, by WD_DMA struct address */
+static CQ_ATTACHMENT *gpAttachments[CQ_ATTACH_BUCKETS];
+static HANDLE ghAttachMutex;
+/* Number of attached DMA transactions: completions are looked up only when
+ * transactions are attached */
+static volatile DWORD gdwAttached;
+
+/*************************************************************
+  Static functions
+ *************************************************************/
+static BOOL WaitHandleCreate(WDC_CQ_WAIT_HANDLE *phWait)
+{
+#if defined(WIN32)
+    /* Manual-reset: signaled until the queue is emptied */
+    *phWait = CreateEvent(NULL, TRUE, FALSE, NULL);
+    return *phWait != NULL;
+#elif defined(LINUX)
+    *phWait = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    return *phWait >= 0;
+#else
+    return FALSE;
+#endif
+}
+
+static void WaitHandleClose(WDC_CQ_WAIT_HANDLE hWait)
+{
+#if defined(WIN32)
+    CloseHandle(hWait);
+#elif defined(LINUX)
+    close(hWait);
+#endif
+}
+
+static void WaitHandleSignal(WDC_CQ_WAIT_HANDLE hWait)
+{
+#if defined(WIN32)
+    SetEvent(hWait);
+#elif defined(LINUX)
+    UINT64 qwVal = 1;
+
+    while (write(hWait, &qwVal, sizeof(qwVal)) < 0 && errno == EINTR)
+        ;
+#endif
+}
+
+static void WaitHandleClear(WDC_CQ_WAIT_HANDLE hWait)
+{
+#if defined(WIN32)
+    ResetEvent(hWait);
+#elif defined(LINUX)
+    UINT64 qwVal;
+
+    while (read(hWait, &qwVal, sizeof(qwVal)) < 0 && errno == EINTR)
+        ;
+#endif
+}
+
+/* Creates the attachments mutex on first use */
+static BOOL AttachMutexInit(void)
+{
+    HANDLE hMutex;
+
+    if (ghAttachMutex)
+        return TRUE;
+
+    if (WD_STATUS_SUCCESS != OsMutexCreate(&hMutex))
+        return FALSE;
+
+#if defined(WIN32)
+    if (InterlockedCompareExchangePointer(&ghAttachMutex, hMutex, NULL))
+#else
+    if (!__sync_bool_compare_and_swap(&ghAttachMutex, NULL, hMutex))
+#endif
+    {
+        /* Created by another thread */
+        OsMutexClose(hMutex);
+    }
+
+    return TRUE;
+}
+
+/* Called with the attachments mutex locked */
+static CQ_ATTACHMENT **AttachmentFind(WD_DMA *pDma)
+{
+    CQ_ATTACHMENT **ppAttach = &gpAttachments[CQ_ATTACH_BUCKET(pDma)];
+
+    while (*ppAttach && (*ppAttach)->pDma != pDma)
+        ppAttach = &(*ppAttach)->pNext;
+
+    return ppAttach;
+}
+
+/* Detaches all the DMA transactions of a completion queue, or one DMA
+ * transaction if pDma is not NULL */
+static void AttachmentsRemove(WDC_COMPLETION_QUEUE *pCq, WD_DMA *pDma)
+{
+    DWORD i, dwLast;
+
+    if (!gdwAttached)
+        return;
+
+    /* A DMA transaction can only be in its own bucket */
+    i = pDma ? CQ_ATTACH_BUCKET(pDma) : 0;
+    dwLast = pDma ? i : CQ_ATTACH_BUCKETS - 1;
+
+    OsMutexLock(ghAttachMutex);
+    for (; i <= dwLast; i++)
+    {
+        CQ_ATTACHMENT **ppAttach = &gpAttachments[i];
+
+        while (*ppAttach)
+        {
+            CQ_ATTACHMENT *pAttach = *ppAttach;
+
+            if ((pCq && pAttach->pCq == pCq) || pAttach->pDma == pDma)
+            {
+                *ppAttach = pAttach->pNext;
+                free(pAttach);
+                gdwAttached--;
+            }
+            else
+            {
+                ppAttach = &pAttach->pNext;
+            }
+        }
+    }
+    OsMutexUnlock(ghAttachMutex);
+}
+
+/*************************************************************
+  Functions implementations
+ *************************************************************/
+DWORD DLLCALLCONV WDC_CompletionQueueCreate(_In_ DWORD dwDepth,
+    _Outptr_ WDC_COMPLETION_QUEUE_HANDLE *phCq)
+{
+    WDC_COMPLETION_QUEUE *pCq;
+    DWORD dwStatus;
+
+    if (!WdcIsValidPtr(phCq, "NULL address of completion queue handle"))
+    {
+        WDC_Err("WDC_CompletionQueueCreate: %s", WdcGetLastErrStr());
+        return WD_INVALID_PARAMETER;
+    }
+
+    *phCq = NULL;
+
+    if (!dwDepth)
+    {
+        WDC_Err("WDC_CompletionQueueCreate: Invalid queue depth (0)\n");
+        return WD_INVALID_PARAMETER;
+    }
+
+    if (!AttachMutexInit())
+    {
+        WDC_Err("WDC_CompletionQueueCreate: Failed creating mutex\n");
+        return WD_INSUFFICIENT_RESOURCES;
+    }
+
+    pCq = (WDC_COMPLETION_QUEUE *)calloc(1, sizeof(WDC_COMPLETION_QUEUE));
+    if (!pCq)
+    {
+        WDC_Err("WDC_CompletionQueueCreate: Failed memory allocation\n");
+        return WD_INSUFFICIENT_RESOURCES;
+    }
+
+    pCq->dwDepth = dwDepth;
+    pCq->pEntries = (WDC_COMPLETION_ENTRY *)malloc(dwDepth *
+        sizeof(WDC_COMPLETION_ENTRY));
+    if (!pCq->pEntries)
+    {
+        WDC_Err("WDC_CompletionQueueCreate: Failed memory allocation\n");
+        dwStatus = WD_INSUFFICIENT_RESOURCES;
+        goto Error;
+    }
+
+    dwStatus = OsMutexCreate(&pCq->hMutex);
+    if (WD_STATUS_SUCCESS != dwStatus)
+    {
+        WDC_Err("WDC_CompletionQueueCreate: Failed creating mutex. "
+            "Error 0x%lx - %s\n", dwStatus, Stat2Str(dwStatus));
+        goto Error;
+    }
+
+    if (!WaitHandleCreate(&pCq->hWait))
+    {
+        WDC_Err("WDC_CompletionQueueCreate: Failed creating wait handle\n");
+        OsMutexClose(pCq->hMutex);
+        dwStatus = WD_INSUFFICIENT_RESOURCES;
+        goto Error;
+    }
+
+    *phCq = pCq;
+
+    return WD_STATUS_SUCCESS;
+
+Error:
+    if (pCq->pEntries)
+        free(pCq->pEntries);
+    free(pCq);
+    return dwStatus;
+}
+
+DWORD DLLCALLCONV WDC_CompletionQueueDestroy(
+    _In_ WDC_COMPLETION_QUEUE_HANDLE hCq)
+{
+    WDC_COMPLETION_QUEUE *pCq = (WDC_COMPLETION_QUEUE *)hCq;
+
+    if (!WdcIsValidPtr(pCq, "NULL completion queue handle"))
+    {
+        WDC_Err("WDC_CompletionQueueDestroy: %s", WdcGetLastErrStr());
+        return WD_INVALID_PARAMETER;
+    }
+
+    AttachmentsRemove(pCq, NULL);
+
+    if (pCq->dwCount)
+    {
+        WDC_Trace("WDC_CompletionQueueDestroy: Dropping %ld completions\n",
+            pCq->dwCount);
+    }
+
+    WaitHandleClose(pCq->hWait);
+    OsMutexClose(pCq->hMutex);
+    free(pCq->pEntries);
+    free(pCq);
+
+    return WD_STATUS_SUCCESS;
+}
+
+DWORD DLLCALLCONV WDC_CompletionQueueGetWaitHandle(
+    _In_ WDC_COMPLETION_QUEUE_HANDLE hCq, _Out_ WDC_CQ_WAIT_HANDLE *phWait)
+{
+    WDC_COMPLETION_QUEUE *pCq = (WDC_COMPLETION_QUEUE *)hCq;
+
+    if (!WdcIsValidPtr(pCq, "NULL completion queue handle") ||
+        !WdcIsValidPtr(phWait, "NULL address of wait handle"))
+    {
+        WDC_Err("WDC_CompletionQueueGetWaitHandle: %s", WdcGetLastErrStr());
+        return WD_INVALID_PARAMETER;
+    }
+
+    *phWait = pCq->hWait;
+
+    return WD_STATUS_SUCCESS;
+}
+
+DWORD DLLCALLCONV WDC_CompletionQueueAttach(
+    _In_ WDC_COMPLETION_QUEUE_HANDLE hCq, _In_ WD_DMA *pDma, _In_ PVOID pCtx)
+{
+    WDC_COMPLETION_QUEUE *pCq = (WDC_COMPLETION_QUEUE *)hCq;
+    CQ_ATTACHMENT **ppAttach;
+
+    if (!WdcIsValidPtr(pCq, "NULL completion queue handle") ||
+        !WdcIsValidPtr(pDma, "NULL pointer to DMA struct"))
+    {
+        WDC_Err("WDC_CompletionQueueAttach: %s", WdcGetLastErrStr());
+        return WD_INVALID_PARAMETER;
+    }
+
+    if (!(pDma->dwOptions & DMA_TRANSACTION))
+    {
+        WDC_Err("WDC_CompletionQueueAttach: Not a DMA transaction\n");
+        return WD_INVALID_PARAMETER;
+    }
+
+    OsMutexLock(ghAttachMutex);
+    ppAttach = AttachmentFind(pDma);
+    if (!*ppAttach)
+    {
+        *ppAttach = (CQ_ATTACHMENT *)calloc(1, sizeof(CQ_ATTACHMENT));
+        if (!*ppAttach)
+        {
+            OsMutexUnlock(ghAttachMutex);
+            WDC_Err("WDC_CompletionQueueAttach: Failed memory allocation\n");
+            return WD_INSUFFICIENT_RESOURCES;
+        }
+
+        (*ppAttach)->pDma = pDma;
+        gdwAttached++;
+    }
+    (*ppAttach)->pCq = pCq;
+    (*ppAttach)->pCtx = pCtx;
+    OsMutexUnlock(ghAttachMutex);
+
+    return WD_STATUS_SUCCESS;
+}
+
+DWORD DLLCALLCONV WDC_CompletionQueueDetach(_In_ WD_DMA *pDma)
+{
+    if (!WdcIsValidPtr(pDma, "NULL pointer to DMA struct"))
+    {
+        WDC_Err("WDC_CompletionQueueDetach: %s", WdcGetLastErrStr());
+        return WD_INVALID_PARAMETER;
+    }
+
+    AttachmentsRemove(NULL, pDma);
+
+    return WD_STATUS_SUCCESS;
+}
+
+DWORD DLLCALLCONV WDC_CompletionQueuePost(
+    _In_ WDC_COMPLETION_QUEUE_HANDLE hCq, _In_ WD_DMA *pDma, _In_ PVOID pCtx,
+    _In_ DWORD dwStatus)
+{
+    WDC_COMPLETION_QUEUE *pCq = (WDC_COMPLETION_QUEUE *)hCq;
+    WDC_COMPLETION_ENTRY *pEntry;
+
+    if (!WdcIsValidPtr(pCq, "NULL completion queue handle"))
+    {
+        WDC_Err("WDC_CompletionQueuePost: %s", WdcGetLastErrStr());
+        return WD_INVALID_PARAMETER;
+    }
+
+    OsMutexLock(pCq->hMutex);
+    if (pCq->dwCount == pCq->dwDepth)
+    {
+        pCq->stats.qwOverflows++;
+        OsMutexUnlock(pCq->hMutex);
+        WDC_Err("WDC_CompletionQueuePost: Completion queue is full (%ld "
+            "entries)\n", pCq->dwDepth);
+        return WD_INSUFFICIENT_RESOURCES;
+    }
+
+    pEntry = &pCq->pEntries[(pCq->dwHead + pCq->dwCount) % pCq->dwDepth];
+    pEntry->pDma = pDma;
+    pEntry->pCtx = pCtx;
+    pEntry->dwStatus = dwStatus;
+
+    if (!pCq->dwCount++)
+    {
+        WaitHandleSignal(pCq->hWait);
+        pCq->stats.qwSignals++;
+    }
+    pCq->stats.qwPosted++;
+    OsMutexUnlock(pCq->hMutex);
+
+    return WD_STATUS_SUCCESS;
+}
+
+DWORD DLLCALLCONV WDC_CompletionQueueReap(
+    _In_ WDC_COMPLETION_QUEUE_HANDLE hCq,
+    _Out_ WDC_COMPLETION_ENTRY *pEntries, _In_ DWORD dwMaxEntries,
+    _Out_ DWORD *pdwEntries)
+{
+    WDC_COMPLETION_QUEUE *pCq = (WDC_COMPLETION_QUEUE *)hCq;
+    DWORD i, dwEntries;
+
+    if (!WdcIsValidPtr(pCq, "NULL completion queue handle") ||
+        !WdcIsValidPtr(pEntries, "NULL pointer to entries array") ||
+        !WdcIsValidPtr(pdwEntries, "NULL pointer to number of entries"))
+    {
+        WDC_Err("WDC_CompletionQueueReap: %s", WdcGetLastErrStr());
+        return WD_INVALID_PARAMETER;
+    }
+
+    OsMutexLock(pCq->hMutex);
+    dwEntries = MIN(pCq->dwCount, dwMaxEntries);
+    for (i = 0; i < dwEntries; i++)
+    {
+        pEntries[i] = pCq->pEntries[pCq->dwHead];
+        pCq->dwHead = (pCq->dwHead + 1) % pCq->dwDepth;
+    }
+
+    pCq->dwCount -= dwEntries;
+    if (dwEntries && !pCq->dwCount)
+        WaitHandleClear(pCq->hWait);
+    pCq->stats.qwReaped += dwEntries;
+    OsMutexUnlock(pCq->hMutex);
+
+    *pdwEntries = dwEntries;
+
+    return WD_STATUS_SUCCESS;
+}
+
+DWORD DLLCALLCONV WDC_CompletionQueueGetStats(
+    _In_ WDC_COMPLETION_QUEUE_HANDLE hCq,
+    _Out_ WDC_COMPLETION_QUEUE_STATS *pStats)
+{
+    WDC_COMPLETION_QUEUE *pCq = (WDC_COMPLETION_QUEUE *)hCq;
+
+    if (!WdcIsValidPtr(pCq, "NULL completion queue handle") ||
+        !WdcIsValidPtr(pStats, "NULL pointer to statistics"))
+    {
+        WDC_Err("WDC_CompletionQueueGetStats: %s", WdcGetLastErrStr());
+        return WD_INVALID_PARAMETER;
+    }
+
+    OsMutexLock(pCq->hMutex);
+    *pStats = pCq->stats;
+    OsMutexUnlock(pCq->hMutex);
+
+    return WD_STATUS_SUCCESS;
+}
+
+/*
+ * WDC library internal functions
+ */
+void WdcCompletionQueueNotify(WD_DMA *pDma, DWORD dwStatus)
+{
+    CQ_ATTACHMENT *pAttach;
+
+    if (!gdwAttached || !pDma)
+        return;
+
+    /* Post with the attachments mutex locked, so that the queue is not
+     * destroyed meanwhile */
+    OsMutexLock(ghAttachMutex);
+    pAttach = *AttachmentFind(pDma);
+    if (pAttach)
+        WDC_CompletionQueuePost(pAttach->pCq, pDma, pAttach->pCtx, dwStatus);
+    OsMutexUnlock(ghAttachMutex);
+}
+
+void WdcCompletionQueueDetach(WD_DMA *pDma)
+{
+    if (pDma)
+        AttachmentsRemove(NULL, pDma);
+}
+
+#endif /* !defined(__KERNEL__) */
@@ -9,19 +9,66 @@
 #include "wdc_lib.h"
 #include "wdc_defs.h"
 #include "wdc_err.h"
+#include "wdc_priv.h"
 #include "status_strings.h"
 
 #if !defined (__KERNEL__)
+#if defined(WIN32)
+    #include <windows.h>
+#else
+    #include <sys/mman.h>
+
+    #if !defined(MAP_HUGETLB)
+        #define MAP_HUGETLB 0x40000
+    #endif
+    #if !defined(MAP_HUGE_SHIFT)
+        #define MAP_HUGE_SHIFT 26
+    #endif
+#endif
+
+#if defined(WIN32)
+    #define SYNC_STAT_INC(qwCounter) \
+        InterlockedIncrement64((LONGLONG volatile *)&(qwCounter))
+#else
+    #define SYNC_STAT_INC(qwCounter) __sync_fetch_and_add(&(qwCounter), 1)
+#endif
+
+/* DMA cache coherence of the platform -- see WdcDMACoherenceInit() */
+static BOOL gfDmaCoherent = FALSE;
+/* Skip the synchronization of all the DMA buffers (WDC_DMA_COHERENT=1) */
+static BOOL gfDmaSyncForceElide = FALSE;
+static WDC_DMA_SYNC_STATS gSyncStats;
+
+/* Huge page sizes to try in WDC_DMAHugeBufAlloc(), largest first */
+static const struct {
+    UINT64 qwPageSize;
+    DWORD dwPageShift;
+} gHugePageSizes[] = {
+    { 0x40000000, 30 },     /* 1GB */
+    { 0x200000, 21 }        /* 2MB */
+};
+
+#define ROUND_UP(qwVal, qwAlign) \
+    (((qwVal) + (qwAlign) - 1) / (qwAlign) * (qwAlign))
+
+/* Number of segments of up to dwMaxSegSize bytes in dwBytes */
+#define SEGS_COUNT(dwBytes, dwMaxSegSize) \
+    ((dwBytes) / (dwMaxSegSize) + ((dwBytes) % (dwMaxSegSize) ? 1 : 0))
+
 /*
  * Static and inline functions implementations
  */
+/* dwPrivBytes: Size of caller private data to allocate before the DMA struct
+ * (multiple of sizeof(UINT64)); see WdcDMABufLockPriv() */
 static DWORD DMABufLock(PWDC_DEVICE pDev, PHYS_ADDR qwAddr, PVOID *ppBuf,
     DWORD dwOptions, DWORD dwDMABufSize, WD_DMA **ppDma, DWORD dwAlignment,
-    DWORD dwMaxTransferSize, DWORD dwTransferElementSize)
+    DWORD dwMaxTransferSize, DWORD dwTransferElementSize, DWORD dwPrivBytes)
 {
     DWORD dwStatus;
     WD_DMA *pDma;
+    BYTE *pBlock;
     DWORD dwPagesNeeded = 0, dwAllocSize;
+    WDC_NUMA_SCOPE numaScope;
     BOOL fIsSG = !(dwOptions & DMA_KERNEL_BUFFER_ALLOC);
     BOOL fReserved = (dwOptions & DMA_RESERVED_MEM);
     BOOL fTransaction = (dwOptions & DMA_TRANSACTION);
@@ -58,14 +105,15 @@ static DWORD DMABufLock(PWDC_DEVICE pDev, PHYS_ADDR qwAddr, PVOID *ppBuf,
         }
     }
 
-    pDma = (WD_DMA *)malloc(dwAllocSize);
-    if (!pDma)
+    pBlock = (BYTE *)malloc(dwPrivBytes + dwAllocSize);
+    if (!pBlock)
     {
         WdcSetLastErrStr("Failed allocating memory for a DMA struct\n");
         return WD_INSUFFICIENT_RESOURCES;
     }
 
-    memset(pDma, 0, dwAllocSize);
+    memset(pBlock, 0, dwPrivBytes + dwAllocSize);
+    pDma = (WD_DMA *)(pBlock + dwPrivBytes);
     pDma->dwBytes = dwDMABufSize;
     pDma->dwOptions = dwOptions;
     pDma->hCard = pDev ? WDC_GET_CARD_HANDLE(pDev) : 0;
@@ -78,6 +126,14 @@ static DWORD DMABufLock(PWDC_DEVICE pDev, PHYS_ADDR qwAddr, PVOID *ppBuf,
             pDma->dwPages = dwPagesNeeded;
     }
 
+    /* Allocate the buffer on the NUMA node of the device: user buffers are
+     * bound to the node, and kernel buffers are allocated by the kernel on
+     * the node of the CPU that requests them */
+    if (fIsSG)
+        WdcNumaMemBind(*ppBuf, dwDMABufSize, WdcNumaNodeGet(pDev));
+    WdcNumaScopeEnter(fIsSG || fReserved ? WDC_NUMA_NODE_ANY :
+        WdcNumaNodeGet(pDev), &numaScope);
+
     if (fTransaction)
     {
         if (fIsSG)
@@ -101,9 +157,11 @@ static DWORD DMABufLock(PWDC_DEVICE pDev, PHYS_ADDR qwAddr, PVOID *ppBuf,
         dwStatus = WD_DMALock(WDC_GetWDHandle(), pDma);
     }
 
+    WdcNumaScopeLeave(&numaScope);
+
     if (WD_STATUS_SUCCESS != dwStatus)
     {
-        free(pDma);
+        free(pBlock);
         WdcSetLastErrStr("Error 0x%lx - %s\n", dwStatus, Stat2Str(dwStatus));
         return dwStatus;
     }
@@ -117,6 +175,117 @@ static DWORD DMABufLock(PWDC_DEVICE pDev, PHYS_ADDR qwAddr, PVOID *ppBuf,
     return WD_STATUS_SUCCESS;
 }
 
+/* Number of WD_DMA_PAGE entries allocated for a DMA struct by DMABufLock() */
+static DWORD DMAPagesCapacity(WD_DMA *pDma)
+{
+    if (pDma->dwOptions & DMA_LARGE_BUFFER)
+        return ((pDma->dwBytes + GetPageSize() - 1) / GetPageSize()) + 1;
+
+    return WD_DMA_PAGES;
+}
+
+#if defined(LINUX)
+/* Returns TRUE if a file contains a string (in its first 64KB) */
+static BOOL FileContains(const CHAR *sFileName, const CHAR *sStr)
+{
+    static CHAR sBuf[0x10000];
+    FILE *fp = fopen(sFileName, "r");
+    size_t bytes;
+
+    if (!fp)
+        return FALSE;
+
+    bytes = fread(sBuf, 1, sizeof(sBuf) - 1, fp);
+    fclose(fp);
+    sBuf[bytes] = '\0';
+
+    return strstr(sBuf, sStr) != NULL;
+}
+#endif
+
+/* Returns TRUE if all DMA is bounced through swiotlb buffers, which requires
+ * the CPU/device synchronization even on cache-coherent platforms */
+static BOOL DMABounceBuffersForced(void)
+{
+#if defined(LINUX)
+    return FileContains("/proc/cmdline", "swiotlb=force") ||
+        /* Confidential computing guests DMA through shared bounce buffers */
+        FileContains("/proc/cpuinfo", " tdx_guest") ||
+        (FileContains("/proc/cpuinfo", " hypervisor") &&
+        FileContains("/proc/cpuinfo", " sev"));
+#else
+    return FALSE;
+#endif
+}
+
+/* Returns TRUE if the synchronization of a DMA buffer can be replaced by a
+ * memory barrier: on a cache-coherent platform, contiguous buffers are
+ * allocated coherent, and Scatter/Gather buffers are not bounced as long as
+ * the device can address all of the memory */
+static inline BOOL DMASyncIsElided(WD_DMA *pDma)
+{
+    if (gfDmaSyncForceElide)
+        return TRUE;
+
+    return gfDmaCoherent && (pDma->dwOptions &
+        (DMA_KERNEL_BUFFER_ALLOC | DMA_ALLOW_64BIT_ADDRESS));
+}
+
+static DWORD DMASync(WD_DMA *pDma, BOOL fIsCpu, const CHAR *sFunc)
+{
+    DWORD dwStatus;
+
+    if (!WdcIsValidPtr(pDma, "NULL pointer to DMA struct"))
+    {
+        WDC_Err("%s: %s", sFunc, WdcGetLastErrStr());
+        return WD_INVALID_PARAMETER;
+    }
+
+    if (DMASyncIsElided(pDma))
+    {
+        OsMemoryBarrier();
+        if (fIsCpu)
+            SYNC_STAT_INC(gSyncStats.qwCpuElided);
+        else
+            SYNC_STAT_INC(gSyncStats.qwIoElided);
+
+        return WD_STATUS_SUCCESS;
+    }
+
+    if (fIsCpu)
+    {
+        SYNC_STAT_INC(gSyncStats.qwCpuSyncs);
+        dwStatus = WD_DMASyncCpu(WDC_GetWDHandle(), pDma);
+    }
+    else
+    {
+        SYNC_STAT_INC(gSyncStats.qwIoSyncs);
+        dwStatus = WD_DMASyncIo(WDC_GetWDHandle(), pDma);
+    }
+
+    if (WD_STATUS_SUCCESS != dwStatus)
+    {
+        WDC_Err("%s: Failed synchronizing DMA buffer. Error 0x%lx - %s\n",
+            sFunc, dwStatus, Stat2Str(dwStatus));
+    }
+
+    return dwStatus;
+}
+
+static DWORD DMASyncRange(WD_DMA *pDma, DWORD dwOffset, DWORD dwBytes,
+    BOOL fIsCpu, const CHAR *sFunc)
+{
+    if (pDma && ((UINT64)dwOffset + dwBytes > pDma->dwBytes || !dwBytes))
+    {
+        WDC_Err("%s: Invalid range (offset 0x%lx, 0x%lx bytes) of a 0x%lx "
+            "bytes DMA buffer\n", sFunc, dwOffset, dwBytes, pDma->dwBytes);
+        return WD_INVALID_PARAMETER;
+    }
+
+    /* The driver synchronizes entire buffers */
+    return DMASync(pDma, fIsCpu, sFunc);
+}
+
 typedef enum
 {
     TRANSACTION_EXECUTE,
@@ -222,7 +391,7 @@ DWORD DLLCALLCONV WDC_DMATransactionInit(WDC_DEVICE_HANDLE hDev, PVOID *ppBuf,
 
     dwStatus = DMABufLock((PWDC_DEVICE)hDev, 0, ppBuf, dwOptions,
         dwDMABufSize, ppDma, dwAlignment, dwMaxTransferSize,
-        dwTransferElementSize);
+        dwTransferElementSize, 0);
     if (dwStatus != WD_STATUS_SUCCESS)
     {
         WDC_Err("%s: Failed initializing DMA transaction. %s\n", __FUNCTION__,
@@ -272,7 +441,12 @@ DWORD DLLCALLCONV WDC_DMATransferCompletedAndCheck(_Inout_ WD_DMA *pDma,
     _In_ BOOL fRunCallback)
 {
     DWORD dwStatus = WDC_DMATransaction(pDma, TRANSFER_COMPLETED_AND_CHECK);
-    if (dwStatus == WD_MORE_PROCESSING_REQUIRED && fRunCallback)
+
+    /* The transaction is complete (or failed) */
+    if (dwStatus != (DWORD)WD_MORE_PROCESSING_REQUIRED)
+        WdcCompletionQueueNotify(pDma, dwStatus);
+
+    if (dwStatus == (DWORD)WD_MORE_PROCESSING_REQUIRED && fRunCallback)
     {
         if (pDma->DMATransactionCallback)
         {
@@ -298,7 +472,10 @@ DWORD DLLCALLCONV WDC_DMATransactionUninit(_In_ WD_DMA *pDma)
     DWORD dwStatus = WDC_DMATransaction(pDma, TRANSACTION_UNINIT);
 
     if (pDma)
+    {
+        WdcCompletionQueueDetach(pDma);
         free(pDma);
+    }
 
     return dwStatus;
 }
@@ -312,7 +489,7 @@ DWORD DLLCALLCONV WDC_DMAContigBufLock(_In_ WDC_DEVICE_HANDLE hDev,
     dwOptions |= DMA_KERNEL_BUFFER_ALLOC;
 
     dwStatus = DMABufLock((PWDC_DEVICE)hDev, 0, ppBuf, dwOptions, dwDMABufSize,
-        ppDma, 0, 0, 0);
+        ppDma, 0, 0, 0, 0);
     if (WD_STATUS_SUCCESS != dwStatus)
         WDC_Err("WDC_DMAContigBufLock: %s", WdcGetLastErrStr());
 
@@ -333,13 +510,137 @@ DWORD DLLCALLCONV WDC_DMASGBufLock(_In_ WDC_DEVICE_HANDLE hDev,
     }
 
     dwStatus = DMABufLock((PWDC_DEVICE)hDev, 0, &pBuf, dwOptions, dwDMABufSize,
-        ppDma, 0 ,0 ,0);
+        ppDma, 0, 0, 0, 0);
     if (WD_STATUS_SUCCESS != dwStatus)
         WDC_Err("WDC_DMASGBufLock: %s\n", WdcGetLastErrStr());
 
     return dwStatus;
 }
 
+DWORD DLLCALLCONV WDC_DMASGBufLockEx(_In_ WDC_DEVICE_HANDLE hDev,
+    _In_ PVOID pBuf, _In_ DWORD dwOptions, _In_ DWORD dwDMABufSize,
+    _In_ DWORD dwMaxSegSize, _Outptr_ WD_DMA **ppDma)
+{
+    DWORD dwStatus;
+
+    if (dwMaxSegSize && dwMaxSegSize < (DWORD)GetPageSize())
+    {
+        WDC_Err("WDC_DMASGBufLockEx: Maximum segment size (0x%lx) is smaller "
+            "than the page size\n", dwMaxSegSize);
+        return WD_INVALID_PARAMETER;
+    }
+
+    dwStatus = WDC_DMASGBufLock(hDev, pBuf, dwOptions, dwDMABufSize, ppDma);
+    if (WD_STATUS_SUCCESS != dwStatus)
+        return dwStatus;
+
+    dwStatus = WdcDMAPagesSplit(*ppDma, dwMaxSegSize);
+    if (WD_STATUS_SUCCESS != dwStatus)
+    {
+        WDC_Err("WDC_DMASGBufLockEx: %s", WdcGetLastErrStr());
+        WDC_DMABufUnlock(*ppDma);
+        *ppDma = NULL;
+    }
+
+    return dwStatus;
+}
+
+DWORD DLLCALLCONV WDC_DMAHugeBufAlloc(_In_ DWORD dwBytes,
+    _Out_ WDC_DMA_HUGE_BUF *pHugeBuf)
+{
+    UINT64 qwMapBytes;
+    PVOID pBuf = NULL;
+    DWORD i;
+
+    if (!WdcIsValidPtr(pHugeBuf, "NULL pointer to huge buffer information") ||
+        !dwBytes)
+    {
+        WDC_Err("WDC_DMAHugeBufAlloc: Invalid parameters\n");
+        return WD_INVALID_PARAMETER;
+    }
+
+    BZERO(*pHugeBuf);
+
+    for (i = 0; i < sizeof(gHugePageSizes) / sizeof(gHugePageSizes[0]); i++)
+    {
+        UINT64 qwPageSize = gHugePageSizes[i].qwPageSize;
+
+        if (dwBytes < qwPageSize)
+            continue;
+
+        qwMapBytes = ROUND_UP((UINT64)dwBytes, qwPageSize);
+#if defined(WIN32)
+        /* Windows supports a single large page size, and requires the
+         * SeLockMemoryPrivilege privilege */
+        if (GetLargePageMinimum() != qwPageSize)
+            continue;
+        pBuf = VirtualAlloc(NULL, (SIZE_T)qwMapBytes,
+            MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES, PAGE_READWRITE);
+#else
+        pBuf = mmap(NULL, (size_t)qwMapBytes, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB |
+            (gHugePageSizes[i].dwPageShift << MAP_HUGE_SHIFT), -1, 0);
+        if (pBuf == MAP_FAILED)
+            pBuf = NULL;
+#endif
+        if (pBuf)
+        {
+            pHugeBuf->dwPageSize = (DWORD)qwPageSize;
+            goto Exit;
+        }
+
+        WDC_Trace("WDC_DMAHugeBufAlloc: No free %ldKB huge pages for a "
+            "0x%lx bytes buffer\n", (DWORD)(qwPageSize >> 10), dwBytes);
+    }
+
+    /* Fall back to regular pages */
+    qwMapBytes = ROUND_UP((UINT64)dwBytes, (UINT64)GetPageSize());
+#if defined(WIN32)
+    pBuf = VirtualAlloc(NULL, (SIZE_T)qwMapBytes, MEM_COMMIT | MEM_RESERVE,
+        PAGE_READWRITE);
+#else
+    pBuf = mmap(NULL, (size_t)qwMapBytes, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pBuf == MAP_FAILED)
+    {
+        pBuf = NULL;
+    }
+    #if defined(MADV_HUGEPAGE)
+    else if (qwMapBytes >= gHugePageSizes[1].qwPageSize)
+    {
+        /* Let transparent huge pages back the buffer, when available */
+        madvise(pBuf, (size_t)qwMapBytes, MADV_HUGEPAGE);
+    }
+    #endif
+#endif
+    if (!pBuf)
+    {
+        WDC_Err("WDC_DMAHugeBufAlloc: Failed allocating 0x%lx bytes\n",
+            dwBytes);
+        return WD_INSUFFICIENT_RESOURCES;
+    }
+    pHugeBuf->dwPageSize = (DWORD)GetPageSize();
+
+Exit:
+    pHugeBuf->pBuf = pBuf;
+    pHugeBuf->qwMapBytes = qwMapBytes;
+
+    return WD_STATUS_SUCCESS;
+}
+
+void DLLCALLCONV WDC_DMAHugeBufFree(_In_ WDC_DMA_HUGE_BUF *pHugeBuf)
+{
+    if (!pHugeBuf || !pHugeBuf->pBuf)
+        return;
+
+#if defined(WIN32)
+    VirtualFree(pHugeBuf->pBuf, 0, MEM_RELEASE);
+#else
+    munmap(pHugeBuf->pBuf, (size_t)pHugeBuf->qwMapBytes);
+#endif
+    BZERO(*pHugeBuf);
+}
+
 DWORD DLLCALLCONV WDC_DMAReservedBufLock(_In_ WDC_DEVICE_HANDLE hDev,
     _In_ PHYS_ADDR qwAddr, _Outptr_ PVOID *ppBuf, _In_ DWORD dwOptions,
     _In_ DWORD dwDMABufSize, _Outptr_ WD_DMA **ppDma)
@@ -350,7 +651,7 @@ DWORD DLLCALLCONV WDC_DMAReservedBufLock(_In_ WDC_DEVICE_HANDLE hDev,
     dwOptions |= DMA_KERNEL_BUFFER_ALLOC;
 
     dwStatus = DMABufLock((PWDC_DEVICE)hDev, qwAddr, ppBuf, dwOptions,
-        dwDMABufSize, ppDma, 0, 0, 0);
+        dwDMABufSize, ppDma, 0, 0, 0, 0);
     if (WD_STATUS_SUCCESS != dwStatus)
         WDC_Err("WDC_DMAReservedBufLock: %s\n", WdcGetLastErrStr());
 
@@ -359,24 +660,38 @@ DWORD DLLCALLCONV WDC_DMAReservedBufLock(_In_ WDC_DEVICE_HANDLE hDev,
 
 DWORD DLLCALLCONV WDC_DMASyncCpu(_In_ WD_DMA *pDma)
 {
-    DWORD dwStatus;
+    return DMASync(pDma, TRUE, "WDC_DMASyncCpu");
+}
 
-    dwStatus = WD_DMASyncCpu(WDC_GetWDHandle(), pDma);
-    if (WD_STATUS_SUCCESS != dwStatus)
-        WDC_Err("WDC_DMASyncCpu: %s\n", WdcGetLastErrStr());
+DWORD DLLCALLCONV WDC_DMASyncIo(_In_ WD_DMA *pDma)
+{
+    return DMASync(pDma, FALSE, "WDC_DMASyncIo");
+}
 
-    return dwStatus;
+DWORD DLLCALLCONV WDC_DMASyncCpuRange(_In_ WD_DMA *pDma, _In_ DWORD dwOffset,
+    _In_ DWORD dwBytes)
+{
+    return DMASyncRange(pDma, dwOffset, dwBytes, TRUE, "WDC_DMASyncCpuRange");
 }
 
-DWORD DLLCALLCONV WDC_DMASyncIo(_In_ WD_DMA *pDma)
+DWORD DLLCALLCONV WDC_DMASyncIoRange(_In_ WD_DMA *pDma, _In_ DWORD dwOffset,
+    _In_ DWORD dwBytes)
 {
-    DWORD dwStatus;
+    return DMASyncRange(pDma, dwOffset, dwBytes, FALSE, "WDC_DMASyncIoRange");
+}
 
-    dwStatus = WD_DMASyncIo(WDC_GetWDHandle(), pDma);
-    if (WD_STATUS_SUCCESS != dwStatus)
-        WDC_Err("WDC_DMASyncIo: %s\n", WdcGetLastErrStr());
+DWORD DLLCALLCONV WDC_DMAGetSyncStats(_Out_ WDC_DMA_SYNC_STATS *pStats)
+{
+    if (!WdcIsValidPtr(pStats, "NULL pointer to statistics"))
+    {
+        WDC_Err("WDC_DMAGetSyncStats: %s", WdcGetLastErrStr());
+        return WD_INVALID_PARAMETER;
+    }
 
-    return dwStatus;
+    *pStats = gSyncStats;
+    pStats->fCoherent = gfDmaCoherent || gfDmaSyncForceElide;
+
+    return WD_STATUS_SUCCESS;
 }
 
 DWORD DLLCALLCONV WDC_DMABufGet(_In_ DWORD hDma, _Outptr_ WD_DMA **ppDma)
@@ -424,14 +739,100 @@ DWORD DLLCALLCONV WDC_DMABufGet(_In_ DWORD hDma, _Outptr_ WD_DMA **ppDma)
 
 DWORD DLLCALLCONV WDC_DMABufUnlock(_In_ WD_DMA *pDma)
 {
-    DWORD dwStatus = WD_STATUS_SUCCESS;
-
     if (!WdcIsValidPtr(pDma, "NULL pointer to DMA struct"))
     {
         WDC_Err("WDC_DMABufUnlock: %s\n", WdcGetLastErrStr());
         return WD_INVALID_PARAMETER;
     }
 
+    return WdcDMABufUnlockPriv(pDma, 0);
+}
+
+/*
+ * WDC library internal functions
+ */
+void WdcDMACoherenceInit(void)
+{
+    const CHAR *sEnv = getenv("WDC_DMA_COHERENT");
+
+    gfDmaSyncForceElide = FALSE;
+    if (sEnv && *sEnv)
+    {
+        gfDmaCoherent = strcmp(sEnv, "0") ? TRUE : FALSE;
+        gfDmaSyncForceElide = gfDmaCoherent;
+        WDC_Trace("WdcDMACoherenceInit: DMA synchronization %s by "
+            "WDC_DMA_COHERENT\n", gfDmaCoherent ? "skipped" : "forced");
+        return;
+    }
+
+#if defined(x86) || defined(x86_64) || defined(__i386__) || \
+    defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+    gfDmaCoherent = !DMABounceBuffersForced();
+#else
+    gfDmaCoherent = FALSE;
+#endif
+
+    WDC_Trace("WdcDMACoherenceInit: DMA is %scache-coherent\n",
+        gfDmaCoherent ? "" : "not ");
+}
+
+DWORD WdcDMABufLockPriv(PWDC_DEVICE pDev, PVOID *ppBuf, DWORD dwOptions,
+    DWORD dwDMABufSize, WD_DMA **ppDma, DWORD dwPrivBytes)
+{
+    return DMABufLock(pDev, 0, ppBuf, dwOptions, dwDMABufSize, ppDma, 0, 0, 0,
+        dwPrivBytes);
+}
+
+DWORD WdcDMAPagesSplit(WD_DMA *pDma, DWORD dwMaxSegSize)
+{
+    DWORD i, dwPages, dwNewPages = 0;
+
+    if (!dwMaxSegSize)
+        return WD_STATUS_SUCCESS;
+
+    for (i = 0; i < pDma->dwPages; i++)
+    {
+        dwNewPages += SEGS_COUNT(pDma->Page[i].dwBytes, dwMaxSegSize);
+    }
+
+    if (dwNewPages == pDma->dwPages)
+        return WD_STATUS_SUCCESS;
+
+    if (dwNewPages > DMAPagesCapacity(pDma))
+    {
+        WdcSetLastErrStr("Splitting the DMA pages to 0x%lx bytes segments "
+            "requires %ld pages\n", dwMaxSegSize, dwNewPages);
+        return WD_INSUFFICIENT_RESOURCES;
+    }
+
+    /* Split in place, from the last page backwards: the destination index is
+     * never lower than the source index */
+    dwPages = dwNewPages;
+    for (i = pDma->dwPages; i-- > 0;)
+    {
+        DMA_ADDR pPhysicalAddr = pDma->Page[i].pPhysicalAddr;
+        DWORD dwBytes = pDma->Page[i].dwBytes;
+        DWORD dwSegs = SEGS_COUNT(dwBytes, dwMaxSegSize);
+
+        while (dwSegs--)
+        {
+            DWORD dwOffset = dwSegs * dwMaxSegSize;
+
+            dwPages--;
+            pDma->Page[dwPages].pPhysicalAddr = pPhysicalAddr + dwOffset;
+            pDma->Page[dwPages].dwBytes = dwBytes - dwOffset;
+            dwBytes = dwOffset;
+        }
+    }
+    pDma->dwPages = dwNewPages;
+
+    return WD_STATUS_SUCCESS;
+}
+
+DWORD WdcDMABufUnlockPriv(WD_DMA *pDma, DWORD dwPrivBytes)
+{
+    DWORD dwStatus = WD_STATUS_SUCCESS;
+
     if (pDma->hDma)
     {
         dwStatus = WD_DMAUnlock(WDC_GetWDHandle(), pDma);
@@ -443,7 +844,7 @@ DWORD DLLCALLCONV WDC_DMABufUnlock(_In_ WD_DMA *pDma)
         }
     }
 
-    free(pDma);
+    free((BYTE *)pDma - dwPrivBytes);
 
     return dwStatus;
 }
@@ -0,0 +1,317 @@
+/* Jungo Connectivity Confidential. Copyright (c) 2022 Jungo Connectivity Ltd.  https://www.jungo.com */
+
+/*****************************************************************************
+*  File: wdc_dma_pipeline.c - Implementation of the WDC DMA segments         *
+*        pipeline API                                                        *
+******************************************************************************/
+
+#include "utils.h"
+#include "wdc_lib.h"
+#include "wdc_defs.h"
+#include "wdc_err.h"
+#include "status_strings.h"
+
+#if !defined(__KERNEL__)
+
+/*************************************************************
+  General definitions
+ *************************************************************/
+/* Segment of the buffer: pages [dwFirstPage, dwFirstPage + dwPages) of the
+ * pipeline's page list */
+typedef struct {
+    UINT64 qwOffset;
+    DWORD dwBytes;
+    DWORD dwFirstPage;
+    DWORD dwPages;
+} PIPELINE_SEG;
+
+typedef struct WDC_DMA_PIPELINE {
+    HANDLE hMutex;
+    WD_DMA *pDma;
+    WDC_DMA_SEG_PROGRAM_FUNC funcProgram;
+    PVOID pCtx;
+    DWORD dwDepth;
+    WD_DMA_PAGE *pPages;    /* Pages of all the segments */
+    PIPELINE_SEG *pSegs;
+    DWORD dwSegs;
+    DWORD dwNextSeg;        /* Next segment to program */
+    DWORD dwCompletedSegs;
+    DWORD dwStatus;         /* First programming error */
+} WDC_DMA_PIPELINE;
+
+/*************************************************************
+  Static functions
+ *************************************************************/
+/* Splits the pages of a DMA buffer into segments of up to dwMaxTransferSize
+ * bytes; pages that cross a segment boundary are split */
+static DWORD SegmentsBuild(WDC_DMA_PIPELINE *pPipe, DWORD dwMaxTransferSize)
+{
+    WD_DMA *pDma = pPipe->pDma;
+    UINT64 qwTotal = 0, qwOffset = 0;
+    DWORD i, dwMaxSegs, dwPages = 0, dwSegBytes = 0;
+    PIPELINE_SEG *pSeg = NULL;
+
+    for (i = 0; i < pDma->dwPages; i++)
+        qwTotal += pDma->Page[i].dwBytes;
+
+    if (!qwTotal || (qwTotal + dwMaxTransferSize - 1) / dwMaxTransferSize >
+        0xFFFFFFFF - pDma->dwPages)
+    {
+        return WD_INVALID_PARAMETER;
+    }
+
+    dwMaxSegs = (DWORD)((qwTotal + dwMaxTransferSize - 1) / dwMaxTransferSize);
+    pPipe->pSegs = (PIPELINE_SEG *)calloc(dwMaxSegs, sizeof(PIPELINE_SEG));
+    /* Each segment boundary splits at most one page */
+    pPipe->pPages = (WD_DMA_PAGE *)malloc((pDma->dwPages + dwMaxSegs) *
+        sizeof(WD_DMA_PAGE));
+    if (!pPipe->pSegs || !pPipe->pPages)
+        return WD_INSUFFICIENT_RESOURCES;
+
+    for (i = 0; i < pDma->dwPages; i++)
+    {
+        DMA_ADDR addr = pDma->Page[i].pPhysicalAddr;
+        DWORD dwLeft = pDma->Page[i].dwBytes;
+
+        while (dwLeft)
+        {
+            DWORD dwChunk;
+
+            if (!pSeg || dwSegBytes == dwMaxTransferSize)
+            {
+                pSeg = &pPipe->pSegs[pPipe->dwSegs++];
+                pSeg->qwOffset = qwOffset;
+                pSeg->dwFirstPage = dwPages;
+                dwSegBytes = 0;
+            }
+
+            dwChunk = MIN(dwLeft, dwMaxTransferSize - dwSegBytes);
+            pPipe->pPages[dwPages].pPhysicalAddr = addr;
+            pPipe->pPages[dwPages].dwBytes = dwChunk;
+            dwPages++;
+
+            pSeg->dwPages++;
+            pSeg->dwBytes += dwChunk;
+            dwSegBytes += dwChunk;
+            qwOffset += dwChunk;
+            addr += dwChunk;
+            dwLeft -= dwChunk;
+        }
+    }
+
+    return WD_STATUS_SUCCESS;
+}
+
+/* Programs the next segments, up to the in-flight depth. Called with the
+ * pipeline mutex locked. */
+static void SegmentsProgram(WDC_DMA_PIPELINE *pPipe)
+{
+    while (WD_STATUS_SUCCESS == pPipe->dwStatus &&
+        pPipe->dwNextSeg < pPipe->dwSegs &&
+        pPipe->dwNextSeg - pPipe->dwCompletedSegs < pPipe->dwDepth)
+    {
+        PIPELINE_SEG *pSeg = &pPipe->pSegs[pPipe->dwNextSeg];
+        WDC_DMA_SEGMENT seg;
+
+        seg.dwIndex = pPipe->dwNextSeg;
+        seg.qwOffset = pSeg->qwOffset;
+        seg.dwBytes = pSeg->dwBytes;
+        seg.dwPages = pSeg->dwPages;
+        seg.pPages = &pPipe->pPages[pSeg->dwFirstPage];
+        seg.fLast = pPipe->dwNextSeg == pPipe->dwSegs - 1;
+
+        pPipe->dwStatus = pPipe->funcProgram(pPipe->pCtx, pPipe->pDma, &seg);
+        if (WD_STATUS_SUCCESS != pPipe->dwStatus)
+        {
+            WDC_Err("WDC_DMAPipeline: Failed programming segment %ld. "
+                "Error 0x%lx - %s\n", seg.dwIndex, pPipe->dwStatus,
+                Stat2Str(pPipe->dwStatus));
+            break;
+        }
+
+        pPipe->dwNextSeg++;
+    }
+}
+
+/*************************************************************
+  Functions implementations
+ *************************************************************/
+DWORD DLLCALLCONV WDC_DMAPipelineCreate(_In_ WD_DMA *pDma,
+    _In_ DWORD dwMaxTransferSize, _In_ DWORD dwDepth,
+    _In_ WDC_DMA_SEG_PROGRAM_FUNC funcProgram, _In_ PVOID pCtx,
+    _Outptr_ WDC_DMA_PIPELINE_HANDLE *phPipe)
+{
+    WDC_DMA_PIPELINE *pPipe;
+    DWORD dwStatus;
+
+    if (!WdcIsValidPtr(phPipe, "NULL address of DMA pipeline handle") ||
+        !WdcIsValidPtr(pDma, "NULL pointer to DMA struct") ||
+        !WdcIsValidPtr(funcProgram, "NULL segment programming function"))
+    {
+        WDC_Err("WDC_DMAPipelineCreate: %s", WdcGetLastErrStr());
+        return WD_INVALID_PARAMETER;
+    }
+
+    *phPipe = NULL;
+
+    if (!dwMaxTransferSize || !dwDepth)
+    {
+        WDC_Err("WDC_DMAPipelineCreate: Invalid maximum transfer size (0x%lx) "
+            "or depth (%ld)\n", dwMaxTransferSize, dwDepth);
+        return WD_INVALID_PARAMETER;
+    }
+
+    if (pDma->dwOptions & DMA_TRANSACTION)
+    {
+        WDC_Err("WDC_DMAPipelineCreate: DMA transactions are segmented by "
+            "WDC_DMATransferCompletedAndCheck()\n");
+        return WD_INVALID_PARAMETER;
+    }
+
+    pPipe = (WDC_DMA_PIPELINE *)calloc(1, sizeof(WDC_DMA_PIPELINE));
+    if (!pPipe)
+    {
+        WDC_Err("WDC_DMAPipelineCreate: Failed memory allocation\n");
+        return WD_INSUFFICIENT_RESOURCES;
+    }
+
+    pPipe->pDma = pDma;
+    pPipe->funcProgram = funcProgram;
+    pPipe->pCtx = pCtx;
+    pPipe->dwDepth = dwDepth;
+
+    dwStatus = SegmentsBuild(pPipe, dwMaxTransferSize);
+    if (WD_STATUS_SUCCESS != dwStatus)
+    {
+        WDC_Err("WDC_DMAPipelineCreate: Failed splitting the DMA buffer into "
+            "segments. Error 0x%lx - %s\n", dwStatus, Stat2Str(dwStatus));
+        goto Error;
+    }
+
+    dwStatus = OsMutexCreate(&pPipe->hMutex);
+    if (WD_STATUS_SUCCESS != dwStatus)
+    {
+        WDC_Err("WDC_DMAPipelineCreate: Failed creating mutex. "
+            "Error 0x%lx - %s\n", dwStatus, Stat2Str(dwStatus));
+        goto Error;
+    }
+
+    /* Nothing to program until WDC_DMAPipelineStart() */
+    pPipe->dwNextSeg = pPipe->dwCompletedSegs = pPipe->dwSegs;
+
+    WDC_Trace("WDC_DMAPipelineCreate: %ld segments, depth %ld\n",
+        pPipe->dwSegs, dwDepth);
+
+    *phPipe = pPipe;
+
+    return WD_STATUS_SUCCESS;
+
+Error:
+    if (pPipe->pSegs)
+        free(pPipe->pSegs);
+    if (pPipe->pPages)
+        free(pPipe->pPages);
+    free(pPipe);
+    return dwStatus;
+}
+
+DWORD DLLCALLCONV WDC_DMAPipelineDestroy(_In_ WDC_DMA_PIPELINE_HANDLE hPipe)
+{
+    WDC_DMA_PIPELINE *pPipe = (WDC_DMA_PIPELINE *)hPipe;
+
+    if (!WdcIsValidPtr(pPipe, "NULL DMA pipeline handle"))
+    {
+        WDC_Err("WDC_DMAPipelineDestroy: %s", WdcGetLastErrStr());
+        return WD_INVALID_PARAMETER;
+    }
+
+    OsMutexClose(pPipe->hMutex);
+    free(pPipe->pSegs);
+    free(pPipe->pPages);
+    free(pPipe);
+
+    return WD_STATUS_SUCCESS;
+}
+
+DWORD DLLCALLCONV WDC_DMAPipelineStart(_In_ WDC_DMA_PIPELINE_HANDLE hPipe)
+{
+    WDC_DMA_PIPELINE *pPipe = (WDC_DMA_PIPELINE *)hPipe;
+    DWORD dwStatus;
+
+    if (!WdcIsValidPtr(pPipe, "NULL DMA pipeline handle"))
+    {
+        WDC_Err("WDC_DMAPipelineStart: %s", WdcGetLastErrStr());
+        return WD_INVALID_PARAMETER;
+    }
+
+    OsMutexLock(pPipe->hMutex);
+    if (pPipe->dwCompletedSegs < pPipe->dwNextSeg)
+    {
+        OsMutexUnlock(pPipe->hMutex);
+        WDC_Err("WDC_DMAPipelineStart: Segments are in flight\n");
+        return WD_OPERATION_FAILED;
+    }
+
+    pPipe->dwNextSeg = pPipe->dwCompletedSegs = 0;
+    pPipe->dwStatus = WD_STATUS_SUCCESS;
+    SegmentsProgram(pPipe);
+    dwStatus = pPipe->dwStatus;
+    OsMutexUnlock(pPipe->hMutex);
+
+    return dwStatus;
+}
+
+DWORD DLLCALLCONV WDC_DMAPipelineSegmentDone(
+    _In_ WDC_DMA_PIPELINE_HANDLE hPipe, _Out_ BOOL *pfDone)
+{
+    WDC_DMA_PIPELINE *pPipe = (WDC_DMA_PIPELINE *)hPipe;
+    DWORD dwStatus;
+
+    if (!WdcIsValidPtr(pPipe, "NULL DMA pipeline handle") ||
+        !WdcIsValidPtr(pfDone, "NULL pointer to done flag"))
+    {
+        WDC_Err("WDC_DMAPipelineSegmentDone: %s", WdcGetLastErrStr());
+        return WD_INVALID_PARAMETER;
+    }
+
+    OsMutexLock(pPipe->hMutex);
+    if (pPipe->dwCompletedSegs == pPipe->dwNextSeg)
+    {
+        OsMutexUnlock(pPipe->hMutex);
+        WDC_Err("WDC_DMAPipelineSegmentDone: No segment is in flight\n");
+        return WD_OPERATION_FAILED;
+    }
+
+    pPipe->dwCompletedSegs++;
+    SegmentsProgram(pPipe);
+    dwStatus = pPipe->dwStatus;
+    *pfDone = pPipe->dwCompletedSegs == pPipe->dwSegs ||
+        (WD_STATUS_SUCCESS != dwStatus &&
+        pPipe->dwCompletedSegs == pPipe->dwNextSeg);
+    OsMutexUnlock(pPipe->hMutex);
+
+    return dwStatus;
+}
+
+DWORD DLLCALLCONV WDC_DMAPipelineGetInfo(_In_ WDC_DMA_PIPELINE_HANDLE hPipe,
+    _Out_ DWORD *pdwSegments, _Out_ DWORD *pdwCompleted)
+{
+    WDC_DMA_PIPELINE *pPipe = (WDC_DMA_PIPELINE *)hPipe;
+
+    if (!WdcIsValidPtr(pPipe, "NULL DMA pipeline handle") ||
+        !WdcIsValidPtr(pdwSegments, "NULL pointer to number of segments") ||
+        !WdcIsValidPtr(pdwCompleted, "NULL pointer to completed segments"))
+    {
+        WDC_Err("WDC_DMAPipelineGetInfo: %s", WdcGetLastErrStr());
+        return WD_INVALID_PARAMETER;
+    }
+
+    OsMutexLock(pPipe->hMutex);
+    *pdwSegments = pPipe->dwSegs;
+    *pdwCompleted = pPipe->dwCompletedSegs;
+    OsMutexUnlock(pPipe->hMutex);
+
+    return WD_STATUS_SUCCESS;
+}
+
+#endif /* !defined(__KERNEL__) */
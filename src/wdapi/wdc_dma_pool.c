@@ -0,0 +1,550 @@
+/* Jungo Connectivity Confidential. Copyright (c) 2022 Jungo Connectivity Ltd.  https://www.jungo.com */
+
+/*****************************************************************************
+*  File: wdc_dma_pool.c - Implementation of the WDC DMA buffers pool API     *
+******************************************************************************/
+
+#include "utils.h"
+#include "wdc_lib.h"
+#include "wdc_defs.h"
+#include "wdc_err.h"
+#include "wdc_priv.h"
+#include "status_strings.h"
+
+#if !defined(__KERNEL__)
+
+/*************************************************************
+  General definitions
+ *************************************************************/
+struct DMA_POOL_CLASS;
+
+/* Pool information of a DMA buffer, allocated immediately before its WD_DMA
+ * struct -- see WdcDMABufLockPriv() */
+typedef struct DMA_POOL_BUF {
+    struct DMA_POOL_BUF *pNext;     /* Free buffers: next free buffer of the
+                                     * size class. Buffers in use: next
+                                     * buffer in use of the hash bucket. */
+    struct DMA_POOL_CLASS *pClass;
+    WDC_DMA_HUGE_BUF userBuf;       /* Scatter/Gather buffers: user-mode
+                                     * buffer allocated by the pool */
+} DMA_POOL_BUF;
+
+#define DMA_POOL_BUF_PRIV_BYTES \
+    ((DWORD)((sizeof(DMA_POOL_BUF) + sizeof(UINT64) - 1) & \
+    ~(sizeof(UINT64) - 1)))
+
+#define DMA_POOL_BUF_FROM_DMA(pDma) \
+    ((DMA_POOL_BUF *)((BYTE *)(pDma) - DMA_POOL_BUF_PRIV_BYTES))
+#define DMA_POOL_BUF_TO_DMA(pBuf) \
+    ((WD_DMA *)((BYTE *)(pBuf) + DMA_POOL_BUF_PRIV_BYTES))
+
+/* Buffers of one size and DMA options */
+typedef struct DMA_POOL_CLASS {
+    struct DMA_POOL_CLASS *pNext;
+    struct WDC_DMA_POOL *pPool;
+    DWORD dwBufSize;
+    DWORD dwOptions;
+    DMA_POOL_BUF *pFree;    /* Free buffers, most recently released first */
+    DWORD dwFree;
+} DMA_POOL_CLASS;
+
+typedef struct WDC_DMA_POOL {
+    PWDC_DEVICE pDev;
+    HANDLE hMutex;
+    WDC_DMA_POOL_PARAMS params;
+    DWORD dwMinClassSize;
+    DMA_POOL_CLASS *pClasses;
+    WDC_DMA_POOL_STATS stats;
+} WDC_DMA_POOL;
+
+#define DMA_POOL_IN_USE_BUCKETS 64
+#define DMA_POOL_IN_USE_BUCKET(pDma) \
+    ((DWORD)(((UPTR)(pDma) >> 4) % DMA_POOL_IN_USE_BUCKETS))
+
+/* Buffers in use of all the pools, by WD_DMA struct address: a released
+ * WD_DMA struct is identified as a pool buffer without accessing memory
+ * outside of it */
+static DMA_POOL_BUF *gpInUse[DMA_POOL_IN_USE_BUCKETS];
+static HANDLE ghInUseMutex;
+
+/*************************************************************
+  Static functions
+ *************************************************************/
+/* Returns the size class of a buffer size, or 0 if the size is too large */
+static DWORD ClassSizeGet(WDC_DMA_POOL *pPool, DWORD dwBytes)
+{
+    DWORD dwClassSize = pPool->dwMinClassSize;
+
+    while (dwClassSize < dwBytes)
+    {
+        if (dwClassSize & 0x80000000)
+            return 0;
+        dwClassSize <<= 1;
+    }
+
+    return dwClassSize;
+}
+
+/* Creates the buffers in use mutex on first use */
+static BOOL InUseMutexInit(void)
+{
+    HANDLE hMutex;
+
+    if (ghInUseMutex)
+        return TRUE;
+
+    if (WD_STATUS_SUCCESS != OsMutexCreate(&hMutex))
+        return FALSE;
+
+#if defined(WIN32)
+    if (InterlockedCompareExchangePointer(&ghInUseMutex, hMutex, NULL))
+#else
+    if (!__sync_bool_compare_and_swap(&ghInUseMutex, NULL, hMutex))
+#endif
+    {
+        /* Created by another thread */
+        OsMutexClose(hMutex);
+    }
+
+    return TRUE;
+}
+
+static void InUseAdd(DMA_POOL_BUF *pBuf)
+{
+    DMA_POOL_BUF **ppBucket =
+        &gpInUse[DMA_POOL_IN_USE_BUCKET(DMA_POOL_BUF_TO_DMA(pBuf))];
+
+    OsMutexLock(ghInUseMutex);
+    pBuf->pNext = *ppBucket;
+    *ppBucket = pBuf;
+    OsMutexUnlock(ghInUseMutex);
+}
+
+/* Returns the buffer of a WD_DMA struct that was received from
+ * WDC_DMAPoolBufGet(), or NULL if the WD_DMA struct is not a buffer in use */
+static DMA_POOL_BUF *InUseRemove(WD_DMA *pDma)
+{
+    DMA_POOL_BUF **ppBuf, *pBuf;
+
+    /* No pool was created */
+    if (!ghInUseMutex)
+        return NULL;
+
+    OsMutexLock(ghInUseMutex);
+    ppBuf = &gpInUse[DMA_POOL_IN_USE_BUCKET(pDma)];
+    while (*ppBuf && DMA_POOL_BUF_TO_DMA(*ppBuf) != pDma)
+        ppBuf = &(*ppBuf)->pNext;
+
+    pBuf = *ppBuf;
+    if (pBuf)
+        *ppBuf = pBuf->pNext;
+    OsMutexUnlock(ghInUseMutex);
+
+    return pBuf;
+}
+
+/* Called with the pool mutex locked */
+static DMA_POOL_CLASS *ClassFind(WDC_DMA_POOL *pPool, DWORD dwBufSize,
+    DWORD dwOptions)
+{
+    DMA_POOL_CLASS *pClass;
+
+    for (pClass = pPool->pClasses; pClass; pClass = pClass->pNext)
+    {
+        if (pClass->dwBufSize == dwBufSize && pClass->dwOptions == dwOptions)
+            return pClass;
+    }
+
+    return NULL;
+}
+
+/* Allocates and locks a new buffer of a size class. Called without the pool
+ * mutex locked. */
+static DWORD BufAlloc(DMA_POOL_CLASS *pClass, DMA_POOL_BUF **ppBuf)
+{
+    DMA_POOL_BUF *pBuf;
+    WD_DMA *pDma;
+    WDC_DMA_HUGE_BUF userBuf;
+    PVOID pAddr = NULL;
+    BOOL fIsSG = !(pClass->dwOptions & DMA_KERNEL_BUFFER_ALLOC);
+    DWORD dwStatus;
+
+    BZERO(userBuf);
+    if (fIsSG)
+    {
+        /* Buffers of at least 2MB are backed by huge pages when available */
+        dwStatus = WDC_DMAHugeBufAlloc(pClass->dwBufSize, &userBuf);
+        if (dwStatus)
+        {
+            WdcSetLastErrStr("Failed allocating a %ld bytes DMA buffer\n",
+                pClass->dwBufSize);
+            return dwStatus;
+        }
+        pAddr = userBuf.pBuf;
+    }
+
+    dwStatus = WdcDMABufLockPriv(pClass->pPool->pDev, &pAddr,
+        pClass->dwOptions, pClass->dwBufSize, &pDma,
+        DMA_POOL_BUF_PRIV_BYTES);
+    if (dwStatus)
+    {
+        WDC_DMAHugeBufFree(&userBuf);
+        return dwStatus;
+    }
+
+    if (fIsSG)
+    {
+        dwStatus = WdcDMAPagesSplit(pDma,
+            pClass->pPool->params.dwMaxSegSize);
+        if (dwStatus)
+        {
+            WdcDMABufUnlockPriv(pDma, DMA_POOL_BUF_PRIV_BYTES);
+            WDC_DMAHugeBufFree(&userBuf);
+            return dwStatus;
+        }
+    }
+
+    pBuf = DMA_POOL_BUF_FROM_DMA(pDma);
+    pBuf->pClass = pClass;
+    pBuf->userBuf = userBuf;
+    *ppBuf = pBuf;
+
+    return WD_STATUS_SUCCESS;
+}
+
+/* Unlocks and frees a buffer. Called without the pool mutex locked. */
+static void BufFree(DMA_POOL_BUF *pBuf)
+{
+    WDC_DMA_HUGE_BUF userBuf = pBuf->userBuf;
+
+    WdcDMABufUnlockPriv(DMA_POOL_BUF_TO_DMA(pBuf), DMA_POOL_BUF_PRIV_BYTES);
+    WDC_DMAHugeBufFree(&userBuf);
+}
+
+static void BufListFree(DMA_POOL_BUF *pList)
+{
+    while (pList)
+    {
+        DMA_POOL_BUF *pNext = pList->pNext;
+
+        BufFree(pList);
+        pList = pNext;
+    }
+}
+
+/* Locks dwCount free buffers in advance for a new size class */
+static void ClassPrefill(DMA_POOL_CLASS *pClass, DWORD dwCount)
+{
+    WDC_DMA_POOL *pPool = pClass->pPool;
+    DMA_POOL_BUF *pBuf;
+    DWORD i;
+
+    for (i = 0; i < dwCount; i++)
+    {
+        if (BufAlloc(pClass, &pBuf))
+        {
+            WDC_Trace("WDC_DMAPoolBufGet: Locked %ld of %ld buffers in "
+                "advance. %s", i, dwCount, WdcGetLastErrStr());
+            break;
+        }
+
+        OsMutexLock(pPool->hMutex);
+        pBuf->pNext = pClass->pFree;
+        pClass->pFree = pBuf;
+        pClass->dwFree++;
+        pPool->stats.dwFree++;
+        OsMutexUnlock(pPool->hMutex);
+    }
+}
+
+/*************************************************************
+  Functions implementation
+ *************************************************************/
+DWORD DLLCALLCONV WDC_DMAPoolCreate(_In_ WDC_DEVICE_HANDLE hDev,
+    _In_ const WDC_DMA_POOL_PARAMS *pParams,
+    _Outptr_ WDC_DMA_POOL_HANDLE *phPool)
+{
+    WDC_DMA_POOL *pPool;
+    DWORD dwStatus;
+
+    if (!WdcIsValidDevHandle(hDev) ||
+        !WdcIsValidPtr((PVOID)pParams, "NULL pool parameters") ||
+        !WdcIsValidPtr(phPool, "NULL address of pool handle"))
+    {
+        WDC_Err("WDC_DMAPoolCreate: %s", WdcGetLastErrStr());
+        return WD_INVALID_PARAMETER;
+    }
+
+    if (pParams->dwMaxSegSize && pParams->dwMaxSegSize < (DWORD)GetPageSize())
+    {
+        WDC_Err("WDC_DMAPoolCreate: Maximum segment size (0x%lx) is smaller "
+            "than the page size\n", pParams->dwMaxSegSize);
+        return WD_INVALID_PARAMETER;
+    }
+
+    if (pParams->dwHighWatermark &&
+        pParams->dwHighWatermark < pParams->dwLowWatermark)
+    {
+        WDC_Err("WDC_DMAPoolCreate: High watermark (%ld) is lower than the "
+            "low watermark (%ld)\n", pParams->dwHighWatermark,
+            pParams->dwLowWatermark);
+        return WD_INVALID_PARAMETER;
+    }
+
+    if (!InUseMutexInit())
+    {
+        WDC_Err("WDC_DMAPoolCreate: Failed creating mutex\n");
+        return WD_INSUFFICIENT_RESOURCES;
+    }
+
+    pPool = (WDC_DMA_POOL *)calloc(1, sizeof(WDC_DMA_POOL));
+    if (!pPool)
+    {
+        WDC_Err("WDC_DMAPoolCreate: Failed allocating memory\n");
+        return WD_INSUFFICIENT_RESOURCES;
+    }
+
+    dwStatus = OsMutexCreate(&pPool->hMutex);
+    if (dwStatus)
+    {
+        WDC_Err("WDC_DMAPoolCreate: Failed creating mutex. Error 0x%lx - %s\n",
+            dwStatus, Stat2Str(dwStatus));
+        free(pPool);
+        return dwStatus;
+    }
+
+    pPool->pDev = (PWDC_DEVICE)hDev;
+    pPool->params = *pParams;
+    pPool->dwMinClassSize = (DWORD)GetPageSize();
+    while (pPool->dwMinClassSize < pParams->dwMinBufSize &&
+        !(pPool->dwMinClassSize & 0x80000000))
+    {
+        pPool->dwMinClassSize <<= 1;
+    }
+
+    *phPool = pPool;
+
+    return WD_STATUS_SUCCESS;
+}
+
+DWORD DLLCALLCONV WDC_DMAPoolDestroy(_In_ WDC_DMA_POOL_HANDLE hPool)
+{
+    WDC_DMA_POOL *pPool = hPool;
+    DMA_POOL_CLASS *pClass;
+
+    if (!WdcIsValidPtr(pPool, "NULL pool handle"))
+    {
+        WDC_Err("WDC_DMAPoolDestroy: %s", WdcGetLastErrStr());
+        return WD_INVALID_PARAMETER;
+    }
+
+    if (pPool->stats.dwInUse)
+    {
+        WDC_Err("WDC_DMAPoolDestroy: %ld buffers were not released\n",
+            pPool->stats.dwInUse);
+        return WD_OPERATION_FAILED;
+    }
+
+    while (pPool->pClasses)
+    {
+        pClass = pPool->pClasses;
+        pPool->pClasses = pClass->pNext;
+        BufListFree(pClass->pFree);
+        free(pClass);
+    }
+
+    OsMutexClose(pPool->hMutex);
+    free(pPool);
+
+    return WD_STATUS_SUCCESS;
+}
+
+DWORD DLLCALLCONV WDC_DMAPoolBufGet(_In_ WDC_DMA_POOL_HANDLE hPool,
+    _In_ DWORD dwDMABufSize, _In_ DWORD dwOptions, _Outptr_ PVOID *ppBuf,
+    _Outptr_ WD_DMA **ppDma)
+{
+    WDC_DMA_POOL *pPool = hPool;
+    DMA_POOL_CLASS *pClass;
+    DMA_POOL_BUF *pBuf;
+    DWORD dwBufSize, dwStatus;
+    BOOL fNewClass = FALSE;
+
+    if (!WdcIsValidPtr(pPool, "NULL pool handle") ||
+        !WdcIsValidPtr(ppBuf, "NULL address of DMA buffer pointer") ||
+        !WdcIsValidPtr(ppDma, "NULL address of DMA struct pointer"))
+    {
+        WDC_Err("WDC_DMAPoolBufGet: %s", WdcGetLastErrStr());
+        return WD_INVALID_PARAMETER;
+    }
+
+    dwBufSize = ClassSizeGet(pPool, dwDMABufSize);
+    if (!dwDMABufSize || !dwBufSize)
+    {
+        WDC_Err("WDC_DMAPoolBufGet: Invalid buffer size (%ld bytes)\n",
+            dwDMABufSize);
+        return WD_INVALID_PARAMETER;
+    }
+
+    OsMutexLock(pPool->hMutex);
+
+    pClass = ClassFind(pPool, dwBufSize, dwOptions);
+    if (!pClass)
+    {
+        pClass = (DMA_POOL_CLASS *)calloc(1, sizeof(DMA_POOL_CLASS));
+        if (!pClass)
+        {
+            OsMutexUnlock(pPool->hMutex);
+            WDC_Err("WDC_DMAPoolBufGet: Failed allocating memory\n");
+            return WD_INSUFFICIENT_RESOURCES;
+        }
+
+        pClass->pPool = pPool;
+        pClass->dwBufSize = dwBufSize;
+        pClass->dwOptions = dwOptions;
+        pClass->pNext = pPool->pClasses;
+        pPool->pClasses = pClass;
+        pPool->stats.dwClasses++;
+        fNewClass = TRUE;
+    }
+
+    pBuf = pClass->pFree;
+    if (pBuf)
+    {
+        pClass->pFree = pBuf->pNext;
+        pClass->dwFree--;
+        pPool->stats.dwFree--;
+        pPool->stats.dwInUse++;
+        pPool->stats.qwHits++;
+        OsMutexUnlock(pPool->hMutex);
+        goto Exit;
+    }
+
+    pPool->stats.qwMisses++;
+    OsMutexUnlock(pPool->hMutex);
+
+    dwStatus = BufAlloc(pClass, &pBuf);
+    if (dwStatus)
+    {
+        WDC_Err("WDC_DMAPoolBufGet: Failed locking a %ld bytes DMA buffer. %s",
+            dwBufSize, WdcGetLastErrStr());
+        return dwStatus;
+    }
+
+    OsMutexLock(pPool->hMutex);
+    pPool->stats.dwInUse++;
+    OsMutexUnlock(pPool->hMutex);
+
+    if (fNewClass)
+        ClassPrefill(pClass, pPool->params.dwLowWatermark);
+
+Exit:
+    InUseAdd(pBuf);
+    *ppDma = DMA_POOL_BUF_TO_DMA(pBuf);
+    *ppBuf = (*ppDma)->pUserAddr;
+
+    return WD_STATUS_SUCCESS;
+}
+
+DWORD DLLCALLCONV WDC_DMAPoolBufRelease(_In_ WD_DMA *pDma)
+{
+    DMA_POOL_BUF *pBuf;
+    DMA_POOL_CLASS *pClass;
+    WDC_DMA_POOL *pPool;
+    DWORD dwHighWatermark;
+    BOOL fUnlock;
+
+    if (!WdcIsValidPtr(pDma, "NULL pointer to DMA struct"))
+    {
+        WDC_Err("WDC_DMAPoolBufRelease: %s", WdcGetLastErrStr());
+        return WD_INVALID_PARAMETER;
+    }
+
+    pBuf = InUseRemove(pDma);
+    if (!pBuf)
+    {
+        WDC_Err("WDC_DMAPoolBufRelease: The DMA buffer was not received from "
+            "WDC_DMAPoolBufGet(), or was already released\n");
+        return WD_INVALID_PARAMETER;
+    }
+
+    pClass = pBuf->pClass;
+    pPool = pClass->pPool;
+    dwHighWatermark = pPool->params.dwHighWatermark;
+
+    OsMutexLock(pPool->hMutex);
+    pPool->stats.qwReleases++;
+    pPool->stats.dwInUse--;
+    fUnlock = dwHighWatermark && pClass->dwFree >= dwHighWatermark;
+    if (fUnlock)
+    {
+        pPool->stats.qwUnlocks++;
+    }
+    else
+    {
+        pBuf->pNext = pClass->pFree;
+        pClass->pFree = pBuf;
+        pClass->dwFree++;
+        pPool->stats.dwFree++;
+    }
+    OsMutexUnlock(pPool->hMutex);
+
+    if (fUnlock)
+        BufFree(pBuf);
+
+    return WD_STATUS_SUCCESS;
+}
+
+DWORD DLLCALLCONV WDC_DMAPoolTrim(_In_ WDC_DMA_POOL_HANDLE hPool)
+{
+    WDC_DMA_POOL *pPool = hPool;
+    DMA_POOL_CLASS *pClass;
+    DMA_POOL_BUF *pTrimmed = NULL;
+
+    if (!WdcIsValidPtr(pPool, "NULL pool handle"))
+    {
+        WDC_Err("WDC_DMAPoolTrim: %s", WdcGetLastErrStr());
+        return WD_INVALID_PARAMETER;
+    }
+
+    OsMutexLock(pPool->hMutex);
+    for (pClass = pPool->pClasses; pClass; pClass = pClass->pNext)
+    {
+        while (pClass->dwFree > pPool->params.dwLowWatermark)
+        {
+            DMA_POOL_BUF *pBuf = pClass->pFree;
+
+            pClass->pFree = pBuf->pNext;
+            pClass->dwFree--;
+            pPool->stats.dwFree--;
+            pPool->stats.qwUnlocks++;
+            pBuf->pNext = pTrimmed;
+            pTrimmed = pBuf;
+        }
+    }
+    OsMutexUnlock(pPool->hMutex);
+
+    BufListFree(pTrimmed);
+
+    return WD_STATUS_SUCCESS;
+}
+
+DWORD DLLCALLCONV WDC_DMAPoolGetStats(_In_ WDC_DMA_POOL_HANDLE hPool,
+    _Out_ WDC_DMA_POOL_STATS *pStats)
+{
+    WDC_DMA_POOL *pPool = hPool;
+
+    if (!WdcIsValidPtr(pPool, "NULL pool handle") ||
+        !WdcIsValidPtr(pStats, "NULL pointer to statistics"))
+    {
+        WDC_Err("WDC_DMAPoolGetStats: %s", WdcGetLastErrStr());
+        return WD_INVALID_PARAMETER;
+    }
+
+    OsMutexLock(pPool->hMutex);
+    *pStats = pPool->stats;
+    OsMutexUnlock(pPool->hMutex);
+
+    return WD_STATUS_SUCCESS;
+}
+
+#endif /* !defined(__KERNEL__) */
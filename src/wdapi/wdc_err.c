@@ -8,13 +8,23 @@
 #include "utils.h"
 #include "wdc_err.h"
 
-static CHAR gsLastErr[256];
+/* Last error message of the calling thread, formatted when it is read */
+static OS_THREAD_LOCAL UTIL_LAZY_MSG gLastErr;
 
 /* WDC debug messages display options */
 /* [Initialized to enable error prints in case of debug options initialization
  * failure] */
 static WDC_DBG_OPTIONS gDbgOptions = WDC_DBG_DEFAULT;
 
+/* Debug sections selected by WDC_SetDebugSections() */
+static DWORD gDbgSections = (DWORD)S_ALL;
+
+/* Enabled debug sections of each debug level -- derived from gDbgOptions and
+ * gDbgSections by DbgSectionsMaskUpdate(). Matches WDC_DBG_DEFAULT. */
+volatile DWORD WdcDbgSectionsMask[D_TRACE + 1] = {
+    0, (DWORD)S_ALL, (DWORD)S_ALL, (DWORD)S_ALL, (DWORD)S_ALL
+};
+
 #if !defined(__KERNEL__)
     #define DEFAULT_DBG_OUT_FILE stderr /* Default debug output file */
     static FILE *gfpDbgFile = NULL; /* Handle to debug output file */
@@ -25,6 +35,7 @@ static WDC_DBG_OPTIONS gDbgOptions = WDC_DBG_DEFAULT;
  *************************************************************/
 static void DbgLog(DEBUG_LEVEL dbgLevel, const CHAR *format, va_list argp);
 static void DbgInit(void);
+static void DbgSectionsMaskUpdate(void);
 
 /*************************************************************
   Functions implementation
@@ -34,14 +45,13 @@ void WdcSetLastErrStr(const CHAR *format, ...)
     va_list argp;
 
     va_start(argp, format);
-    vsnprintf(gsLastErr, sizeof(gsLastErr), format, argp);
-    gsLastErr[sizeof(gsLastErr) - 1] = '\0';
+    UtilLazyMsgSet(&gLastErr, format, argp);
     va_end(argp);
 }
 
 const CHAR *WdcGetLastErrStr()
 {
-    return gsLastErr;
+    return UtilLazyMsgGet(&gLastErr);
 }
 
 void DLLCALLCONV WDC_Err(const CHAR *format, ...)
@@ -82,6 +92,7 @@ DWORD DLLCALLCONV WDC_SetDebugOptions(_In_ WDC_DBG_OPTIONS dbgOptions,
     if (dbgOptions & WDC_DBG_NONE)
     {
         gDbgOptions = WDC_DBG_NONE;
+        DbgSectionsMaskUpdate();
         return WD_STATUS_SUCCESS;
     }
 
@@ -142,12 +153,45 @@ DWORD DLLCALLCONV WDC_SetDebugOptions(_In_ WDC_DBG_OPTIONS dbgOptions,
     }
 
     gDbgOptions = dbgOptions;
+    DbgSectionsMaskUpdate();
 
     WDC_Trace("WDC_SetDebugOptions: Debug options set to 0x%lx\n", gDbgOptions);
 
     return WD_STATUS_SUCCESS;
 }
 
+DWORD DLLCALLCONV WDC_SetDebugSections(_In_ DWORD dwSections)
+{
+    gDbgSections = dwSections;
+    DbgSectionsMaskUpdate();
+
+    WDC_Trace("WDC_SetDebugSections: Debug sections set to 0x%lx\n",
+        dwSections);
+
+    return WD_STATUS_SUCCESS;
+}
+
+static void DbgSectionsMaskUpdate(void)
+{
+    DWORD dwLevel, dwMaxLevel;
+
+    if (gDbgOptions & WDC_DBG_NONE)
+        dwMaxLevel = D_OFF;
+    else if (gDbgOptions & WDC_DBG_LEVEL_TRACE)
+        dwMaxLevel = D_TRACE;
+    else if (gDbgOptions & WDC_DBG_LEVEL_ERR)
+        dwMaxLevel = D_ERROR;
+    else
+        dwMaxLevel = D_OFF;
+
+    WdcDbgSectionsMask[D_OFF] = 0;
+    for (dwLevel = D_ERROR; dwLevel <= D_TRACE; dwLevel++)
+    {
+        WdcDbgSectionsMask[dwLevel] = dwLevel <= dwMaxLevel ?
+            gDbgSections : 0;
+    }
+}
+
 static void DbgInit(void)
 {
 #if !defined(__KERNEL__)
@@ -166,6 +210,7 @@ static void DbgInit(void)
 #endif
 
     gDbgOptions = WDC_DBG_DEFAULT;
+    DbgSectionsMaskUpdate();
 }
 
 static void DbgLog(DEBUG_LEVEL dbgLevel, const CHAR *format, va_list argp)
@@ -8,8 +8,21 @@
 #include "wdc_lib.h"
 #include "wdc_defs.h"
 #include "wdc_err.h"
+#include "wdc_priv.h"
 #include "status_strings.h"
 
+/* WDC events handler: invalidates the device's register shadow cache, since
+ * the device may have been reset, and calls the user's events handler */
+static void WdcEventHandler(WD_EVENT *pEvent, PVOID pData)
+{
+    PWDC_DEVICE pDev = (PWDC_DEVICE)pData;
+    WDC_DEVICE_PRIV *pPriv = WDC_DEV_PRIV(pDev);
+
+    WdcShadowInvalidate(pDev);
+
+    pPriv->funcEventHandler(pEvent, pPriv->pEventData);
+}
+
 DWORD DLLCALLCONV WDC_EventRegister(_In_ WDC_DEVICE_HANDLE hDev,
     _In_ DWORD dwActions, _In_ EVENT_HANDLER funcEventHandler,
     _In_ PVOID pData, _In_ BOOL fUseKP)
@@ -56,8 +69,11 @@ DWORD DLLCALLCONV WDC_EventRegister(_In_ WDC_DEVICE_HANDLE hDev,
     pDev->Event.u.Pci.cardId = pDev->id;
     pDev->Event.u.Pci.pciSlot = pDev->slot;
 
+    WDC_DEV_PRIV(pDev)->funcEventHandler = funcEventHandler;
+    WDC_DEV_PRIV(pDev)->pEventData = pData;
+
     dwStatus = EventRegister(&pDev->hEvent, WDC_GetWDHandle(), &pDev->Event,
-        funcEventHandler, pData);
+        WdcEventHandler, pDev);
     if (WD_STATUS_SUCCESS != dwStatus)
     {
         WDC_Err("WDC_EventRegister: Failed to register event.\n"
@@ -67,6 +83,12 @@ DWORD DLLCALLCONV WDC_EventRegister(_In_ WDC_DEVICE_HANDLE hDev,
         return dwStatus;
     }
 
+    if (EventThreadGet(pDev->hEvent) &&
+        !ThreadClassHasAffinity(THREAD_CLASS_EVENT))
+    {
+        WDC_NumaThreadBind(hDev, EventThreadGet(pDev->hEvent));
+    }
+
     WDC_Trace("WDC_EventRegister: Events registered successfully. "
         "event handle 0x%lx\n", pDev->hEvent);
 
@@ -9,6 +9,7 @@
 #include "wdc_lib.h"
 #include "wdc_defs.h"
 #include "wdc_err.h"
+#include "wdc_priv.h"
 #include "status_strings.h"
 #include "pci_regs.h"
 
@@ -31,6 +32,11 @@ static DWORD deviceClose(WDC_DEVICE_HANDLE hDev);
 static DWORD KernelPlugInOpen(WDC_DEVICE_HANDLE hDev,
     const CHAR *pcKPDriverName, PVOID pKPOpenData);
 static DWORD SetDeviceInfo(PWDC_DEVICE pDev);
+#if defined (LINUX)
+static void CardWcOptionsSet(WD_CARD *pCard, const WD_CARD *pReqCard);
+static BOOL AddrDescIsUserMapped(PWDC_DEVICE pDev,
+    const WDC_ADDR_DESC *pAddrDesc);
+#endif
 #endif
 
 #define MAX_ADDR_SPACE_NUM WD_CARD_ITEMS
@@ -175,6 +181,8 @@ DWORD DLLCALLCONV WDC_DriverOpen(_In_ WDC_DRV_OPEN_OPTIONS openOptions,
         }
     }
 
+    WdcDMACoherenceInit();
+
     return WD_STATUS_SUCCESS;
 
 Error:
@@ -673,6 +681,15 @@ static PWDC_DEVICE deviceCreate(const PVOID pDeviceInfo, const PVOID pDevCtx,
 
     BZERO(*pDev);
 
+    pDev->pPriv = calloc(1, sizeof(WDC_DEVICE_PRIV));
+    if (!pDev->pPriv)
+    {
+        WdcSetLastErrStr("deviceCreate: Failed memory allocation\n");
+        goto Error;
+    }
+
+    WDC_DEV_PRIV(pDev)->dwNumaNode = WDC_NUMA_NODE_ANY;
+
     switch (bus)
     {
     case WD_BUS_PCI:
@@ -688,6 +705,7 @@ static PWDC_DEVICE deviceCreate(const PVOID pDeviceInfo, const PVOID pDevCtx,
             goto Error;
         }
 
+        WdcNumaDeviceInit(pDev);
         break;
     }
     case WD_BUS_ISA:
@@ -728,6 +746,11 @@ static DWORD deviceOpen(WDC_DEVICE_HANDLE *phDev, const PVOID pDeviceInfo,
     if (!pDev)
         return WD_INSUFFICIENT_RESOURCES;
 
+#if defined (LINUX)
+    /* WD_ITEM_MEM_USER_MAP_WC is handled in user mode, by SetDeviceInfo() */
+    CardWcOptionsSet(&pDev->cardReg.Card, NULL);
+#endif
+
     dwStatus = WD_CardRegister(ghWD, &pDev->cardReg);
     if (WD_STATUS_SUCCESS != dwStatus)
     {
@@ -736,6 +759,14 @@ static DWORD deviceOpen(WDC_DEVICE_HANDLE *phDev, const PVOID pDeviceInfo,
         goto Error;
     }
 
+#if defined (LINUX)
+    if (WD_BUS_PCI == bus)
+    {
+        CardWcOptionsSet(&pDev->cardReg.Card,
+            &((const WD_PCI_CARD_INFO *)pDeviceInfo)->Card);
+    }
+#endif
+
     dwStatus = SetDeviceInfo(pDev);
     if (WD_STATUS_SUCCESS != dwStatus)
         goto Error;
@@ -758,6 +789,12 @@ static void deviceDestroy(PWDC_DEVICE pDev)
     if (pDev->pAddrDesc)
         free(pDev->pAddrDesc);
 
+    if (pDev->pPriv)
+    {
+        WdcShadowDestroy(pDev);
+        free(pDev->pPriv);
+    }
+
     free(pDev);
 }
 
@@ -789,6 +826,9 @@ static DWORD deviceClose(WDC_DEVICE_HANDLE hDev)
         }
     }
 
+    /* Write the deferred register writes of the shadow cache, if any */
+    WDC_ShadowFlush(hDev);
+
     if (WDC_IS_KP(pDev))
     {
         dwStatus = WD_KernelPlugInClose(ghWD, &pDev->kerPlug);
@@ -812,21 +852,16 @@ static DWORD deviceClose(WDC_DEVICE_HANDLE hDev)
 
 #if defined (LINUX)
         {
-            DWORD dwNumItems = pDev->cardReg.Card.dwItems;
-            WD_ITEMS* pItem = pDev->cardReg.Card.Item;
-            WDC_ADDR_DESC addrDescs[MAX_ADDR_SPACE_NUM];
-            WDC_ADDR_DESC* pAddrDesc;
             DWORD i;
 
-            BZERO(addrDescs);
-            for (i = 0; i < dwNumItems; i++, pItem++)
+            for (i = 0; i < pDev->dwNumAddrSpaces; i++)
             {
-                if (pItem->item == ITEM_MEMORY &&
-                    pItem->I.Mem.dwOptions & WD_ITEM_MEM_USER_MAP)
+                WDC_ADDR_DESC *pAddrDesc = WDC_GET_ADDR_DESC(pDev, i);
+
+                if (AddrDescIsUserMapped(pDev, pAddrDesc))
                 {
-                    pAddrDesc = &addrDescs[pItem->I.Mem.dwBar];
                     munmap((PVOID)pAddrDesc->pUserDirectMemAddr,
-                        pItem->I.Mem.qwBytes);
+                        pAddrDesc->qwBytes);
                 }
             }
         }
@@ -858,6 +893,93 @@ static DWORD KernelPlugInOpen(WDC_DEVICE_HANDLE hDev,
     return dwStatus;
 }
 
+#if defined (LINUX)
+/* Set the WD_ITEM_MEM_USER_MAP_WC option of the memory items of pCard as in
+ * pReqCard, or clear it if pReqCard is NULL */
+static void CardWcOptionsSet(WD_CARD *pCard, const WD_CARD *pReqCard)
+{
+    DWORD i;
+
+    for (i = 0; i < pCard->dwItems; i++)
+    {
+        WD_ITEMS *pItem = &pCard->Item[i];
+
+        if (pItem->item != ITEM_MEMORY)
+            continue;
+
+        pItem->I.Mem.dwOptions &= ~WD_ITEM_MEM_USER_MAP_WC;
+        if (pReqCard && i < pReqCard->dwItems &&
+            pReqCard->Item[i].item == ITEM_MEMORY)
+        {
+            pItem->I.Mem.dwOptions |= pReqCard->Item[i].I.Mem.dwOptions &
+                WD_ITEM_MEM_USER_MAP_WC;
+        }
+    }
+}
+
+/* Check if the user-mode mapping of an address space was done by the WDC
+ * library (and should therefore be unmapped by it) */
+static BOOL AddrDescIsUserMapped(PWDC_DEVICE pDev,
+    const WDC_ADDR_DESC *pAddrDesc)
+{
+    const WD_ITEMS *pItem = &pDev->cardReg.Card.Item[pAddrDesc->dwItemIndex];
+
+    if (!WDC_ADDR_IS_MEM(pAddrDesc) || !pAddrDesc->pUserDirectMemAddr)
+        return FALSE;
+
+    return WDC_ADDR_IS_WC(pAddrDesc) ||
+        (pItem->I.Mem.dwOptions & WD_ITEM_MEM_USER_MAP);
+}
+
+/* Map a prefetchable memory BAR as write-combining, using the BAR's sysfs
+ * resourceN_wc file. On failure the existing (uncached) mapping is kept */
+static void MapWriteCombining(PWDC_DEVICE pDev, const WD_ITEMS *pItem,
+    WDC_ADDR_DESC *pAddrDesc)
+{
+    CHAR sPath[128];
+    PVOID pMap;
+    int fd;
+
+    snprintf(sPath, sizeof(sPath),
+        "/sys/bus/pci/devices/%04x:%02x:%02x.%x/resource%d_wc",
+        (UINT32)pDev->slot.dwDomain, (UINT32)pDev->slot.dwBus,
+        (UINT32)pDev->slot.dwSlot, (UINT32)pDev->slot.dwFunction,
+        (UINT32)pItem->I.Mem.dwBar);
+
+    fd = open(sPath, O_RDWR | O_SYNC);
+    if (fd < 0)
+    {
+        WDC_Trace("%s: BAR [%d] cannot be mapped as write-combining (%s is "
+            "not available); keeping uncached mapping\n", __FUNCTION__,
+            pItem->I.Mem.dwBar, sPath);
+        return;
+    }
+
+    pMap = mmap(NULL, pItem->I.Mem.qwBytes, PROT_READ | PROT_WRITE,
+        MAP_SHARED, fd, 0);
+    close(fd);
+    if (pMap == MAP_FAILED)
+    {
+        WDC_Trace("%s: Failed mapping %s; keeping uncached mapping\n",
+            __FUNCTION__, sPath);
+        return;
+    }
+
+    if (pItem->I.Mem.dwOptions & WD_ITEM_MEM_USER_MAP)
+    {
+        munmap((PVOID)pAddrDesc->pUserDirectMemAddr,
+            pItem->I.Mem.qwBytes);
+    }
+
+    pAddrDesc->pUserDirectMemAddr = (UPTR)pMap;
+    pAddrDesc->dwOptions |= WDC_ADDR_DESC_WRITE_COMBINING;
+
+    WDC_Trace("%s: BAR [%d] mapped as write-combining. "
+        "pUserDirectMemAddr[0x%lx]\n", __FUNCTION__, pItem->I.Mem.dwBar,
+        pAddrDesc->pUserDirectMemAddr);
+}
+#endif
+
 static DWORD SetDeviceInfo(PWDC_DEVICE pDev)
 {
     DWORD i;
@@ -908,6 +1030,9 @@ static DWORD SetDeviceInfo(PWDC_DEVICE pDev)
                     pAddrDesc->pUserDirectMemAddr);
                 close(fd);
             }
+
+            if (pItem->I.Mem.dwOptions & WD_ITEM_MEM_USER_MAP_WC)
+                MapWriteCombining(pDev, pItem, pAddrDesc);
 #endif
             pAddrDesc->qwBytes = pItem->I.Mem.qwBytes;
 
@@ -4,9 +4,11 @@
 *  File: wdc_ints.c - Implementation of WDC interrupt handling API  *
 *********************************************************************/
 
+#include "utils.h"
 #include "wdc_lib.h"
 #include "wdc_defs.h"
 #include "wdc_err.h"
+#include "wdc_priv.h"
 #include "status_strings.h"
 
 /*************************************************************
@@ -21,6 +23,396 @@
 #define OPTION_INTERRUPT(x) ((x) & INTERRUPT_TYPE_ALL)
 
 #if !defined (__KERNEL__)
+/* Per-vector interrupt handlers: the driver reports all the MSI/MSI-X vectors
+ * of a device through its single interrupt handle, so the handler of the
+ * interrupt identifies the vector by the message data of the last received
+ * interrupt, and wakes the thread of the vector, which calls the vector's
+ * handler */
+#if defined(WIN32)
+    #define VECTOR_PENDING_INC(lPending) InterlockedIncrement(&(lPending))
+    #define VECTOR_PENDING_TAKE(lPending) InterlockedExchange(&(lPending), 0)
+#else
+    #define VECTOR_PENDING_INC(lPending) __sync_fetch_and_add(&(lPending), 1)
+    #define VECTOR_PENDING_TAKE(lPending) \
+        __sync_lock_test_and_set(&(lPending), 0)
+#endif
+
+/* Message data that is not reported by the driver */
+#define INT_MESSAGE_NONE ((DWORD)-1)
+
+/* MSI/MSI-X capability registers, relative to the capability offset */
+#define MSI_CTRL_OFFSET 0x2
+#define MSI_CTRL_64BIT 0x80
+#define MSI_CTRL_QSIZE(wCtrl) (1 << (((wCtrl) >> 4) & 0x7))
+#define MSI_DATA_OFFSET(wCtrl) ((wCtrl) & MSI_CTRL_64BIT ? 0xC : 0x8)
+#define MSIX_TABLE_OFFSET 0x4
+#define MSIX_TABLE_BIR_MASK 0x7
+#define MSIX_ENTRY_SIZE 16
+#define MSIX_ENTRY_DATA_OFFSET 8
+
+struct WDC_INT_VECTORS;
+
+typedef struct {
+    struct WDC_INT_VECTORS *pVectors;
+    INT_HANDLER funcIntHandler;
+    PVOID pData;
+    DWORD dwMessage;        /* Message data of the vector */
+    volatile long lPending;  /* Interrupts that were not handled yet */
+    HANDLE hEvent;          /* Wakes the vector's thread */
+    HANDLE hThread;
+} INT_VECTOR;
+
+typedef struct WDC_INT_VECTORS {
+    PWDC_DEVICE pDev;
+    DWORD dwNumVectors;
+    volatile BOOL fStop;
+    /* TRUE if the vector of an interrupt can be identified by the reported
+     * message; otherwise (and until the interrupt is enabled), all the
+     * vectors are woken per interrupt */
+    volatile BOOL fIdentify;
+    DWORD dwLastCounter;
+    INT_VECTOR vectors[1];
+} WDC_INT_VECTORS;
+
+static void DLLCALLCONV IntVectorThread(void *pData)
+{
+    INT_VECTOR *pVector = (INT_VECTOR *)pData;
+    WDC_INT_VECTORS *pVectors = pVector->pVectors;
+
+    for (;;)
+    {
+        OsEventWait(pVector->hEvent, INFINITE);
+        if (pVectors->fStop)
+            break;
+
+        /* Interrupts of the vector that arrive while its handler runs are
+         * served by one more call */
+        if (VECTOR_PENDING_TAKE(pVector->lPending))
+            pVector->funcIntHandler(pVector->pData);
+    }
+}
+
+static void IntVectorWake(INT_VECTOR *pVector)
+{
+    if (!VECTOR_PENDING_INC(pVector->lPending))
+        OsEventSignal(pVector->hEvent);
+}
+
+/* Returns the index of the vector of a message, or dwNumVectors if the
+ * message is unknown */
+static DWORD IntVectorFind(WDC_INT_VECTORS *pVectors, DWORD dwMessage)
+{
+#if defined(WIN32)
+    /* The driver reports the message number, which is the vector index */
+    return MIN(dwMessage, pVectors->dwNumVectors);
+#else
+    DWORD i;
+
+    for (i = 0; i < pVectors->dwNumVectors; i++)
+    {
+        if (pVectors->vectors[i].dwMessage == dwMessage)
+            break;
+    }
+
+    return i;
+#endif
+}
+
+/* Handler of the device's interrupt */
+static void DLLCALLCONV IntVectorsDispatch(PVOID pData)
+{
+    WDC_INT_VECTORS *pVectors = (WDC_INT_VECTORS *)pData;
+    WD_INTERRUPT *pInt = &pVectors->pDev->Int;
+    DWORD dwMessage = pInt->dwLastMessage;
+    DWORD dwCount = pInt->dwCounter - pVectors->dwLastCounter;
+    DWORD i = pVectors->dwNumVectors;
+
+    pVectors->dwLastCounter = pInt->dwCounter;
+    /* The wait reports the message of each interrupt; a reactor sweep does
+     * not, which leaves this mark */
+    pInt->dwLastMessage = INT_MESSAGE_NONE;
+
+    /* Only the message of the last interrupt is reported, so when several
+     * interrupts were received since the last call, all the vectors are
+     * woken */
+    if (pVectors->fIdentify && dwCount <= 1 && !pInt->dwLost &&
+        INT_MESSAGE_NONE != dwMessage)
+    {
+        i = IntVectorFind(pVectors, dwMessage);
+    }
+
+    if (i < pVectors->dwNumVectors)
+    {
+        IntVectorWake(&pVectors->vectors[i]);
+        return;
+    }
+
+    for (i = 0; i < pVectors->dwNumVectors; i++)
+        IntVectorWake(&pVectors->vectors[i]);
+}
+
+#if !defined(WIN32)
+/* Returns the address space of a BAR, or the number of address spaces if the
+ * BAR is not a memory BAR of the device */
+static DWORD BarAddrSpaceGet(PWDC_DEVICE pDev, DWORD dwBar)
+{
+    DWORD i;
+
+    for (i = 0; i < pDev->dwNumAddrSpaces; i++)
+    {
+        WD_ITEMS *pItem =
+            &pDev->cardReg.Card.Item[pDev->pAddrDesc[i].dwItemIndex];
+
+        if (ITEM_MEMORY == pItem->item && pItem->I.Mem.dwBar == dwBar)
+            break;
+    }
+
+    return i;
+}
+
+/* Reads the message data of the vectors from the device. The vectors are
+ * programmed by the OS when the interrupt is enabled. */
+static BOOL IntVectorsMessagesRead(WDC_INT_VECTORS *pVectors)
+{
+    PWDC_DEVICE pDev = pVectors->pDev;
+    BOOL fMsix = WDC_GET_ENABLED_INT_TYPE(pDev) & INTERRUPT_MESSAGE_X;
+    WDC_PCI_SCAN_CAPS_RESULT scanResult;
+    DWORD dwCapOffset, i;
+
+    if (!WDC_INT_IS_MSI(WDC_GET_ENABLED_INT_TYPE(pDev)))
+        return FALSE;
+
+    if (WDC_PciScanCaps(pDev, fMsix ? PCI_CAP_ID_MSIX : PCI_CAP_ID_MSI,
+        &scanResult) || !scanResult.dwNumCaps)
+    {
+        return FALSE;
+    }
+    dwCapOffset = scanResult.pciCaps[0].dwCapOffset;
+
+    if (fMsix)
+    {
+        UINT32 u32Table, u32Data;
+        DWORD dwAddrSpace;
+
+        if (WDC_PciReadCfg32(pDev, dwCapOffset + MSIX_TABLE_OFFSET, &u32Table))
+            return FALSE;
+
+        dwAddrSpace = BarAddrSpaceGet(pDev, u32Table & MSIX_TABLE_BIR_MASK);
+        if (dwAddrSpace == pDev->dwNumAddrSpaces)
+            return FALSE;
+
+        for (i = 0; i < pVectors->dwNumVectors; i++)
+        {
+            if (WDC_ReadAddr32(pDev, dwAddrSpace,
+                (u32Table & ~MSIX_TABLE_BIR_MASK) + i * MSIX_ENTRY_SIZE +
+                MSIX_ENTRY_DATA_OFFSET, &u32Data))
+            {
+                return FALSE;
+            }
+
+            pVectors->vectors[i].dwMessage = u32Data;
+        }
+    }
+    else
+    {
+        WORD wCtrl, wData;
+
+        /* The vectors of multiple message MSI are numbered in the low bits of
+         * the message data */
+        if (WDC_PciReadCfg16(pDev, dwCapOffset + MSI_CTRL_OFFSET, &wCtrl) ||
+            WDC_PciReadCfg16(pDev, dwCapOffset + MSI_DATA_OFFSET(wCtrl),
+            &wData))
+        {
+            return FALSE;
+        }
+
+        wData &= ~(MSI_CTRL_QSIZE(wCtrl) - 1);
+        for (i = 0; i < pVectors->dwNumVectors; i++)
+            pVectors->vectors[i].dwMessage = (DWORD)wData + i;
+    }
+
+    return TRUE;
+}
+
+/* The message data of MSI-X vectors that target different CPUs may repeat
+ * (x86 without interrupt remapping), in which case the message does not
+ * identify the vector */
+static BOOL IntVectorsMessagesUnique(WDC_INT_VECTORS *pVectors)
+{
+    DWORD i, j;
+
+    for (i = 1; i < pVectors->dwNumVectors; i++)
+    {
+        for (j = 0; j < i; j++)
+        {
+            if (pVectors->vectors[i].dwMessage ==
+                pVectors->vectors[j].dwMessage)
+            {
+                return FALSE;
+            }
+        }
+    }
+
+    return TRUE;
+}
+#endif
+
+static void IntVectorsFree(WDC_INT_VECTORS *pVectors)
+{
+    DWORD i;
+
+    pVectors->fStop = TRUE;
+    for (i = 0; i < pVectors->dwNumVectors; i++)
+    {
+        INT_VECTOR *pVector = &pVectors->vectors[i];
+
+        if (pVector->hThread)
+        {
+            OsEventSignal(pVector->hEvent);
+            ThreadWait(pVector->hThread);
+        }
+
+        if (pVector->hEvent)
+            OsEventClose(pVector->hEvent);
+    }
+
+    free(pVectors);
+}
+
+static DWORD IntVectorsAlloc(PWDC_DEVICE pDev,
+    const WDC_INT_VECTOR *pIntVectors, DWORD dwNumVectors,
+    WDC_INT_VECTORS **ppVectors)
+{
+    WDC_INT_VECTORS *pVectors;
+    DWORD i, dwStatus = WD_STATUS_SUCCESS;
+
+    pVectors = (WDC_INT_VECTORS *)calloc(1, sizeof(WDC_INT_VECTORS) +
+        (dwNumVectors - 1) * sizeof(INT_VECTOR));
+    if (!pVectors)
+        return WD_INSUFFICIENT_RESOURCES;
+
+    pVectors->pDev = pDev;
+    pVectors->dwNumVectors = dwNumVectors;
+    for (i = 0; i < dwNumVectors; i++)
+    {
+        INT_VECTOR *pVector = &pVectors->vectors[i];
+
+        pVector->pVectors = pVectors;
+        pVector->funcIntHandler = pIntVectors[i].funcIntHandler;
+        pVector->pData = pIntVectors[i].pData;
+        pVector->dwMessage = i;
+
+        dwStatus = OsEventCreate(&pVector->hEvent);
+        if (WD_STATUS_SUCCESS != dwStatus)
+        {
+            pVector->hEvent = NULL;
+            break;
+        }
+
+        dwStatus = ThreadStartClass(&pVector->hThread, THREAD_CLASS_INTERRUPT,
+            IntVectorThread, pVector);
+        if (WD_STATUS_SUCCESS != dwStatus)
+        {
+            pVector->hThread = NULL;
+            break;
+        }
+
+        if (!ThreadClassHasAffinity(THREAD_CLASS_INTERRUPT))
+            WDC_NumaThreadBind(pDev, pVector->hThread);
+    }
+
+    if (WD_STATUS_SUCCESS != dwStatus)
+    {
+        IntVectorsFree(pVectors);
+        return dwStatus;
+    }
+
+    *ppVectors = pVectors;
+
+    return WD_STATUS_SUCCESS;
+}
+
+/* Hybrid interrupt/polling completion: the interrupt handler polls the
+ * device's completions; when a poll reaches its budget, the interrupt is
+ * masked and the completions are polled until the device is idle */
+#define INT_HYBRID_DEFAULT_BUDGET 64
+#define INT_HYBRID_DEFAULT_IDLE_POLLS 16
+
+typedef struct WDC_INT_HYBRID {
+    WDC_INT_HYBRID_PARAMS params;
+    volatile BOOL fStop;
+    BOOL fMasked;
+    WDC_INT_HYBRID_STATS stats;
+} WDC_INT_HYBRID;
+
+static DWORD IntHybridPoll(WDC_INT_HYBRID *pHybrid)
+{
+    DWORD dwCompleted = pHybrid->params.funcPoll(pHybrid->params.pCtx,
+        pHybrid->params.dwBudget);
+
+    return MIN(dwCompleted, pHybrid->params.dwBudget);
+}
+
+/* Handler of the device's interrupt */
+static void DLLCALLCONV IntHybridHandler(PVOID pData)
+{
+    WDC_INT_HYBRID *pHybrid = (WDC_INT_HYBRID *)pData;
+    WDC_INT_HYBRID_PARAMS *pParams = &pHybrid->params;
+    DWORD dwCompleted, dwIdlePolls = 0;
+    WD_SLEEP slp;
+
+    pHybrid->stats.qwInterrupts++;
+    dwCompleted = IntHybridPoll(pHybrid);
+    pHybrid->stats.qwIntCompletions += dwCompleted;
+    if (dwCompleted < pParams->dwBudget)
+        return;
+
+    pParams->funcIntMask(pParams->pCtx, TRUE);
+    pHybrid->fMasked = TRUE;
+    pHybrid->stats.qwPollModeSwitches++;
+
+    BZERO(slp);
+    slp.dwMicroSeconds = pParams->dwPollIntervalUs;
+    slp.dwOptions = SLEEP_NON_BUSY;
+
+    while (!pHybrid->fStop)
+    {
+        if (pParams->dwPollIntervalUs)
+            WD_Sleep(WDC_GetWDHandle(), &slp);
+
+        dwCompleted = IntHybridPoll(pHybrid);
+        pHybrid->stats.qwPolls++;
+        pHybrid->stats.qwPollCompletions += dwCompleted;
+        dwIdlePolls = dwCompleted ? 0 : dwIdlePolls + 1;
+        if (dwIdlePolls < pParams->dwIdlePolls)
+            continue;
+
+        /* Completions that arrive after the last poll and before the
+         * interrupt is unmasked do not generate an interrupt, so poll once
+         * more after unmasking */
+        pParams->funcIntMask(pParams->pCtx, FALSE);
+        pHybrid->fMasked = FALSE;
+        pHybrid->stats.qwIntModeSwitches++;
+
+        dwCompleted = IntHybridPoll(pHybrid);
+        pHybrid->stats.qwPollCompletions += dwCompleted;
+        if (!dwCompleted)
+            break;
+
+        pParams->funcIntMask(pParams->pCtx, TRUE);
+        pHybrid->fMasked = TRUE;
+        pHybrid->stats.qwPollModeSwitches++;
+        dwIdlePolls = 0;
+    }
+
+    if (pHybrid->fMasked)
+    {
+        pParams->funcIntMask(pParams->pCtx, FALSE);
+        pHybrid->fMasked = FALSE;
+        pHybrid->stats.qwIntModeSwitches++;
+    }
+}
+
 DWORD DLLCALLCONV WDC_IntEnable(_In_ WDC_DEVICE_HANDLE hDev,
     _In_ WD_TRANSFER *pTransCmds, _In_ DWORD dwNumCmds, _In_ DWORD dwOptions,
     _In_ INT_HANDLER funcIntHandler, _In_ PVOID pData, _In_ BOOL fUseKP)
@@ -105,6 +497,13 @@ DWORD DLLCALLCONV WDC_IntEnable(_In_ WDC_DEVICE_HANDLE hDev,
         return dwStatus;
     }
 
+    /* CPUs that were set for the interrupt threads take precedence */
+    if (InterruptThreadGet(pDev->hIntThread) &&
+        !ThreadClassHasAffinity(THREAD_CLASS_INTERRUPT))
+    {
+        WDC_NumaThreadBind(hDev, InterruptThreadGet(pDev->hIntThread));
+    }
+
     WDC_Trace("WDC_IntEnable: Interrupt enabled successfully\n");
 
     return WD_STATUS_SUCCESS;
@@ -129,6 +528,10 @@ DWORD DLLCALLCONV WDC_IntDisable(_In_ WDC_DEVICE_HANDLE hDev)
         return WD_OPERATION_ALREADY_DONE;
     }
 
+    /* Stop polling before the interrupt thread is waited for */
+    if (WDC_DEV_PRIV(pDev)->pIntHybrid)
+        WDC_DEV_PRIV(pDev)->pIntHybrid->fStop = TRUE;
+
     dwStatus = InterruptDisable(pDev->hIntThread);
     if (WD_STATUS_SUCCESS == dwStatus)
     {
@@ -140,11 +543,236 @@ DWORD DLLCALLCONV WDC_IntDisable(_In_ WDC_DEVICE_HANDLE hDev)
             "Error 0x%lx - %s\n", dwStatus, Stat2Str(dwStatus));
     }
 
+    if (WDC_DEV_PRIV(pDev)->pIntHybrid)
+    {
+        free(WDC_DEV_PRIV(pDev)->pIntHybrid);
+        WDC_DEV_PRIV(pDev)->pIntHybrid = NULL;
+    }
+
+    if (WDC_DEV_PRIV(pDev)->pIntVectors)
+    {
+        IntVectorsFree(WDC_DEV_PRIV(pDev)->pIntVectors);
+        WDC_DEV_PRIV(pDev)->pIntVectors = NULL;
+    }
+
     pDev->hIntThread = NULL;
     pDev->Int.kpCall.hKernelPlugIn = 0;
 
     return dwStatus;
 }
+
+DWORD DLLCALLCONV WDC_IntEnableVectors(_In_ WDC_DEVICE_HANDLE hDev,
+    _In_ const WDC_INT_VECTOR *pIntVectors, _In_ DWORD dwNumVectors,
+    _In_ WD_TRANSFER *pTransCmds, _In_ DWORD dwNumCmds, _In_ DWORD dwOptions,
+    _In_ BOOL fUseKP)
+{
+    PWDC_DEVICE pDev = (PWDC_DEVICE)hDev;
+    WDC_INT_VECTORS *pVectors;
+    BOOL fIdentify;
+    DWORD i, dwStatus;
+
+    WDC_Trace("WDC_IntEnableVectors: Entered\n");
+
+    if (!WdcIsValidDevHandle(hDev) ||
+        !WdcIsValidPtr((PVOID)pIntVectors, "NULL pointer to vectors array"))
+    {
+        WDC_Err("WDC_IntEnableVectors: %s", WdcGetLastErrStr());
+        return WD_INVALID_PARAMETER;
+    }
+
+    if (!dwNumVectors || dwNumVectors > WDC_INT_MAX_VECTORS)
+    {
+        WDC_Err("WDC_IntEnableVectors: Error - Invalid number of vectors "
+            "(%ld)\n", dwNumVectors);
+        return WD_INVALID_PARAMETER;
+    }
+
+    for (i = 0; i < dwNumVectors; i++)
+    {
+        if (!pIntVectors[i].funcIntHandler)
+        {
+            WDC_Err("WDC_IntEnableVectors: Error - NULL interrupt handler "
+                "callback function of vector %ld\n", i);
+            return WD_INVALID_PARAMETER;
+        }
+    }
+
+    if (dwOptions & INTERRUPT_DONT_GET_MSI_MESSAGE)
+    {
+        WDC_Err("WDC_IntEnableVectors: Error - The vectors are identified by "
+            "the MSI message (INTERRUPT_DONT_GET_MSI_MESSAGE is set)\n");
+        return WD_INVALID_PARAMETER;
+    }
+
+    if (pDev->hIntThread)
+    {
+        WDC_Trace("WDC_IntEnableVectors: Interrupt is already enabled\n");
+        return WD_OPERATION_ALREADY_DONE;
+    }
+
+    dwStatus = IntVectorsAlloc(pDev, pIntVectors, dwNumVectors, &pVectors);
+    if (WD_STATUS_SUCCESS != dwStatus)
+    {
+        WDC_Err("WDC_IntEnableVectors: Failed starting the vectors threads. "
+            "Error 0x%lx - %s\n", dwStatus, Stat2Str(dwStatus));
+        return dwStatus;
+    }
+
+    pDev->Int.dwLastMessage = INT_MESSAGE_NONE;
+    dwStatus = WDC_IntEnable(hDev, pTransCmds, dwNumCmds, dwOptions,
+        IntVectorsDispatch, pVectors, fUseKP);
+    if (WD_STATUS_SUCCESS != dwStatus)
+    {
+        IntVectorsFree(pVectors);
+        return dwStatus;
+    }
+
+    WDC_DEV_PRIV(pDev)->pIntVectors = pVectors;
+#if defined(WIN32)
+    fIdentify = WDC_INT_IS_MSI(WDC_GET_ENABLED_INT_TYPE(pDev));
+#else
+    /* The driver reports the message data only where it fills dwLastMessage;
+     * otherwise the dispatch finds INT_MESSAGE_NONE and wakes all the
+     * vectors */
+    fIdentify = IntVectorsMessagesRead(pVectors) &&
+        IntVectorsMessagesUnique(pVectors);
+#endif
+    OsMemoryBarrier();
+    pVectors->fIdentify = fIdentify;
+
+    if (dwNumVectors > 1 &&
+        !WDC_INT_IS_MSI(WDC_GET_ENABLED_INT_TYPE(pDev)))
+    {
+        WDC_Err("WDC_IntEnableVectors: Warning - %s is enabled; all the "
+            "vectors handlers are called per interrupt\n",
+            WDC_IntType2Str(WDC_GET_ENABLED_INT_TYPE(pDev)));
+    }
+
+    WDC_Trace("WDC_IntEnableVectors: %ld vectors enabled, %s\n",
+        dwNumVectors, fIdentify ? "identified by the interrupt message" :
+        "all woken per interrupt");
+
+    return WD_STATUS_SUCCESS;
+}
+
+DWORD DLLCALLCONV WDC_IntEnableHybrid(_In_ WDC_DEVICE_HANDLE hDev,
+    _In_ WD_TRANSFER *pTransCmds, _In_ DWORD dwNumCmds, _In_ DWORD dwOptions,
+    _In_ const WDC_INT_HYBRID_PARAMS *pParams, _In_ BOOL fUseKP)
+{
+    PWDC_DEVICE pDev = (PWDC_DEVICE)hDev;
+    WDC_INT_HYBRID *pHybrid;
+    DWORD dwStatus;
+
+    WDC_Trace("WDC_IntEnableHybrid: Entered\n");
+
+    if (!WdcIsValidDevHandle(hDev) ||
+        !WdcIsValidPtr((PVOID)pParams, "NULL pointer to hybrid parameters"))
+    {
+        WDC_Err("WDC_IntEnableHybrid: %s", WdcGetLastErrStr());
+        return WD_INVALID_PARAMETER;
+    }
+
+    if (!pParams->funcPoll || !pParams->funcIntMask)
+    {
+        WDC_Err("WDC_IntEnableHybrid: Error - NULL %s callback function\n",
+            !pParams->funcPoll ? "poll" : "interrupt mask");
+        return WD_INVALID_PARAMETER;
+    }
+
+    if (pDev->hIntThread)
+    {
+        WDC_Trace("WDC_IntEnableHybrid: Interrupt is already enabled\n");
+        return WD_OPERATION_ALREADY_DONE;
+    }
+
+    pHybrid = (WDC_INT_HYBRID *)calloc(1, sizeof(WDC_INT_HYBRID));
+    if (!pHybrid)
+    {
+        WDC_Err("WDC_IntEnableHybrid: Failed allocating memory\n");
+        return WD_INSUFFICIENT_RESOURCES;
+    }
+
+    pHybrid->params = *pParams;
+    if (!pHybrid->params.dwBudget)
+        pHybrid->params.dwBudget = INT_HYBRID_DEFAULT_BUDGET;
+    if (!pHybrid->params.dwIdlePolls)
+        pHybrid->params.dwIdlePolls = INT_HYBRID_DEFAULT_IDLE_POLLS;
+
+    WDC_DEV_PRIV(pDev)->pIntHybrid = pHybrid;
+    dwStatus = WDC_IntEnable(hDev, pTransCmds, dwNumCmds, dwOptions,
+        IntHybridHandler, pHybrid, fUseKP);
+    if (WD_STATUS_SUCCESS != dwStatus)
+    {
+        WDC_DEV_PRIV(pDev)->pIntHybrid = NULL;
+        free(pHybrid);
+        return dwStatus;
+    }
+
+    WDC_Trace("WDC_IntEnableHybrid: Budget %ld, idle polls %ld, poll interval "
+        "%ld us\n", pHybrid->params.dwBudget, pHybrid->params.dwIdlePolls,
+        pHybrid->params.dwPollIntervalUs);
+
+    return WD_STATUS_SUCCESS;
+}
+
+DWORD DLLCALLCONV WDC_IntGetHybridStats(_In_ WDC_DEVICE_HANDLE hDev,
+    _Out_ WDC_INT_HYBRID_STATS *pStats)
+{
+    if (!WdcIsValidDevHandle(hDev) ||
+        !WdcIsValidPtr(pStats, "NULL pointer to statistics"))
+    {
+        WDC_Err("WDC_IntGetHybridStats: %s", WdcGetLastErrStr());
+        return WD_INVALID_PARAMETER;
+    }
+
+    if (!WDC_DEV_PRIV(hDev)->pIntHybrid)
+    {
+        WDC_Err("WDC_IntGetHybridStats: Hybrid completion is not enabled\n");
+        return WD_OPERATION_FAILED;
+    }
+
+    *pStats = WDC_DEV_PRIV(hDev)->pIntHybrid->stats;
+
+    return WD_STATUS_SUCCESS;
+}
+
+DWORD DLLCALLCONV WDC_IntReactorStart(
+    _In_ const WDC_INT_REACTOR_PARAMS *pParams)
+{
+    DWORD dwStatus;
+
+    if (!WdcIsValidPtr((PVOID)pParams, "NULL pointer to reactor parameters"))
+    {
+        WDC_Err("WDC_IntReactorStart: %s", WdcGetLastErrStr());
+        return WD_INVALID_PARAMETER;
+    }
+
+    dwStatus = InterruptReactorStart(WDC_GetWDHandle(), pParams);
+    if (WD_STATUS_SUCCESS != dwStatus)
+    {
+        WDC_Err("WDC_IntReactorStart: Failed starting the interrupts reactor. "
+            "Error 0x%lx - %s\n", dwStatus, Stat2Str(dwStatus));
+        return dwStatus;
+    }
+
+    WDC_Trace("WDC_IntReactorStart: %ld workers, sleep %ld-%ld us\n",
+        pParams->dwWorkers, pParams->dwMinSleepUs, pParams->dwMaxSleepUs);
+
+    return WD_STATUS_SUCCESS;
+}
+
+DWORD DLLCALLCONV WDC_IntReactorStop(void)
+{
+    DWORD dwStatus = InterruptReactorStop();
+
+    if (WD_STATUS_SUCCESS != dwStatus)
+    {
+        WDC_Err("WDC_IntReactorStop: Failed stopping the interrupts reactor. "
+            "Error 0x%lx - %s\n", dwStatus, Stat2Str(dwStatus));
+    }
+
+    return dwStatus;
+}
 #endif
 
 BOOL DLLCALLCONV WDC_IntIsEnabled(_In_ WDC_DEVICE_HANDLE hDev)
@@ -8,6 +8,14 @@
 #include "wdc_lib.h"
 #include "wdc_defs.h"
 #include "wdc_err.h"
+#include "status_strings.h"
+
+#if !defined(__KERNEL__) && defined(__GNUC__) && \
+    (defined(x86_64) || defined(__x86_64__))
+    /* Wide (SSE2/AVX2) accesses for direct memory block transfers */
+    #define WDC_BLOCK_SIMD
+    #include <immintrin.h>
+#endif
 
 /*************************************************************
   General definitions
@@ -114,6 +122,39 @@ BOOL DLLCALLCONV WDC_AddrSpaceIsActive(_In_ WDC_DEVICE_HANDLE hDev,
     return (BOOL)pAddrDesc->qwBytes;
 }
 
+/* -----------------------------------------------
+    Write-combining memory address spaces
+   ----------------------------------------------- */
+/* Drain the CPU's write-combining buffers */
+static inline void WcFlush(void)
+{
+#if defined(WDC_BLOCK_SIMD)
+    _mm_sfence();
+#elif defined(__GNUC__) && (defined(ARM64) || defined(__aarch64__))
+    __asm__ __volatile__("dsb st" ::: "memory");
+#else
+    OsMemoryBarrier();
+#endif
+}
+
+DWORD DLLCALLCONV WDC_FlushWriteCombining(_In_ WDC_DEVICE_HANDLE hDev,
+    _In_ DWORD dwAddrSpace)
+{
+    if (!WdcIsValidDevHandle(hDev) ||
+        dwAddrSpace >= ((PWDC_DEVICE)hDev)->dwNumAddrSpaces)
+    {
+        WDC_Err("WDC_FlushWriteCombining: %s\n", !WdcIsValidDevHandle(hDev) ?
+            "Invalid device handle" : "Invalid address space");
+        return WD_INVALID_PARAMETER;
+    }
+
+    /* Stores to uncached address spaces are not buffered, but a fence is
+     * still issued, to order them with any preceding non-temporal stores */
+    WcFlush();
+
+    return WD_STATUS_SUCCESS;
+}
+
 /* -----------------------------------------------
     Read/Write memory and I/O addresses
    ----------------------------------------------- */
@@ -199,6 +240,281 @@ DECLARE_WRITE_ADDR(8)
 DECLARE_WRITE_ADDR(16)
 DECLARE_WRITE_ADDR(32)
 DECLARE_WRITE_ADDR(64)
+
+/* -----------------------------------------------
+    Direct block access to memory address spaces
+   ----------------------------------------------- */
+/* Block transfers on memory address spaces are performed directly on the
+ * mapped address space (see WDC_MEM_DIRECT_ADDR), without a transition to the
+ * kernel. The access mode is the width of each device access: WDC_MODE_8/16/32
+ * blocks are accessed item by item, while WDC_MODE_64 blocks with
+ * auto-increment may also be accessed with wide SSE2/AVX2 loads and
+ * non-temporal stores. With WDC_ADDR_RW_NO_AUTOINC every access is of exactly
+ * the mode's width, to the same device address (FIFO semantics).
+ * I/O address spaces, and memory blocks that cannot be accessed directly
+ * (unmapped, unaligned or out of the address space's range), are transferred by
+ * WD_Transfer() */
+static inline BOOL BlockIsDirect(const WDC_ADDR_DESC *pAddrDesc,
+    KPTR dwOffset, DWORD dwBytes, WDC_ADDR_MODE mode,
+    WDC_ADDR_RW_OPTIONS options)
+{
+    UPTR pAddr = (UPTR)WDC_MEM_DIRECT_ADDR(pAddrDesc);
+    UINT64 qwEnd = (UINT64)dwOffset +
+        ((options & WDC_ADDR_RW_NO_AUTOINC) ? (UINT64)mode : (UINT64)dwBytes);
+
+    if (!WDC_ADDR_IS_MEM(pAddrDesc) || !pAddr || !dwBytes)
+        return FALSE;
+
+    if (mode != WDC_MODE_8 && mode != WDC_MODE_16 && mode != WDC_MODE_32 &&
+        mode != WDC_MODE_64)
+    {
+        return FALSE;
+    }
+
+    if ((dwBytes % mode) || ((pAddr + (UPTR)dwOffset) % mode))
+        return FALSE;
+
+    return qwEnd <= pAddrDesc->qwBytes;
+}
+
+#define DECLARE_BLOCK_DIRECT(bits) \
+static void BlockRead##bits(UPTR pAddr, BYTE *pBuf, DWORD dwBytes, \
+    BOOL fAutoinc) \
+{ \
+    volatile U##bits *pReg = (volatile U##bits *)pAddr; \
+    U##bits val; \
+    DWORD i; \
+    \
+    if (fAutoinc) \
+    { \
+        for (i = 0; i < dwBytes; i += sizeof(val)) \
+        { \
+            val = *pReg++; \
+            memcpy(pBuf + i, &val, sizeof(val)); \
+        } \
+    } \
+    else \
+    { \
+        for (i = 0; i < dwBytes; i += sizeof(val)) \
+        { \
+            val = *pReg; \
+            memcpy(pBuf + i, &val, sizeof(val)); \
+        } \
+    } \
+} \
+\
+static void BlockWrite##bits(UPTR pAddr, const BYTE *pBuf, DWORD dwBytes, \
+    BOOL fAutoinc) \
+{ \
+    volatile U##bits *pReg = (volatile U##bits *)pAddr; \
+    U##bits val; \
+    DWORD i; \
+    \
+    if (fAutoinc) \
+    { \
+        for (i = 0; i < dwBytes; i += sizeof(val)) \
+        { \
+            memcpy(&val, pBuf + i, sizeof(val)); \
+            *pReg++ = val; \
+        } \
+    } \
+    else \
+    { \
+        for (i = 0; i < dwBytes; i += sizeof(val)) \
+        { \
+            memcpy(&val, pBuf + i, sizeof(val)); \
+            *pReg = val; \
+        } \
+    } \
+}
+
+DECLARE_BLOCK_DIRECT(8)
+DECLARE_BLOCK_DIRECT(16)
+DECLARE_BLOCK_DIRECT(32)
+DECLARE_BLOCK_DIRECT(64)
+
+#if defined(WDC_BLOCK_SIMD)
+static BOOL BlockHasAvx2(void)
+{
+    static int iAvx2 = -1;
+
+    if (iAvx2 < 0)
+    {
+        __builtin_cpu_init();
+        iAvx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+    }
+
+    return (BOOL)iAvx2;
+}
+
+/* Reads 32 byte chunks; pAddr must be 32 byte aligned.
+ * Returns the number of bytes read */
+__attribute__((target("avx2")))
+static DWORD BlockReadAvx2(UPTR pAddr, BYTE *pBuf, DWORD dwBytes)
+{
+    DWORD i;
+
+    for (i = 0; i + 32 <= dwBytes; i += 32)
+    {
+        _mm256_storeu_si256((__m256i *)(pBuf + i),
+            *(volatile __m256i *)(pAddr + i));
+    }
+
+    return i;
+}
+
+/* Writes 32 byte chunks; pAddr must be 32 byte aligned.
+ * Returns the number of bytes written */
+__attribute__((target("avx2")))
+static DWORD BlockWriteAvx2(UPTR pAddr, const BYTE *pBuf, DWORD dwBytes)
+{
+    DWORD i;
+
+    for (i = 0; i + 32 <= dwBytes; i += 32)
+    {
+        _mm256_stream_si256((__m256i *)(pAddr + i),
+            _mm256_loadu_si256((const __m256i *)(pBuf + i)));
+    }
+
+    return i;
+}
+
+static void BlockRead64Wide(UPTR pAddr, BYTE *pBuf, DWORD dwBytes)
+{
+    DWORD i = 0;
+
+    /* Use 64 bit accesses until the device address is 32 byte aligned */
+    for (; i < dwBytes && ((pAddr + i) & 31); i += 8)
+        BlockRead64(pAddr + i, pBuf + i, 8, TRUE);
+
+    if (BlockHasAvx2())
+        i += BlockReadAvx2(pAddr + i, pBuf + i, dwBytes - i);
+
+    for (; i + 16 <= dwBytes; i += 16)
+    {
+        _mm_storeu_si128((__m128i *)(pBuf + i),
+            *(volatile __m128i *)(pAddr + i));
+    }
+
+    if (i < dwBytes)
+        BlockRead64(pAddr + i, pBuf + i, dwBytes - i, TRUE);
+}
+
+static void BlockWrite64Wide(UPTR pAddr, const BYTE *pBuf, DWORD dwBytes)
+{
+    DWORD i = 0;
+
+    /* Use 64 bit accesses until the device address is 32 byte aligned */
+    for (; i < dwBytes && ((pAddr + i) & 31); i += 8)
+        BlockWrite64(pAddr + i, pBuf + i, 8, TRUE);
+
+    if (BlockHasAvx2())
+        i += BlockWriteAvx2(pAddr + i, pBuf + i, dwBytes - i);
+
+    for (; i + 16 <= dwBytes; i += 16)
+    {
+        _mm_stream_si128((__m128i *)(pAddr + i),
+            _mm_loadu_si128((const __m128i *)(pBuf + i)));
+    }
+
+    if (i < dwBytes)
+        BlockWrite64(pAddr + i, pBuf + i, dwBytes - i, TRUE);
+
+    /* Non-temporal stores are weakly ordered: make sure the block reaches the
+     * device before any following access to it */
+    _mm_sfence();
+}
+#endif
+
+static void BlockReadDirect(UPTR pAddr, PVOID pData, DWORD dwBytes,
+    WDC_ADDR_MODE mode, WDC_ADDR_RW_OPTIONS options)
+{
+    BOOL fAutoinc = !(options & WDC_ADDR_RW_NO_AUTOINC);
+
+    switch (mode)
+    {
+    case WDC_MODE_8:
+        BlockRead8(pAddr, (BYTE *)pData, dwBytes, fAutoinc);
+        break;
+    case WDC_MODE_16:
+        BlockRead16(pAddr, (BYTE *)pData, dwBytes, fAutoinc);
+        break;
+    case WDC_MODE_32:
+        BlockRead32(pAddr, (BYTE *)pData, dwBytes, fAutoinc);
+        break;
+    case WDC_MODE_64:
+#if defined(WDC_BLOCK_SIMD)
+        if (fAutoinc)
+        {
+            BlockRead64Wide(pAddr, (BYTE *)pData, dwBytes);
+            break;
+        }
+#endif
+        BlockRead64(pAddr, (BYTE *)pData, dwBytes, fAutoinc);
+        break;
+    }
+}
+
+static void BlockWriteDirect(UPTR pAddr, const PVOID pData, DWORD dwBytes,
+    WDC_ADDR_MODE mode, WDC_ADDR_RW_OPTIONS options, BOOL fWc)
+{
+    BOOL fAutoinc = !(options & WDC_ADDR_RW_NO_AUTOINC);
+
+    if (fWc)
+    {
+        DWORD i, dwWidth = WDC_ADDR_MODE_TO_SIZE(mode);
+
+        /* The CPU merges stores to the same write-combining address, so each
+         * element of a FIFO write is drained before the next one */
+        if (!fAutoinc)
+        {
+            for (i = 0; i < dwBytes; i += dwWidth)
+            {
+                BlockWriteDirect(pAddr, (BYTE *)pData + i, dwWidth, mode,
+                    options, FALSE);
+                WcFlush();
+            }
+            return;
+        }
+
+        /* Writes to a write-combining mapping are merged by the CPU anyway, so
+         * the access width is irrelevant: use the widest stores possible */
+#if defined(WDC_BLOCK_SIMD)
+        if (!(dwBytes % 8) && !(pAddr % 8))
+        {
+            BlockWrite64Wide(pAddr, (const BYTE *)pData, dwBytes);
+            return;
+        }
+#endif
+        BlockWriteDirect(pAddr, pData, dwBytes, mode, options, FALSE);
+        WcFlush();
+        return;
+    }
+
+    switch (mode)
+    {
+    case WDC_MODE_8:
+        BlockWrite8(pAddr, (const BYTE *)pData, dwBytes, fAutoinc);
+        break;
+    case WDC_MODE_16:
+        BlockWrite16(pAddr, (const BYTE *)pData, dwBytes, fAutoinc);
+        break;
+    case WDC_MODE_32:
+        BlockWrite32(pAddr, (const BYTE *)pData, dwBytes, fAutoinc);
+        break;
+    case WDC_MODE_64:
+#if defined(WDC_BLOCK_SIMD)
+        if (fAutoinc)
+        {
+            BlockWrite64Wide(pAddr, (const BYTE *)pData, dwBytes);
+            break;
+        }
+#endif
+        BlockWrite64(pAddr, (const BYTE *)pData, dwBytes, fAutoinc);
+        break;
+    }
+}
+
 DWORD DLLCALLCONV WDC_ReadAddrBlock(_In_ WDC_DEVICE_HANDLE hDev,
     _In_ DWORD dwAddrSpace, _In_ KPTR dwOffset, _In_ DWORD dwBytes,
     _Outptr_ PVOID pData, _In_ WDC_ADDR_MODE mode,
@@ -215,6 +531,13 @@ DWORD DLLCALLCONV WDC_ReadAddrBlock(_In_ WDC_DEVICE_HANDLE hDev,
 
     pAddrDesc = WDC_GET_ADDR_DESC(hDev, dwAddrSpace);
 
+    if (BlockIsDirect(pAddrDesc, dwOffset, dwBytes, mode, options))
+    {
+        BlockReadDirect((UPTR)WDC_MEM_DIRECT_ADDR(pAddrDesc) + (UPTR)dwOffset,
+            pData, dwBytes, mode, options);
+        return WD_STATUS_SUCCESS;
+    }
+
     READ_WRITE_ADDR_TRANS(pAddrDesc, dwOffset, pData, dwBytes, mode, WDC_READ,
         options, dwStatus);
     return dwStatus;
@@ -235,6 +558,13 @@ DWORD DLLCALLCONV WDC_WriteAddrBlock(_In_ WDC_DEVICE_HANDLE hDev,
 
     pAddrDesc = WDC_GET_ADDR_DESC(hDev, dwAddrSpace);
 
+    if (BlockIsDirect(pAddrDesc, dwOffset, dwBytes, mode, options))
+    {
+        BlockWriteDirect((UPTR)WDC_MEM_DIRECT_ADDR(pAddrDesc) + (UPTR)dwOffset,
+            pData, dwBytes, mode, options, WDC_ADDR_IS_WC(pAddrDesc));
+        return WD_STATUS_SUCCESS;
+    }
+
     READ_WRITE_ADDR_TRANS(pAddrDesc, dwOffset, pData, dwBytes, mode, WDC_WRITE,
         options, dwStatus);
     return dwStatus;
@@ -257,3 +587,720 @@ DWORD DLLCALLCONV WDC_MultiTransfer(_In_ WD_TRANSFER *pTransCmds,
     return WD_MultiTransfer(WDC_GetWDHandle(), pTransCmds, dwNumTrans);
 }
 
+
+#if !defined(__KERNEL__)
+/* -----------------------------------------------
+    Command buffers
+   ----------------------------------------------- */
+typedef struct {
+    PWDC_DEVICE pDev;
+    DWORD dwMaxCmds;
+    DWORD dwNumCmds;
+    WD_TRANSFER *pTrans; /* Commands; results are stored in pTrans[i].Data */
+    UPTR *pDirectAddr;   /* User-mode address of each memory command, or 0 for
+                          * commands that are executed by the kernel */
+    BOOL *pfWc;          /* Is each memory command on a write-combining
+                          * address space */
+} WDC_CMD_BUF;
+
+/* Get the access width (in bytes) of a memory or I/O transfer command.
+ * (I/O commands are numbered as their memory counterparts, minus 20) */
+static DWORD TransCmdWidth(DWORD cmdTrans)
+{
+    if (cmdTrans >= RP_BYTE && cmdTrans <= WP_SQWORD)
+        cmdTrans += RM_BYTE - RP_BYTE;
+
+    switch (cmdTrans)
+    {
+    case RM_BYTE: case WM_BYTE: case RM_SBYTE: case WM_SBYTE:
+        return WDC_SIZE_8;
+    case RM_WORD: case WM_WORD: case RM_SWORD: case WM_SWORD:
+        return WDC_SIZE_16;
+    case RM_DWORD: case WM_DWORD: case RM_SDWORD: case WM_SDWORD:
+        return WDC_SIZE_32;
+    case RM_QWORD: case WM_QWORD: case RM_SQWORD: case WM_SQWORD:
+        return WDC_SIZE_64;
+    default:
+        return 0;
+    }
+}
+
+static inline BOOL TransCmdIsMem(DWORD cmdTrans)
+{
+    return cmdTrans >= RM_BYTE && cmdTrans <= WM_SQWORD;
+}
+
+static inline BOOL TransCmdIsString(DWORD cmdTrans)
+{
+    return (cmdTrans >= RP_SBYTE && cmdTrans <= WP_SQWORD) ||
+        (cmdTrans >= RM_SBYTE && cmdTrans <= WM_SQWORD);
+}
+
+static inline BOOL TransCmdIsRead(DWORD cmdTrans)
+{
+    switch (cmdTrans)
+    {
+    case RM_BYTE: case RM_WORD: case RM_DWORD: case RM_QWORD:
+    case RM_SBYTE: case RM_SWORD: case RM_SDWORD: case RM_SQWORD:
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+/* Find the user-mode address of a memory transfer command, or return 0 if the
+ * command cannot be executed directly from user mode */
+static UPTR TransCmdDirectAddr(PWDC_DEVICE pDev, const WD_TRANSFER *pTrans,
+    BOOL *pfWc)
+{
+    DWORD i, dwWidth = TransCmdWidth(pTrans->cmdTrans);
+    UINT64 qwBytes;
+
+    if (!TransCmdIsMem(pTrans->cmdTrans))
+        return 0;
+
+    qwBytes = (TransCmdIsString(pTrans->cmdTrans) && pTrans->fAutoinc) ?
+        (UINT64)pTrans->dwBytes : (UINT64)dwWidth;
+
+    if (TransCmdIsString(pTrans->cmdTrans) &&
+        (!pTrans->dwBytes || pTrans->dwBytes % dwWidth))
+    {
+        return 0;
+    }
+
+    for (i = 0; i < pDev->dwNumAddrSpaces; i++)
+    {
+        WDC_ADDR_DESC *pAddrDesc = WDC_GET_ADDR_DESC(pDev, i);
+        UPTR pAddr = (UPTR)WDC_MEM_DIRECT_ADDR(pAddrDesc);
+
+        if (!WDC_ADDR_IS_MEM(pAddrDesc) || !pAddr ||
+            pTrans->pPort < pAddrDesc->pAddr ||
+            (UINT64)(pTrans->pPort - pAddrDesc->pAddr) + qwBytes >
+            pAddrDesc->qwBytes)
+        {
+            continue;
+        }
+
+        pAddr += (UPTR)(pTrans->pPort - pAddrDesc->pAddr);
+        if (pAddr % dwWidth)
+            return 0;
+
+        *pfWc = WDC_ADDR_IS_WC(pAddrDesc) ? TRUE : FALSE;
+        return pAddr;
+    }
+
+    return 0;
+}
+
+/* Execute a memory transfer command directly from user mode */
+static void TransCmdExecDirect(WD_TRANSFER *pTrans, UPTR pAddr, BOOL fWc)
+{
+    switch (pTrans->cmdTrans)
+    {
+    case RM_BYTE:
+        pTrans->Data.Byte = WDC_ReadMem8(pAddr, 0);
+        break;
+    case RM_WORD:
+        pTrans->Data.Word = WDC_ReadMem16(pAddr, 0);
+        break;
+    case RM_DWORD:
+        pTrans->Data.Dword = WDC_ReadMem32(pAddr, 0);
+        break;
+    case RM_QWORD:
+        pTrans->Data.Qword = WDC_ReadMem64(pAddr, 0);
+        break;
+    case WM_BYTE:
+        WDC_WriteMem8(pAddr, 0, pTrans->Data.Byte);
+        break;
+    case WM_WORD:
+        WDC_WriteMem16(pAddr, 0, pTrans->Data.Word);
+        break;
+    case WM_DWORD:
+        WDC_WriteMem32(pAddr, 0, pTrans->Data.Dword);
+        break;
+    case WM_QWORD:
+        WDC_WriteMem64(pAddr, 0, pTrans->Data.Qword);
+        break;
+    default: /* String commands */
+        if (TransCmdIsRead(pTrans->cmdTrans))
+        {
+            BlockReadDirect(pAddr, pTrans->Data.pBuffer, pTrans->dwBytes,
+                (WDC_ADDR_MODE)TransCmdWidth(pTrans->cmdTrans),
+                pTrans->fAutoinc ? WDC_ADDR_RW_DEFAULT :
+                WDC_ADDR_RW_NO_AUTOINC);
+        }
+        else
+        {
+            BlockWriteDirect(pAddr, pTrans->Data.pBuffer, pTrans->dwBytes,
+                (WDC_ADDR_MODE)TransCmdWidth(pTrans->cmdTrans),
+                pTrans->fAutoinc ? WDC_ADDR_RW_DEFAULT :
+                WDC_ADDR_RW_NO_AUTOINC, fWc);
+        }
+        break;
+    }
+}
+
+static DWORD CmdBufAppend(WDC_CMD_BUF *pCmdBuf, const WD_TRANSFER *pTrans,
+    DWORD *pdwIndex)
+{
+    DWORD dwIndex;
+
+    if (pCmdBuf->dwNumCmds >= pCmdBuf->dwMaxCmds)
+    {
+        WdcSetLastErrStr("Error - Command buffer is full (%d commands)\n",
+            pCmdBuf->dwMaxCmds);
+        return WD_INSUFFICIENT_RESOURCES;
+    }
+
+    dwIndex = pCmdBuf->dwNumCmds++;
+    pCmdBuf->pTrans[dwIndex] = *pTrans;
+    pCmdBuf->pfWc[dwIndex] = FALSE;
+    pCmdBuf->pDirectAddr[dwIndex] = TransCmdDirectAddr(pCmdBuf->pDev, pTrans,
+        &pCmdBuf->pfWc[dwIndex]);
+
+    if (pdwIndex)
+        *pdwIndex = dwIndex;
+
+    return WD_STATUS_SUCCESS;
+}
+
+static DWORD CmdBufAppendAddr(WDC_CMD_BUF *pCmdBuf, DWORD dwAddrSpace,
+    KPTR dwOffset, WDC_ADDR_MODE mode, WDC_DIRECTION direction, UINT64 qwVal,
+    DWORD *pdwIndex)
+{
+    WDC_ADDR_DESC *pAddrDesc;
+    WD_TRANSFER trans;
+
+    if (dwAddrSpace >= pCmdBuf->pDev->dwNumAddrSpaces)
+    {
+        WdcSetLastErrStr("Error - Invalid address space (%d)\n",
+            dwAddrSpace);
+        return WD_INVALID_PARAMETER;
+    }
+
+    pAddrDesc = WDC_GET_ADDR_DESC(pCmdBuf->pDev, dwAddrSpace);
+
+    BZERO(trans);
+    trans.pPort = pAddrDesc->pAddr + dwOffset;
+    trans.cmdTrans = get_trans_cmd(mode, direction, FALSE,
+        WDC_ADDR_IS_MEM(pAddrDesc));
+    if (!trans.cmdTrans)
+    {
+        WdcSetLastErrStr("Error - Invalid access mode (%d)\n", mode);
+        return WD_INVALID_PARAMETER;
+    }
+    trans.Data.Qword = qwVal;
+
+    return CmdBufAppend(pCmdBuf, &trans, pdwIndex);
+}
+
+DWORD DLLCALLCONV WDC_CmdBufCreate(_In_ WDC_DEVICE_HANDLE hDev,
+    _In_ DWORD dwMaxCmds, _Outptr_ WDC_CMD_BUF_HANDLE *phCmdBuf)
+{
+    WDC_CMD_BUF *pCmdBuf;
+
+    if (!WdcIsValidDevHandle(hDev) || !dwMaxCmds || !phCmdBuf)
+    {
+        WDC_Err("WDC_CmdBufCreate: %s\n", !WdcIsValidDevHandle(hDev) ?
+            "Invalid device handle" : "Invalid parameter");
+        return WD_INVALID_PARAMETER;
+    }
+
+    pCmdBuf = (WDC_CMD_BUF *)calloc(1, sizeof(WDC_CMD_BUF));
+    if (!pCmdBuf)
+        goto Error;
+
+    pCmdBuf->pTrans = (WD_TRANSFER *)calloc(dwMaxCmds, sizeof(WD_TRANSFER));
+    pCmdBuf->pDirectAddr = (UPTR *)calloc(dwMaxCmds, sizeof(UPTR));
+    pCmdBuf->pfWc = (BOOL *)calloc(dwMaxCmds, sizeof(BOOL));
+    if (!pCmdBuf->pTrans || !pCmdBuf->pDirectAddr || !pCmdBuf->pfWc)
+        goto Error;
+
+    pCmdBuf->pDev = (PWDC_DEVICE)hDev;
+    pCmdBuf->dwMaxCmds = dwMaxCmds;
+    *phCmdBuf = (WDC_CMD_BUF_HANDLE)pCmdBuf;
+
+    return WD_STATUS_SUCCESS;
+
+Error:
+    WDC_Err("WDC_CmdBufCreate: Failed allocating memory for %d commands\n",
+        dwMaxCmds);
+    if (pCmdBuf)
+        WDC_CmdBufDestroy(pCmdBuf);
+    return WD_INSUFFICIENT_RESOURCES;
+}
+
+DWORD DLLCALLCONV WDC_CmdBufDestroy(_In_ WDC_CMD_BUF_HANDLE hCmdBuf)
+{
+    WDC_CMD_BUF *pCmdBuf = (WDC_CMD_BUF *)hCmdBuf;
+
+    if (!pCmdBuf)
+    {
+        WDC_Err("WDC_CmdBufDestroy: Invalid command buffer handle\n");
+        return WD_INVALID_PARAMETER;
+    }
+
+    if (pCmdBuf->pTrans)
+        free(pCmdBuf->pTrans);
+    if (pCmdBuf->pDirectAddr)
+        free(pCmdBuf->pDirectAddr);
+    if (pCmdBuf->pfWc)
+        free(pCmdBuf->pfWc);
+    free(pCmdBuf);
+
+    return WD_STATUS_SUCCESS;
+}
+
+DWORD DLLCALLCONV WDC_CmdBufReset(_In_ WDC_CMD_BUF_HANDLE hCmdBuf)
+{
+    if (!hCmdBuf)
+    {
+        WDC_Err("WDC_CmdBufReset: Invalid command buffer handle\n");
+        return WD_INVALID_PARAMETER;
+    }
+
+    ((WDC_CMD_BUF *)hCmdBuf)->dwNumCmds = 0;
+
+    return WD_STATUS_SUCCESS;
+}
+
+DWORD DLLCALLCONV WDC_CmdBufAppendRead(_In_ WDC_CMD_BUF_HANDLE hCmdBuf,
+    _In_ DWORD dwAddrSpace, _In_ KPTR dwOffset, _In_ WDC_ADDR_MODE mode,
+    _Outptr_ DWORD *pdwIndex)
+{
+    DWORD dwStatus;
+
+    if (!hCmdBuf)
+    {
+        WDC_Err("WDC_CmdBufAppendRead: Invalid command buffer handle\n");
+        return WD_INVALID_PARAMETER;
+    }
+
+    dwStatus = CmdBufAppendAddr((WDC_CMD_BUF *)hCmdBuf, dwAddrSpace,
+        dwOffset, mode, WDC_READ, 0, pdwIndex);
+    if (WD_STATUS_SUCCESS != dwStatus)
+        WDC_Err("WDC_CmdBufAppendRead: %s", WdcGetLastErrStr());
+
+    return dwStatus;
+}
+
+DWORD DLLCALLCONV WDC_CmdBufAppendWrite(_In_ WDC_CMD_BUF_HANDLE hCmdBuf,
+    _In_ DWORD dwAddrSpace, _In_ KPTR dwOffset, _In_ WDC_ADDR_MODE mode,
+    _In_ UINT64 qwVal, _Outptr_ DWORD *pdwIndex)
+{
+    DWORD dwStatus;
+
+    if (!hCmdBuf)
+    {
+        WDC_Err("WDC_CmdBufAppendWrite: Invalid command buffer handle\n");
+        return WD_INVALID_PARAMETER;
+    }
+
+    dwStatus = CmdBufAppendAddr((WDC_CMD_BUF *)hCmdBuf, dwAddrSpace,
+        dwOffset, mode, WDC_WRITE, qwVal, pdwIndex);
+    if (WD_STATUS_SUCCESS != dwStatus)
+        WDC_Err("WDC_CmdBufAppendWrite: %s", WdcGetLastErrStr());
+
+    return dwStatus;
+}
+
+DWORD DLLCALLCONV WDC_CmdBufAppendTransfers(_In_ WDC_CMD_BUF_HANDLE hCmdBuf,
+    _In_ const WD_TRANSFER *pTransCmds, _In_ DWORD dwNumTrans)
+{
+    WDC_CMD_BUF *pCmdBuf = (WDC_CMD_BUF *)hCmdBuf;
+    DWORD i, dwStatus;
+
+    if (!pCmdBuf || !pTransCmds)
+    {
+        WDC_Err("WDC_CmdBufAppendTransfers: %s\n", !pCmdBuf ?
+            "Invalid command buffer handle" : "NULL WD_TRANSFER pointer");
+        return WD_INVALID_PARAMETER;
+    }
+
+    if (dwNumTrans > pCmdBuf->dwMaxCmds - pCmdBuf->dwNumCmds)
+    {
+        WDC_Err("WDC_CmdBufAppendTransfers: Not enough room for %d commands "
+            "(%d of %d used)\n", dwNumTrans, pCmdBuf->dwNumCmds,
+            pCmdBuf->dwMaxCmds);
+        return WD_INSUFFICIENT_RESOURCES;
+    }
+
+    for (i = 0; i < dwNumTrans; i++)
+    {
+        dwStatus = CmdBufAppend(pCmdBuf, &pTransCmds[i], NULL);
+        if (WD_STATUS_SUCCESS != dwStatus)
+            return dwStatus;
+    }
+
+    return WD_STATUS_SUCCESS;
+}
+
+DWORD DLLCALLCONV WDC_CmdBufExecute(_In_ WDC_CMD_BUF_HANDLE hCmdBuf)
+{
+    WDC_CMD_BUF *pCmdBuf = (WDC_CMD_BUF *)hCmdBuf;
+    BOOL fWcPending = FALSE;
+    UPTR pWcLast = 0;
+    DWORD i, j, dwStatus;
+
+    if (!pCmdBuf)
+    {
+        WDC_Err("WDC_CmdBufExecute: Invalid command buffer handle\n");
+        return WD_INVALID_PARAMETER;
+    }
+
+    for (i = 0; i < pCmdBuf->dwNumCmds; i = j)
+    {
+        /* Keep the program order between write-combining accesses and
+         * other accesses, and do not let the CPU merge repeated accesses to
+         * the same write-combining address (e.g. a FIFO register) */
+        if (fWcPending && (!pCmdBuf->pfWc[i] ||
+            pCmdBuf->pDirectAddr[i] == pWcLast))
+        {
+            WcFlush();
+            fWcPending = FALSE;
+        }
+
+        if (pCmdBuf->pDirectAddr[i])
+        {
+            TransCmdExecDirect(&pCmdBuf->pTrans[i], pCmdBuf->pDirectAddr[i],
+                pCmdBuf->pfWc[i]);
+            fWcPending |= pCmdBuf->pfWc[i];
+            pWcLast = pCmdBuf->pfWc[i] ? pCmdBuf->pDirectAddr[i] : 0;
+            j = i + 1;
+            continue;
+        }
+
+        /* Pass the run of consecutive kernel commands in a single call */
+        for (j = i + 1; j < pCmdBuf->dwNumCmds && !pCmdBuf->pDirectAddr[j];
+            j++);
+
+        dwStatus = (j - i == 1) ?
+            WD_Transfer(WDC_GetWDHandle(), &pCmdBuf->pTrans[i]) :
+            WD_MultiTransfer(WDC_GetWDHandle(), &pCmdBuf->pTrans[i], j - i);
+        if (WD_STATUS_SUCCESS != dwStatus)
+        {
+            WDC_Err("WDC_CmdBufExecute: Failed executing commands %d-%d. "
+                "Error 0x%x - %s\n", i, j - 1, dwStatus, Stat2Str(dwStatus));
+            return dwStatus;
+        }
+    }
+
+    if (fWcPending)
+        WcFlush();
+
+    return WD_STATUS_SUCCESS;
+}
+
+DWORD DLLCALLCONV WDC_CmdBufGetResult(_In_ WDC_CMD_BUF_HANDLE hCmdBuf,
+    _In_ DWORD dwIndex, _Outptr_ UINT64 *pqwVal)
+{
+    WDC_CMD_BUF *pCmdBuf = (WDC_CMD_BUF *)hCmdBuf;
+    WD_TRANSFER *pTrans;
+
+    if (!pCmdBuf || !pqwVal || dwIndex >= pCmdBuf->dwNumCmds)
+    {
+        WDC_Err("WDC_CmdBufGetResult: %s\n", !pCmdBuf ?
+            "Invalid command buffer handle" : "Invalid parameter");
+        return WD_INVALID_PARAMETER;
+    }
+
+    pTrans = &pCmdBuf->pTrans[dwIndex];
+    if (TransCmdIsString(pTrans->cmdTrans))
+    {
+        WDC_Err("WDC_CmdBufGetResult: Command %d is a string command; its data "
+            "is in its buffer\n", dwIndex);
+        return WD_INVALID_PARAMETER;
+    }
+
+    switch (TransCmdWidth(pTrans->cmdTrans))
+    {
+    case WDC_SIZE_8:
+        *pqwVal = pTrans->Data.Byte;
+        break;
+    case WDC_SIZE_16:
+        *pqwVal = pTrans->Data.Word;
+        break;
+    case WDC_SIZE_32:
+        *pqwVal = pTrans->Data.Dword;
+        break;
+    default:
+        *pqwVal = pTrans->Data.Qword;
+        break;
+    }
+
+    return WD_STATUS_SUCCESS;
+}
+
+DWORD DLLCALLCONV WDC_CmdBufGetInfo(_In_ WDC_CMD_BUF_HANDLE hCmdBuf,
+    _Outptr_ DWORD *pdwNumCmds, _Outptr_ DWORD *pdwKernelCmds,
+    _Outptr_ DWORD *pdwKernelRuns)
+{
+    WDC_CMD_BUF *pCmdBuf = (WDC_CMD_BUF *)hCmdBuf;
+    DWORD i, dwKernelCmds = 0, dwKernelRuns = 0;
+
+    if (!pCmdBuf)
+    {
+        WDC_Err("WDC_CmdBufGetInfo: Invalid command buffer handle\n");
+        return WD_INVALID_PARAMETER;
+    }
+
+    for (i = 0; i < pCmdBuf->dwNumCmds; i++)
+    {
+        if (pCmdBuf->pDirectAddr[i])
+            continue;
+
+        dwKernelCmds++;
+        if (!i || pCmdBuf->pDirectAddr[i - 1])
+            dwKernelRuns++;
+    }
+
+    if (pdwNumCmds)
+        *pdwNumCmds = pCmdBuf->dwNumCmds;
+    if (pdwKernelCmds)
+        *pdwKernelCmds = dwKernelCmds;
+    if (pdwKernelRuns)
+        *pdwKernelRuns = dwKernelRuns;
+
+    return WD_STATUS_SUCCESS;
+}
+
+/* -----------------------------------------------
+    Write batches
+   ----------------------------------------------- */
+/* Write batch: the writes of an open scope are kept in a command buffer, and
+ * executed on commit, followed by a single flush read */
+typedef struct {
+    WDC_CMD_BUF_HANDLE hCmdBuf;
+    BOOL fInScope;
+    DWORD dwFlushAddrSpace;
+    KPTR dwFlushOffset;
+    DWORD dwFlushPoints;     /* Flush points marked in the open scope */
+    WDC_WRITE_BATCH_STATS stats;
+} WDC_WRITE_BATCH;
+
+DWORD DLLCALLCONV WDC_WriteBatchCreate(_In_ WDC_DEVICE_HANDLE hDev,
+    _In_ DWORD dwMaxWrites, _Outptr_ WDC_WRITE_BATCH_HANDLE *phBatch)
+{
+    WDC_WRITE_BATCH *pBatch;
+    DWORD dwStatus;
+
+    if (!WdcIsValidDevHandle(hDev) || !dwMaxWrites || !phBatch)
+    {
+        WDC_Err("WDC_WriteBatchCreate: %s\n", !WdcIsValidDevHandle(hDev) ?
+            "Invalid device handle" : "Invalid parameter");
+        return WD_INVALID_PARAMETER;
+    }
+
+    pBatch = (WDC_WRITE_BATCH *)calloc(1, sizeof(WDC_WRITE_BATCH));
+    if (!pBatch)
+    {
+        WDC_Err("WDC_WriteBatchCreate: Failed allocating memory\n");
+        return WD_INSUFFICIENT_RESOURCES;
+    }
+
+    /* One more command for the flush read */
+    dwStatus = WDC_CmdBufCreate(hDev, dwMaxWrites + 1, &pBatch->hCmdBuf);
+    if (dwStatus)
+    {
+        free(pBatch);
+        return dwStatus;
+    }
+
+    *phBatch = (WDC_WRITE_BATCH_HANDLE)pBatch;
+
+    return WD_STATUS_SUCCESS;
+}
+
+DWORD DLLCALLCONV WDC_WriteBatchDestroy(_In_ WDC_WRITE_BATCH_HANDLE hBatch)
+{
+    WDC_WRITE_BATCH *pBatch = (WDC_WRITE_BATCH *)hBatch;
+
+    if (!pBatch)
+    {
+        WDC_Err("WDC_WriteBatchDestroy: Invalid write batch handle\n");
+        return WD_INVALID_PARAMETER;
+    }
+
+    if (pBatch->fInScope)
+    {
+        WDC_Trace("WDC_WriteBatchDestroy: Discarding the writes of an open "
+            "scope\n");
+    }
+
+    WDC_CmdBufDestroy(pBatch->hCmdBuf);
+    free(pBatch);
+
+    return WD_STATUS_SUCCESS;
+}
+
+DWORD DLLCALLCONV WDC_WriteBatchBegin(_In_ WDC_WRITE_BATCH_HANDLE hBatch,
+    _In_ DWORD dwFlushAddrSpace, _In_ KPTR dwFlushOffset)
+{
+    WDC_WRITE_BATCH *pBatch = (WDC_WRITE_BATCH *)hBatch;
+
+    if (!pBatch)
+    {
+        WDC_Err("WDC_WriteBatchBegin: Invalid write batch handle\n");
+        return WD_INVALID_PARAMETER;
+    }
+
+    if (!pBatch->fInScope)
+    {
+        WDC_CmdBufReset(pBatch->hCmdBuf);
+        pBatch->dwFlushPoints = 0;
+        pBatch->fInScope = TRUE;
+    }
+
+    pBatch->dwFlushAddrSpace = dwFlushAddrSpace;
+    pBatch->dwFlushOffset = dwFlushOffset;
+
+    return WD_STATUS_SUCCESS;
+}
+
+static DWORD WriteBatchWrite(WDC_WRITE_BATCH *pBatch, DWORD dwAddrSpace,
+    KPTR dwOffset, WDC_ADDR_MODE mode, UINT64 qwVal, const CHAR *sFunc)
+{
+    DWORD dwStatus;
+
+    if (!pBatch || !pBatch->fInScope)
+    {
+        WDC_Err("%s: %s\n", sFunc, !pBatch ? "Invalid write batch handle" :
+            "No open scope (see WDC_WriteBatchBegin())");
+        return WD_INVALID_PARAMETER;
+    }
+
+    dwStatus = WDC_CmdBufAppendWrite(pBatch->hCmdBuf, dwAddrSpace, dwOffset,
+        mode, qwVal, NULL);
+    if (dwStatus)
+    {
+        WDC_Err("%s: Failed adding write to the batch. Error 0x%lx - %s\n",
+            sFunc, dwStatus, Stat2Str(dwStatus));
+    }
+
+    return dwStatus;
+}
+
+DWORD DLLCALLCONV WDC_WriteBatchWrite32(_In_ WDC_WRITE_BATCH_HANDLE hBatch,
+    _In_ DWORD dwAddrSpace, _In_ KPTR dwOffset, _In_ UINT32 u32Val)
+{
+    return WriteBatchWrite((WDC_WRITE_BATCH *)hBatch, dwAddrSpace, dwOffset,
+        WDC_MODE_32, u32Val, "WDC_WriteBatchWrite32");
+}
+
+DWORD DLLCALLCONV WDC_WriteBatchWrite64(_In_ WDC_WRITE_BATCH_HANDLE hBatch,
+    _In_ DWORD dwAddrSpace, _In_ KPTR dwOffset, _In_ UINT64 u64Val)
+{
+    return WriteBatchWrite((WDC_WRITE_BATCH *)hBatch, dwAddrSpace, dwOffset,
+        WDC_MODE_64, u64Val, "WDC_WriteBatchWrite64");
+}
+
+DWORD DLLCALLCONV WDC_WriteBatchFlushPoint(_In_ WDC_WRITE_BATCH_HANDLE hBatch)
+{
+    WDC_WRITE_BATCH *pBatch = (WDC_WRITE_BATCH *)hBatch;
+
+    if (!pBatch || !pBatch->fInScope)
+    {
+        WDC_Err("WDC_WriteBatchFlushPoint: %s\n", !pBatch ?
+            "Invalid write batch handle" :
+            "No open scope (see WDC_WriteBatchBegin())");
+        return WD_INVALID_PARAMETER;
+    }
+
+    pBatch->dwFlushPoints++;
+
+    return WD_STATUS_SUCCESS;
+}
+
+DWORD DLLCALLCONV WDC_WriteBatchCommit(_In_ WDC_WRITE_BATCH_HANDLE hBatch,
+    _Outptr_ UINT32 *pu32FlushVal)
+{
+    WDC_WRITE_BATCH *pBatch = (WDC_WRITE_BATCH *)hBatch;
+    DWORD dwStatus, dwIndex, dwWrites;
+    UINT64 qwVal = 0;
+
+    if (!pBatch || !pBatch->fInScope)
+    {
+        WDC_Err("WDC_WriteBatchCommit: %s\n", !pBatch ?
+            "Invalid write batch handle" :
+            "No open scope (see WDC_WriteBatchBegin())");
+        return WD_INVALID_PARAMETER;
+    }
+
+    pBatch->fInScope = FALSE;
+
+    WDC_CmdBufGetInfo(pBatch->hCmdBuf, &dwWrites, NULL, NULL);
+    if (!dwWrites)
+        return WD_STATUS_SUCCESS;
+
+    /* Posted writes reach the device in order; a single read of the device,
+     * after the last write, guarantees that all of them have completed */
+    dwStatus = WDC_CmdBufAppendRead(pBatch->hCmdBuf, pBatch->dwFlushAddrSpace,
+        pBatch->dwFlushOffset, WDC_MODE_32, &dwIndex);
+    if (dwStatus)
+    {
+        WDC_Err("WDC_WriteBatchCommit: Failed adding the flush read. "
+            "Error 0x%lx - %s\n", dwStatus, Stat2Str(dwStatus));
+        return dwStatus;
+    }
+
+    dwStatus = WDC_CmdBufExecute(pBatch->hCmdBuf);
+    if (dwStatus)
+    {
+        WDC_Err("WDC_WriteBatchCommit: Failed executing the batch. "
+            "Error 0x%lx - %s\n", dwStatus, Stat2Str(dwStatus));
+        return dwStatus;
+    }
+
+    WDC_CmdBufGetResult(pBatch->hCmdBuf, dwIndex, &qwVal);
+    if (pu32FlushVal)
+        *pu32FlushVal = (UINT32)qwVal;
+
+    pBatch->stats.qwScopes++;
+    pBatch->stats.qwWrites += dwWrites;
+    pBatch->stats.qwFlushReads++;
+    if (pBatch->dwFlushPoints > 1)
+        pBatch->stats.qwFlushReadsSaved += pBatch->dwFlushPoints - 1;
+
+    return WD_STATUS_SUCCESS;
+}
+
+DWORD DLLCALLCONV WDC_WriteBatchAbort(_In_ WDC_WRITE_BATCH_HANDLE hBatch)
+{
+    WDC_WRITE_BATCH *pBatch = (WDC_WRITE_BATCH *)hBatch;
+
+    if (!pBatch)
+    {
+        WDC_Err("WDC_WriteBatchAbort: Invalid write batch handle\n");
+        return WD_INVALID_PARAMETER;
+    }
+
+    if (!pBatch->fInScope)
+        return WD_STATUS_SUCCESS;
+
+    /* None of the scope's writes has been issued yet */
+    WDC_CmdBufReset(pBatch->hCmdBuf);
+    pBatch->dwFlushPoints = 0;
+    pBatch->fInScope = FALSE;
+
+    return WD_STATUS_SUCCESS;
+}
+
+DWORD DLLCALLCONV WDC_WriteBatchGetStats(_In_ WDC_WRITE_BATCH_HANDLE hBatch,
+    _Outptr_ WDC_WRITE_BATCH_STATS *pStats, _In_ BOOL fReset)
+{
+    WDC_WRITE_BATCH *pBatch = (WDC_WRITE_BATCH *)hBatch;
+
+    if (!pBatch || !pStats)
+    {
+        WDC_Err("WDC_WriteBatchGetStats: %s\n", !pBatch ?
+            "Invalid write batch handle" : "Invalid parameter");
+        return WD_INVALID_PARAMETER;
+    }
+
+    *pStats = pBatch->stats;
+    if (fReset)
+        BZERO(pBatch->stats);
+
+    return WD_STATUS_SUCCESS;
+}
+#endif /* !defined(__KERNEL__) */
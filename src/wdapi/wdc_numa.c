@@ -0,0 +1,267 @@
+/* Jungo Connectivity Confidential. Copyright (c) 2022 Jungo Connectivity Ltd.  https://www.jungo.com */
+
+/*****************************************************************************
+*  File: wdc_numa.c - Implementation of the WDC NUMA placement API           *
+******************************************************************************/
+
+#if defined(LINUX) && !defined(__KERNEL__) && !defined(_GNU_SOURCE)
+    #define _GNU_SOURCE /* pthread_getaffinity_np() */
+#endif
+
+#include "utils.h"
+#include "wdc_lib.h"
+#include "wdc_defs.h"
+#include "wdc_err.h"
+#include "wdc_priv.h"
+#include "status_strings.h"
+
+#if !defined(__KERNEL__)
+
+#if defined(WIN32)
+    #include <windows.h>
+#elif defined(LINUX)
+    #include <pthread.h>
+    #include <sched.h>
+    #include <unistd.h>
+    #include <errno.h>
+    #include <sys/syscall.h>
+
+    /* From linux/mempolicy.h */
+    #define NUMA_MPOL_PREFERRED 1
+    #define NUMA_MPOL_MF_MOVE (1 << 1)
+    #define NUMA_MAX_NODES 1024
+#endif
+
+/*************************************************************
+  General definitions
+ *************************************************************/
+/* Node of the allocations that are not associated with a device */
+static DWORD gdwDefaultNode = WDC_NUMA_NODE_ANY;
+/* TRUE if the default node was set by WDC_SetNumaNode() */
+static BOOL gfDefaultNodeSet = FALSE;
+
+static BOOL NumaNodeIsValid(DWORD dwNode)
+{
+#if defined(WIN32)
+    ULONG ulHighest;
+
+    return GetNumaHighestNodeNumber(&ulHighest) && dwNode <= ulHighest;
+#elif defined(LINUX)
+    CHAR sPath[64];
+
+    snprintf(sPath, sizeof(sPath), "/sys/devices/system/node/node%u",
+        (unsigned)dwNode);
+
+    return !access(sPath, F_OK);
+#else
+    return FALSE;
+#endif
+}
+
+/* Returns the NUMA node of a PCI device, or WDC_NUMA_NODE_ANY if the node is
+ * unknown or the system is not NUMA */
+static DWORD NumaNodeDetect(const WD_PCI_SLOT *pSlot)
+{
+#if defined(LINUX)
+    CHAR sPath[64];
+    FILE *fp;
+    int node = -1;
+
+    snprintf(sPath, sizeof(sPath),
+        "/sys/bus/pci/devices/%04x:%02x:%02x.%x/numa_node",
+        (unsigned)pSlot->dwDomain, (unsigned)pSlot->dwBus,
+        (unsigned)pSlot->dwSlot, (unsigned)pSlot->dwFunction);
+
+    fp = fopen(sPath, "r");
+    if (!fp)
+        return WDC_NUMA_NODE_ANY;
+
+    if (fscanf(fp, "%d", &node) != 1)
+        node = -1;
+    fclose(fp);
+
+    return node < 0 ? WDC_NUMA_NODE_ANY : (DWORD)node;
+#else
+    UNUSED_VAR(pSlot);
+    return WDC_NUMA_NODE_ANY;
+#endif
+}
+
+/*************************************************************
+  Functions implementations
+ *************************************************************/
+DWORD DLLCALLCONV WDC_GetNumaNode(_In_ WDC_DEVICE_HANDLE hDev,
+    _Out_ DWORD *pdwNode)
+{
+    if (!WdcIsValidPtr(pdwNode, "NULL pointer to NUMA node") ||
+        (hDev && !WdcIsValidDevHandle(hDev)))
+    {
+        WDC_Err("WDC_GetNumaNode: %s", WdcGetLastErrStr());
+        return WD_INVALID_PARAMETER;
+    }
+
+    *pdwNode = WdcNumaNodeGet((PWDC_DEVICE)hDev);
+
+    return WD_STATUS_SUCCESS;
+}
+
+DWORD DLLCALLCONV WDC_SetNumaNode(_In_ WDC_DEVICE_HANDLE hDev,
+    _In_ DWORD dwNode)
+{
+    if (hDev && !WdcIsValidDevHandle(hDev))
+    {
+        WDC_Err("WDC_SetNumaNode: %s", WdcGetLastErrStr());
+        return WD_INVALID_PARAMETER;
+    }
+
+    if (WDC_NUMA_NODE_ANY != dwNode && !NumaNodeIsValid(dwNode))
+    {
+        WDC_Err("WDC_SetNumaNode: Invalid NUMA node %ld\n", dwNode);
+        return WD_INVALID_PARAMETER;
+    }
+
+    if (hDev)
+    {
+        WDC_DEV_PRIV(hDev)->dwNumaNode = dwNode;
+    }
+    else
+    {
+        gdwDefaultNode = dwNode;
+        gfDefaultNodeSet = TRUE;
+    }
+
+    return WD_STATUS_SUCCESS;
+}
+
+DWORD DLLCALLCONV WDC_NumaThreadBind(_In_ WDC_DEVICE_HANDLE hDev,
+    _In_ HANDLE hThread)
+{
+    DWORD dwNode, dwStatus;
+
+    if (hDev && !WdcIsValidDevHandle(hDev))
+    {
+        WDC_Err("WDC_NumaThreadBind: %s", WdcGetLastErrStr());
+        return WD_INVALID_PARAMETER;
+    }
+
+    dwNode = WdcNumaNodeGet((PWDC_DEVICE)hDev);
+    if (WDC_NUMA_NODE_ANY == dwNode)
+        return WD_STATUS_SUCCESS;
+
+    dwStatus = ThreadBindNumaNode(hThread, dwNode);
+    if (WD_STATUS_SUCCESS != dwStatus)
+    {
+        WDC_Err("WDC_NumaThreadBind: Failed binding a thread to NUMA node "
+            "%ld. Error 0x%lx - %s\n", dwNode, dwStatus, Stat2Str(dwStatus));
+    }
+
+    return dwStatus;
+}
+
+/*
+ * WDC library internal functions
+ */
+void WdcNumaDeviceInit(PWDC_DEVICE pDev)
+{
+    DWORD dwNode = NumaNodeDetect(&pDev->slot);
+
+    WDC_DEV_PRIV(pDev)->dwNumaNode = dwNode;
+    if (WDC_NUMA_NODE_ANY == dwNode)
+        return;
+
+    if (!gfDefaultNodeSet && WDC_NUMA_NODE_ANY == gdwDefaultNode)
+        gdwDefaultNode = dwNode;
+
+    WDC_Trace("WdcNumaDeviceInit: Device %04lx:%02lx:%02lx.%lx is on NUMA "
+        "node %ld\n", pDev->slot.dwDomain, pDev->slot.dwBus, pDev->slot.dwSlot,
+        pDev->slot.dwFunction, dwNode);
+}
+
+DWORD WdcNumaNodeGet(PWDC_DEVICE pDev)
+{
+    return pDev ? WDC_DEV_PRIV(pDev)->dwNumaNode : gdwDefaultNode;
+}
+
+void WdcNumaMemBind(PVOID pBuf, UINT64 qwBytes, DWORD dwNode)
+{
+#if defined(LINUX)
+    unsigned long mask[NUMA_MAX_NODES / (8 * sizeof(unsigned long))];
+    UPTR start, end;
+
+    if (WDC_NUMA_NODE_ANY == dwNode || dwNode >= NUMA_MAX_NODES || !pBuf ||
+        !qwBytes)
+    {
+        return;
+    }
+
+    start = (UPTR)pBuf & ~((UPTR)GetPageSize() - 1);
+    end = ((UPTR)pBuf + qwBytes + GetPageSize() - 1) &
+        ~((UPTR)GetPageSize() - 1);
+
+    memset(mask, 0, sizeof(mask));
+    mask[dwNode / (8 * sizeof(unsigned long))] =
+        1UL << (dwNode % (8 * sizeof(unsigned long)));
+
+    /* Pages that are shared with other processes are not migrated */
+    if (syscall(SYS_mbind, start, end - start, NUMA_MPOL_PREFERRED, mask,
+        NUMA_MAX_NODES, NUMA_MPOL_MF_MOVE))
+    {
+        WDC_Trace("WdcNumaMemBind: Failed binding buffer %p to NUMA node %ld "
+            "(errno %d)\n", pBuf, dwNode, errno);
+    }
+#else
+    /* Pages are allocated on the node of the thread that first touches them */
+    UNUSED_VAR(pBuf);
+    UNUSED_VAR(qwBytes);
+    UNUSED_VAR(dwNode);
+#endif
+}
+
+void WdcNumaScopeEnter(DWORD dwNode, WDC_NUMA_SCOPE *pScope)
+{
+    pScope->fBound = FALSE;
+    if (WDC_NUMA_NODE_ANY == dwNode)
+        return;
+
+#if defined(WIN32)
+    {
+        ULONGLONG qwMask;
+
+        if (dwNode > 0xFF || !GetNumaNodeProcessorMask((UCHAR)dwNode,
+            &qwMask) || !qwMask)
+        {
+            return;
+        }
+
+        pScope->qwSavedMask[0] = SetThreadAffinityMask(GetCurrentThread(),
+            (DWORD_PTR)qwMask);
+        pScope->fBound = pScope->qwSavedMask[0] != 0;
+    }
+#elif defined(LINUX)
+    if (sizeof(cpu_set_t) > sizeof(pScope->qwSavedMask) ||
+        pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t),
+        (cpu_set_t *)pScope->qwSavedMask))
+    {
+        return;
+    }
+
+    pScope->fBound = WD_STATUS_SUCCESS == ThreadBindNumaNode(NULL, dwNode);
+#endif
+}
+
+void WdcNumaScopeLeave(WDC_NUMA_SCOPE *pScope)
+{
+    if (!pScope->fBound)
+        return;
+
+#if defined(WIN32)
+    SetThreadAffinityMask(GetCurrentThread(),
+        (DWORD_PTR)pScope->qwSavedMask[0]);
+#elif defined(LINUX)
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t),
+        (cpu_set_t *)pScope->qwSavedMask);
+#endif
+    pScope->fBound = FALSE;
+}
+
+#endif /* !defined(__KERNEL__) */
@@ -0,0 +1,76 @@
+/* Jungo Connectivity Confidential. Copyright (c) 2022 Jungo Connectivity Ltd.  https://www.jungo.com */
+
+#ifndef _WDC_PRIV_H_
+#define _WDC_PRIV_H_
+
+/****************************************************************
+*  File: wdc_priv.h - WD card (WDC) internal device information *
+*        (for use only by the WDC library)                      *
+*****************************************************************/
+
+#include "wdc_defs.h"
+
+#if !defined(__KERNEL__)
+
+/* WDC library internal device information (pDev->pPriv) */
+typedef struct {
+    struct WDC_SHADOW *pShadow;     /* Register shadow cache -- see
+                                     * wdc_shadow.c */
+    EVENT_HANDLER funcEventHandler; /* User's events handler, called by the
+                                     * WDC events handler */
+    PVOID pEventData;               /* User's events handler data */
+    DWORD dwNumaNode;               /* NUMA node of the device -- see
+                                     * wdc_numa.c */
+    struct WDC_INT_VECTORS *pIntVectors; /* Per-vector interrupt handlers --
+                                          * see wdc_ints.c */
+    struct WDC_INT_HYBRID *pIntHybrid;   /* Hybrid interrupt/polling
+                                          * completion -- see wdc_ints.c */
+} WDC_DEVICE_PRIV;
+
+/* Get the internal information of a device */
+#define WDC_DEV_PRIV(pDev) ((WDC_DEVICE_PRIV *)((PWDC_DEVICE)(pDev))->pPriv)
+
+/* Register shadow cache internal API (wdc_shadow.c) */
+void WdcShadowInvalidate(PWDC_DEVICE pDev);
+void WdcShadowDestroy(PWDC_DEVICE pDev);
+
+/* NUMA placement internal API (wdc_numa.c) */
+typedef struct {
+    BOOL fBound;
+    UINT64 qwSavedMask[16]; /* CPU affinity of the thread before the scope */
+} WDC_NUMA_SCOPE;
+
+void WdcNumaDeviceInit(PWDC_DEVICE pDev);
+/* NUMA node of a device, or the default node if pDev is NULL */
+DWORD WdcNumaNodeGet(PWDC_DEVICE pDev);
+/* Prefer the allocation of a user buffer's pages on a node, and migrate the
+ * pages that are already allocated */
+void WdcNumaMemBind(PVOID pBuf, UINT64 qwBytes, DWORD dwNode);
+/* Run the calling thread on a node until WdcNumaScopeLeave(), so that the
+ * kernel allocates memory on the node */
+void WdcNumaScopeEnter(DWORD dwNode, WDC_NUMA_SCOPE *pScope);
+void WdcNumaScopeLeave(WDC_NUMA_SCOPE *pScope);
+
+/* DMA completion queues internal API (wdc_completion.c) */
+/* Post the completion of a DMA transaction to its attached queue, if any */
+void WdcCompletionQueueNotify(WD_DMA *pDma, DWORD dwStatus);
+void WdcCompletionQueueDetach(WD_DMA *pDma);
+
+/* DMA buffers with caller private data (wdc_dma.c): dwPrivBytes (a multiple
+ * of sizeof(UINT64)) are allocated immediately before the WD_DMA struct, and
+ * are accessible at ((BYTE *)pDma - dwPrivBytes). Buffers locked with
+ * WdcDMABufLockPriv() must be unlocked with WdcDMABufUnlockPriv(), with the
+ * same dwPrivBytes. */
+DWORD WdcDMABufLockPriv(PWDC_DEVICE pDev, PVOID *ppBuf, DWORD dwOptions,
+    DWORD dwDMABufSize, WD_DMA **ppDma, DWORD dwPrivBytes);
+DWORD WdcDMABufUnlockPriv(WD_DMA *pDma, DWORD dwPrivBytes);
+/* Detect whether the DMA buffers synchronization can be skipped -- called by
+ * WDC_DriverOpen() */
+void WdcDMACoherenceInit(void);
+/* Split the pages of a locked Scatter/Gather DMA buffer that are larger than
+ * dwMaxSegSize (0 - no limit) */
+DWORD WdcDMAPagesSplit(WD_DMA *pDma, DWORD dwMaxSegSize);
+
+#endif /* !defined(__KERNEL__) */
+
+#endif /* _WDC_PRIV_H_ */
@@ -0,0 +1,586 @@
+/* Jungo Connectivity Confidential. Copyright (c) 2022 Jungo Connectivity Ltd.  https://www.jungo.com */
+
+/*****************************************************************************
+*  File: wdc_shadow.c - Implementation of the WDC register shadow cache API  *
+******************************************************************************/
+
+#include "wdc_lib.h"
+#include "wdc_defs.h"
+#include "wdc_err.h"
+#include "wdc_priv.h"
+#include "status_strings.h"
+
+#if !defined(__KERNEL__)
+
+/*************************************************************
+  General definitions
+ *************************************************************/
+/* Shadow slot flags: the cache is kept in 32-bit slots */
+#define SHADOW_SLOT_VALID 0x1
+#define SHADOW_SLOT_DIRTY 0x2
+#define SHADOW_SLOT_WIDE  0x4 /* Low slot of a deferred 64-bit write; the
+                               * next slot holds its high 32 bits */
+
+#define SHADOW_SLOT_SIZE ((DWORD)sizeof(UINT32))
+
+/* Cached range of an address space */
+typedef struct {
+    DWORD dwAddrSpace;
+    KPTR dwOffset;
+    DWORD dwBytes;
+    WDC_SHADOW_POLICY policy;
+    UINT32 *pu32Vals; /* Cached values, one per 32-bit slot */
+    BYTE *pbFlags;    /* SHADOW_SLOT_XXX flags, one per 32-bit slot */
+} SHADOW_RANGE;
+
+/* Register shadow cache of a device */
+typedef struct WDC_SHADOW {
+    HANDLE hMutex;
+    DWORD dwNumRanges;
+    SHADOW_RANGE *pRanges;   /* Sorted by address space and offset */
+    WDC_SHADOW_STATS stats;
+} WDC_SHADOW;
+
+/*************************************************************
+  Static functions
+ *************************************************************/
+static WDC_SHADOW *ShadowGet(WDC_DEVICE_HANDLE hDev)
+{
+    WDC_DEVICE_PRIV *pPriv = WDC_DEV_PRIV(hDev);
+
+    return pPriv ? pPriv->pShadow : NULL;
+}
+
+static void RangeFree(SHADOW_RANGE *pRange)
+{
+    if (pRange->pu32Vals)
+        free(pRange->pu32Vals);
+    if (pRange->pbFlags)
+        free(pRange->pbFlags);
+}
+
+/* Find the range of an access. Returns NULL if the access is outside of all
+ * the cached ranges; sets *pfPartial if it overlaps a range only partially. */
+static SHADOW_RANGE *RangeFind(WDC_SHADOW *pShadow, DWORD dwAddrSpace,
+    KPTR dwOffset, DWORD dwBytes, BOOL *pfPartial)
+{
+    DWORD i;
+
+    *pfPartial = FALSE;
+    for (i = 0; i < pShadow->dwNumRanges; i++)
+    {
+        SHADOW_RANGE *pRange = &pShadow->pRanges[i];
+        KPTR dwEnd = pRange->dwOffset + pRange->dwBytes;
+
+        if (pRange->dwAddrSpace != dwAddrSpace ||
+            dwOffset >= dwEnd || dwOffset + dwBytes <= pRange->dwOffset)
+        {
+            continue;
+        }
+
+        if (dwOffset < pRange->dwOffset || dwOffset + dwBytes > dwEnd ||
+            (dwOffset - pRange->dwOffset) % SHADOW_SLOT_SIZE)
+        {
+            *pfPartial = TRUE;
+            return NULL;
+        }
+
+        return pRange;
+    }
+
+    return NULL;
+}
+
+static DWORD DeviceRead(WDC_DEVICE_HANDLE hDev, DWORD dwAddrSpace,
+    KPTR dwOffset, DWORD dwBytes, UINT64 *pu64Val)
+{
+    DWORD dwStatus;
+
+    if (dwBytes == sizeof(UINT64))
+        return WDC_ReadAddr64(hDev, dwAddrSpace, dwOffset, pu64Val);
+
+    {
+        UINT32 u32Val = 0;
+
+        dwStatus = WDC_ReadAddr32(hDev, dwAddrSpace, dwOffset, &u32Val);
+        *pu64Val = u32Val;
+    }
+
+    return dwStatus;
+}
+
+static DWORD DeviceWrite(WDC_DEVICE_HANDLE hDev, DWORD dwAddrSpace,
+    KPTR dwOffset, DWORD dwBytes, UINT64 u64Val)
+{
+    if (dwBytes == sizeof(UINT64))
+        return WDC_WriteAddr64(hDev, dwAddrSpace, dwOffset, u64Val);
+
+    return WDC_WriteAddr32(hDev, dwAddrSpace, dwOffset, (UINT32)u64Val);
+}
+
+static DWORD ShadowRead(WDC_DEVICE_HANDLE hDev, DWORD dwAddrSpace,
+    KPTR dwOffset, DWORD dwBytes, UINT64 *pu64Val, const CHAR *sFunc)
+{
+    WDC_SHADOW *pShadow;
+    SHADOW_RANGE *pRange;
+    DWORD i, dwSlot, dwSlots = dwBytes / SHADOW_SLOT_SIZE;
+    DWORD dwStatus = WD_STATUS_SUCCESS;
+    BOOL fPartial, fHit = TRUE;
+
+    if (!WdcIsValidDevHandle(hDev) || !pu64Val)
+    {
+        WDC_Err("%s: %s\n", sFunc, !pu64Val ? "Invalid parameter" :
+            WdcGetLastErrStr());
+        return WD_INVALID_PARAMETER;
+    }
+
+    pShadow = ShadowGet(hDev);
+    if (!pShadow)
+        return DeviceRead(hDev, dwAddrSpace, dwOffset, dwBytes, pu64Val);
+
+    OsMutexLock(pShadow->hMutex);
+
+    pRange = RangeFind(pShadow, dwAddrSpace, dwOffset, dwBytes, &fPartial);
+    if (fPartial)
+    {
+        WDC_Err("%s: Access (offset 0x%" PRI64 "x, %ld bytes) is not "
+            "aligned to a cached range's slots or crosses its boundary\n",
+            sFunc, (UINT64)dwOffset, dwBytes);
+        dwStatus = WD_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    if (!pRange || pRange->policy == WDC_SHADOW_VOLATILE)
+    {
+        pShadow->stats.qwUncached++;
+        dwStatus = DeviceRead(hDev, dwAddrSpace, dwOffset, dwBytes, pu64Val);
+        goto Exit;
+    }
+
+    dwSlot = (DWORD)((dwOffset - pRange->dwOffset) / SHADOW_SLOT_SIZE);
+    for (i = 0; i < dwSlots; i++)
+    {
+        if (!(pRange->pbFlags[dwSlot + i] & SHADOW_SLOT_VALID))
+            fHit = FALSE;
+    }
+
+    if (!fHit)
+    {
+        UINT64 u64Val;
+
+        pShadow->stats.qwMisses++;
+        dwStatus = DeviceRead(hDev, dwAddrSpace, dwOffset, dwBytes, &u64Val);
+        if (dwStatus)
+            goto Exit;
+
+        /* Do not overwrite deferred writes with the device's values */
+        for (i = 0; i < dwSlots; i++)
+        {
+            if (pRange->pbFlags[dwSlot + i] & SHADOW_SLOT_DIRTY)
+                continue;
+
+            pRange->pu32Vals[dwSlot + i] = (UINT32)(u64Val >> (32 * i));
+            pRange->pbFlags[dwSlot + i] |= SHADOW_SLOT_VALID;
+        }
+    }
+    else
+    {
+        pShadow->stats.qwHits++;
+    }
+
+    *pu64Val = pRange->pu32Vals[dwSlot];
+    if (dwSlots > 1)
+        *pu64Val |= (UINT64)pRange->pu32Vals[dwSlot + 1] << 32;
+
+Exit:
+    OsMutexUnlock(pShadow->hMutex);
+    return dwStatus;
+}
+
+static DWORD ShadowWrite(WDC_DEVICE_HANDLE hDev, DWORD dwAddrSpace,
+    KPTR dwOffset, DWORD dwBytes, UINT64 u64Val, const CHAR *sFunc)
+{
+    WDC_SHADOW *pShadow;
+    SHADOW_RANGE *pRange;
+    DWORD i, dwSlot, dwSlots = dwBytes / SHADOW_SLOT_SIZE;
+    DWORD dwStatus = WD_STATUS_SUCCESS;
+    BOOL fPartial;
+
+    if (!WdcIsValidDevHandle(hDev))
+    {
+        WDC_Err("%s: %s\n", sFunc, WdcGetLastErrStr());
+        return WD_INVALID_PARAMETER;
+    }
+
+    pShadow = ShadowGet(hDev);
+    if (!pShadow)
+        return DeviceWrite(hDev, dwAddrSpace, dwOffset, dwBytes, u64Val);
+
+    OsMutexLock(pShadow->hMutex);
+
+    pRange = RangeFind(pShadow, dwAddrSpace, dwOffset, dwBytes, &fPartial);
+    if (fPartial)
+    {
+        WDC_Err("%s: Access (offset 0x%" PRI64 "x, %ld bytes) is not "
+            "aligned to a cached range's slots or crosses its boundary\n",
+            sFunc, (UINT64)dwOffset, dwBytes);
+        dwStatus = WD_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    if (!pRange || pRange->policy == WDC_SHADOW_VOLATILE)
+    {
+        pShadow->stats.qwUncached++;
+        dwStatus = DeviceWrite(hDev, dwAddrSpace, dwOffset, dwBytes, u64Val);
+        goto Exit;
+    }
+
+    dwSlot = (DWORD)((dwOffset - pRange->dwOffset) / SHADOW_SLOT_SIZE);
+
+    if (pRange->policy == WDC_SHADOW_WRITE_BACK)
+    {
+        pShadow->stats.qwDeferredWrites++;
+        for (i = 0; i < dwSlots; i++)
+        {
+            pRange->pu32Vals[dwSlot + i] = (UINT32)(u64Val >> (32 * i));
+            pRange->pbFlags[dwSlot + i] |= SHADOW_SLOT_VALID |
+                SHADOW_SLOT_DIRTY;
+        }
+
+        /* Keep the access width for WDC_ShadowFlush(). A 32-bit write to a
+         * half of a deferred 64-bit write is merged into it; a 64-bit write
+         * that overlaps a deferred 64-bit write leaves the other write's
+         * remaining half to be flushed as a 32-bit write */
+        if (dwSlots > 1)
+        {
+            if (dwSlot > 0)
+                pRange->pbFlags[dwSlot - 1] &= ~SHADOW_SLOT_WIDE;
+            pRange->pbFlags[dwSlot + 1] &= ~SHADOW_SLOT_WIDE;
+            pRange->pbFlags[dwSlot] |= SHADOW_SLOT_WIDE;
+        }
+        goto Exit;
+    }
+
+    pShadow->stats.qwDeviceWrites++;
+    dwStatus = DeviceWrite(hDev, dwAddrSpace, dwOffset, dwBytes, u64Val);
+
+    for (i = 0; i < dwSlots; i++)
+    {
+        if (pRange->policy == WDC_SHADOW_WRITE_THROUGH && !dwStatus)
+        {
+            pRange->pu32Vals[dwSlot + i] = (UINT32)(u64Val >> (32 * i));
+            pRange->pbFlags[dwSlot + i] = SHADOW_SLOT_VALID;
+        }
+        else
+        {
+            pRange->pbFlags[dwSlot + i] = 0;
+        }
+    }
+
+Exit:
+    OsMutexUnlock(pShadow->hMutex);
+    return dwStatus;
+}
+
+/*************************************************************
+  Functions implementation
+ *************************************************************/
+DWORD DLLCALLCONV WDC_ShadowRangeSet(_In_ WDC_DEVICE_HANDLE hDev,
+    _In_ DWORD dwAddrSpace, _In_ KPTR dwOffset, _In_ DWORD dwBytes,
+    _In_ WDC_SHADOW_POLICY policy)
+{
+    PWDC_DEVICE pDev = (PWDC_DEVICE)hDev;
+    WDC_DEVICE_PRIV *pPriv;
+    WDC_SHADOW *pShadow;
+    SHADOW_RANGE range, *pRanges;
+    DWORD i, dwStatus = WD_STATUS_SUCCESS;
+    BOOL fPartial;
+
+    if (!WdcIsValidDevHandle(hDev) || !WDC_DEV_PRIV(hDev))
+    {
+        WDC_Err("WDC_ShadowRangeSet: %s\n", WdcGetLastErrStr());
+        return WD_INVALID_PARAMETER;
+    }
+
+    if (dwAddrSpace >= pDev->dwNumAddrSpaces ||
+        !WDC_AddrSpaceIsActive(hDev, dwAddrSpace) || !dwBytes ||
+        (dwOffset % SHADOW_SLOT_SIZE) || (dwBytes % SHADOW_SLOT_SIZE) ||
+        (UINT64)dwOffset + dwBytes >
+        WDC_GET_ADDR_DESC(pDev, dwAddrSpace)->qwBytes ||
+        policy > WDC_SHADOW_WRITE_BACK)
+    {
+        WDC_Err("WDC_ShadowRangeSet: Invalid range (address space %ld, "
+            "offset 0x%" PRI64 "x, %ld bytes, policy %d)\n", dwAddrSpace,
+            (UINT64)dwOffset, dwBytes, policy);
+        return WD_INVALID_PARAMETER;
+    }
+
+    pPriv = WDC_DEV_PRIV(hDev);
+    if (!pPriv->pShadow)
+    {
+        pShadow = (WDC_SHADOW *)calloc(1, sizeof(WDC_SHADOW));
+        if (!pShadow)
+        {
+            WDC_Err("WDC_ShadowRangeSet: Failed allocating memory\n");
+            return WD_INSUFFICIENT_RESOURCES;
+        }
+
+        dwStatus = OsMutexCreate(&pShadow->hMutex);
+        if (dwStatus)
+        {
+            WDC_Err("WDC_ShadowRangeSet: Failed creating mutex. "
+                "Error 0x%lx - %s\n", dwStatus, Stat2Str(dwStatus));
+            free(pShadow);
+            return dwStatus;
+        }
+
+        pPriv->pShadow = pShadow;
+    }
+    pShadow = pPriv->pShadow;
+
+    BZERO(range);
+    range.dwAddrSpace = dwAddrSpace;
+    range.dwOffset = dwOffset;
+    range.dwBytes = dwBytes;
+    range.policy = policy;
+    range.pu32Vals = (UINT32 *)calloc(dwBytes / SHADOW_SLOT_SIZE,
+        sizeof(UINT32));
+    range.pbFlags = (BYTE *)calloc(dwBytes / SHADOW_SLOT_SIZE, sizeof(BYTE));
+    if (!range.pu32Vals || !range.pbFlags)
+    {
+        WDC_Err("WDC_ShadowRangeSet: Failed allocating memory for %ld bytes "
+            "range\n", dwBytes);
+        RangeFree(&range);
+        return WD_INSUFFICIENT_RESOURCES;
+    }
+
+    OsMutexLock(pShadow->hMutex);
+
+    if (RangeFind(pShadow, dwAddrSpace, dwOffset, dwBytes, &fPartial) ||
+        fPartial)
+    {
+        WDC_Err("WDC_ShadowRangeSet: Range overlaps a previously set range\n");
+        dwStatus = WD_RESOURCE_OVERLAP;
+        goto Error;
+    }
+
+    pRanges = (SHADOW_RANGE *)realloc(pShadow->pRanges,
+        (pShadow->dwNumRanges + 1) * sizeof(SHADOW_RANGE));
+    if (!pRanges)
+    {
+        WDC_Err("WDC_ShadowRangeSet: Failed allocating memory\n");
+        dwStatus = WD_INSUFFICIENT_RESOURCES;
+        goto Error;
+    }
+    pShadow->pRanges = pRanges;
+
+    /* Keep the ranges sorted, so that WDC_ShadowFlush() writes in ascending
+     * address order */
+    for (i = pShadow->dwNumRanges; i > 0; i--)
+    {
+        SHADOW_RANGE *pPrev = &pRanges[i - 1];
+
+        if (pPrev->dwAddrSpace < dwAddrSpace ||
+            (pPrev->dwAddrSpace == dwAddrSpace && pPrev->dwOffset < dwOffset))
+        {
+            break;
+        }
+        pRanges[i] = *pPrev;
+    }
+    pRanges[i] = range;
+    pShadow->dwNumRanges++;
+
+    OsMutexUnlock(pShadow->hMutex);
+
+    WDC_Trace("WDC_ShadowRangeSet: Address space %ld, offset 0x%" PRI64 "x, "
+        "%ld bytes, policy %d\n", dwAddrSpace, (UINT64)dwOffset, dwBytes,
+        policy);
+
+    return WD_STATUS_SUCCESS;
+
+Error:
+    OsMutexUnlock(pShadow->hMutex);
+    RangeFree(&range);
+    return dwStatus;
+}
+
+DWORD DLLCALLCONV WDC_ShadowReadAddr32(_In_ WDC_DEVICE_HANDLE hDev,
+    _In_ DWORD dwAddrSpace, _In_ KPTR dwOffset, _Outptr_ UINT32 *pu32Val)
+{
+    UINT64 u64Val = 0;
+    DWORD dwStatus;
+
+    if (!pu32Val)
+    {
+        WDC_Err("WDC_ShadowReadAddr32: Invalid parameter\n");
+        return WD_INVALID_PARAMETER;
+    }
+
+    dwStatus = ShadowRead(hDev, dwAddrSpace, dwOffset, sizeof(UINT32),
+        &u64Val, "WDC_ShadowReadAddr32");
+    *pu32Val = (UINT32)u64Val;
+
+    return dwStatus;
+}
+
+DWORD DLLCALLCONV WDC_ShadowReadAddr64(_In_ WDC_DEVICE_HANDLE hDev,
+    _In_ DWORD dwAddrSpace, _In_ KPTR dwOffset, _Outptr_ UINT64 *pu64Val)
+{
+    return ShadowRead(hDev, dwAddrSpace, dwOffset, sizeof(UINT64), pu64Val,
+        "WDC_ShadowReadAddr64");
+}
+
+DWORD DLLCALLCONV WDC_ShadowWriteAddr32(_In_ WDC_DEVICE_HANDLE hDev,
+    _In_ DWORD dwAddrSpace, _In_ KPTR dwOffset, _In_ UINT32 u32Val)
+{
+    return ShadowWrite(hDev, dwAddrSpace, dwOffset, sizeof(UINT32), u32Val,
+        "WDC_ShadowWriteAddr32");
+}
+
+DWORD DLLCALLCONV WDC_ShadowWriteAddr64(_In_ WDC_DEVICE_HANDLE hDev,
+    _In_ DWORD dwAddrSpace, _In_ KPTR dwOffset, _In_ UINT64 u64Val)
+{
+    return ShadowWrite(hDev, dwAddrSpace, dwOffset, sizeof(UINT64), u64Val,
+        "WDC_ShadowWriteAddr64");
+}
+
+DWORD DLLCALLCONV WDC_ShadowFlush(_In_ WDC_DEVICE_HANDLE hDev)
+{
+    WDC_SHADOW *pShadow;
+    DWORD i, j, dwStatus = WD_STATUS_SUCCESS;
+
+    if (!WdcIsValidDevHandle(hDev))
+    {
+        WDC_Err("WDC_ShadowFlush: %s\n", WdcGetLastErrStr());
+        return WD_INVALID_PARAMETER;
+    }
+
+    pShadow = ShadowGet(hDev);
+    if (!pShadow)
+        return WD_STATUS_SUCCESS;
+
+    OsMutexLock(pShadow->hMutex);
+
+    for (i = 0; i < pShadow->dwNumRanges; i++)
+    {
+        SHADOW_RANGE *pRange = &pShadow->pRanges[i];
+
+        if (pRange->policy != WDC_SHADOW_WRITE_BACK)
+            continue;
+
+        for (j = 0; j < pRange->dwBytes / SHADOW_SLOT_SIZE; j++)
+        {
+            BOOL fWide = pRange->pbFlags[j] & SHADOW_SLOT_WIDE;
+            UINT64 u64Val = pRange->pu32Vals[j];
+
+            if (!(pRange->pbFlags[j] & SHADOW_SLOT_DIRTY))
+                continue;
+
+            /* Write the slot with the width it was written with */
+            if (fWide)
+                u64Val |= (UINT64)pRange->pu32Vals[j + 1] << 32;
+
+            dwStatus = DeviceWrite(hDev, pRange->dwAddrSpace,
+                pRange->dwOffset + j * SHADOW_SLOT_SIZE,
+                fWide ? sizeof(UINT64) : sizeof(UINT32), u64Val);
+            if (dwStatus)
+            {
+                WDC_Err("WDC_ShadowFlush: Failed writing offset 0x%" PRI64
+                    "x of address space %ld. Error 0x%lx - %s\n",
+                    (UINT64)(pRange->dwOffset + j * SHADOW_SLOT_SIZE),
+                    pRange->dwAddrSpace, dwStatus, Stat2Str(dwStatus));
+                goto Exit;
+            }
+
+            pRange->pbFlags[j] &= ~(SHADOW_SLOT_DIRTY | SHADOW_SLOT_WIDE);
+            if (fWide)
+                pRange->pbFlags[++j] &= ~SHADOW_SLOT_DIRTY;
+            pShadow->stats.qwFlushedWrites++;
+        }
+    }
+
+Exit:
+    OsMutexUnlock(pShadow->hMutex);
+    return dwStatus;
+}
+
+void WdcShadowInvalidate(PWDC_DEVICE pDev)
+{
+    WDC_SHADOW *pShadow = ShadowGet(pDev);
+    DWORD i;
+
+    if (!pShadow)
+        return;
+
+    OsMutexLock(pShadow->hMutex);
+    for (i = 0; i < pShadow->dwNumRanges; i++)
+    {
+        SHADOW_RANGE *pRange = &pShadow->pRanges[i];
+
+        memset(pRange->pbFlags, 0, pRange->dwBytes / SHADOW_SLOT_SIZE);
+    }
+    pShadow->stats.qwInvalidations++;
+    OsMutexUnlock(pShadow->hMutex);
+}
+
+DWORD DLLCALLCONV WDC_ShadowInvalidate(_In_ WDC_DEVICE_HANDLE hDev)
+{
+    if (!WdcIsValidDevHandle(hDev))
+    {
+        WDC_Err("WDC_ShadowInvalidate: %s\n", WdcGetLastErrStr());
+        return WD_INVALID_PARAMETER;
+    }
+
+    WdcShadowInvalidate((PWDC_DEVICE)hDev);
+
+    return WD_STATUS_SUCCESS;
+}
+
+DWORD DLLCALLCONV WDC_ShadowGetStats(_In_ WDC_DEVICE_HANDLE hDev,
+    _Outptr_ WDC_SHADOW_STATS *pStats, _In_ BOOL fReset)
+{
+    WDC_SHADOW *pShadow;
+
+    if (!WdcIsValidDevHandle(hDev) || !pStats)
+    {
+        WDC_Err("WDC_ShadowGetStats: %s\n", !pStats ? "Invalid parameter" :
+            WdcGetLastErrStr());
+        return WD_INVALID_PARAMETER;
+    }
+
+    pShadow = ShadowGet(hDev);
+    if (!pShadow)
+    {
+        BZERO(*pStats);
+        return WD_STATUS_SUCCESS;
+    }
+
+    OsMutexLock(pShadow->hMutex);
+    *pStats = pShadow->stats;
+    if (fReset)
+        BZERO(pShadow->stats);
+    OsMutexUnlock(pShadow->hMutex);
+
+    return WD_STATUS_SUCCESS;
+}
+
+void WdcShadowDestroy(PWDC_DEVICE pDev)
+{
+    WDC_DEVICE_PRIV *pPriv = WDC_DEV_PRIV(pDev);
+    WDC_SHADOW *pShadow = pPriv ? pPriv->pShadow : NULL;
+    DWORD i;
+
+    if (!pShadow)
+        return;
+
+    for (i = 0; i < pShadow->dwNumRanges; i++)
+        RangeFree(&pShadow->pRanges[i]);
+    if (pShadow->pRanges)
+        free(pShadow->pRanges);
+
+    OsMutexClose(pShadow->hMutex);
+    free(pShadow);
+    pPriv->pShadow = NULL;
+}
+
+#endif /* !defined(__KERNEL__) */
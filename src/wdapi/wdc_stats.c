@@ -0,0 +1,445 @@
+/* Jungo Connectivity Confidential. Copyright (c) 2022 Jungo Connectivity Ltd.  https://www.jungo.com */
+
+/*****************************************************************************
+*  File: wdc_stats.c - Implementation of the WinDriver API calls statistics  *
+*        (see wd_stats.h) and of the WDC statistics API                      *
+******************************************************************************/
+
+#include "wdc_lib.h"
+#include "wdc_err.h"
+#include "utils.h"
+#include <stdio.h>
+#include <time.h>
+
+#if defined(UNIX)
+    #include <pthread.h>
+    #include <unistd.h>
+#endif
+
+#if !defined(__KERNEL__)
+
+/*************************************************************
+  General definitions
+ *************************************************************/
+/* Per-ioctl counters index: the ioctl function number's low 8 bits */
+#define STATS_IOCTL_INDEX(dwIoctl) \
+    (WD_CTL_DECODE_FUNC((UINT32)(dwIoctl)) & (WD_STATS_MAX_IOCTLS - 1))
+
+/* Counters of a thread. Only the owning thread updates its counters; readers
+ * merge the counters of all the threads. Thread counters are never freed:
+ * when a thread exits, its counters are released for reuse by a new thread,
+ * and keep their values. */
+typedef struct STATS_THREAD {
+    struct STATS_THREAD *pNext;
+    volatile BOOL fInUse;
+    WD_IOCTL_STATS *volatile pIoctls[WD_STATS_MAX_IOCTLS]; /* Allocated on the
+                                                            * ioctl's first
+                                                            * call */
+} STATS_THREAD;
+
+#if defined(WIN32)
+    static SRWLOCK statsLock = SRWLOCK_INIT;
+    static INIT_ONCE statsOnce = INIT_ONCE_STATIC_INIT;
+    static DWORD dwStatsTlsIndex = FLS_OUT_OF_INDEXES;
+
+    #define STATS_LOCK() AcquireSRWLockExclusive(&statsLock)
+    #define STATS_UNLOCK() ReleaseSRWLockExclusive(&statsLock)
+#else
+    static pthread_mutex_t statsLock = PTHREAD_MUTEX_INITIALIZER;
+    static pthread_once_t statsOnce = PTHREAD_ONCE_INIT;
+    static pthread_key_t statsTlsKey;
+    static BOOL fStatsTlsKey;
+
+    #define STATS_LOCK() pthread_mutex_lock(&statsLock)
+    #define STATS_UNLOCK() pthread_mutex_unlock(&statsLock)
+#endif
+
+static STATS_THREAD *pStatsThreads; /* Protected by statsLock */
+static WD_IOCTL_STATS statsBase[WD_STATS_MAX_IOCTLS]; /* Counters values at
+                                                       * the last reset;
+                                                       * protected by
+                                                       * statsLock */
+
+/*************************************************************
+  Counting
+ *************************************************************/
+static UINT64 StatsTimeNs(void)
+{
+#if defined(WIN32)
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER cnt;
+
+    if (!freq.QuadPart)
+        QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&cnt);
+    return (UINT64)(cnt.QuadPart / freq.QuadPart * 1000000000 +
+        cnt.QuadPart % freq.QuadPart * 1000000000 / freq.QuadPart);
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (UINT64)ts.tv_sec * 1000000000 + (UINT64)ts.tv_nsec;
+#endif
+}
+
+/* Returns the latency histogram bucket of a call duration: floor(log2(ns)) */
+static DWORD StatsHistBucket(UINT64 qwNs)
+{
+    DWORD dwBucket;
+
+    if (!qwNs)
+        return 0;
+
+#if defined(__GNUC__)
+    dwBucket = 63 - __builtin_clzll(qwNs);
+#elif defined(_MSC_VER) && defined(_WIN64)
+    {
+        unsigned long index;
+
+        _BitScanReverse64(&index, qwNs);
+        dwBucket = index;
+    }
+#else
+    for (dwBucket = 0; qwNs >>= 1; dwBucket++)
+        ;
+#endif
+
+    return MIN(dwBucket, WD_STATS_HIST_BUCKETS - 1);
+}
+
+/* Called on thread exit: releases the thread's counters for reuse */
+#if defined(WIN32)
+static VOID WINAPI StatsThreadExit(PVOID pData)
+#else
+static void StatsThreadExit(void *pData)
+#endif
+{
+    STATS_THREAD *pThread = (STATS_THREAD *)pData;
+
+    if (pThread)
+        pThread->fInUse = FALSE;
+}
+
+#if defined(WIN32)
+static BOOL CALLBACK StatsInit(PINIT_ONCE pInitOnce, PVOID pParam,
+    PVOID *ppContext)
+{
+    UNUSED_VAR(pInitOnce);
+    UNUSED_VAR(pParam);
+    UNUSED_VAR(ppContext);
+
+    dwStatsTlsIndex = FlsAlloc(StatsThreadExit);
+    return TRUE;
+}
+#else
+static void StatsInit(void)
+{
+    fStatsTlsKey = !pthread_key_create(&statsTlsKey, StatsThreadExit);
+}
+#endif
+
+/* Returns the calling thread's counters, allocating them on the thread's
+ * first call */
+static STATS_THREAD *StatsThread(void)
+{
+    STATS_THREAD *pThread;
+
+#if defined(WIN32)
+    InitOnceExecuteOnce(&statsOnce, StatsInit, NULL, NULL);
+    if (dwStatsTlsIndex == FLS_OUT_OF_INDEXES)
+        return NULL;
+    pThread = (STATS_THREAD *)FlsGetValue(dwStatsTlsIndex);
+#else
+    pthread_once(&statsOnce, StatsInit);
+    if (!fStatsTlsKey)
+        return NULL;
+    pThread = (STATS_THREAD *)pthread_getspecific(statsTlsKey);
+#endif
+    if (pThread)
+        return pThread;
+
+    STATS_LOCK();
+    for (pThread = pStatsThreads; pThread && pThread->fInUse;
+        pThread = pThread->pNext)
+    {
+    }
+    if (!pThread)
+    {
+        pThread = (STATS_THREAD *)calloc(1, sizeof(*pThread));
+        if (pThread)
+        {
+            pThread->pNext = pStatsThreads;
+            pStatsThreads = pThread;
+        }
+    }
+    if (pThread)
+        pThread->fInUse = TRUE;
+    STATS_UNLOCK();
+
+    if (!pThread)
+        return NULL;
+
+#if defined(WIN32)
+    FlsSetValue(dwStatsTlsIndex, pThread);
+#else
+    pthread_setspecific(statsTlsKey, pThread);
+#endif
+    return pThread;
+}
+
+/* Returns the calling thread's counters of an ioctl */
+static WD_IOCTL_STATS *StatsThreadIoctl(DWORD dwIoctl)
+{
+    STATS_THREAD *pThread = StatsThread();
+    WD_IOCTL_STATS *pIoctl;
+    DWORD dwIndex = STATS_IOCTL_INDEX(dwIoctl);
+
+    if (!pThread)
+        return NULL;
+
+    pIoctl = pThread->pIoctls[dwIndex];
+    if (pIoctl)
+        return pIoctl;
+
+    pIoctl = (WD_IOCTL_STATS *)calloc(1, sizeof(*pIoctl));
+    if (!pIoctl)
+        return NULL;
+    pIoctl->dwIoctl = (UINT32)dwIoctl;
+
+    /* Publish the zeroed counters to the readers */
+    OsMemoryBarrier();
+    pThread->pIoctls[dwIndex] = pIoctl;
+
+    return pIoctl;
+}
+
+DWORD DLLCALLCONV WdFunctionStats(DWORD dwIoctl, HANDLE h, PVOID pParam,
+    DWORD dwSize, BOOL fWait)
+{
+    WD_IOCTL_STATS *pIoctl;
+    UINT64 qwStart, qwNs;
+    DWORD rc;
+
+    qwStart = StatsTimeNs();
+    rc = WD_FUNCTION_LOCAL(dwIoctl, h, pParam, dwSize, fWait);
+    qwNs = StatsTimeNs() - qwStart;
+
+    pIoctl = StatsThreadIoctl(dwIoctl);
+    if (pIoctl)
+    {
+        pIoctl->qwCalls++;
+        if (rc != WD_STATUS_SUCCESS)
+            pIoctl->qwErrors++;
+        pIoctl->qwTotalNs += qwNs;
+        pIoctl->qwHist[StatsHistBucket(qwNs)]++;
+    }
+
+    return rc;
+}
+
+/*************************************************************
+  Statistics API
+ *************************************************************/
+/* Merges the counters of all the threads, and subtracts the counters values
+ * at the last reset. Must be called with statsLock held. */
+static void StatsMerge(WD_IOCTL_STATS *pSum)
+{
+    STATS_THREAD *pThread;
+    DWORD i, j;
+
+    memset(pSum, 0, WD_STATS_MAX_IOCTLS * sizeof(*pSum));
+    for (pThread = pStatsThreads; pThread; pThread = pThread->pNext)
+    {
+        for (i = 0; i < WD_STATS_MAX_IOCTLS; i++)
+        {
+            WD_IOCTL_STATS *pIoctl = pThread->pIoctls[i];
+
+            if (!pIoctl)
+                continue;
+
+            pSum[i].dwIoctl = pIoctl->dwIoctl;
+            pSum[i].qwCalls += pIoctl->qwCalls;
+            pSum[i].qwErrors += pIoctl->qwErrors;
+            pSum[i].qwTotalNs += pIoctl->qwTotalNs;
+            for (j = 0; j < WD_STATS_HIST_BUCKETS; j++)
+                pSum[i].qwHist[j] += pIoctl->qwHist[j];
+        }
+    }
+
+    for (i = 0; i < WD_STATS_MAX_IOCTLS; i++)
+    {
+        pSum[i].qwCalls -= statsBase[i].qwCalls;
+        pSum[i].qwErrors -= statsBase[i].qwErrors;
+        pSum[i].qwTotalNs -= statsBase[i].qwTotalNs;
+        for (j = 0; j < WD_STATS_HIST_BUCKETS; j++)
+            pSum[i].qwHist[j] -= statsBase[i].qwHist[j];
+    }
+}
+
+/* Returns the merged statistics of the ioctls that were called, sorted by
+ * ioctl code. If pStats is too small, its entries are filled with the first
+ * ioctls, *pdwNumIoctls is set to the number of ioctls that were called and
+ * WD_INSUFFICIENT_RESOURCES is returned. */
+static DWORD StatsCollect(WD_IOCTL_STATS *pStats, DWORD dwMaxIoctls,
+    DWORD *pdwNumIoctls)
+{
+    WD_IOCTL_STATS *pSum, stats;
+    DWORD i, j, dwNum = 0;
+
+    pSum = (WD_IOCTL_STATS *)malloc(WD_STATS_MAX_IOCTLS * sizeof(*pSum));
+    if (!pSum)
+    {
+        WdcSetLastErrStr("Error - Failed allocating memory for the "
+            "statistics\n");
+        return WD_INSUFFICIENT_RESOURCES;
+    }
+
+    STATS_LOCK();
+    StatsMerge(pSum);
+    STATS_UNLOCK();
+
+    /* Sort all the called ioctls by ioctl code (insertion sort, in place),
+     * so that a truncated result holds the lowest codes */
+    for (i = 0; i < WD_STATS_MAX_IOCTLS; i++)
+    {
+        if (!pSum[i].qwCalls)
+            continue;
+
+        stats = pSum[i];
+        for (j = dwNum; j > 0 && pSum[j - 1].dwIoctl > stats.dwIoctl; j--)
+            pSum[j] = pSum[j - 1];
+        pSum[j] = stats;
+        dwNum++;
+    }
+
+    if (dwNum && dwMaxIoctls)
+        memcpy(pStats, pSum, MIN(dwNum, dwMaxIoctls) * sizeof(*pStats));
+
+    free(pSum);
+    *pdwNumIoctls = dwNum;
+
+    if (dwNum > dwMaxIoctls)
+    {
+        WdcSetLastErrStr("Error - The statistics array is too small: %ld "
+            "entries, %ld ioctls were called\n", dwMaxIoctls, dwNum);
+        return WD_INSUFFICIENT_RESOURCES;
+    }
+
+    return WD_STATUS_SUCCESS;
+}
+
+DWORD DLLCALLCONV WDC_GetStats(_Out_ WD_IOCTL_STATS *pStats,
+    _In_ DWORD dwMaxIoctls, _Out_ DWORD *pdwNumIoctls)
+{
+    DWORD dwStatus;
+
+    if ((!pStats && dwMaxIoctls) || !pdwNumIoctls)
+    {
+        WDC_Err("WDC_GetStats: Invalid parameters\n");
+        return WD_INVALID_PARAMETER;
+    }
+
+    dwStatus = StatsCollect(pStats, dwMaxIoctls, pdwNumIoctls);
+    if (WD_STATUS_SUCCESS != dwStatus)
+        WDC_Err("WDC_GetStats: %s", WdcGetLastErrStr());
+
+    return dwStatus;
+}
+
+void DLLCALLCONV WDC_ResetStats(void)
+{
+    WD_IOCTL_STATS *pSum;
+    DWORD i;
+
+    pSum = (WD_IOCTL_STATS *)malloc(WD_STATS_MAX_IOCTLS * sizeof(*pSum));
+    if (!pSum)
+    {
+        WDC_Err("WDC_ResetStats: Failed allocating memory\n");
+        return;
+    }
+
+    STATS_LOCK();
+    StatsMerge(pSum);
+    for (i = 0; i < WD_STATS_MAX_IOCTLS; i++)
+    {
+        DWORD j;
+
+        statsBase[i].qwCalls += pSum[i].qwCalls;
+        statsBase[i].qwErrors += pSum[i].qwErrors;
+        statsBase[i].qwTotalNs += pSum[i].qwTotalNs;
+        for (j = 0; j < WD_STATS_HIST_BUCKETS; j++)
+            statsBase[i].qwHist[j] += pSum[i].qwHist[j];
+    }
+    STATS_UNLOCK();
+
+    free(pSum);
+}
+
+DWORD DLLCALLCONV WDC_ExportStats(_In_ const CHAR *sFileName)
+{
+    WD_STATS_FILE_HEADER hdr;
+    WD_IOCTL_STATS *pStats = NULL;
+    DWORD dwNumIoctls, dwStatus;
+    FILE *fp = NULL;
+
+    if (!sFileName)
+    {
+        WDC_Err("WDC_ExportStats: Invalid parameters\n");
+        return WD_INVALID_PARAMETER;
+    }
+
+    pStats = (WD_IOCTL_STATS *)malloc(WD_STATS_MAX_IOCTLS * sizeof(*pStats));
+    if (!pStats)
+    {
+        WdcSetLastErrStr("Error - Failed allocating memory for the "
+            "statistics\n");
+        dwStatus = WD_INSUFFICIENT_RESOURCES;
+        goto Error;
+    }
+
+    dwStatus = StatsCollect(pStats, WD_STATS_MAX_IOCTLS, &dwNumIoctls);
+    if (WD_STATUS_SUCCESS != dwStatus)
+        goto Error;
+
+    BZERO(hdr);
+    hdr.dwMagic = WD_STATS_FILE_MAGIC;
+    hdr.dwVersion = WD_STATS_FILE_VERSION;
+#if defined(WIN32)
+    hdr.dwProcessId = (UINT32)GetCurrentProcessId();
+#else
+    hdr.dwProcessId = (UINT32)getpid();
+#endif
+    hdr.dwNumIoctls = dwNumIoctls;
+    hdr.qwTime = (UINT64)time(NULL);
+
+    fp = fopen(sFileName, "wb");
+    if (!fp)
+    {
+        WdcSetLastErrStr("Error - Failed creating file %s\n", sFileName);
+        dwStatus = WD_SYSTEM_INTERNAL_ERROR;
+        goto Error;
+    }
+
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+        fwrite(pStats, sizeof(*pStats), dwNumIoctls, fp) != dwNumIoctls)
+    {
+        WdcSetLastErrStr("Error - Failed writing to file %s\n", sFileName);
+        dwStatus = WD_SYSTEM_INTERNAL_ERROR;
+        goto Error;
+    }
+
+    goto Exit;
+
+Error:
+    WDC_Err("WDC_ExportStats: %s", WdcGetLastErrStr());
+
+Exit:
+    if (fp)
+        fclose(fp);
+    if (pStats)
+        free(pStats);
+
+    return dwStatus;
+}
+
+#endif /* !defined(__KERNEL__) */
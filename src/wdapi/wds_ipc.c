@@ -26,6 +26,12 @@ typedef struct
     HANDLE              hEvent;
     IPC_MSG_RX_HANDLER  pFunc; /* User messages handler cb function */
     void               *pData; /* User private ctx */
+
+    /* Batched messages delivery -- see WDS_IpcRegisterBatch() */
+    IPC_MSG_RX_BATCH_HANDLER pBatchFunc;
+    DWORD               dwBatchOptions;
+    DWORD               dwBatchMsgs;
+    WDS_IPC_MSG_RX      batchMsgs[WDS_IPC_RX_BATCH_MAX];
 } IPC_CTX, *PIPC_CTX;
 
 static PIPC_CTX gpIPC = NULL;
@@ -44,6 +50,52 @@ BOOL DLLCALLCONV WDS_IsSharedIntsEnabledLocally(void)
     return gpSharedIntIPC ? TRUE : FALSE;
 }
 
+static void ipcBatchFlush(PIPC_CTX pIpc)
+{
+    if (!pIpc->dwBatchMsgs)
+        return;
+
+    pIpc->pBatchFunc(pIpc->batchMsgs, pIpc->dwBatchMsgs, pIpc->pData);
+    pIpc->dwBatchMsgs = 0;
+}
+
+static void ipcBatchAdd(PIPC_CTX pIpc, const WDS_IPC_MSG_RX *pRxMsg)
+{
+    DWORD i;
+
+    /* A repeated message keeps the position of the first one in the batch,
+     * with the data of the last one */
+    if (pIpc->dwBatchOptions & WDS_IPC_COALESCE)
+    {
+        for (i = 0; i < pIpc->dwBatchMsgs; i++)
+        {
+            if (pIpc->batchMsgs[i].dwMsgID == pRxMsg->dwMsgID &&
+                pIpc->batchMsgs[i].dwSenderUID == pRxMsg->dwSenderUID)
+            {
+                pIpc->batchMsgs[i].qwMsgData = pRxMsg->qwMsgData;
+                return;
+            }
+        }
+    }
+
+    if (pIpc->dwBatchMsgs == WDS_IPC_RX_BATCH_MAX)
+        ipcBatchFlush(pIpc);
+
+    pIpc->batchMsgs[pIpc->dwBatchMsgs++] = *pRxMsg;
+}
+
+/* Called after the messages that the events thread pulled in one wakeup were
+ * passed to ipcEventsHandler() */
+static void ipcEventsBatchEnd(DWORD dwNumEvents, void *pData)
+{
+    PIPC_CTX pIpc = (PIPC_CTX)pData;
+
+    UNUSED_VAR(dwNumEvents);
+
+    if (pIpc && pIpc->pBatchFunc)
+        ipcBatchFlush(pIpc);
+}
+
 static void ipcEventsHandler(WD_EVENT *pEvent, void *pData)
 {
     PIPC_CTX pIpc = (PIPC_CTX)pData;
@@ -59,22 +111,29 @@ static void ipcEventsHandler(WD_EVENT *pEvent, void *pData)
         "from process [0x%lx]\n", pEvent->u.Ipc.dwMsgID,
         pEvent->u.Ipc.qwMsgData, pEvent->u.Ipc.dwSenderUID);
 
+    rxMsg.dwSenderUID = pEvent->u.Ipc.dwSenderUID;
+    rxMsg.dwMsgID = pEvent->u.Ipc.dwMsgID;
+    rxMsg.qwMsgData = pEvent->u.Ipc.qwMsgData;
+
+    if (pIpc->pBatchFunc)
+    {
+        ipcBatchAdd(pIpc, &rxMsg);
+        return;
+    }
+
     if (!pIpc->pFunc)
     {
         WDS_Trace("ipcEventsHandler: User did not supply messages callback\n");
         return;
     }
 
-    rxMsg.dwSenderUID = pEvent->u.Ipc.dwSenderUID;
-    rxMsg.dwMsgID = pEvent->u.Ipc.dwMsgID;
-    rxMsg.qwMsgData = pEvent->u.Ipc.qwMsgData;
-
     /* Calling user IPC callback */
     pIpc->pFunc(&rxMsg, pIpc->pData);
 }
 
 static DWORD ipcEventRegister(PIPC_CTX pIpc, DWORD dwAction,
-    IPC_MSG_RX_HANDLER pFunc, void *pData)
+    IPC_MSG_RX_HANDLER pFunc, IPC_MSG_RX_BATCH_HANDLER pBatchFunc,
+    DWORD dwBatchOptions, void *pData)
 {
     WD_EVENT Event; /* Event information */
     DWORD dwStatus;
@@ -94,18 +153,25 @@ static DWORD ipcEventRegister(PIPC_CTX pIpc, DWORD dwAction,
     Event.u.Ipc.dwSubGroupID = pIpc->procInfo.dwSubGroupID;
     Event.u.Ipc.dwGroupID = pIpc->procInfo.dwGroupID;
 
-    dwStatus = EventRegister(&pIpc->hEvent, WDS_GetWDHandle(), &Event,
-        ipcEventsHandler, pIpc);
+    /* The handlers may be called as soon as the event is registered */
+    pIpc->pFunc = pFunc;
+    pIpc->pBatchFunc = pBatchFunc;
+    pIpc->dwBatchOptions = dwBatchOptions;
+    pIpc->pData = pData;
+
+    dwStatus = EventRegisterBatch(&pIpc->hEvent, WDS_GetWDHandle(), &Event,
+        ipcEventsHandler, ipcEventsBatchEnd, pIpc);
     if (WD_STATUS_SUCCESS != dwStatus)
     {
         WDS_Err("ipcEventRegister: Failed registering event. "
             "Error [0x%lx - %s]\n", dwStatus, Stat2Str(dwStatus));
+        pIpc->pFunc = NULL;
+        pIpc->pBatchFunc = NULL;
+        pIpc->dwBatchOptions = 0;
+        pIpc->pData = NULL;
         return dwStatus;
     }
 
-    pIpc->pFunc = pFunc;
-    pIpc->pData = pData;
-
     WDS_Trace("ipcEventRegister: Registration to IPC messages completed "
         "successfully. dwAction [0x%lx], hIpc [0x%lx], dwSubGroupID [0x%lx], "
         "dwGroupID [0x%lx]\n", Event.dwAction, Event.u.Ipc.hIpc,
@@ -131,6 +197,8 @@ static void ipcEventUnRegister(PIPC_CTX pIpc)
     pIpc->hEvent = NULL;
     pIpc->pFunc = NULL;
     pIpc->pData = NULL;
+    pIpc->pBatchFunc = NULL;
+    pIpc->dwBatchMsgs = 0;
 }
 
 static DWORD ipcCtxCreate(PIPC_CTX *ppIPC, const CHAR *pcProcessName,
@@ -171,18 +239,9 @@ static void ipcCtxDestroy(PIPC_CTX pIpc)
     free(pIpc);
 }
 
-/*
- * const CHAR *pcProcessName - In - Optional process name string
- * DWORD dwGroupID - In - 0 (Zero) not allowed
- * DWORD dwSubGroupID - In - 0 (Zero) not allowed
- * DWORD dwAction - In - IPC messages types to receive- WD_IPC_UNICAST_MSG,
- *                       WD_IPC_MULTICAST_MSG, WD_IPC_ALL_MSG
- * IPC_MSG_RX_HANDLER pFunc - IN - Function to be called back once event happens
- * void* pData - IN - Private data for the event handler
- */
-DWORD DLLCALLCONV WDS_IpcRegister(_In_ const CHAR *pcProcessName,
-    _In_ DWORD dwGroupID, _In_ DWORD dwSubGroupID, _In_ DWORD dwAction,
-    _In_ IPC_MSG_RX_HANDLER pFunc, _In_ void *pData)
+static DWORD ipcProcessRegister(const CHAR *pcProcessName, DWORD dwGroupID,
+    DWORD dwSubGroupID, DWORD dwAction, IPC_MSG_RX_HANDLER pFunc,
+    IPC_MSG_RX_BATCH_HANDLER pBatchFunc, DWORD dwBatchOptions, void *pData)
 {
     DWORD dwStatus, dwErrorStatus;
     PIPC_CTX pIpc = NULL;
@@ -226,7 +285,8 @@ DWORD DLLCALLCONV WDS_IpcRegister(_In_ const CHAR *pcProcessName,
 
     /* Event register must be done after IPC register since we use hIpc as the
      * process unique identifier */
-    dwStatus = ipcEventRegister(pIpc, dwAction, pFunc, pData);
+    dwStatus = ipcEventRegister(pIpc, dwAction, pFunc, pBatchFunc,
+        dwBatchOptions, pData);
     if (WD_STATUS_SUCCESS != dwStatus)
     {
         WDS_Err("WDS_IpcRegister: Failed registering IPC event. "
@@ -251,6 +311,46 @@ Error:
     return dwStatus;
 }
 
+/*
+ * const CHAR *pcProcessName - In - Optional process name string
+ * DWORD dwGroupID - In - 0 (Zero) not allowed
+ * DWORD dwSubGroupID - In - 0 (Zero) not allowed
+ * DWORD dwAction - In - IPC messages types to receive- WD_IPC_UNICAST_MSG,
+ *                       WD_IPC_MULTICAST_MSG, WD_IPC_ALL_MSG
+ * IPC_MSG_RX_HANDLER pFunc - IN - Function to be called back once event happens
+ * void* pData - IN - Private data for the event handler
+ */
+DWORD DLLCALLCONV WDS_IpcRegister(_In_ const CHAR *pcProcessName,
+    _In_ DWORD dwGroupID, _In_ DWORD dwSubGroupID, _In_ DWORD dwAction,
+    _In_ IPC_MSG_RX_HANDLER pFunc, _In_ void *pData)
+{
+    return ipcProcessRegister(pcProcessName, dwGroupID, dwSubGroupID, dwAction,
+        pFunc, NULL, 0, pData);
+}
+
+/*
+ * Same as WDS_IpcRegister(), except that the messages that arrive together
+ * are passed to pFunc in one call.
+ * DWORD dwOptions - In - WDS_IPC_COALESCE: pass one message per sender and
+ *                        message ID in each call
+ */
+DWORD DLLCALLCONV WDS_IpcRegisterBatch(_In_ const CHAR *pcProcessName,
+    _In_ DWORD dwGroupID, _In_ DWORD dwSubGroupID, _In_ DWORD dwAction,
+    _In_ IPC_MSG_RX_BATCH_HANDLER pFunc, _In_ void *pData,
+    _In_ DWORD dwOptions)
+{
+    if (!pFunc || dwOptions & ~WDS_IPC_COALESCE)
+    {
+        WDS_Err("WDS_IpcRegisterBatch: Invalid parameters. pFunc [%p], "
+            "dwOptions [0x%lx]\n", pFunc, dwOptions);
+        return WD_INVALID_PARAMETER;
+    }
+
+    return ipcProcessRegister(pcProcessName, dwGroupID, dwSubGroupID, dwAction,
+        NULL, pFunc, dwOptions, pData);
+}
+
+
 void DLLCALLCONV WDS_IpcUnRegister(void)
 {
     DWORD dwStatus;
@@ -434,6 +534,99 @@ DWORD DLLCALLCONV WDS_IpcMulticast(_In_ DWORD dwMsgID, _In_ UINT64 qwMsgData)
     return dwStatus;
 }
 
+/* Returns TRUE if pMsgs[dwIndex] has the same type, recipient and message ID
+ * as an earlier message of the batch */
+static BOOL ipcMsgIsRepeated(const WDS_IPC_MSG_TX *pMsgs, DWORD dwIndex)
+{
+    DWORD i;
+
+    for (i = 0; i < dwIndex; i++)
+    {
+        if (pMsgs[i].dwOptions == pMsgs[dwIndex].dwOptions &&
+            pMsgs[i].dwRecipientID == pMsgs[dwIndex].dwRecipientID &&
+            pMsgs[i].dwMsgID == pMsgs[dwIndex].dwMsgID)
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+/* WDS_IpcSendBatch() - Sends the messages of pMsgs in order. With
+ *                      WDS_IPC_COALESCE, a repeated message is sent once, at
+ *                      the position of the first one, with the data of the
+ *                      last one. */
+DWORD DLLCALLCONV WDS_IpcSendBatch(_In_ const WDS_IPC_MSG_TX *pMsgs,
+    _In_ DWORD dwNumMsgs, _In_ DWORD dwOptions, _Out_ DWORD *pdwSent)
+{
+    WD_IPC_SEND ipcSend;
+    DWORD dwStatus = WD_STATUS_SUCCESS, dwSent = 0, i, j;
+
+    if (pdwSent)
+        *pdwSent = 0;
+
+    if (!gpIPC)
+    {
+        WDS_Err("WDS_IpcSendBatch: Error - IPC was not registered\n");
+        return WD_WINDRIVER_STATUS_ERROR;
+    }
+
+    /* The batch size is bounded, since coalescing compares each message with
+     * the other messages of the batch */
+    if ((!pMsgs && dwNumMsgs) || dwNumMsgs > WDS_IPC_TX_BATCH_MAX ||
+        dwOptions & ~WDS_IPC_COALESCE)
+    {
+        WDS_Err("WDS_IpcSendBatch: Invalid parameters. pMsgs [%p], "
+            "dwNumMsgs [%ld], dwOptions [0x%lx]\n", pMsgs, dwNumMsgs,
+            dwOptions);
+        return WD_INVALID_PARAMETER;
+    }
+
+    BZERO(ipcSend);
+    ipcSend.hIpc = gpIPC->procInfo.hIpc;
+
+    for (i = 0; i < dwNumMsgs; i++)
+    {
+        if ((dwOptions & WDS_IPC_COALESCE) && ipcMsgIsRepeated(pMsgs, i))
+            continue;
+
+        ipcSend.dwOptions = pMsgs[i].dwOptions;
+        ipcSend.dwRecipientID = pMsgs[i].dwOptions == WD_IPC_MULTICAST ? 0 :
+            pMsgs[i].dwRecipientID;
+        ipcSend.dwMsgID = pMsgs[i].dwMsgID;
+        ipcSend.qwMsgData = pMsgs[i].qwMsgData;
+
+        if (dwOptions & WDS_IPC_COALESCE)
+        {
+            for (j = i + 1; j < dwNumMsgs; j++)
+            {
+                if (pMsgs[j].dwOptions == pMsgs[i].dwOptions &&
+                    pMsgs[j].dwRecipientID == pMsgs[i].dwRecipientID &&
+                    pMsgs[j].dwMsgID == pMsgs[i].dwMsgID)
+                {
+                    ipcSend.qwMsgData = pMsgs[j].qwMsgData;
+                }
+            }
+        }
+
+        dwStatus = WD_IpcSend(WDS_GetWDHandle(), &ipcSend);
+        if (WD_STATUS_SUCCESS != dwStatus)
+        {
+            WDS_Err("WDS_IpcSendBatch: Failed sending message %ld of %ld. "
+                "Error [0x%lx - %s]\n", i, dwNumMsgs, dwStatus,
+                Stat2Str(dwStatus));
+            break;
+        }
+        dwSent++;
+    }
+
+    if (pdwSent)
+        *pdwSent = dwSent;
+
+    return dwStatus;
+}
+
 DWORD DLLCALLCONV WDS_SharedIntEnable(_In_ const CHAR *pcProcessName,
     _In_ DWORD dwGroupID, _In_ DWORD dwSubGroupID, _In_ DWORD dwAction,
     _In_ IPC_MSG_RX_HANDLER pFunc, _In_ void *pData)
@@ -494,7 +687,7 @@ DWORD DLLCALLCONV WDS_SharedIntEnable(_In_ const CHAR *pcProcessName,
 
     /* Event registration must be done after IPC register since we use hIpc as
      * the process unique identifier */
-    dwStatus = ipcEventRegister(pIpc, dwAction, pFunc, pData);
+    dwStatus = ipcEventRegister(pIpc, dwAction, pFunc, NULL, 0, pData);
     if (WD_STATUS_SUCCESS != dwStatus)
     {
         WDS_Err("%s: Failed registering IPC event. Error [0x%lx - %s]\n",
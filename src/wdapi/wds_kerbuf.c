@@ -9,12 +9,14 @@
 #include "wds_lib.h"
 #include "wdc_defs.h"
 #include "wdc_err.h"
+#include "wdc_priv.h"
 #include "status_strings.h"
 
 DWORD DLLCALLCONV WDS_SharedBufferAlloc(_In_ UINT64 qwBytes,
     _In_ DWORD dwOptions, _Outptr_ WD_KERNEL_BUFFER **ppKerBuf)
 {
     WD_KERNEL_BUFFER *pKerBuf;
+    WDC_NUMA_SCOPE numaScope;
     DWORD dwStatus;
 
     WDC_Trace("WDS_SharedBufferAlloc Entered. bytes [%"PRI64"d] "
@@ -36,7 +38,10 @@ DWORD DLLCALLCONV WDS_SharedBufferAlloc(_In_ UINT64 qwBytes,
     pKerBuf->qwBytes = qwBytes;
     pKerBuf->dwOptions = dwOptions;
 
+    /* Allocate the buffer on the default NUMA node -- see WDC_GetNumaNode() */
+    WdcNumaScopeEnter(WdcNumaNodeGet(NULL), &numaScope);
     dwStatus = WD_KernelBufLock(WDC_GetWDHandle(), pKerBuf);
+    WdcNumaScopeLeave(&numaScope);
     if (WD_STATUS_SUCCESS != dwStatus)
     {
         WDC_Err("WDS_SharedBufferAlloc: Failed kernel buffer alloc. "
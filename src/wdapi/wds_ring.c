@@ -0,0 +1,479 @@
+/* Jungo Connectivity Confidential. Copyright (c) 2022 Jungo Connectivity Ltd.  https://www.jungo.com */
+
+/*
+ *  File: wds_ring.c
+ *  Implementation of WDS shared rings
+ *
+ *  The records are written to a power-of-2 byte ring, each after an 8 bytes
+ *  record header, at 8 bytes aligned positions. The positions are 64-bit
+ *  byte counters that never wrap.
+ *  The producers reserve space by advancing the producer head, and publish
+ *  the records by advancing the producer tail in the order of the
+ *  reservations. The consumers claim records by advancing the consumer head,
+ *  and release their space by advancing the consumer tail in the same order.
+ *  With a single producer and a single consumer, the heads are advanced
+ *  without atomic operations.
+ */
+
+#include "utils.h"
+#include "wds_lib.h"
+#include "wdc_err.h"
+#include "status_strings.h"
+
+#if defined(WIN32)
+    #include <windows.h>
+#elif defined(UNIX)
+    #include <sched.h>
+#endif
+
+/*************************************************************
+  General definitions
+ *************************************************************/
+#define WDS_RING_MAGIC 0x474E5257 /* "WRNG" */
+#define WDS_RING_CACHE_LINE 64
+#define WDS_RING_RECORD_HDR_BYTES 8
+#define WDS_RING_ALIGN(qwBytes) (((UINT64)(qwBytes) + 7) & ~(UINT64)7)
+/* Spins of a producer or a consumer that waits for the ones before it, before
+ * it yields the CPU */
+#define WDS_RING_SPINS_BEFORE_YIELD 1024
+
+#if defined(WIN32)
+    #define RING_CAS(pqwVal, qwOld, qwNew) \
+        ((UINT64)InterlockedCompareExchange64((LONGLONG volatile *)(pqwVal), \
+        (LONGLONG)(qwNew), (LONGLONG)(qwOld)) == (qwOld))
+    #define RING_YIELD() SwitchToThread()
+#else
+    #define RING_CAS(pqwVal, qwOld, qwNew) \
+        __sync_bool_compare_and_swap((pqwVal), (qwOld), (qwNew))
+    #define RING_YIELD() sched_yield()
+#endif
+
+/* A position, alone in its cache line */
+typedef struct {
+    volatile UINT64 qwPos;
+    BYTE pad[WDS_RING_CACHE_LINE - sizeof(UINT64)];
+} WDS_RING_POS;
+
+/* Ring control area, at the start of the ring memory */
+typedef struct {
+    UINT32 dwMagic;
+    UINT32 dwOptions;
+    UINT64 qwDataBytes;            /* Power of 2 */
+    UINT32 dwRingID;
+    volatile UINT32 dwConsumerUID; /* Process to wake with doorbells */
+    BYTE pad[WDS_RING_CACHE_LINE - 4 * sizeof(UINT32) - sizeof(UINT64)];
+    WDS_RING_POS prodHead;  /* End of the reserved records */
+    WDS_RING_POS prodTail;  /* End of the published records */
+    WDS_RING_POS consHead;  /* End of the claimed records */
+    WDS_RING_POS consTail;  /* End of the released records */
+} WDS_RING_CTRL;
+
+/* Record header */
+typedef struct {
+    UINT32 dwBytes;
+    UINT32 dwReserved;
+} WDS_RING_RECORD;
+
+/* Ring handle, private to the process */
+typedef struct {
+    WDS_RING_CTRL *pCtrl;
+    BYTE *pData;
+    UINT64 qwMask;
+    BOOL fMpmc;
+    WD_KERNEL_BUFFER *pKerBuf; /* Buffer of WDS_SharedRingAlloc() or
+                                * WDS_SharedRingGet(), or NULL */
+    WDS_RING_DOORBELL_FUNC pfDoorbell;
+    void *pDoorbellCtx;
+} WDS_RING;
+
+/*************************************************************
+  Static functions
+ *************************************************************/
+static void RingCopyIn(WDS_RING *pRing, UINT64 qwPos, const void *pSrc,
+    UINT64 qwBytes)
+{
+    UINT64 qwOffset = qwPos & pRing->qwMask;
+    UINT64 qwFirst = MIN(qwBytes, pRing->qwMask + 1 - qwOffset);
+
+    memcpy(pRing->pData + qwOffset, pSrc, (size_t)qwFirst);
+    if (qwFirst < qwBytes)
+    {
+        memcpy(pRing->pData, (const BYTE *)pSrc + qwFirst,
+            (size_t)(qwBytes - qwFirst));
+    }
+}
+
+static void RingCopyOut(WDS_RING *pRing, UINT64 qwPos, void *pDst,
+    UINT64 qwBytes)
+{
+    UINT64 qwOffset = qwPos & pRing->qwMask;
+    UINT64 qwFirst = MIN(qwBytes, pRing->qwMask + 1 - qwOffset);
+
+    memcpy(pDst, pRing->pData + qwOffset, (size_t)qwFirst);
+    if (qwFirst < qwBytes)
+    {
+        memcpy((BYTE *)pDst + qwFirst, pRing->pData,
+            (size_t)(qwBytes - qwFirst));
+    }
+}
+
+/* Waits until the records before qwPos are published/released, and moves
+ * the tail to qwNewPos */
+static void RingTailAdvance(WDS_RING_POS *pTail, UINT64 qwPos,
+    UINT64 qwNewPos, BOOL fMpmc)
+{
+    DWORD dwSpins = 0;
+
+    if (fMpmc)
+    {
+        while (pTail->qwPos != qwPos)
+        {
+            if (++dwSpins == WDS_RING_SPINS_BEFORE_YIELD)
+            {
+                dwSpins = 0;
+                RING_YIELD();
+            }
+        }
+    }
+
+    OsMemoryBarrier();
+    pTail->qwPos = qwNewPos;
+}
+
+static void DLLCALLCONV RingIpcDoorbell(void *pCtx, DWORD dwConsumerUID,
+    DWORD dwRingID)
+{
+    UNUSED_VAR(pCtx);
+
+    WDS_IpcUidUnicast(dwConsumerUID, WDS_RING_DOORBELL_MSG_ID,
+        (UINT64)dwRingID);
+}
+
+static DWORD RingOpen(PVOID pMem, UINT64 qwBytes, WDS_RING **ppRing)
+{
+    WDS_RING_CTRL *pCtrl = (WDS_RING_CTRL *)pMem;
+    WDS_RING *pRing;
+    UINT64 qwDataBytes;
+
+    if (qwBytes < sizeof(WDS_RING_CTRL) || pCtrl->dwMagic != WDS_RING_MAGIC)
+    {
+        WDC_Err("RingOpen: Memory %p is not a shared ring\n", pMem);
+        return WD_INVALID_PARAMETER;
+    }
+
+    /* The control block is in shared memory: read the data size once, and
+     * validate it before it is used for the ring's mask */
+    qwDataBytes = *(volatile UINT64 *)&pCtrl->qwDataBytes;
+    if (qwDataBytes < WDS_RING_RECORD_HDR_BYTES ||
+        (qwDataBytes & (qwDataBytes - 1)) ||
+        qwDataBytes > qwBytes - sizeof(WDS_RING_CTRL))
+    {
+        WDC_Err("RingOpen: Invalid ring data size [%"PRI64"d] for %"PRI64"d "
+            "bytes of memory %p\n", qwDataBytes, qwBytes, pMem);
+        return WD_INVALID_PARAMETER;
+    }
+
+    pRing = (WDS_RING *)calloc(1, sizeof(WDS_RING));
+    if (!pRing)
+    {
+        WDC_Err("RingOpen: Memory allocation failed\n");
+        return WD_INSUFFICIENT_RESOURCES;
+    }
+
+    pRing->pCtrl = pCtrl;
+    pRing->pData = (BYTE *)pMem + sizeof(WDS_RING_CTRL);
+    pRing->qwMask = qwDataBytes - 1;
+    pRing->fMpmc = (pCtrl->dwOptions & WDS_RING_MPMC) ? TRUE : FALSE;
+    pRing->pfDoorbell = RingIpcDoorbell;
+    *ppRing = pRing;
+
+    return WD_STATUS_SUCCESS;
+}
+
+/*************************************************************
+  Functions implementations
+ *************************************************************/
+DWORD DLLCALLCONV WDS_RingCreate(_In_ PVOID pMem, _In_ UINT64 qwBytes,
+    _In_ DWORD dwOptions, _In_ DWORD dwRingID, _Outptr_ HANDLE *phRing)
+{
+    WDS_RING_CTRL *pCtrl = (WDS_RING_CTRL *)pMem;
+    UINT64 qwDataBytes;
+    DWORD dwStatus;
+
+    if (!WdcIsValidPtr(phRing, "NULL address of ring handle") ||
+        !WdcIsValidPtr(pMem, "NULL ring memory"))
+    {
+        WDC_Err("WDS_RingCreate: %s", WdcGetLastErrStr());
+        return WD_INVALID_PARAMETER;
+    }
+
+    *phRing = NULL;
+
+    if ((UPTR)pMem % WDS_RING_CACHE_LINE || dwOptions & ~WDS_RING_MPMC ||
+        qwBytes < sizeof(WDS_RING_CTRL) + 2 * WDS_RING_RECORD_HDR_BYTES)
+    {
+        WDC_Err("WDS_RingCreate: Invalid parameters. pMem [%p], bytes "
+            "[%"PRI64"d], dwOptions [0x%lx]\n", pMem, qwBytes, dwOptions);
+        return WD_INVALID_PARAMETER;
+    }
+
+    for (qwDataBytes = WDS_RING_RECORD_HDR_BYTES;
+        qwDataBytes * 2 <= qwBytes - sizeof(WDS_RING_CTRL); qwDataBytes *= 2)
+    {
+    }
+
+    memset(pCtrl, 0, sizeof(WDS_RING_CTRL));
+    pCtrl->dwOptions = dwOptions;
+    pCtrl->qwDataBytes = qwDataBytes;
+    pCtrl->dwRingID = dwRingID;
+    /* The magic number marks the ring as ready for WDS_RingAttach() */
+    OsMemoryBarrier();
+    pCtrl->dwMagic = WDS_RING_MAGIC;
+
+    dwStatus = RingOpen(pMem, qwBytes, (WDS_RING **)phRing);
+    if (WD_STATUS_SUCCESS == dwStatus)
+    {
+        WDC_Trace("WDS_RingCreate: Ring ID [0x%lx], data bytes [%"PRI64"d], "
+            "dwOptions [0x%lx]\n", dwRingID, qwDataBytes, dwOptions);
+    }
+
+    return dwStatus;
+}
+
+DWORD DLLCALLCONV WDS_RingAttach(_In_ PVOID pMem, _In_ UINT64 qwBytes,
+    _Outptr_ HANDLE *phRing)
+{
+    if (!WdcIsValidPtr(phRing, "NULL address of ring handle") ||
+        !WdcIsValidPtr(pMem, "NULL ring memory"))
+    {
+        WDC_Err("WDS_RingAttach: %s", WdcGetLastErrStr());
+        return WD_INVALID_PARAMETER;
+    }
+
+    *phRing = NULL;
+
+    return RingOpen(pMem, qwBytes, (WDS_RING **)phRing);
+}
+
+DWORD DLLCALLCONV WDS_SharedRingAlloc(_In_ UINT64 qwBytes,
+    _In_ DWORD dwOptions, _Outptr_ HANDLE *phRing)
+{
+    WD_KERNEL_BUFFER *pKerBuf;
+    DWORD dwStatus;
+
+    if (!WdcIsValidPtr(phRing, "NULL address of ring handle"))
+    {
+        WDC_Err("WDS_SharedRingAlloc: %s", WdcGetLastErrStr());
+        return WD_INVALID_PARAMETER;
+    }
+
+    *phRing = NULL;
+
+    dwStatus = WDS_SharedBufferAlloc(qwBytes,
+        KER_BUF_ALLOC_NON_CONTIG | KER_BUF_ALLOC_CACHED, &pKerBuf);
+    if (WD_STATUS_SUCCESS != dwStatus)
+        return dwStatus;
+
+    dwStatus = WDS_RingCreate((PVOID)pKerBuf->pUserAddr, qwBytes, dwOptions,
+        WDS_SharedBufferGetGlobalHandle(pKerBuf), phRing);
+    if (WD_STATUS_SUCCESS != dwStatus)
+    {
+        WDS_SharedBufferFree(pKerBuf);
+        return dwStatus;
+    }
+
+    ((WDS_RING *)*phRing)->pKerBuf = pKerBuf;
+
+    return WD_STATUS_SUCCESS;
+}
+
+DWORD DLLCALLCONV WDS_SharedRingGet(_In_ DWORD dwRingID,
+    _Outptr_ HANDLE *phRing)
+{
+    WD_KERNEL_BUFFER *pKerBuf;
+    DWORD dwStatus;
+
+    if (!WdcIsValidPtr(phRing, "NULL address of ring handle"))
+    {
+        WDC_Err("WDS_SharedRingGet: %s", WdcGetLastErrStr());
+        return WD_INVALID_PARAMETER;
+    }
+
+    *phRing = NULL;
+
+    dwStatus = WDS_SharedBufferGet(dwRingID, &pKerBuf);
+    if (WD_STATUS_SUCCESS != dwStatus)
+        return dwStatus;
+
+    dwStatus = WDS_RingAttach((PVOID)pKerBuf->pUserAddr, pKerBuf->qwBytes,
+        phRing);
+    if (WD_STATUS_SUCCESS != dwStatus)
+    {
+        WDS_SharedBufferFree(pKerBuf);
+        return dwStatus;
+    }
+
+    ((WDS_RING *)*phRing)->pKerBuf = pKerBuf;
+
+    return WD_STATUS_SUCCESS;
+}
+
+DWORD DLLCALLCONV WDS_RingIdGet(_In_ HANDLE hRing)
+{
+    return hRing ? ((WDS_RING *)hRing)->pCtrl->dwRingID : 0;
+}
+
+DWORD DLLCALLCONV WDS_RingClose(_In_ HANDLE hRing)
+{
+    WDS_RING *pRing = (WDS_RING *)hRing;
+    DWORD dwStatus = WD_STATUS_SUCCESS;
+
+    if (!WdcIsValidPtr(pRing, "NULL ring handle"))
+        return WD_INVALID_PARAMETER;
+
+    if (pRing->pKerBuf)
+        dwStatus = WDS_SharedBufferFree(pRing->pKerBuf);
+
+    free(pRing);
+
+    return dwStatus;
+}
+
+DWORD DLLCALLCONV WDS_RingConsumerSet(_In_ HANDLE hRing,
+    _In_ DWORD dwConsumerUID)
+{
+    if (!WdcIsValidPtr(hRing, "NULL ring handle"))
+        return WD_INVALID_PARAMETER;
+
+    ((WDS_RING *)hRing)->pCtrl->dwConsumerUID = dwConsumerUID;
+
+    return WD_STATUS_SUCCESS;
+}
+
+DWORD DLLCALLCONV WDS_RingDoorbellSet(_In_ HANDLE hRing,
+    _In_ WDS_RING_DOORBELL_FUNC pFunc, _In_ void *pCtx)
+{
+    WDS_RING *pRing = (WDS_RING *)hRing;
+
+    if (!WdcIsValidPtr(pRing, "NULL ring handle"))
+        return WD_INVALID_PARAMETER;
+
+    pRing->pfDoorbell = pFunc ? pFunc : RingIpcDoorbell;
+    pRing->pDoorbellCtx = pFunc ? pCtx : NULL;
+
+    return WD_STATUS_SUCCESS;
+}
+
+DWORD DLLCALLCONV WDS_RingPush(_In_ HANDLE hRing, _In_ const void *pData,
+    _In_ DWORD dwBytes)
+{
+    WDS_RING *pRing = (WDS_RING *)hRing;
+    WDS_RING_CTRL *pCtrl;
+    WDS_RING_RECORD record;
+    UINT64 qwPos, qwRecordBytes;
+    DWORD dwConsumerUID;
+
+    if (!pRing || (!pData && dwBytes))
+        return WD_INVALID_PARAMETER;
+
+    pCtrl = pRing->pCtrl;
+    qwRecordBytes = WDS_RING_RECORD_HDR_BYTES + WDS_RING_ALIGN(dwBytes);
+    if (qwRecordBytes > pRing->qwMask + 1)
+    {
+        WDC_Err("WDS_RingPush: Record of %ld bytes exceeds the ring size\n",
+            dwBytes);
+        return WD_INVALID_PARAMETER;
+    }
+
+    /* Reserve space for the record */
+    do {
+        qwPos = pCtrl->prodHead.qwPos;
+        if (qwPos + qwRecordBytes - pCtrl->consTail.qwPos >
+            pRing->qwMask + 1)
+        {
+            return WD_TRY_AGAIN;
+        }
+
+        if (!pRing->fMpmc)
+        {
+            pCtrl->prodHead.qwPos = qwPos + qwRecordBytes;
+            break;
+        }
+    } while (!RING_CAS(&pCtrl->prodHead.qwPos, qwPos, qwPos + qwRecordBytes));
+
+    record.dwBytes = dwBytes;
+    record.dwReserved = 0;
+    RingCopyIn(pRing, qwPos, &record, sizeof(record));
+    RingCopyIn(pRing, qwPos + WDS_RING_RECORD_HDR_BYTES, pData, dwBytes);
+
+    RingTailAdvance(&pCtrl->prodTail, qwPos, qwPos + qwRecordBytes,
+        pRing->fMpmc);
+
+    /* A consumer that finds the ring empty reads the producer tail after it
+     * moves the consumer head; either it sees the record, or the record is
+     * pushed to an empty ring and the doorbell wakes it */
+    OsMemoryBarrier();
+    dwConsumerUID = pCtrl->dwConsumerUID;
+    if (pCtrl->consHead.qwPos == qwPos && dwConsumerUID)
+        pRing->pfDoorbell(pRing->pDoorbellCtx, dwConsumerUID, pCtrl->dwRingID);
+
+    return WD_STATUS_SUCCESS;
+}
+
+DWORD DLLCALLCONV WDS_RingPop(_In_ HANDLE hRing, _Out_ void *pBuf,
+    _In_ DWORD dwBufBytes, _Out_ DWORD *pdwBytes)
+{
+    WDS_RING *pRing = (WDS_RING *)hRing;
+    WDS_RING_CTRL *pCtrl;
+    WDS_RING_RECORD record;
+    UINT64 qwPos, qwRecordBytes;
+
+    if (!pRing || !pdwBytes || (!pBuf && dwBufBytes))
+        return WD_INVALID_PARAMETER;
+
+    pCtrl = pRing->pCtrl;
+
+    /* Claim the oldest record */
+    for (;;)
+    {
+        qwPos = pCtrl->consHead.qwPos;
+        OsMemoryBarrier();
+        if (qwPos == pCtrl->prodTail.qwPos)
+            return WD_TRY_AGAIN;
+        OsMemoryBarrier();
+
+        RingCopyOut(pRing, qwPos, &record, sizeof(record));
+        qwRecordBytes = WDS_RING_RECORD_HDR_BYTES +
+            WDS_RING_ALIGN(record.dwBytes);
+
+        /* Another consumer may have claimed the record and released it to
+         * the producers meanwhile */
+        OsMemoryBarrier();
+        if (pRing->fMpmc && qwPos != pCtrl->consHead.qwPos)
+            continue;
+
+        if (record.dwBytes > dwBufBytes)
+        {
+            *pdwBytes = record.dwBytes;
+            return WD_INSUFFICIENT_RESOURCES;
+        }
+
+        if (!pRing->fMpmc)
+        {
+            pCtrl->consHead.qwPos = qwPos + qwRecordBytes;
+            break;
+        }
+
+        if (RING_CAS(&pCtrl->consHead.qwPos, qwPos, qwPos + qwRecordBytes))
+            break;
+    }
+
+    RingCopyOut(pRing, qwPos + WDS_RING_RECORD_HDR_BYTES, pBuf,
+        record.dwBytes);
+    *pdwBytes = record.dwBytes;
+
+    RingTailAdvance(&pCtrl->consTail, qwPos, qwPos + qwRecordBytes,
+        pRing->fMpmc);
+
+    return WD_STATUS_SUCCESS;
+}
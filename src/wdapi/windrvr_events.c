@@ -111,34 +111,75 @@ typedef struct
     HANDLE         hWD;
 
     EVENT_HANDLER  func;
+    EVENT_BATCH_END_HANDLER end_func;
     void          *data;
 
     WD_INTERRUPT   Int;        /* Int.hInterrupt holds hEvent */
     WD_EVENT_TYPE  dwEventType;
 
     HANDLE         thread;
+
+    WD_EVENT      *pePulled;   /* Pull buffer, allocated on registration */
+    EVENT_STATS    stats;
 } local_event_handle_t;
 
+DWORD DLLCALLCONV EventPullBatch(HANDLE hWD, DWORD hEvent, WD_EVENT *pe,
+    DWORD dwMaxEvents, EVENT_HANDLER pFunc, void *pData, DWORD *pdwPulled)
+{
+    DWORD dwPulled = 0, dwStatus = WD_STATUS_SUCCESS;
+
+    while (!dwMaxEvents || dwPulled < dwMaxEvents)
+    {
+        memset(pe, 0, sizeof(WD_EVENT));
+        pe->dwNumMatchTables = 1;
+        pe->hEvent = hEvent;
+
+        dwStatus = WD_EventPull(hWD, pe);
+        if (dwStatus || !pe->dwAction)
+            break;
+
+        dwPulled++;
+        pFunc(pe, pData);
+
+        if (pe->dwOptions & WD_ACKNOWLEDGE)
+            WD_EventSend(hWD, pe);
+    }
+
+    if (pdwPulled)
+        *pdwPulled = dwPulled;
+
+    return dwStatus;
+}
+
 static void DLLCALLCONV event_handler(void *h)
 {
     local_event_handle_t *handle = (local_event_handle_t *)h;
-    WD_EVENT *pePulled;
+    DWORD dwPulled;
 
-    pePulled = EventAlloc(1);
-    pePulled->hEvent = handle->Int.hInterrupt;
-    WD_EventPull(handle->hWD, pePulled);
+    /* Events that arrive while the handler runs are pulled in the same
+     * batch; their wakeups find no pending event */
+    EventPullBatch(handle->hWD, handle->Int.hInterrupt, handle->pePulled, 0,
+        handle->func, handle->data, &dwPulled);
+    if (!dwPulled)
+        return;
 
-    if (pePulled->dwAction)
-        handle->func(pePulled, handle->data);
+    handle->stats.qwBatches++;
+    handle->stats.qwDelivered += dwPulled;
+    handle->stats.qwCoalesced += dwPulled - 1;
 
-    if (pePulled->dwOptions & WD_ACKNOWLEDGE)
-        WD_EventSend(handle->hWD, pePulled);
-
-    EventFree(pePulled);
+    if (handle->end_func)
+        handle->end_func(dwPulled, handle->data);
 }
 
 DWORD DLLCALLCONV EventRegister(HANDLE *phEvent, HANDLE hWD, WD_EVENT *pEvent,
     EVENT_HANDLER pFunc, void *pData)
+{
+    return EventRegisterBatch(phEvent, hWD, pEvent, pFunc, NULL, pData);
+}
+
+DWORD DLLCALLCONV EventRegisterBatch(HANDLE *phEvent, HANDLE hWD,
+    WD_EVENT *pEvent, EVENT_HANDLER pFunc, EVENT_BATCH_END_HANDLER pEndFunc,
+    void *pData)
 {
     DWORD dwStatus;
     local_event_handle_t *handle;
@@ -155,16 +196,23 @@ DWORD DLLCALLCONV EventRegister(HANDLE *phEvent, HANDLE hWD, WD_EVENT *pEvent,
     BZERO(*handle);
     handle->hWD = hWD;
     handle->func = pFunc;
+    handle->end_func = pEndFunc;
     handle->data = pData;
     handle->dwEventType = pEvent->dwEventType;
+    handle->pePulled = EventAlloc(1);
+    if (!handle->pePulled)
+    {
+        dwStatus = WD_INSUFFICIENT_RESOURCES;
+        goto Error;
+    }
 
     dwStatus = WD_EventRegister(hWD, pEvent);
     if (dwStatus)
         goto Error;
 
     handle->Int.hInterrupt = pEvent->hEvent;
-    dwStatus = InterruptEnable(&handle->thread, hWD, &handle->Int,
-        event_handler, (PVOID)handle);
+    dwStatus = InterruptEnableClass(&handle->thread, hWD, &handle->Int,
+        event_handler, (PVOID)handle, THREAD_CLASS_EVENT);
     if (dwStatus)
         goto Error;
 
@@ -175,7 +223,10 @@ Error:
     if (handle && handle->Int.hInterrupt)
         WD_EventUnregister(hWD, pEvent);
     if (handle)
+    {
+        EventFree(handle->pePulled);
         free(handle);
+    }
     return dwStatus;
 }
 
@@ -188,16 +239,41 @@ DWORD DLLCALLCONV EventUnregister(HANDLE hEvent)
     if (!handle)
         return WD_INVALID_HANDLE;
 
-    pe = EventAlloc(1);
+    InterruptDisable(handle->thread);
+
+    /* The events thread no longer uses the pull buffer */
+    pe = handle->pePulled;
+    memset(pe, 0, sizeof(WD_EVENT));
+    pe->dwNumMatchTables = 1;
     pe->hEvent = handle->Int.hInterrupt;
     pe->dwEventType = handle->dwEventType;
 
-    InterruptDisable(handle->thread);
     dwStatus = WD_EventUnregister(handle->hWD, pe);
 
     EventFree(pe);
     free(handle);
     return dwStatus;
 }
+
+HANDLE DLLCALLCONV EventThreadGet(HANDLE hEvent)
+{
+    local_event_handle_t *handle = (local_event_handle_t *)hEvent;
+
+    return handle ? InterruptThreadGet(handle->thread) : NULL;
+}
+
+DWORD DLLCALLCONV EventGetStats(HANDLE hEvent, EVENT_STATS *pStats)
+{
+    local_event_handle_t *handle = (local_event_handle_t *)hEvent;
+
+    if (!handle)
+        return WD_INVALID_HANDLE;
+    if (!pStats)
+        return WD_INVALID_PARAMETER;
+
+    *pStats = handle->stats;
+
+    return WD_STATUS_SUCCESS;
+}
 #endif
 
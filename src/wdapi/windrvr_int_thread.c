@@ -20,15 +20,52 @@ extern "C" {
 #endif  // __cplusplus
 
 #if !defined(__KERNEL__)
-    typedef struct
+    struct INT_REACTOR_WORKER;
+
+    typedef struct INT_THREAD_DATA
     {
         HANDLE hWD;
         INT_HANDLER func;
         PVOID pData;
         WD_INTERRUPT *pInt;
         void *thread;
+        /* Reactor mode: the thread is NULL, and the interrupt is served by a
+         * reactor worker */
+        struct INT_REACTOR_WORKER *pWorker;
+        struct INT_THREAD_DATA *pNext; /* Next interrupt of the worker */
+        DWORD dwLastCounter;
+        /* Disabled by its own handler: freed by the worker when the handler
+         * returns */
+        BOOL fFreeOnReturn;
     } INT_THREAD_DATA;
 
+    /* Reactor worker: polls the interrupt counters of its interrupts */
+    typedef struct INT_REACTOR_WORKER
+    {
+        HANDLE hThread;
+        HANDLE hMutex;          /* Protects pInts and pDispatching; not held
+                                 * while a handler runs */
+        INT_THREAD_DATA *pInts;
+        DWORD dwInts;
+        DWORD dwListSeq;        /* Incremented when pInts changes */
+        INT_THREAD_DATA *pDispatching; /* Interrupt whose handler runs */
+        HANDLE hDispatched;     /* Signaled after a handler returns, when
+                                 * dwRemoveWaiters is not 0 */
+        DWORD dwRemoveWaiters;  /* Threads that wait for a handler to return,
+                                 * to remove its interrupt */
+        volatile BOOL fStop;
+    } INT_REACTOR_WORKER;
+
+    static struct
+    {
+        HANDLE hWD;
+        INT_REACTOR_PARAMS params;
+        INT_REACTOR_WORKER *pWorkers; /* NULL - reactor is not started */
+    } gReactor;
+
+    /* The reactor worker of the calling thread */
+    static OS_THREAD_LOCAL INT_REACTOR_WORKER *gpCurrentReactorWorker;
+
     static void DLLCALLCONV interrupt_thread_handler(void *data)
     {
         DWORD dwStatus;
@@ -56,8 +93,262 @@ extern "C" {
         }
     }
 
+    static void ReactorSleep(DWORD dwMicroSecs)
+    {
+        WD_SLEEP slp;
+
+        BZERO(slp);
+        slp.dwMicroSeconds = dwMicroSecs;
+        slp.dwOptions = SLEEP_NON_BUSY;
+        WD_Sleep(gReactor.hWD, &slp);
+    }
+
+    /* Sweeps the interrupt counters of the worker's interrupts and calls the
+     * handlers of the interrupts that occurred. Idle sweeps are spaced by an
+     * exponentially growing sleep, from dwMinSleepUs to dwMaxSleepUs. */
+    static void DLLCALLCONV reactor_worker_handler(void *data)
+    {
+        INT_REACTOR_WORKER *pWorker = (INT_REACTOR_WORKER *)data;
+        DWORD dwSleepUs = gReactor.params.dwMinSleepUs;
+
+        gpCurrentReactorWorker = pWorker;
+        while (!pWorker->fStop)
+        {
+            INT_THREAD_DATA *pThread;
+            BOOL fActive = FALSE;
+
+            OsMutexLock(pWorker->hMutex);
+            for (pThread = pWorker->pInts; pThread; pThread = pThread->pNext)
+            {
+                DWORD dwListSeq;
+
+                if (WD_IntCount(pThread->hWD, pThread->pInt) ||
+                    pThread->pInt->dwCounter == pThread->dwLastCounter)
+                {
+                    continue;
+                }
+
+                /* The handler may disable interrupts, including its own, so
+                 * it runs without the mutex; ReactorRemove() does not free
+                 * the dispatched interrupt */
+                pThread->dwLastCounter = pThread->pInt->dwCounter;
+                pWorker->pDispatching = pThread;
+                dwListSeq = pWorker->dwListSeq;
+                OsMutexUnlock(pWorker->hMutex);
+
+                pThread->func(pThread->pData);
+                fActive = TRUE;
+
+                OsMutexLock(pWorker->hMutex);
+                pWorker->pDispatching = NULL;
+                if (pWorker->dwRemoveWaiters)
+                    OsEventSignal(pWorker->hDispatched);
+
+                if (pThread->fFreeOnReturn)
+                    free(pThread);
+
+                /* The interrupts were added or removed while the handler ran,
+                 * so the rest of them are swept in the next iteration */
+                if (pWorker->dwListSeq != dwListSeq)
+                    break;
+            }
+            OsMutexUnlock(pWorker->hMutex);
+
+            if (fActive)
+            {
+                dwSleepUs = gReactor.params.dwMinSleepUs;
+                continue;
+            }
+
+            ReactorSleep(dwSleepUs);
+            dwSleepUs = MIN(dwSleepUs * 2, gReactor.params.dwMaxSleepUs);
+        }
+    }
+
+    /* Assigns an interrupt to the least loaded reactor worker */
+    static void ReactorAdd(INT_THREAD_DATA *pThread)
+    {
+        INT_REACTOR_WORKER *pWorker = &gReactor.pWorkers[0];
+        DWORD i;
+
+        for (i = 1; i < gReactor.params.dwWorkers; i++)
+        {
+            if (gReactor.pWorkers[i].dwInts < pWorker->dwInts)
+                pWorker = &gReactor.pWorkers[i];
+        }
+
+        /* Interrupts that occurred before the registration are not
+         * dispatched */
+        WD_IntCount(pThread->hWD, pThread->pInt);
+        pThread->dwLastCounter = pThread->pInt->dwCounter;
+        pThread->pWorker = pWorker;
+
+        OsMutexLock(pWorker->hMutex);
+        pThread->pNext = pWorker->pInts;
+        pWorker->pInts = pThread;
+        pWorker->dwInts++;
+        pWorker->dwListSeq++;
+        OsMutexUnlock(pWorker->hMutex);
+    }
+
+    /* Removes an interrupt from its reactor worker; when it returns, the
+     * interrupt's handler is not running, unless the handler itself removes
+     * the interrupt. Returns FALSE in this case: the worker frees the
+     * interrupt when the handler returns. */
+    static BOOL ReactorRemove(INT_THREAD_DATA *pThread)
+    {
+        INT_REACTOR_WORKER *pWorker = pThread->pWorker;
+        INT_THREAD_DATA **ppThread;
+        BOOL fFree = TRUE;
+
+        OsMutexLock(pWorker->hMutex);
+        for (ppThread = &pWorker->pInts; *ppThread;
+            ppThread = &(*ppThread)->pNext)
+        {
+            if (*ppThread == pThread)
+            {
+                *ppThread = pThread->pNext;
+                pWorker->dwInts--;
+                pWorker->dwListSeq++;
+                break;
+            }
+        }
+
+        if (pWorker->pDispatching == pThread)
+        {
+            if (gpCurrentReactorWorker == pWorker)
+            {
+                pThread->fFreeOnReturn = TRUE;
+                fFree = FALSE;
+            }
+            else
+            {
+                pWorker->dwRemoveWaiters++;
+                while (pWorker->pDispatching == pThread)
+                {
+                    OsMutexUnlock(pWorker->hMutex);
+                    /* The event is shared by all the waiters of the worker,
+                     * so the wait is bounded */
+                    OsEventWaitUs(pWorker->hDispatched, 1000, 0);
+                    OsMutexLock(pWorker->hMutex);
+                }
+                pWorker->dwRemoveWaiters--;
+            }
+        }
+        OsMutexUnlock(pWorker->hMutex);
+
+        return fFree;
+    }
+
+    static void ReactorWorkersFree(DWORD dwWorkers)
+    {
+        DWORD i;
+
+        for (i = 0; i < dwWorkers; i++)
+        {
+            INT_REACTOR_WORKER *pWorker = &gReactor.pWorkers[i];
+
+            pWorker->fStop = TRUE;
+            if (pWorker->hThread)
+                ThreadWait(pWorker->hThread);
+            if (pWorker->hMutex)
+                OsMutexClose(pWorker->hMutex);
+            if (pWorker->hDispatched)
+                OsEventClose(pWorker->hDispatched);
+        }
+
+        free(gReactor.pWorkers);
+        gReactor.pWorkers = NULL;
+    }
+
+    DWORD DLLCALLCONV InterruptReactorStart(HANDLE hWD,
+        const INT_REACTOR_PARAMS *pParams)
+    {
+        DWORD i, dwCpu = 0, dwStatus = WD_STATUS_SUCCESS;
+
+        if (gReactor.pWorkers)
+            return WD_OPERATION_ALREADY_DONE;
+
+        if (!pParams || !pParams->dwWorkers || !pParams->dwMinSleepUs ||
+            pParams->dwMaxSleepUs < pParams->dwMinSleepUs)
+        {
+            return WD_INVALID_PARAMETER;
+        }
+
+        gReactor.hWD = hWD;
+        gReactor.params = *pParams;
+        gReactor.pWorkers = (INT_REACTOR_WORKER *)calloc(pParams->dwWorkers,
+            sizeof(INT_REACTOR_WORKER));
+        if (!gReactor.pWorkers)
+            return WD_INSUFFICIENT_RESOURCES;
+
+        for (i = 0; i < pParams->dwWorkers; i++)
+        {
+            INT_REACTOR_WORKER *pWorker = &gReactor.pWorkers[i];
+
+            dwStatus = OsMutexCreate(&pWorker->hMutex);
+            if (dwStatus)
+                break;
+
+            dwStatus = OsEventCreate(&pWorker->hDispatched);
+            if (dwStatus)
+            {
+                pWorker->hDispatched = NULL;
+                break;
+            }
+
+            dwStatus = ThreadStartClass(&pWorker->hThread,
+                THREAD_CLASS_INTERRUPT, reactor_worker_handler,
+                (void *)pWorker);
+            if (dwStatus)
+                break;
+
+            /* Pin the workers to the CPUs of the mask, round robin, unless
+             * the interrupt threads class already has a CPU mask */
+            if (pParams->qwCpuMask &&
+                !ThreadClassHasAffinity(THREAD_CLASS_INTERRUPT))
+            {
+                while (!(pParams->qwCpuMask & ((UINT64)1 << dwCpu)))
+                    dwCpu = (dwCpu + 1) % 64;
+
+                ThreadSetAffinity(pWorker->hThread, (UINT64)1 << dwCpu);
+                dwCpu = (dwCpu + 1) % 64;
+            }
+        }
+
+        if (dwStatus)
+            ReactorWorkersFree(i + 1);
+
+        return dwStatus;
+    }
+
+    DWORD DLLCALLCONV InterruptReactorStop(void)
+    {
+        DWORD i;
+
+        if (!gReactor.pWorkers)
+            return WD_OPERATION_ALREADY_DONE;
+
+        for (i = 0; i < gReactor.params.dwWorkers; i++)
+        {
+            if (gReactor.pWorkers[i].dwInts)
+                return WD_OPERATION_FAILED;
+        }
+
+        ReactorWorkersFree(gReactor.params.dwWorkers);
+
+        return WD_STATUS_SUCCESS;
+    }
+
     DWORD DLLCALLCONV InterruptEnable(HANDLE *phThread, HANDLE hWD,
         WD_INTERRUPT *pInt, INT_HANDLER func, PVOID pData)
+    {
+        return InterruptEnableClass(phThread, hWD, pInt, func, pData,
+            THREAD_CLASS_INTERRUPT);
+    }
+
+    DWORD DLLCALLCONV InterruptEnableClass(HANDLE *phThread, HANDLE hWD,
+        WD_INTERRUPT *pInt, INT_HANDLER func, PVOID pData, DWORD dwThreadClass)
     {
         INT_THREAD_DATA *pThread;
         DWORD dwStatus;
@@ -78,8 +369,17 @@ extern "C" {
         pThread->hWD = hWD;
         pThread->pInt = pInt;
 
-        dwStatus = ThreadStart(&pThread->thread, interrupt_thread_handler,
-            (void *)pThread);
+        /* The reactor polls the interrupt counter, which does not return the
+         * results of the interrupt transfer commands */
+        if (gReactor.pWorkers && !(pInt->dwOptions & INTERRUPT_CMD_COPY))
+        {
+            ReactorAdd(pThread);
+            *phThread = (HANDLE)pThread;
+            return WD_STATUS_SUCCESS;
+        }
+
+        dwStatus = ThreadStartClass(&pThread->thread, dwThreadClass,
+            interrupt_thread_handler, (void *)pThread);
         if (dwStatus)
         {
             WD_IntDisable(hWD, pInt);
@@ -105,6 +405,16 @@ Error:
         if (!pThread)
             return WD_INVALID_HANDLE;
 
+        if (pThread->pWorker)
+        {
+            BOOL fFree = ReactorRemove(pThread);
+
+            dwStatus = WD_IntDisable(pThread->hWD, pThread->pInt);
+            if (fFree)
+                free(pThread);
+            return dwStatus;
+        }
+
         /* Copy pInt to a local variable to prevent a data race with data that
          * is returned from WD_IntWait */
         tmpInt = *pThread->pInt;
@@ -114,6 +424,13 @@ Error:
         free(pThread);
         return dwStatus;
     }
+
+    HANDLE DLLCALLCONV InterruptThreadGet(HANDLE hThread)
+    {
+        INT_THREAD_DATA *pThread = (INT_THREAD_DATA *)hThread;
+
+        return pThread ? (HANDLE)pThread->thread : NULL;
+    }
 #endif
 
 #ifdef __cplusplus